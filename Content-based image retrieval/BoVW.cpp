@@ -1,25 +1,10 @@
 #include "BoVW.h"
 
 void BagOfVisualWord::buildVocabulary(vector<Mat>& allDescriptors) {
-    Mat descriptorsStacked;
-
-    // Convert and merge all descriptors into one matrix
-    for (const Mat& desc : allDescriptors) {
-        if (!desc.empty()) {
-            Mat floatDesc;
-            // Ensure descriptors are of type CV_32F (required for k-means)
-            if (desc.type() != CV_32F)
-                desc.convertTo(floatDesc, CV_32F);
-            else
-                floatDesc = desc;
-
-            // Only accept 2D descriptors (rows = keypoints, cols = descriptor length)
-            if (floatDesc.dims == 2)
-                descriptorsStacked.push_back(floatDesc);
-            else
-                cerr << "Descriptor with unexpected dimensions, skipping.\n";
-        }
-    }
+    // Convert and merge all descriptors (or a uniform sample of them) into one matrix
+    Mat descriptorsStacked = MiniBatchKMeans::sampleDescriptors(allDescriptors, trainingSampleSize);
+    if (trainingSampleSize > 0)
+        cout << "Training vocabulary on " << descriptorsStacked.rows << " sampled descriptors" << endl;
 
     // Validate the input before clustering
     if (descriptorsStacked.empty()) {
@@ -32,6 +17,15 @@ void BagOfVisualWord::buildVocabulary(vector<Mat>& allDescriptors) {
         return;
     }
 
+    // Vocabulary tree: hierarchical k-means, the leaves are the visual words
+    if (useTree) {
+        if (tree.build(descriptorsStacked, threadCount)) {
+            vocabulary = tree.getLeafCenters();
+            updateWordNorms();
+        }
+        return;
+    }
+
     if (dictionarySize <= 0) {
         cerr << "Error: dictionarySize must be greater than 0.\n";
         return;
@@ -43,34 +37,114 @@ void BagOfVisualWord::buildVocabulary(vector<Mat>& allDescriptors) {
         return;
     }
 
+    // Mini-batch k-means: cost depends on the batch size and number of steps, not on the sample size
+    if (miniBatchSize > 0) {
+        MiniBatchKMeans trainer(dictionarySize, miniBatchSize, miniBatchIterations);
+        trainer.setThreadCount(threadCount);
+        if (trainer.fit(descriptorsStacked)) {
+            vocabulary = trainer.getCenters();
+            updateWordNorms();
+        }
+        return;
+    }
+
     // Apply K-means clustering to generate the visual vocabulary
     Mat labels;
     kmeans(descriptorsStacked, dictionarySize, labels,
         TermCriteria(TermCriteria::EPS + TermCriteria::MAX_ITER, 100, 0.01),
         3, KMEANS_PP_CENTERS, vocabulary);  // vocabulary is set to cluster centers
+    updateWordNorms();
 }
 
-Mat BagOfVisualWord::computeHistogram(const Mat& descriptors) {
-    // Initialize histogram with zeros (1 row, dictionarySize columns)
-    Mat hist = Mat::zeros(1, vocabulary.rows, CV_32F);
+void BagOfVisualWord::updateWordNorms() {
+    wordNorms = vocabulary.empty() ? Mat() : computeRowNorms(vocabulary);
+}
+
+Mat BagOfVisualWord::computeRowNorms(const Mat& centers) {
+    Mat norms(1, centers.rows, CV_32F);
+    float* normPtr = norms.ptr<float>(0);
+    for (int i = 0; i < centers.rows; ++i) {
+        const float* row = centers.ptr<float>(i);
+        float sum = 0.0f;
+        for (int d = 0; d < centers.cols; ++d)
+            sum += row[d] * row[d];
+        normPtr[i] = sum;
+    }
+    return norms;
+}
+
+void BagOfVisualWord::assignNearestWords(const Mat& descriptors, const Mat& centers, const Mat& centerNorms,
+    vector<int>& labels, vector<float>* distances) {
+    CV_Assert(descriptors.type() == CV_32F && centers.type() == CV_32F);
+    CV_Assert(descriptors.cols == centers.cols && centerNorms.cols == centers.rows);
+
+    const int rows = descriptors.rows;
+    labels.assign(rows, 0);
+    vector<float> bestScores(rows, FLT_MAX);  // min over words of ||c||^2 - 2 x.c
+
+    Mat scores, normTile, rowMin;
+    for (int r0 = 0; r0 < rows; r0 += descriptorTileRows) {
+        const int r1 = min(rows, r0 + descriptorTileRows);
+        Mat descriptorTile = descriptors.rowRange(r0, r1);
+
+        for (int w0 = 0; w0 < centers.rows; w0 += wordTileRows) {
+            const int w1 = min(centers.rows, w0 + wordTileRows);
 
-    // For each descriptor, find the nearest visual word (L2 distance)
-    for (int i = 0; i < descriptors.rows; ++i) {
-        float minDist = FLT_MAX;
-        int bestIdx = 0;
-
-        // Find the closest word in the vocabulary
-        for (int j = 0; j < vocabulary.rows; ++j) {
-            float dist = norm(descriptors.row(i), vocabulary.row(j), NORM_L2);
-            if (dist < minDist) {
-                minDist = dist;
-                bestIdx = j;
+            // scores = -2 * X * C^T + ||c||^2, one row per descriptor of the tile
+            repeat(centerNorms.colRange(w0, w1), r1 - r0, 1, normTile);
+            gemm(descriptorTile, centers.rowRange(w0, w1), -2.0, normTile, 1.0, scores, GEMM_2_T);
+
+            // Vectorized row minimum, then locate the arg-min only for rows that improved
+            reduce(scores, rowMin, 1, REDUCE_MIN);
+            for (int i = 0; i < r1 - r0; ++i) {
+                const float best = rowMin.at<float>(i, 0);
+                if (best >= bestScores[r0 + i])
+                    continue;
+
+                const float* scoreRow = scores.ptr<float>(i);
+                int bestIdx = 0;
+                while (bestIdx < w1 - w0 - 1 && scoreRow[bestIdx] != best)
+                    ++bestIdx;
+
+                bestScores[r0 + i] = best;
+                labels[r0 + i] = w0 + bestIdx;
             }
         }
+    }
 
-        // Increment corresponding bin in histogram
-        hist.at<float>(0, bestIdx) += 1.0f;
+    if (distances) {
+        // Add back ||x||^2 to get the squared distances
+        Mat descriptorNorms = computeRowNorms(descriptors);
+        distances->resize(rows);
+        for (int i = 0; i < rows; ++i)
+            (*distances)[i] = max(0.0f, bestScores[i] + descriptorNorms.at<float>(0, i));
     }
+}
+
+Mat BagOfVisualWord::computeHistogram(const Mat& descriptors) const {
+    // Initialize histogram with zeros (1 row, dictionarySize columns)
+    Mat hist = Mat::zeros(1, vocabulary.rows, CV_32F);
+    if (descriptors.empty() || vocabulary.empty())
+        return hist;
+
+    Mat floatDescriptors;
+    if (descriptors.type() != CV_32F)
+        descriptors.convertTo(floatDescriptors, CV_32F);
+    else
+        floatDescriptors = descriptors;
+
+    // Find the nearest visual word (L2 distance) of every descriptor at once,
+    // or descend the vocabulary tree when there is one
+    vector<int> labels;
+    if (!tree.empty())
+        tree.quantize(floatDescriptors, labels);
+    else
+        assignNearestWords(floatDescriptors, vocabulary, wordNorms, labels);
+
+    // Increment corresponding bin in histogram
+    float* histPtr = hist.ptr<float>(0);
+    for (int label : labels)
+        histPtr[label] += 1.0f;
 
     // Normalize histogram using L2 norm
     normalize(hist, hist, 1, 0, NORM_L2);
@@ -83,4 +157,29 @@ Mat BagOfVisualWord::getVocabulary() const {
 
 void BagOfVisualWord::setVocabulary(Mat vocab) {
     vocabulary = vocab.clone();  // Deep copy to avoid aliasing
+    tree = VocabularyTree();     // A flat vocabulary replaces any tree
+    useTree = false;
+    updateWordNorms();
+}
+
+void BagOfVisualWord::setThreadCount(int count) {
+    threadCount = count;
+}
+
+void BagOfVisualWord::setMiniBatchTraining(int batchSize, int sampleSize, int maxIterations) {
+    miniBatchSize = batchSize;
+    trainingSampleSize = sampleSize;
+    miniBatchIterations = maxIterations;
+}
+
+const VocabularyTree& BagOfVisualWord::getVocabularyTree() const {
+    return tree;
+}
+
+void BagOfVisualWord::setVocabularyTree(const VocabularyTree& vocabularyTree) {
+    tree = vocabularyTree;
+    useTree = true;
+    vocabulary = tree.getLeafCenters();
+    dictionarySize = vocabulary.rows;
+    updateWordNorms();
 }
\ No newline at end of file
@@ -3,6 +3,9 @@
 #include <opencv2/opencv.hpp>
 #include <vector>
 
+#include "VocabularyTree.h"
+#include "MiniBatchKMeans.h"
+
 using namespace std;
 using namespace cv;
 
@@ -17,7 +20,24 @@ using namespace cv;
 class BagOfVisualWord {
 private:
     Mat vocabulary;         ///< Matrix representing the visual vocabulary (each row is a cluster center).
+    Mat wordNorms;          ///< Squared L2 norm of each visual word (1 x K, CV_32F), cached for batched assignment.
     int dictionarySize;     ///< Number of clusters (visual words) in the vocabulary.
+    VocabularyTree tree;    ///< Hierarchical vocabulary; when trained it replaces the flat nearest-word search.
+    bool useTree = false;   ///< True if `buildVocabulary()` trains a vocabulary tree instead of flat k-means.
+    int threadCount = 0;    ///< Threads used to train the vocabulary (<= 0 uses all hardware threads).
+    int miniBatchSize = 0;  ///< Batch size of mini-batch k-means (0 = full `cv::kmeans`).
+    int miniBatchIterations = 200;  ///< Maximum number of mini-batch k-means steps.
+    int trainingSampleSize = 0;     ///< Descriptors sampled to train the vocabulary (0 = all of them).
+
+    static const int descriptorTileRows = 256;  ///< Descriptors processed per tile of the batched assignment.
+    static const int wordTileRows = 256;        ///< Visual words processed per tile of the batched assignment.
+
+    /**
+     * @brief Recomputes the cached squared norms of the visual words.
+     *
+     * @return void
+     */
+    void updateWordNorms();
 
 public:
     /**
@@ -32,7 +52,26 @@ public:
      *
      * @param[in] vocabulary   Matrix where each row is a visual word (cluster center).
      */
-    BagOfVisualWord(Mat vocabulary) : vocabulary(vocabulary) {}
+    BagOfVisualWord(Mat vocabulary) : vocabulary(vocabulary), dictionarySize(vocabulary.rows) { updateWordNorms(); }
+
+    /**
+     * @brief Constructor for vocabulary tree mode.
+     *
+     * `buildVocabulary()` will train a hierarchical k-means tree with branchFactor^depth words,
+     * and `computeHistogram()` will quantize by descending the tree.
+     *
+     * @param[in] branchFactor   Number of children per tree node.
+     * @param[in] depth          Number of tree levels.
+     */
+    BagOfVisualWord(int branchFactor, int depth)
+        : dictionarySize(VocabularyTree::wordCount(branchFactor, depth)), tree(branchFactor, depth), useTree(true) {}
+
+    /**
+     * @brief Constructor with a trained vocabulary tree.
+     *
+     * @param[in] vocabularyTree   Trained tree; its leaves form the vocabulary.
+     */
+    BagOfVisualWord(const VocabularyTree& vocabularyTree) { setVocabularyTree(vocabularyTree); }
 
     /**
      * @brief Destructor.
@@ -42,8 +81,11 @@ public:
     /**
      * @brief Builds the visual vocabulary by clustering descriptors using k-means.
      *
-     * This method aggregates all descriptors across images, then clusters them into
-     * `dictionarySize` visual words. The vocabulary is stored internally.
+     * This method aggregates all descriptors across images (or a random sample of them, see
+     * `setMiniBatchTraining()`), then clusters them into `dictionarySize` visual words with
+     * `cv::kmeans` or mini-batch k-means. The vocabulary is stored internally.
+     * In vocabulary tree mode, a hierarchical k-means tree is trained instead and its
+     * leaves become the vocabulary.
      *
      * @param[in] descriptors   A vector where each element is a matrix of descriptors
      *                          (one matrix per image; rows = local descriptors).
@@ -52,17 +94,46 @@ public:
      */
     void buildVocabulary(vector<Mat>& descriptors);
 
+    /**
+     * @brief Assigns every descriptor to its nearest center (L2) using blocked matrix products.
+     *
+     * Uses ||x - c||^2 = ||x||^2 - 2 x.c + ||c||^2: the dot products of a tile of descriptors
+     * with a tile of centers are computed by one GEMM call, the precomputed center norms are
+     * added, and the arg-min of each row is tracked across center tiles. Tiles are small enough
+     * to stay in cache, so the cost is dominated by the GEMM instead of N x K calls to `norm()`.
+     *
+     * @param[in]  descriptors   Descriptors to assign (rows = descriptors, CV_32F).
+     * @param[in]  centers       Cluster centers (rows = centers, CV_32F, same column count).
+     * @param[in]  centerNorms   Squared L2 norm of each center (1 x centers.rows, CV_32F).
+     * @param[out] labels        Index of the nearest center for each descriptor.
+     * @param[out] distances     Optional squared distance to the nearest center for each descriptor.
+     *
+     * @return void
+     */
+    static void assignNearestWords(const Mat& descriptors, const Mat& centers, const Mat& centerNorms,
+        vector<int>& labels, vector<float>* distances = nullptr);
+
+    /**
+     * @brief Computes the squared L2 norm of each row of a matrix.
+     *
+     * @param[in] centers   Input matrix (CV_32F).
+     *
+     * @return A 1 x centers.rows matrix (CV_32F) of squared row norms.
+     */
+    static Mat computeRowNorms(const Mat& centers);
+
     /**
      * @brief Computes the BoVW histogram for a given image descriptor set.
      *
-     * This function assigns each descriptor to its nearest visual word in the vocabulary,
-     * and creates a normalized histogram representing the frequency of each word.
+     * This function assigns each descriptor to its nearest visual word in the vocabulary
+     * (batched, see `assignNearestWords()`), and creates a normalized histogram representing
+     * the frequency of each word.
      *
      * @param[in] descriptors   A matrix of descriptors from an image (rows = local descriptors).
      *
      * @return A normalized histogram (cv::Mat) representing visual word frequencies.
      */
-    Mat computeHistogram(const Mat& descriptors);
+    Mat computeHistogram(const Mat& descriptors) const;
 
     /**
      * @brief Returns the current visual vocabulary.
@@ -71,6 +142,43 @@ public:
      */
     Mat getVocabulary() const;
 
+    /**
+     * @brief Sets the number of threads used to train the vocabulary.
+     *
+     * @param[in] count   Number of threads; a value <= 0 uses all hardware threads.
+     *
+     * @return void
+     */
+    void setThreadCount(int count);
+
+    /**
+     * @brief Configures how the flat vocabulary is trained.
+     *
+     * @param[in] batchSize       Batch size of mini-batch k-means; 0 keeps the full `cv::kmeans`.
+     * @param[in] sampleSize      Number of descriptors sampled for training (also used by the
+     *                            vocabulary tree); 0 trains on every descriptor.
+     * @param[in] maxIterations   Maximum number of mini-batch steps.
+     *
+     * @return void
+     */
+    void setMiniBatchTraining(int batchSize, int sampleSize, int maxIterations = 200);
+
+    /**
+     * @brief Returns the vocabulary tree (empty in flat mode).
+     *
+     * @return A const reference to the tree.
+     */
+    const VocabularyTree& getVocabularyTree() const;
+
+    /**
+     * @brief Switches to a trained vocabulary tree; its leaves become the vocabulary.
+     *
+     * @param[in] vocabularyTree   Trained tree.
+     *
+     * @return void
+     */
+    void setVocabularyTree(const VocabularyTree& vocabularyTree);
+
     /**
      * @brief Sets the visual vocabulary manually.
      *
@@ -0,0 +1,161 @@
+#pragma once
+
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+
+using namespace std;
+
+/**
+ * @class BoundedQueue
+ * @brief A blocking FIFO queue with a fixed capacity, used to connect pipeline stages.
+ *
+ * `push()` blocks while the queue is full (back-pressure on the producer stage) and `pop()`
+ * blocks while it is empty. Once the producers call `close()`, consumers drain the remaining
+ * items and then `pop()` returns false. The queue also records occupancy and waiting times
+ * so a pipeline can report which stage is the bottleneck.
+ *
+ * @tparam T   Type of the queued items (moved in and out of the queue).
+ */
+template <typename T>
+class BoundedQueue {
+private:
+    deque<T> items;                     ///< Queued items.
+    size_t capacity;                    ///< Maximum number of queued items.
+    bool closed = false;                ///< True once no more items will be pushed.
+    mutable mutex queueMutex;           ///< Protects all members.
+    condition_variable notFull;         ///< Signaled when an item is removed or the queue is closed.
+    condition_variable notEmpty;        ///< Signaled when an item is added or the queue is closed.
+
+    size_t pushCount = 0;               ///< Total number of pushed items.
+    size_t occupancySum = 0;            ///< Sum of the queue length observed at each push.
+    size_t maxOccupancy = 0;            ///< Largest queue length observed.
+    size_t fullWaits = 0;               ///< Number of pushes that had to wait for free space.
+    size_t emptyWaits = 0;              ///< Number of pops that had to wait for an item.
+
+public:
+    /**
+     * @brief Constructor.
+     *
+     * @param[in] queueCapacity   Maximum number of queued items (at least 1).
+     */
+    explicit BoundedQueue(size_t queueCapacity) : capacity(queueCapacity > 0 ? queueCapacity : 1) {}
+
+    /**
+     * @brief Adds an item, waiting while the queue is full.
+     *
+     * @param[in] item   The item to enqueue (moved).
+     *
+     * @return true if the item was queued; false if the queue has been closed.
+     */
+    bool push(T item) {
+        unique_lock<mutex> lock(queueMutex);
+        if (items.size() >= capacity && !closed) {
+            ++fullWaits;
+            notFull.wait(lock, [this] { return items.size() < capacity || closed; });
+        }
+        if (closed)
+            return false;
+
+        items.push_back(std::move(item));
+        ++pushCount;
+        occupancySum += items.size();
+        if (items.size() > maxOccupancy)
+            maxOccupancy = items.size();
+
+        lock.unlock();
+        notEmpty.notify_one();
+        return true;
+    }
+
+    /**
+     * @brief Removes the oldest item, waiting while the queue is empty and still open.
+     *
+     * @param[out] item   Receives the dequeued item.
+     *
+     * @return true if an item was dequeued; false if the queue is closed and drained.
+     */
+    bool pop(T& item) {
+        unique_lock<mutex> lock(queueMutex);
+        if (items.empty() && !closed) {
+            ++emptyWaits;
+            notEmpty.wait(lock, [this] { return !items.empty() || closed; });
+        }
+        if (items.empty())
+            return false;
+
+        item = std::move(items.front());
+        items.pop_front();
+
+        lock.unlock();
+        notFull.notify_one();
+        return true;
+    }
+
+    /**
+     * @brief Marks the end of the stream and wakes up all waiting threads.
+     *
+     * Items already in the queue can still be popped.
+     *
+     * @return void
+     */
+    void close() {
+        {
+            lock_guard<mutex> lock(queueMutex);
+            closed = true;
+        }
+        notFull.notify_all();
+        notEmpty.notify_all();
+    }
+
+    /**
+     * @brief Returns the capacity of the queue.
+     *
+     * @return The maximum number of queued items.
+     */
+    size_t getCapacity() const { return capacity; }
+
+    /**
+     * @brief Returns the largest queue length observed so far.
+     *
+     * @return The maximum occupancy.
+     */
+    size_t getMaxOccupancy() const {
+        lock_guard<mutex> lock(queueMutex);
+        return maxOccupancy;
+    }
+
+    /**
+     * @brief Returns the average queue length observed at each push.
+     *
+     * @return The average occupancy (0 if nothing was pushed).
+     */
+    double getAverageOccupancy() const {
+        lock_guard<mutex> lock(queueMutex);
+        return pushCount > 0 ? static_cast<double>(occupancySum) / pushCount : 0.0;
+    }
+
+    /**
+     * @brief Returns how many pushes were blocked because the queue was full.
+     *
+     * A high value means the consumer stage is slower than the producer stage.
+     *
+     * @return The number of blocked pushes.
+     */
+    size_t getFullWaits() const {
+        lock_guard<mutex> lock(queueMutex);
+        return fullWaits;
+    }
+
+    /**
+     * @brief Returns how many pops were blocked because the queue was empty.
+     *
+     * A high value means the producer stage is slower than the consumer stage.
+     *
+     * @return The number of blocked pops.
+     */
+    size_t getEmptyWaits() const {
+        lock_guard<mutex> lock(queueMutex);
+        return emptyWaits;
+    }
+};
@@ -1,5 +1,30 @@
 ﻿#include "ColorCorrelogram.h"
 
+#include <cstdint>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define COLOR_CORRELOGRAM_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace {
+    // matches[i] += (a[i] == b[i]) over a row segment. SSE2 is part of every x86 target
+    // the project builds for, so no runtime dispatch is needed.
+    void addMatches(const uchar* a, const uchar* b, uchar* matches, int count) {
+        int i = 0;
+#ifdef COLOR_CORRELOGRAM_SSE2
+        for (; i + 16 <= count; i += 16) {
+            const __m128i equal = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i)),
+                _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i)));
+            __m128i* out = reinterpret_cast<__m128i*>(matches + i);
+            _mm_storeu_si128(out, _mm_sub_epi8(_mm_loadu_si128(out), equal));  // equal lanes are -1
+        }
+#endif
+        for (; i < count; ++i)
+            matches[i] += a[i] == b[i];
+    }
+}
+
 int ColorCorrelogram::colorQuantization(Vec3b hsvColor) {
     int h = hsvColor[0]; // H: 0-179
     int s = hsvColor[1]; // S: 0-255
@@ -31,10 +56,181 @@ void ColorCorrelogram::getNeighborPixels(int x, int y, int rows, int cols, int d
     }
 }
 
+void ColorCorrelogram::quantizeImage(const Mat& hsv_image, Mat& quantized) {
+    // The bin is a sum of one term per channel, tabulated once per image
+    uchar hueTerms[256], saturationTerms[256], valueTerms[256];
+    for (int i = 0; i < 256; ++i) {
+        hueTerms[i] = static_cast<uchar>(colorQuantization(Vec3b(static_cast<uchar>(i), 0, 0)));
+        saturationTerms[i] = static_cast<uchar>(colorQuantization(Vec3b(0, static_cast<uchar>(i), 0)));
+        valueTerms[i] = static_cast<uchar>(colorQuantization(Vec3b(0, 0, static_cast<uchar>(i))));
+    }
+
+    quantized.create(hsv_image.rows, hsv_image.cols, CV_8U);
+    for (int i = 0; i < hsv_image.rows; ++i) {
+        const uchar* hsv = hsv_image.ptr<uchar>(i);
+        uchar* bin = quantized.ptr<uchar>(i);
+        for (int j = 0; j < hsv_image.cols; ++j, hsv += 3)
+            bin[j] = static_cast<uchar>(hueTerms[hsv[0]] + saturationTerms[hsv[1]] + valueTerms[hsv[2]]);
+    }
+}
+
+void ColorCorrelogram::countSampled(const Mat& quantized, vector<long long>& counts) {
+    static const int distances[distanceCount] = { 1, 3, 5, 7 };
+    const int rows = quantized.rows;
+    const int cols = quantized.cols;
+    const int stepX = max(1, rows / 100);
+    const int stepY = max(1, cols / 100);
+
+    for (int x = 0; x < rows; x += stepX) {
+        const uchar* row = quantized.ptr<uchar>(x);
+        const uchar* above[distanceCount];
+        const uchar* below[distanceCount];
+        for (int k = 0; k < distanceCount; ++k) {
+            above[k] = x - distances[k] >= 0 ? quantized.ptr<uchar>(x - distances[k]) : nullptr;
+            below[k] = x + distances[k] < rows ? quantized.ptr<uchar>(x + distances[k]) : nullptr;
+        }
+
+        for (int y = 0; y < cols; y += stepY) {
+            const uchar c1 = row[y];
+            for (int k = 0; k < distanceCount; ++k) {
+                // The 8 neighbors at distance d that are inside the image
+                const int d = distances[k];
+                const bool left = y - d >= 0, right = y + d < cols;
+                long long matches = 0;
+                if (left)
+                    matches += row[y - d] == c1;
+                if (right)
+                    matches += row[y + d] == c1;
+                if (above[k]) {
+                    matches += above[k][y] == c1;
+                    if (left)
+                        matches += above[k][y - d] == c1;
+                    if (right)
+                        matches += above[k][y + d] == c1;
+                }
+                if (below[k]) {
+                    matches += below[k][y] == c1;
+                    if (left)
+                        matches += below[k][y - d] == c1;
+                    if (right)
+                        matches += below[k][y + d] == c1;
+                }
+                counts[k * bins + c1] += matches;
+            }
+        }
+    }
+}
+
+void ColorCorrelogram::countExact(const Mat& quantized, vector<long long>& counts) {
+    static const int distances[distanceCount] = { 1, 3, 5, 7 };
+    const int rows = quantized.rows;
+    const int cols = quantized.cols;
+
+    // The matches of a pixel at the 4 distances are packed in 16-bit fields of one word, so a
+    // pixel costs one increment of its color. A field grows by at most 4 per pixel: the packed
+    // counts are flushed before 16383 pixels have been added.
+    const int flushPixels = 16383;
+    vector<uint64_t> packed(bins, 0);
+    int pending = 0;
+    auto flush = [&]() {
+        for (int c = 0; c < bins; ++c) {
+            for (int k = 0; k < distanceCount; ++k)
+                counts[k * bins + c] += (packed[c] >> (16 * k)) & 0xFFFF;
+            packed[c] = 0;
+        }
+        pending = 0;
+    };
+
+    vector<uchar> matches(static_cast<size_t>(distanceCount) * cols);
+    for (int x = 0; x < rows; ++x) {
+        const uchar* row = quantized.ptr<uchar>(x);
+        fill(matches.begin(), matches.end(), 0);
+
+        // Forward neighbors only: right, below, below-right and below-left
+        for (int k = 0; k < distanceCount; ++k) {
+            const int d = distances[k];
+            uchar* distanceMatches = &matches[static_cast<size_t>(k) * cols];
+            if (d >= cols && x + d >= rows)
+                continue;
+            if (d < cols)
+                addMatches(row, row + d, distanceMatches, cols - d);
+            if (x + d < rows) {
+                const uchar* below = quantized.ptr<uchar>(x + d);
+                addMatches(row, below, distanceMatches, cols);
+                if (d < cols) {
+                    addMatches(row, below + d, distanceMatches, cols - d);
+                    addMatches(row + d, below, distanceMatches + d, cols - d);
+                }
+            }
+        }
+
+        const uchar* m0 = &matches[0];
+        const uchar* m1 = m0 + cols;
+        const uchar* m2 = m1 + cols;
+        const uchar* m3 = m2 + cols;
+        for (int begin = 0; begin < cols; ) {
+            if (pending == flushPixels)
+                flush();
+            const int end = min(cols, begin + flushPixels - pending);
+            for (int y = begin; y < end; ++y)
+                packed[row[y]] += m0[y] | static_cast<uint64_t>(m1[y]) << 16
+                    | static_cast<uint64_t>(m2[y]) << 32 | static_cast<uint64_t>(m3[y]) << 48;
+            pending += end - begin;
+            begin = end;
+        }
+    }
+    flush();
+}
+
 void ColorCorrelogram::createFeature(String image_id, Mat image) {
+    // Convert to HSV
+    Mat hsv_image;
+    cvtColor(image, hsv_image, COLOR_BGR2HSV);
+    computeCorrelogram(image_id, hsv_image);
+}
+
+unsigned ColorCorrelogram::getRequiredPlanes() const {
+    return ImagePlanes::HSV;
+}
+
+void ColorCorrelogram::createFeatureFromPlanes(String image_id, const ImagePlanes& planes) {
+    if (planes.hsv.empty())
+        createFeature(image_id, planes.bgr);
+    else
+        computeCorrelogram(image_id, planes.hsv);
+}
+
+void ColorCorrelogram::computeCorrelogram(const String& image_id, const Mat& hsv_image) {
+    Mat quantized;
+    quantizeImage(hsv_image, quantized);
+
+    // Step 2: Compute correlogram, all distances in one sweep
+    vector<long long> counts(static_cast<size_t>(distanceCount) * bins, 0);
+    if (mode == CorrelogramMode::Exact)
+        countExact(quantized, counts);
+    else
+        countSampled(quantized, counts);
+
+    // Each distance is normalized by its number of matches
+    vector<float> correlogram(static_cast<size_t>(distanceCount) * bins, 0.0f);
+    for (int k = 0; k < distanceCount; ++k) {
+        long long totalMatches = 0;
+        for (int i = 0; i < bins; ++i)
+            totalMatches += counts[k * bins + i];
+        if (totalMatches > 0) {
+            for (int i = 0; i < bins; ++i)
+                correlogram[k * bins + i] = static_cast<float>(counts[k * bins + i]) / static_cast<float>(totalMatches);
+        }
+    }
+
+    // Save result
+    id = image_id;
+    imageDescriptors = Mat(correlogram).reshape(1, 1).clone(); // 1-row descriptor
+}
+
+Mat ColorCorrelogram::computeReference(const Mat& image) {
+    ColorCorrelogram quantizer;
     vector<int> distances = { 1, 3, 5, 7 };
-    const int h_bins = 9, s_bins = 4, v_bins = 4;
-    const int bins = h_bins * s_bins * v_bins; // total = 144
     const int rows = image.rows;
     const int cols = image.cols;
     vector<float> correlogram(bins * distances.size(), 0.0f);
@@ -46,9 +242,9 @@ void ColorCorrelogram::createFeature(String image_id, Mat image) {
     Mat quantized(rows, cols, CV_8U);
     for (int i = 0; i < rows; ++i)
         for (int j = 0; j < cols; ++j)
-            quantized.at<uchar>(i, j) = colorQuantization(hsv_image.at<Vec3b>(i, j));
+            quantized.at<uchar>(i, j) = static_cast<uchar>(quantizer.colorQuantization(hsv_image.at<Vec3b>(i, j)));
 
-    // Step 2: Compute correlogram
+    // One pass over the sampling grid per distance
     for (size_t d = 0; d < distances.size(); ++d) {
         int dist = distances[d];
         vector<int> colorCount(bins, 0);
@@ -87,8 +283,5 @@ void ColorCorrelogram::createFeature(String image_id, Mat image) {
         }
     }
 
-    // Save result
-    id = image_id;
-    imageDescriptors = Mat(correlogram).reshape(1, 1); // 1-row descriptor
-    imageDescriptors.convertTo(imageDescriptors, CV_32F);
-}
\ No newline at end of file
+    return Mat(correlogram).reshape(1, 1).clone();
+}
@@ -2,6 +2,15 @@
 
 #include "Features.h"
 
+/**
+ * @enum CorrelogramMode
+ * @brief Pixels whose neighborhoods are counted by the color correlogram.
+ */
+enum class CorrelogramMode {
+    Sampled,    ///< A grid of about 100 x 100 pixels, 8 neighbors per distance (the original descriptor)
+    Exact       ///< Every pixel and every in-bounds neighbor pair
+};
+
 /**
  * @class ColorCorrelogram
  * @brief Extracts color correlogram features from an image.
@@ -9,16 +18,80 @@
  * The color correlogram encodes how spatial correlation between identical colors
  * varies with distance. This descriptor is robust to changes in image scale,
  * viewpoint, and partial occlusion, and is useful for content-based image retrieval.
+ *
+ * Colors are quantized to 9 x 4 x 4 HSV bins through per-channel lookup tables, and every
+ * distance in {1, 3, 5, 7} is counted in the same sweep over the rows, so each row is read
+ * while its neighbors are still in cache.
+ *
+ * The sampled mode reproduces the original descriptor: a grid of about 100 x 100 pixels, each
+ * compared with its 8 neighbors at every distance. The exact mode counts every pixel of the
+ * image. It compares each pixel with its 4 forward neighbors only (right, below-left, below,
+ * below-right): the backward comparisons are the same pairs seen from the other pixel, so
+ * the normalized descriptor is unchanged. Equality tests run on whole row segments, 16
+ * pixels per SSE2 instruction, and the four per-distance counts of a pixel are added to its
+ * color with a single packed increment.
+ *
+ * On the 720 x 1280 dataset images the exact descriptor takes about 2.5x the time of the
+ * sampled one (about 4 ms against 1.7 ms, color conversion excluded). It removes the
+ * sampling noise of the 10^4-pixel grid: the two modes differ by 0.01-0.05 in L1 per
+ * distance (each distance sums to 1), more on highly textured images. See `createFeature()`;
+ * `Tester::runDistanceBenchmark()` reproduces these figures against `computeReference()`.
  */
 class ColorCorrelogram : public Feature {
 private:
     vector<Point> neighborPixels; ///< Stores neighbor pixel offsets for a given distance.
+    CorrelogramMode mode;         ///< Pixels counted by `createFeature()`
+
+    static const int distanceCount = 4;         ///< Distances of the descriptor: 1, 3, 5, 7
+    static const int bins = 9 * 4 * 4;          ///< Quantized colors (H x S x V)
+
+    /**
+     * @brief Quantizes every pixel of an HSV image.
+     *
+     * @param[in]  hsv_image   The input image in HSV color space.
+     * @param[out] quantized   Color bin of every pixel (CV_8U, same size).
+     *
+     * @return void
+     */
+    void quantizeImage(const Mat& hsv_image, Mat& quantized);
+
+    /**
+     * @brief Computes the correlogram of an HSV image and stores it as the descriptor.
+     *
+     * @param[in] image_id    A unique string identifier for the image.
+     * @param[in] hsv_image   The input image in HSV color space.
+     *
+     * @return void
+     */
+    void computeCorrelogram(const String& image_id, const Mat& hsv_image);
+
+    /**
+     * @brief Counts identical neighbors around the pixels of the sampling grid.
+     *
+     * @param[in]  quantized   Color bin of every pixel.
+     * @param[out] counts      Matches of each (distance, color), distance major.
+     *
+     * @return void
+     */
+    void countSampled(const Mat& quantized, vector<long long>& counts);
+
+    /**
+     * @brief Counts identical neighbor pairs over the whole image.
+     *
+     * @param[in]  quantized   Color bin of every pixel.
+     * @param[out] counts      Matches of each (distance, color), distance major.
+     *
+     * @return void
+     */
+    void countExact(const Mat& quantized, vector<long long>& counts);
 
 public:
     /**
-     * @brief Default constructor.
+     * @brief Constructor.
+     *
+     * @param[in] countMode   Sampled grid (the original descriptor) or every pixel.
      */
-    ColorCorrelogram() {}
+    explicit ColorCorrelogram(CorrelogramMode countMode = CorrelogramMode::Sampled) : mode(countMode) {}
 
     /**
      * @brief Destructor.
@@ -67,7 +140,8 @@ public:
      *
      * This method computes spatial correlations of identical quantized colors
      * at predefined distances from each pixel in the image and stores the result
-     * in the internal feature descriptor.
+     * in the internal feature descriptor: 4 distances x 144 colors, each distance
+     * normalized to sum to 1.
      *
      * @param[in] image_id   A unique string identifier for the image.
      * @param[in] src_image  The input image in BGR format.
@@ -75,4 +149,33 @@ public:
      * @return void
      */
     void createFeature(cv::String image_id, cv::Mat src_image) override;
+
+    /**
+     * @brief Computes the sampled correlogram with the original per-distance, per-pixel loops.
+     *
+     * The reference for `createFeature()` in sampled mode, which gives the same descriptor:
+     * one `at<>` access per pixel to quantize, then one pass over the sampling grid per distance.
+     *
+     * @param[in] src_image  The input image in BGR format.
+     *
+     * @return A 1 x 576 CV_32F descriptor.
+     */
+    static cv::Mat computeReference(const cv::Mat& src_image);
+
+    /**
+     * @brief Asks for the shared HSV plane.
+     *
+     * @return `ImagePlanes::HSV`.
+     */
+    unsigned getRequiredPlanes() const override;
+
+    /**
+     * @brief Extracts the color correlogram from the shared HSV plane.
+     *
+     * @param[in] image_id   A unique string identifier for the image.
+     * @param[in] planes     The decoded image and its HSV plane.
+     *
+     * @return void
+     */
+    void createFeatureFromPlanes(cv::String image_id, const ImagePlanes& planes) override;
 };
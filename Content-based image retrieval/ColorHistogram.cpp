@@ -1,17 +1,223 @@
 #include "ColorHistogram.h"
+#include "DistanceKernels.h"
+
+#include <cstdint>
+#include <cstring>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define COLOR_HISTOGRAM_X86 1
+#include <immintrin.h>
+#endif
+
+// MSVC compiles intrinsics of any instruction set, GCC and Clang need a per-function target
+#if defined(_MSC_VER) || !defined(COLOR_HISTOGRAM_X86)
+#define KERNEL_TARGET(isa)
+#else
+#define KERNEL_TARGET(isa) __attribute__((target(isa)))
+#endif
+
+namespace {
+    const int hsvShift = 12;            // Fixed-point precision of OpenCV's 8-bit BGR -> HSV
+    const int binCount = 16 * 8 * 8;    // Histogram size (H x S x V)
+    const int binStride = binCount + 64; // Out-of-range hues land in [binCount, binStride)
+    const int blockPixels = 256;        // Pixels decoded before they are binned
+
+    /**
+     * @brief Lookup tables of the fused kernel.
+     *
+     * A pixel is reduced to its value v = max(B, G, R), its spread d = v - min(B, G, R) and the
+     * hue numerator n of the channel holding v (G - B, B - R + 2d or R - G + 4d). The hue then
+     * only depends on (d, n) and the saturation on (v, d), so both bins come from a table
+     * instead of the two fixed-point divisions of cvtColor.
+     */
+    struct HsvBinTables {
+        int saturationDivisors[256];    // (255 << shift) / v
+        int hueDivisors[256];           // (180 << shift) / (6 * d)
+        int hueRowOffsets[256];         // Entry of (d, n = 0) in hueBins: rows hold n in [-d, 5d]
+        vector<uint8_t> hueBins;        // Hue bin of (d, n), 16 if the hue is outside [0, 180)
+        vector<uint8_t> saturationValueBins; // S bin * 8 + V bin of (v, d), at v * 256 + d
+
+        HsvBinTables() : hueBins(), saturationValueBins(256 * 256, 0) {
+            saturationDivisors[0] = hueDivisors[0] = 0;
+            for (int i = 1; i < 256; ++i) {
+                saturationDivisors[i] = saturate_cast<int>((255 << hsvShift) / (1. * i));
+                hueDivisors[i] = saturate_cast<int>((180 << hsvShift) / (6. * i));
+            }
+
+            hueBins.reserve(3 * 256 * 256);
+            for (int d = 0; d < 256; ++d) {
+                hueRowOffsets[d] = static_cast<int>(hueBins.size()) + d;
+                for (int n = -d; n <= 5 * d; ++n) {
+                    const int bin = binOf(hueOf(n, d), 16, 0, 180);
+                    hueBins.push_back(static_cast<uint8_t>(bin < 0 ? 16 : bin));
+                }
+            }
+            for (int v = 0; v < 256; ++v) {
+                for (int d = 0; d <= v; ++d) {
+                    const int s = (d * saturationDivisors[v] + (1 << (hsvShift - 1))) >> hsvShift;
+                    saturationValueBins[v * 256 + d] = static_cast<uint8_t>(binOf(s, 8, 0, 256) * 8 + binOf(v, 8, 0, 256));
+                }
+            }
+        }
+
+        // Hue of cvtColor(COLOR_BGR2HSV) on 8-bit images from the numerator and the spread
+        int hueOf(int n, int d) const {
+            int h = (n * hueDivisors[d] + (1 << (hsvShift - 1))) >> hsvShift;
+            h += h < 0 ? 180 : 0;
+            return saturate_cast<uchar>(h);
+        }
+
+        // Same lookup as calcHist on 8-bit images with uniform ranges, -1 outside the range
+        static int binOf(int value, int bins, double low, double high) {
+            const double scale = bins / (high - low);
+            const int bin = cvFloor(value * scale + (-scale * low));
+            if (value < low || value >= high)
+                return -1;
+            return max(min(bin, bins - 1), 0);
+        }
+
+        int binOfPixel(int v, int d, int n) const {
+            return hueBins[hueRowOffsets[d] + n] * 64 + saturationValueBins[v * 256 + d];
+        }
+    };
+
+    const HsvBinTables& binTables() {
+        static const HsvBinTables tables;
+        return tables;
+    }
+
+    // Value, spread and hue numerator of BGR pixels [begin, end) of a row
+    void decodePixelsScalar(const uchar* pixels, int begin, int end, uint8_t* values, uint8_t* spreads, int16_t* numerators) {
+        for (int i = begin; i < end; ++i) {
+            const int b = pixels[3 * i], g = pixels[3 * i + 1], r = pixels[3 * i + 2];
+            const int v = max(b, max(g, r));
+            const int d = v - min(b, min(g, r));
+            values[i] = static_cast<uint8_t>(v);
+            spreads[i] = static_cast<uint8_t>(d);
+            numerators[i] = static_cast<int16_t>(v == r ? g - b : (v == g ? b - r + 2 * d : r - g + 4 * d));
+        }
+    }
+
+#ifdef COLOR_HISTOGRAM_X86
+    // 16 pixels per iteration: the BGR bytes are split into planes with shuffles, the numerator
+    // is selected on 16-bit lanes. Returns the number of pixels decoded (a multiple of 16).
+    KERNEL_TARGET("sse4.2")
+    int decodePixelsSSE42(const uchar* pixels, int count, uint8_t* values, uint8_t* spreads, int16_t* numerators) {
+        const __m128i blue0 = _mm_setr_epi8(0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+        const __m128i blue1 = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14, -1, -1, -1, -1, -1);
+        const __m128i blue2 = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 1, 4, 7, 10, 13);
+        const __m128i green0 = _mm_setr_epi8(1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+        const __m128i green1 = _mm_setr_epi8(-1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1);
+        const __m128i green2 = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14);
+        const __m128i red0 = _mm_setr_epi8(2, 5, 8, 11, 14, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+        const __m128i red1 = _mm_setr_epi8(-1, -1, -1, -1, -1, 1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1);
+        const __m128i red2 = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15);
+        const __m128i zero = _mm_setzero_si128();
+
+        int i = 0;
+        for (; i + 16 <= count; i += 16, pixels += 48) {
+            const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pixels));
+            const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pixels + 16));
+            const __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pixels + 32));
+            const __m128i blue = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(a, blue0), _mm_shuffle_epi8(b, blue1)), _mm_shuffle_epi8(c, blue2));
+            const __m128i green = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(a, green0), _mm_shuffle_epi8(b, green1)), _mm_shuffle_epi8(c, green2));
+            const __m128i red = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(a, red0), _mm_shuffle_epi8(b, red1)), _mm_shuffle_epi8(c, red2));
+
+            const __m128i value = _mm_max_epu8(blue, _mm_max_epu8(green, red));
+            const __m128i spread = _mm_sub_epi8(value, _mm_min_epu8(blue, _mm_min_epu8(green, red)));
+            const __m128i redMax = _mm_cmpeq_epi8(value, red);
+            const __m128i greenMax = _mm_cmpeq_epi8(value, green);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(values + i), value);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(spreads + i), spread);
+
+            for (int half = 0; half < 2; ++half) {
+                const __m128i b16 = half ? _mm_unpackhi_epi8(blue, zero) : _mm_unpacklo_epi8(blue, zero);
+                const __m128i g16 = half ? _mm_unpackhi_epi8(green, zero) : _mm_unpacklo_epi8(green, zero);
+                const __m128i r16 = half ? _mm_unpackhi_epi8(red, zero) : _mm_unpacklo_epi8(red, zero);
+                const __m128i d16 = half ? _mm_unpackhi_epi8(spread, zero) : _mm_unpacklo_epi8(spread, zero);
+                const __m128i redMask = half ? _mm_unpackhi_epi8(redMax, redMax) : _mm_unpacklo_epi8(redMax, redMax);
+                const __m128i greenMask = half ? _mm_unpackhi_epi8(greenMax, greenMax) : _mm_unpacklo_epi8(greenMax, greenMax);
+
+                // Red first, then green, then blue, as in the scalar conversion
+                const __m128i d2 = _mm_add_epi16(d16, d16);
+                const __m128i fromRed = _mm_sub_epi16(g16, b16);
+                const __m128i fromGreen = _mm_add_epi16(_mm_sub_epi16(b16, r16), d2);
+                const __m128i fromBlue = _mm_add_epi16(_mm_sub_epi16(r16, g16), _mm_add_epi16(d2, d2));
+                const __m128i numerator = _mm_blendv_epi8(_mm_blendv_epi8(fromBlue, fromGreen, greenMask), fromRed, redMask);
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(numerators + i + 8 * half), numerator);
+            }
+        }
+        return i;
+    }
+#endif
+
+    void binRow(const uchar* pixels, int count, bool vectorized, const HsvBinTables& tables, int* c0, int* c1, int* c2, int* c3) {
+        uint8_t values[blockPixels], spreads[blockPixels];
+        int16_t numerators[blockPixels];
+
+        for (int begin = 0; begin < count; begin += blockPixels, pixels += 3 * blockPixels) {
+            const int size = min(blockPixels, count - begin);
+            int decoded = 0;
+#ifdef COLOR_HISTOGRAM_X86
+            if (vectorized)
+                decoded = decodePixelsSSE42(pixels, size, values, spreads, numerators);
+#endif
+            decodePixelsScalar(pixels, decoded, size, values, spreads, numerators);
+
+            // Four interleaved histograms: pixels of the same color do not wait on each other's increment
+            int i = 0;
+            for (; i + 4 <= size; i += 4) {
+                ++c0[tables.binOfPixel(values[i], spreads[i], numerators[i])];
+                ++c1[tables.binOfPixel(values[i + 1], spreads[i + 1], numerators[i + 1])];
+                ++c2[tables.binOfPixel(values[i + 2], spreads[i + 2], numerators[i + 2])];
+                ++c3[tables.binOfPixel(values[i + 3], spreads[i + 3], numerators[i + 3])];
+            }
+            for (; i < size; ++i)
+                ++c0[tables.binOfPixel(values[i], spreads[i], numerators[i])];
+        }
+    }
+}
 
 void ColorHistogram::createFeature(String image_id, Mat src_image) {
+    // Set attributes
+    id = image_id;
+    imageDescriptors = computeHistogram(src_image);
+}
+
+unsigned ColorHistogram::getRequiredPlanes() const {
+    return fusedKernelAvailable() ? 0u : static_cast<unsigned>(ImagePlanes::HSV);
+}
+
+void ColorHistogram::createFeatureFromPlanes(String image_id, const ImagePlanes& planes) {
+    id = image_id;
+    if ((planes.bgr.type() == CV_8UC3 && fusedKernelAvailable()) || planes.hsv.empty())
+        imageDescriptors = computeHistogram(planes.bgr);
+    else
+        imageDescriptors = computeHistogramOfHsv(planes.hsv);
+}
+
+bool ColorHistogram::fusedKernelAvailable() {
+    // Without SSE4.2 the fused kernel is slower than OpenCV's own vectorized conversion
+    static const bool vectorized = DistanceKernels::detectSimdLevel() != SimdLevel::Scalar;
+    return vectorized && fusedKernelVerified();
+}
+
+Mat ColorHistogram::computeHistogram(const Mat& src_image) {
+    if (src_image.type() == CV_8UC3 && fusedKernelAvailable())
+        return computeHistogramFused(src_image);
+    return computeHistogramOpenCV(src_image);
+}
+
+Mat ColorHistogram::computeHistogramOpenCV(const Mat& src_image) {
     // Convert to HSV
     Mat hsv_image;
     cvtColor(src_image, hsv_image, COLOR_BGR2HSV);
+    return computeHistogramOfHsv(hsv_image);
+}
 
-    // Split channels
-    vector<Mat> hsv_planes;
-    split(hsv_image, hsv_planes);
-
+Mat ColorHistogram::computeHistogramOfHsv(const Mat& hsv_image) {
     // Define histogram bin sizes for H, S, V (quantization)
-    int h_bins = 16, s_bins = 8, v_bins = 8;
-    int histSize[] = { h_bins, s_bins, v_bins };
+    int histSize[] = { hueBins, saturationBins, valueBins };
 
     // HSV ranges: H [0,180], S,V [0,256]
     float h_range[] = { 0, 180 };
@@ -31,8 +237,80 @@ void ColorHistogram::createFeature(String image_id, Mat src_image) {
 
     // Optional: Normalize histogram to [0,1]
     normalize(hsv_hist, hsv_hist, 0, 1, NORM_MINMAX, -1, Mat());
+    return hsv_hist;
+}
 
-    // Set attributes
-    id = image_id;
-    imageDescriptors = hsv_hist;
-}
\ No newline at end of file
+Mat ColorHistogram::computeHistogramFused(const Mat& src_image, bool vectorized) {
+    CV_Assert(src_image.type() == CV_8UC3);
+    const HsvBinTables& tables = binTables();
+    static const bool sse42 = DistanceKernels::detectSimdLevel() != SimdLevel::Scalar;
+
+    vector<int> counts(4 * binStride, 0);
+    int* c0 = counts.data();
+    int* c1 = c0 + binStride;
+    int* c2 = c1 + binStride;
+    int* c3 = c2 + binStride;
+
+    int rows = src_image.rows, cols = src_image.cols;
+    if (src_image.isContinuous()) {
+        cols *= rows;
+        rows = 1;
+    }
+    for (int y = 0; y < rows; ++y)
+        binRow(src_image.ptr<uchar>(y), cols, vectorized && sse42, tables, c0, c1, c2, c3);
+
+    // Same float histogram as calcHist, then the same normalization
+    Mat hist(1, binCount, CV_32F);
+    float* bins = hist.ptr<float>(0);
+    for (int i = 0; i < binCount; ++i)
+        bins[i] = static_cast<float>(c0[i] + c1[i] + c2[i] + c3[i]);
+    normalize(hist, hist, 0, 1, NORM_MINMAX, -1, Mat());
+    return hist;
+}
+
+bool ColorHistogram::fusedKernelVerified() {
+    // Checked against the OpenCV loaded by this process, once
+    static const bool verified = checkFusedKernel();
+    return verified;
+}
+
+bool ColorHistogram::checkFusedKernel() {
+    // Every BGR color, one 256 x 256 (G, R) slice per blue value: per-pixel HSV and per-slice histogram
+    const HsvBinTables& tables = binTables();
+    Mat slice(256, 256, CV_8UC3), hsv;
+    for (int b = 0; b < 256; ++b) {
+        for (int g = 0; g < 256; ++g) {
+            uchar* pixel = slice.ptr<uchar>(g);
+            for (int r = 0; r < 256; ++r, pixel += 3) {
+                pixel[0] = static_cast<uchar>(b);
+                pixel[1] = static_cast<uchar>(g);
+                pixel[2] = static_cast<uchar>(r);
+            }
+        }
+
+        cvtColor(slice, hsv, COLOR_BGR2HSV);
+        for (int g = 0; g < 256; ++g) {
+            const uchar* expected = hsv.ptr<uchar>(g);
+            for (int r = 0; r < 256; ++r, expected += 3) {
+                const int v = max(b, max(g, r));
+                const int d = v - min(b, min(g, r));
+                const int n = v == r ? g - b : (v == g ? b - r + 2 * d : r - g + 4 * d);
+                const int s = (d * tables.saturationDivisors[v] + (1 << (hsvShift - 1))) >> hsvShift;
+                if (tables.hueOf(n, d) != expected[0] || s != expected[1] || v != expected[2]) {
+                    cerr << "Color histogram: fused kernel differs from cvtColor, using OpenCV" << endl;
+                    return false;
+                }
+            }
+        }
+
+        Mat reference = computeHistogramOpenCV(slice);
+        for (bool vectorized : { false, true }) {
+            Mat fused = computeHistogramFused(slice, vectorized);
+            if (reference.total() != fused.total() || memcmp(fused.data, reference.data, fused.total() * sizeof(float)) != 0) {
+                cerr << "Color histogram: fused kernel differs from calcHist, using OpenCV" << endl;
+                return false;
+            }
+        }
+    }
+    return true;
+}
@@ -12,8 +12,18 @@ using namespace cv;
  * @brief Extracts and stores color histogram features from an image.
  *
  * This class implements a color-based global feature descriptor by computing
- * separate 1D histograms for the Blue, Green, and Red channels in an image.
+ * a joint 16 x 8 x 8 histogram of the Hue, Saturation and Value of every pixel.
  * The extracted histogram can be used for color-based image retrieval and comparison.
+ *
+ * BGR images are binned by a fused kernel: each pixel goes straight from BGR to its HSV
+ * bin in one pass over the image, through lookup tables built from the integer arithmetic
+ * of OpenCV's 8-bit `cvtColor` and the bin boundaries of `calcHist`, without any
+ * intermediate image.
+ * The kernel is checked against `cvtColor` and `calcHist` on every BGR color; if the
+ * installed OpenCV converts differently, the OpenCV path is used instead, so descriptors
+ * are always identical to it. The check converts and bins 2^24 pixels, a few hundred
+ * milliseconds, paid once per process on its first color histogram. It is not cached on
+ * disk, so a process always checks the OpenCV library it actually loaded.
  */
 class ColorHistogram : public Feature {
 private:
@@ -21,13 +31,48 @@ private:
     Mat g_hist;   ///< Histogram of the Green channel.
     Mat b_hist;   ///< Histogram of the Blue channel.
 
+    static const int hueBins = 16;          ///< Hue bins (range [0, 180))
+    static const int saturationBins = 8;    ///< Saturation bins (range [0, 256))
+    static const int valueBins = 8;         ///< Value bins (range [0, 256))
+
+    /**
+     * @brief Tells whether the fused kernel bins every BGR color like `cvtColor` and `calcHist`.
+     *
+     * Computed by `checkFusedKernel()` on the first call and kept for the rest of the process.
+     *
+     * @return true if the fused kernel can be used.
+     */
+    static bool fusedKernelVerified();
+
+    /**
+     * @brief Compares the fused kernel with `cvtColor` and `calcHist` on all 2^24 BGR colors.
+     *
+     * @return true if every color gets the same HSV values and every slice the same histogram.
+     */
+    static bool checkFusedKernel();
+
+    /**
+     * @brief Tells whether 8-bit BGR images go through the fused kernel.
+     *
+     * @return true on CPUs with SSE4.2 once the kernel has been verified.
+     */
+    static bool fusedKernelAvailable();
+
+    /**
+     * @brief Computes the normalized histogram of an image already converted to HSV.
+     *
+     * @param[in] hsv_image    The image in HSV color space.
+     *
+     * @return A 1 x 1024 CV_32F descriptor.
+     */
+    static Mat computeHistogramOfHsv(const Mat& hsv_image);
+
 public:
     /**
-     * @brief Extracts and stores the RGB color histograms from a source image.
+     * @brief Extracts and stores the HSV color histogram from a source image.
      *
-     * This method computes a separate histogram for each color channel (B, G, R),
-     * typically using 256 bins per channel. The resulting histograms are concatenated
-     * and stored as the descriptor for the image.
+     * The histogram has 16 x 8 x 8 = 1024 bins (H major, V minor), min-max normalized
+     * to [0, 1], and is stored as the descriptor for the image.
      *
      * @param[in] image_id     A unique string identifier for the input image.
      * @param[in] src_image    The input image in BGR color space (cv::Mat format).
@@ -35,4 +80,58 @@ public:
      * @return void
      */
     void createFeature(String image_id, Mat src_image) override;
+
+    /**
+     * @brief Asks for the shared HSV plane when the fused kernel cannot be used.
+     *
+     * @return `ImagePlanes::HSV`, or 0 when the histogram is binned straight from BGR.
+     */
+    unsigned getRequiredPlanes() const override;
+
+    /**
+     * @brief Extracts the histogram from the fused kernel or the shared HSV plane.
+     *
+     * @param[in] image_id   A unique string identifier for the input image.
+     * @param[in] planes     The decoded image and its HSV plane.
+     *
+     * @return void
+     */
+    void createFeatureFromPlanes(String image_id, const ImagePlanes& planes) override;
+
+    /**
+     * @brief Computes the normalized HSV histogram of an image.
+     *
+     * Uses the fused kernel for 8-bit BGR images on CPUs with SSE4.2 once it has been
+     * verified, the OpenCV path otherwise.
+     *
+     * @param[in] src_image    The input image in BGR color space.
+     *
+     * @return A 1 x 1024 CV_32F descriptor.
+     */
+    static Mat computeHistogram(const Mat& src_image);
+
+    /**
+     * @brief Computes the normalized HSV histogram with `cvtColor` and `calcHist`.
+     *
+     * Reference for the fused kernel, and fallback for images it does not handle.
+     *
+     * @param[in] src_image    The input image in BGR color space.
+     *
+     * @return A 1 x 1024 CV_32F descriptor.
+     */
+    static Mat computeHistogramOpenCV(const Mat& src_image);
+
+    /**
+     * @brief Computes the normalized HSV histogram of an 8-bit BGR image in one pass.
+     *
+     * Pixels are decoded 256 at a time (16 per SSE4.2 instruction when the CPU has it), then
+     * binned through the lookup tables. Does not check that the kernel matches OpenCV
+     * (see `computeHistogram`).
+     *
+     * @param[in] src_image    The input image, CV_8UC3 in BGR order.
+     * @param[in] vectorized   False to decode the pixels with scalar code only.
+     *
+     * @return A 1 x 1024 CV_32F descriptor.
+     */
+    static Mat computeHistogramFused(const Mat& src_image, bool vectorized = true);
 };
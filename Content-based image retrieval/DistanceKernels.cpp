@@ -0,0 +1,334 @@
+#include "DistanceKernels.h"
+
+#include <cmath>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define DISTANCE_KERNELS_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+// MSVC compiles intrinsics of any instruction set, GCC and Clang need a per-function target
+#if defined(_MSC_VER) || !defined(DISTANCE_KERNELS_X86)
+#define KERNEL_TARGET(isa)
+#else
+#define KERNEL_TARGET(isa) __attribute__((target(isa)))
+#endif
+
+// ----------------------------------------------------------------------------
+// Scalar kernels (reference and fallback)
+// ----------------------------------------------------------------------------
+
+static float chiSquareScalar(const float* a, const float* b, size_t length) {
+    double sum = 0.0;
+    for (size_t i = 0; i < length; ++i) {
+        const float s = a[i] + b[i];
+        // Avoid division by zero
+        if (s != 0.0f) {
+            const float d = a[i] - b[i];
+            sum += (d * d) / s;
+        }
+    }
+    return static_cast<float>(sum);
+}
+
+static float squaredL2Scalar(const float* a, const float* b, size_t length) {
+    double sum = 0.0;
+    for (size_t i = 0; i < length; ++i) {
+        const float d = a[i] - b[i];
+        sum += d * d;
+    }
+    return static_cast<float>(sum);
+}
+
+static float l1Scalar(const float* a, const float* b, size_t length) {
+    double sum = 0.0;
+    for (size_t i = 0; i < length; ++i)
+        sum += fabs(a[i] - b[i]);
+    return static_cast<float>(sum);
+}
+
+#ifdef DISTANCE_KERNELS_X86
+
+// ----------------------------------------------------------------------------
+// SSE4.2 kernels: 4 floats per vector, two accumulators
+// ----------------------------------------------------------------------------
+
+static inline float horizontalSum128(__m128 v) {
+    __m128 shuffled = _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1));
+    __m128 sums = _mm_add_ps(v, shuffled);
+    shuffled = _mm_movehl_ps(shuffled, sums);
+    sums = _mm_add_ss(sums, shuffled);
+    return _mm_cvtss_f32(sums);
+}
+
+KERNEL_TARGET("sse4.2")
+static float chiSquareSSE42(const float* a, const float* b, size_t length) {
+    const __m128 zero = _mm_setzero_ps();
+    __m128 acc0 = _mm_setzero_ps(), acc1 = _mm_setzero_ps();
+    size_t i = 0;
+    for (; i + 8 <= length; i += 8) {
+        __m128 a0 = _mm_loadu_ps(a + i), b0 = _mm_loadu_ps(b + i);
+        __m128 a1 = _mm_loadu_ps(a + i + 4), b1 = _mm_loadu_ps(b + i + 4);
+        __m128 d0 = _mm_sub_ps(a0, b0), s0 = _mm_add_ps(a0, b0);
+        __m128 d1 = _mm_sub_ps(a1, b1), s1 = _mm_add_ps(a1, b1);
+        // Bins with a + b == 0 give 0/0: masked out instead of branching
+        __m128 q0 = _mm_and_ps(_mm_div_ps(_mm_mul_ps(d0, d0), s0), _mm_cmpneq_ps(s0, zero));
+        __m128 q1 = _mm_and_ps(_mm_div_ps(_mm_mul_ps(d1, d1), s1), _mm_cmpneq_ps(s1, zero));
+        acc0 = _mm_add_ps(acc0, q0);
+        acc1 = _mm_add_ps(acc1, q1);
+    }
+    float sum = horizontalSum128(_mm_add_ps(acc0, acc1));
+    return sum + chiSquareScalar(a + i, b + i, length - i);
+}
+
+KERNEL_TARGET("sse4.2")
+static float squaredL2SSE42(const float* a, const float* b, size_t length) {
+    __m128 acc0 = _mm_setzero_ps(), acc1 = _mm_setzero_ps();
+    size_t i = 0;
+    for (; i + 8 <= length; i += 8) {
+        __m128 d0 = _mm_sub_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i));
+        __m128 d1 = _mm_sub_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4));
+        acc0 = _mm_add_ps(acc0, _mm_mul_ps(d0, d0));
+        acc1 = _mm_add_ps(acc1, _mm_mul_ps(d1, d1));
+    }
+    float sum = horizontalSum128(_mm_add_ps(acc0, acc1));
+    return sum + squaredL2Scalar(a + i, b + i, length - i);
+}
+
+KERNEL_TARGET("sse4.2")
+static float l1SSE42(const float* a, const float* b, size_t length) {
+    const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+    __m128 acc0 = _mm_setzero_ps(), acc1 = _mm_setzero_ps();
+    size_t i = 0;
+    for (; i + 8 <= length; i += 8) {
+        __m128 d0 = _mm_sub_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i));
+        __m128 d1 = _mm_sub_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4));
+        acc0 = _mm_add_ps(acc0, _mm_and_ps(d0, absMask));
+        acc1 = _mm_add_ps(acc1, _mm_and_ps(d1, absMask));
+    }
+    float sum = horizontalSum128(_mm_add_ps(acc0, acc1));
+    return sum + l1Scalar(a + i, b + i, length - i);
+}
+
+// ----------------------------------------------------------------------------
+// AVX2 kernels: 8 floats per vector, two accumulators, FMA
+// ----------------------------------------------------------------------------
+
+KERNEL_TARGET("avx2,fma")
+static inline float horizontalSum256(__m256 v) {
+    return horizontalSum128(_mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1)));
+}
+
+KERNEL_TARGET("avx2,fma")
+static float chiSquareAVX2(const float* a, const float* b, size_t length) {
+    const __m256 zero = _mm256_setzero_ps();
+    __m256 acc0 = _mm256_setzero_ps(), acc1 = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 16 <= length; i += 16) {
+        __m256 a0 = _mm256_loadu_ps(a + i), b0 = _mm256_loadu_ps(b + i);
+        __m256 a1 = _mm256_loadu_ps(a + i + 8), b1 = _mm256_loadu_ps(b + i + 8);
+        __m256 d0 = _mm256_sub_ps(a0, b0), s0 = _mm256_add_ps(a0, b0);
+        __m256 d1 = _mm256_sub_ps(a1, b1), s1 = _mm256_add_ps(a1, b1);
+        __m256 q0 = _mm256_and_ps(_mm256_div_ps(_mm256_mul_ps(d0, d0), s0), _mm256_cmp_ps(s0, zero, _CMP_NEQ_OQ));
+        __m256 q1 = _mm256_and_ps(_mm256_div_ps(_mm256_mul_ps(d1, d1), s1), _mm256_cmp_ps(s1, zero, _CMP_NEQ_OQ));
+        acc0 = _mm256_add_ps(acc0, q0);
+        acc1 = _mm256_add_ps(acc1, q1);
+    }
+    float sum = horizontalSum256(_mm256_add_ps(acc0, acc1));
+    return sum + chiSquareScalar(a + i, b + i, length - i);
+}
+
+KERNEL_TARGET("avx2,fma")
+static float squaredL2AVX2(const float* a, const float* b, size_t length) {
+    __m256 acc0 = _mm256_setzero_ps(), acc1 = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 16 <= length; i += 16) {
+        __m256 d0 = _mm256_sub_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i));
+        __m256 d1 = _mm256_sub_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8));
+        acc0 = _mm256_fmadd_ps(d0, d0, acc0);
+        acc1 = _mm256_fmadd_ps(d1, d1, acc1);
+    }
+    float sum = horizontalSum256(_mm256_add_ps(acc0, acc1));
+    return sum + squaredL2Scalar(a + i, b + i, length - i);
+}
+
+KERNEL_TARGET("avx2,fma")
+static float l1AVX2(const float* a, const float* b, size_t length) {
+    const __m256 absMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7FFFFFFF));
+    __m256 acc0 = _mm256_setzero_ps(), acc1 = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 16 <= length; i += 16) {
+        __m256 d0 = _mm256_sub_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i));
+        __m256 d1 = _mm256_sub_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8));
+        acc0 = _mm256_add_ps(acc0, _mm256_and_ps(d0, absMask));
+        acc1 = _mm256_add_ps(acc1, _mm256_and_ps(d1, absMask));
+    }
+    float sum = horizontalSum256(_mm256_add_ps(acc0, acc1));
+    return sum + l1Scalar(a + i, b + i, length - i);
+}
+
+// ----------------------------------------------------------------------------
+// AVX-512 kernels: 16 floats per vector, masked tail instead of a scalar loop
+// ----------------------------------------------------------------------------
+
+KERNEL_TARGET("avx512f")
+static inline float horizontalSum512(__m512 v) {
+    __m256 low = _mm512_castps512_ps256(v);
+    __m256 high = _mm256_castpd_ps(_mm512_extractf64x4_pd(_mm512_castps_pd(v), 1));
+    __m256 sum = _mm256_add_ps(low, high);
+    return horizontalSum128(_mm_add_ps(_mm256_castps256_ps128(sum), _mm256_extractf128_ps(sum, 1)));
+}
+
+KERNEL_TARGET("avx512f")
+static inline __mmask16 tailMask(size_t remaining) {
+    return static_cast<__mmask16>((1u << remaining) - 1u);
+}
+
+KERNEL_TARGET("avx512f")
+static float chiSquareAVX512(const float* a, const float* b, size_t length) {
+    const __m512 zero = _mm512_setzero_ps();
+    __m512 acc = _mm512_setzero_ps();
+    size_t i = 0;
+    for (; i < length; i += 16) {
+        const __mmask16 load = (length - i >= 16) ? static_cast<__mmask16>(0xFFFF) : tailMask(length - i);
+        __m512 va = _mm512_maskz_loadu_ps(load, a + i), vb = _mm512_maskz_loadu_ps(load, b + i);
+        __m512 d = _mm512_sub_ps(va, vb), s = _mm512_add_ps(va, vb);
+        // Only divide where a + b != 0 (this also drops the padding lanes of the tail)
+        const __mmask16 nonZero = _mm512_cmp_ps_mask(s, zero, _CMP_NEQ_OQ);
+        acc = _mm512_add_ps(acc, _mm512_maskz_div_ps(nonZero, _mm512_mul_ps(d, d), s));
+    }
+    return horizontalSum512(acc);
+}
+
+KERNEL_TARGET("avx512f")
+static float squaredL2AVX512(const float* a, const float* b, size_t length) {
+    __m512 acc = _mm512_setzero_ps();
+    size_t i = 0;
+    for (; i < length; i += 16) {
+        const __mmask16 load = (length - i >= 16) ? static_cast<__mmask16>(0xFFFF) : tailMask(length - i);
+        __m512 d = _mm512_sub_ps(_mm512_maskz_loadu_ps(load, a + i), _mm512_maskz_loadu_ps(load, b + i));
+        acc = _mm512_fmadd_ps(d, d, acc);
+    }
+    return horizontalSum512(acc);
+}
+
+KERNEL_TARGET("avx512f")
+static float l1AVX512(const float* a, const float* b, size_t length) {
+    __m512 acc = _mm512_setzero_ps();
+    size_t i = 0;
+    for (; i < length; i += 16) {
+        const __mmask16 load = (length - i >= 16) ? static_cast<__mmask16>(0xFFFF) : tailMask(length - i);
+        __m512 d = _mm512_sub_ps(_mm512_maskz_loadu_ps(load, a + i), _mm512_maskz_loadu_ps(load, b + i));
+        acc = _mm512_add_ps(acc, _mm512_abs_ps(d));
+    }
+    return horizontalSum512(acc);
+}
+
+// ----------------------------------------------------------------------------
+// CPU feature detection
+// ----------------------------------------------------------------------------
+
+static void cpuid(int leaf, int subleaf, unsigned int regs[4]) {
+#ifdef _MSC_VER
+    int info[4];
+    __cpuidex(info, leaf, subleaf);
+    for (int i = 0; i < 4; ++i)
+        regs[i] = static_cast<unsigned int>(info[i]);
+#else
+    __cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+static unsigned long long readXCR0() {
+#ifdef _MSC_VER
+    return _xgetbv(0);
+#else
+    unsigned int eax = 0, edx = 0;
+    __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+    return (static_cast<unsigned long long>(edx) << 32) | eax;
+#endif
+}
+
+#endif  // DISTANCE_KERNELS_X86
+
+static const DistanceKernelSet scalarKernels = { SimdLevel::Scalar, "Scalar", chiSquareScalar, squaredL2Scalar, l1Scalar };
+#ifdef DISTANCE_KERNELS_X86
+static const DistanceKernelSet sse42Kernels = { SimdLevel::SSE42, "SSE4.2", chiSquareSSE42, squaredL2SSE42, l1SSE42 };
+static const DistanceKernelSet avx2Kernels = { SimdLevel::AVX2, "AVX2", chiSquareAVX2, squaredL2AVX2, l1AVX2 };
+static const DistanceKernelSet avx512Kernels = { SimdLevel::AVX512, "AVX-512", chiSquareAVX512, squaredL2AVX512, l1AVX512 };
+#endif
+
+SimdLevel DistanceKernels::detectSimdLevel() {
+#ifdef DISTANCE_KERNELS_X86
+    unsigned int regs[4] = { 0, 0, 0, 0 };
+    cpuid(0, 0, regs);
+    const unsigned int maxLeaf = regs[0];
+    if (maxLeaf < 1)
+        return SimdLevel::Scalar;
+
+    cpuid(1, 0, regs);
+    const bool sse42 = (regs[2] & (1u << 20)) != 0;
+    const bool fma = (regs[2] & (1u << 12)) != 0;
+    const bool osxsave = (regs[2] & (1u << 27)) != 0;
+    const bool avx = (regs[2] & (1u << 28)) != 0;
+    if (!sse42)
+        return SimdLevel::Scalar;
+
+    // The OS must save the YMM (and ZMM) registers on context switches
+    const unsigned long long xcr0 = osxsave ? readXCR0() : 0;
+    const bool ymmEnabled = (xcr0 & 0x6) == 0x6;
+    const bool zmmEnabled = (xcr0 & 0xE6) == 0xE6;
+
+    bool avx2 = false, avx512 = false;
+    if (maxLeaf >= 7) {
+        cpuid(7, 0, regs);
+        avx2 = (regs[1] & (1u << 5)) != 0;
+        avx512 = (regs[1] & (1u << 16)) != 0;
+    }
+
+    if (avx512 && avx && fma && zmmEnabled)
+        return SimdLevel::AVX512;
+    if (avx2 && avx && fma && ymmEnabled)
+        return SimdLevel::AVX2;
+    return SimdLevel::SSE42;
+#else
+    return SimdLevel::Scalar;
+#endif
+}
+
+const DistanceKernelSet& DistanceKernels::forLevel(SimdLevel level) {
+#ifdef DISTANCE_KERNELS_X86
+    // Never hand out kernels the CPU cannot run
+    if (level > detectSimdLevel())
+        return scalarKernels;
+
+    switch (level) {
+    case SimdLevel::SSE42: return sse42Kernels;
+    case SimdLevel::AVX2: return avx2Kernels;
+    case SimdLevel::AVX512: return avx512Kernels;
+    default: break;
+    }
+#endif
+    return scalarKernels;
+}
+
+const DistanceKernelSet& DistanceKernels::best() {
+    // Resolved once, on first use (thread-safe static initialization)
+    static const DistanceKernelSet& selected = forLevel(detectSimdLevel());
+    return selected;
+}
+
+vector<SimdLevel> DistanceKernels::availableLevels() {
+    vector<SimdLevel> levels;
+    const SimdLevel highest = detectSimdLevel();
+    for (SimdLevel level : { SimdLevel::Scalar, SimdLevel::SSE42, SimdLevel::AVX2, SimdLevel::AVX512 }) {
+        if (level <= highest)
+            levels.push_back(level);
+    }
+    return levels;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+using namespace std;
+
+/**
+ * @enum SimdLevel
+ * @brief Instruction set used by a set of distance kernels.
+ */
+enum class SimdLevel { Scalar, SSE42, AVX2, AVX512 };
+
+/**
+ * @brief Signature of a distance kernel between two float vectors of the same length.
+ */
+typedef float (*DistanceKernel)(const float* a, const float* b, size_t length);
+
+/**
+ * @struct DistanceKernelSet
+ * @brief The distance kernels compiled for one instruction set.
+ */
+struct DistanceKernelSet {
+    SimdLevel level;            ///< Instruction set of the kernels
+    const char* name;           ///< Printable name of the instruction set
+    DistanceKernel chiSquare;   ///< Sum of (a - b)^2 / (a + b) over the bins where a + b != 0
+    DistanceKernel squaredL2;   ///< Sum of (a - b)^2
+    DistanceKernel l1;          ///< Sum of |a - b|
+};
+
+/**
+ * @class DistanceKernels
+ * @brief Vectorized distance kernels selected at run time from the CPU features.
+ *
+ * Every kernel exists in a scalar version and, on x86, in SSE4.2, AVX2 and AVX-512 versions.
+ * The vector versions are compiled for their instruction set regardless of the global compiler
+ * flags, and `best()` picks the widest one the CPU and OS support (CPUID/XGETBV) the first
+ * time it is called. The kernels only read raw float arrays, so they do not depend on OpenCV.
+ */
+class DistanceKernels {
+public:
+    /**
+     * @brief Returns the kernels for the widest instruction set supported by this machine.
+     *
+     * @return A reference to a kernel set that stays valid for the whole program.
+     */
+    static const DistanceKernelSet& best();
+
+    /**
+     * @brief Returns the kernels of a given instruction set.
+     *
+     * @param[in] level   Requested instruction set.
+     *
+     * @return The kernel set of that level, or the scalar set if it is not supported here.
+     */
+    static const DistanceKernelSet& forLevel(SimdLevel level);
+
+    /**
+     * @brief Detects the widest instruction set usable on this machine.
+     *
+     * @return The detected level (Scalar on non-x86 builds).
+     */
+    static SimdLevel detectSimdLevel();
+
+    /**
+     * @brief Lists the instruction sets usable on this machine, from Scalar upwards.
+     *
+     * @return The supported levels.
+     */
+    static vector<SimdLevel> availableLevels();
+};
@@ -6,24 +6,10 @@ float Distance::calculateSimilarity(Mat query, Mat image, string type) {
         CV_Assert(query.size() == image.size());
         CV_Assert(query.type() == CV_32F && image.type() == CV_32F);
 
-        double chi2 = 0.0;
-
-        // Loop through each histogram bin
-        for (int i = 0; i < query.total(); ++i) {
-            float h1 = query.at<float>(i);
-            float h2 = image.at<float>(i);
-
-            // Avoid division by zero
-            if (h1 + h2 != 0.0f) {
-                chi2 += ((h1 - h2) * (h1 - h2)) / (h1 + h2);
-            }
-        }
-
-        chi2 *= 0.5;
-
-        // Convert Chi-square distance to a similarity score in [0, 1]
-        double similarity = 1.0 / (1.0 + chi2); // As chi2 → 0, similarity → 1
-        return similarity;
+        // The kernels need contiguous rows
+        Mat q = query.isContinuous() ? query : query.clone();
+        Mat h = image.isContinuous() ? image : image.clone();
+        return chiSquareSimilarity(q.ptr<float>(0), h.ptr<float>(0), q.total());
     }
     else {
         // Unsupported similarity type
@@ -33,10 +19,14 @@ float Distance::calculateSimilarity(Mat query, Mat image, string type) {
 }
 
 float Distance::calculateDistance(Mat query, Mat image, string type) {
-    if (type == "L2") {
-        // Euclidean (L2) distance between the two vectors
-        float sim = norm(query, image, NORM_L2);
-        return sim;
+    if (type == "L2" || type == "L1") {
+        if (query.type() != CV_32F || image.type() != CV_32F || query.size() != image.size())
+            return norm(query, image, type == "L2" ? NORM_L2 : NORM_L1);
+
+        Mat q = query.isContinuous() ? query : query.clone();
+        Mat h = image.isContinuous() ? image : image.clone();
+        return type == "L2" ? l2Distance(q.ptr<float>(0), h.ptr<float>(0), q.total())
+                            : l1Distance(q.ptr<float>(0), h.ptr<float>(0), q.total());
     }
     else {
         // Unsupported distance type
@@ -44,3 +34,18 @@ float Distance::calculateDistance(Mat query, Mat image, string type) {
         return -1.0f;
     }
 }
+
+float Distance::chiSquareSimilarity(const float* query, const float* image, size_t length) {
+    double chi2 = 0.5 * DistanceKernels::best().chiSquare(query, image, length);
+
+    // Convert Chi-square distance to a similarity score in [0, 1]
+    return static_cast<float>(1.0 / (1.0 + chi2)); // As chi2 → 0, similarity → 1
+}
+
+float Distance::l2Distance(const float* query, const float* image, size_t length) {
+    return sqrt(DistanceKernels::best().squaredL2(query, image, length));
+}
+
+float Distance::l1Distance(const float* query, const float* image, size_t length) {
+    return DistanceKernels::best().l1(query, image, length);
+}
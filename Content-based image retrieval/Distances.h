@@ -5,6 +5,8 @@
 #include <vector>
 #include <opencv2/opencv.hpp>
 
+#include "DistanceKernels.h"
+
 using namespace cv;
 using namespace std;
 
@@ -14,6 +16,9 @@ using namespace std;
  *
  * This class allows the comparison of two feature vectors (e.g., histograms or descriptor-based features)
  * using different distance or similarity metrics such as L2 (Euclidean), Cosine similarity, or correlation.
+ *
+ * The metrics are computed by the SIMD kernels of `DistanceKernels`, chosen once for the running CPU.
+ * Hot loops should call the pointer-based static functions, which skip the metric name lookup.
  */
 class Distance {
 public:
@@ -25,7 +30,7 @@ public:
      *
      * @param[in] query   First feature vector (query) represented as a cv::Mat.
      * @param[in] image   Second feature vector (from image database) as a cv::Mat.
-     * @param[in] method  The similarity metric to use (e.g., "cosine", "correlation").
+     * @param[in] method  The similarity metric to use ("Chi-square").
      *
      * @return A float representing the similarity score. Higher values indicate higher similarity.
      */
@@ -39,9 +44,42 @@ public:
      *
      * @param[in] query   First feature vector (query) represented as a cv::Mat.
      * @param[in] image   Second feature vector (from image database) as a cv::Mat.
-     * @param[in] method  The distance metric to use (e.g., "euclidean", "chi-squared").
+     * @param[in] method  The distance metric to use ("L2" or "L1").
      *
      * @return A float representing the distance score. Lower values indicate higher similarity.
      */
     float calculateDistance(Mat query, Mat image, string method);
+
+    /**
+     * @brief Chi-square similarity 1 / (1 + chi2 / 2) between two histograms.
+     *
+     * @param[in] query    First histogram.
+     * @param[in] image    Second histogram.
+     * @param[in] length   Number of bins.
+     *
+     * @return The similarity in (0, 1]; 1 for identical histograms.
+     */
+    static float chiSquareSimilarity(const float* query, const float* image, size_t length);
+
+    /**
+     * @brief Euclidean (L2) distance between two vectors.
+     *
+     * @param[in] query    First vector.
+     * @param[in] image    Second vector.
+     * @param[in] length   Number of elements.
+     *
+     * @return The L2 distance.
+     */
+    static float l2Distance(const float* query, const float* image, size_t length);
+
+    /**
+     * @brief Manhattan (L1) distance between two vectors.
+     *
+     * @param[in] query    First vector.
+     * @param[in] image    Second vector.
+     * @param[in] length   Number of elements.
+     *
+     * @return The L1 distance.
+     */
+    static float l1Distance(const float* query, const float* image, size_t length);
 };
@@ -1,14 +1,12 @@
 ﻿#include "Evaluate.h"
 
-void Evaluator::calculateAveragePrecision(vector<pair<string, float>> retrievedList, string query_image, map<string, Feature*> groundTruth) {
+void Evaluator::calculateAveragePrecision(vector<pair<string, float>> retrievedList, string query_image, const FeatureStore& groundTruth) {
     int relevantFound = 0;         // Number of relevant images found so far
 	int groundTruthSize = 0;           // Total number of relevant images in the ground truth
     double precisionSum = 0.0;     // Sum of precision values at each relevant position
 
 	// Construting groundth truth vector for the query image
-    for (const auto& entry : groundTruth) {
-        string id = entry.first;  // this is the image ID (key)
-
+    for (const string& id : groundTruth.getIds()) {
         // Check if the ID contains the query image ID as substring
         if (id.find(query_image) != string::npos) {
             ++groundTruthSize;
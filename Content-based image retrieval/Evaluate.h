@@ -3,6 +3,7 @@
 #include <vector>
 #include "ImageDatabase.h"
 #include "Features.h"
+#include "FeatureStore.h"
 
 using namespace std;
 
@@ -32,13 +33,13 @@ public:
      *
      * @param[in] rankedList  A ranked list of image results (image ID and distance or similarity score).
      * @param[in] queryId     The ID or prefix of the query image to determine relevance.
-     * @param[in] groundTruth Map of ground truth images used for matching relevance (from index).
+     * @param[in] groundTruth Feature store of the index, whose image IDs define the relevant images.
      *
      * @return void
      *
      * @note Relevance is determined based on substring matching (e.g., category or shared prefix).
      */
-    void calculateAveragePrecision(vector<pair<string, float>> rankedList, string queryId, map<string, Feature*> groundTruth);
+    void calculateAveragePrecision(vector<pair<string, float>> rankedList, string queryId, const FeatureStore& groundTruth);
 
     /**
      * @brief Computes the Mean Average Precision (mAP) over all evaluated queries.
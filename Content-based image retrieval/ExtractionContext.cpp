@@ -0,0 +1,27 @@
+#include "ExtractionContext.h"
+
+ExtractionContext& ExtractionContext::forThread() {
+    thread_local ExtractionContext context;
+    return context;
+}
+
+SIFT& ExtractionContext::getSift() {
+    if (!sift)
+        sift = SIFT::create();
+    return *sift;
+}
+
+ORB& ExtractionContext::getOrb() {
+    if (!orb)
+        orb = ORB::create();
+    return *orb;
+}
+
+const Mat& ExtractionContext::toGray(const Mat& image) {
+    if (image.channels() != 3)
+        return image;
+
+    // Same-size images reuse the buffer
+    cvtColor(image, gray, COLOR_BGR2GRAY);
+    return gray;
+}
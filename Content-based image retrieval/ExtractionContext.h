@@ -0,0 +1,65 @@
+#pragma once
+
+#include <opencv2/opencv.hpp>
+#include <opencv2/features2d.hpp>
+#include <vector>
+
+using namespace std;
+using namespace cv;
+
+/**
+ * @class ExtractionContext
+ * @brief Detectors and scratch buffers reused by the local feature extractions of one thread.
+ *
+ * Creating a SIFT or ORB detector, and allocating the gray image, keypoint list and
+ * descriptor matrix of every image, costs a few allocations per image for nothing: the
+ * detectors keep no state between two images, and images of a database usually share their
+ * size. Each thread therefore owns one context (see `forThread()`), created on its first
+ * extraction and reused by every image it processes afterwards. Once warmed up, the only
+ * allocations left per image are the descriptor matrix the feature keeps and the scale-space
+ * pyramids OpenCV builds inside the detectors.
+ *
+ * A context is never shared between threads, so it needs no locking.
+ */
+class ExtractionContext {
+private:
+    Ptr<SIFT> sift;                 ///< SIFT detector, created on first use
+    Ptr<ORB> orb;                   ///< ORB detector, created on first use
+
+public:
+    Mat gray;                       ///< Gray conversion of the current image
+    vector<KeyPoint> keypoints;     ///< Keypoints of the current image
+    Mat descriptors;                ///< Detector output, reused when two images get the same keypoint count
+    vector<int> order;              ///< Keypoint ranking used to keep the strongest keypoints
+    Mat bytes;                      ///< Descriptors converted to bytes for geometric verification
+
+    /**
+     * @brief Returns the context of the calling thread.
+     *
+     * @return The context, created on the first call of the thread and destroyed with it.
+     */
+    static ExtractionContext& forThread();
+
+    /**
+     * @brief Returns the SIFT detector of the context.
+     *
+     * @return A detector with OpenCV's default parameters.
+     */
+    SIFT& getSift();
+
+    /**
+     * @brief Returns the ORB detector of the context.
+     *
+     * @return A detector with OpenCV's default parameters.
+     */
+    ORB& getOrb();
+
+    /**
+     * @brief Gives the gray version of an image without copying a single-channel image.
+     *
+     * @param[in] image   The input image (BGR or single-channel).
+     *
+     * @return `image` itself if it is single-channel, else its conversion stored in `gray`.
+     */
+    const Mat& toGray(const Mat& image);
+};
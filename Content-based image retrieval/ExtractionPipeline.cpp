@@ -0,0 +1,259 @@
+#include "ExtractionPipeline.h"
+
+ExtractionPipeline::ExtractionPipeline(int threadCount, size_t capacity) : queueCapacity(capacity > 0 ? capacity : 1) {
+    if (threadCount <= 0)
+        threadCount = ThreadPool::defaultThreadCount();
+
+    readThreads = 1;
+    decodeThreads = max(1, threadCount / 4);
+    extractThreads = max(1, threadCount - decodeThreads);
+    quantizeThreads = max(1, threadCount / 4);
+}
+
+void ExtractionPipeline::setStageThreads(int read, int decode, int extract, int quantize) {
+    readThreads = max(1, read);
+    decodeThreads = max(1, decode);
+    extractThreads = max(1, extract);
+    quantizeThreads = max(1, quantize);
+}
+
+void ExtractionPipeline::stageWorker(StageStatistics& statistics, BoundedQueue<PipelineItem>* input, BoundedQueue<PipelineItem>* output,
+    atomic<int>& remainingWorkers, const function<bool(PipelineItem&)>& process, Log& log) {
+    size_t items = 0, failures = 0;
+    double busySeconds = 0.0;
+    Timer timer;
+    PipelineItem item;
+
+    while (input->pop(item)) {
+        bool processed = false;
+        timer.start();
+        try {
+            processed = process(item);
+        }
+        catch (const cv::Exception& e) {
+            lock_guard<mutex> lock(logMutex);
+            log.writeToFeatureDatabaseLog("Error in " + statistics.name + " stage for " + item.path + ": " + e.what());
+        }
+        catch (const std::exception& e) {
+            // Out of memory and other standard errors only lose this item, not the whole run
+            lock_guard<mutex> lock(logMutex);
+            log.writeToFeatureDatabaseLog("Error in " + statistics.name + " stage for " + item.path + ": " + e.what());
+        }
+        catch (...) {
+            lock_guard<mutex> lock(logMutex);
+            log.writeToFeatureDatabaseLog("Unknown error in " + statistics.name + " stage for " + item.path);
+        }
+        timer.stop();
+        busySeconds += timer.elapsedSeconds();
+
+        if (!processed) {
+            // Drop the item, releasing everything it holds
+            ++failures;
+            delete item.feature;
+            item = PipelineItem();
+            continue;
+        }
+
+        ++items;
+        if (output)
+            output->push(std::move(item));
+        item = PipelineItem();
+    }
+
+    // The last thread of the stage ends the stream for the next stage
+    if (--remainingWorkers == 0 && output)
+        output->close();
+
+    lock_guard<mutex> lock(statisticsMutex);
+    statistics.items += items;
+    statistics.failures += failures;
+    statistics.busySeconds += busySeconds;
+}
+
+void ExtractionPipeline::recordQueue(string name, const BoundedQueue<PipelineItem>& queue) {
+    QueueStatistics statistics;
+    statistics.name = name;
+    statistics.capacity = queue.getCapacity();
+    statistics.maxOccupancy = queue.getMaxOccupancy();
+    statistics.averageOccupancy = queue.getAverageOccupancy();
+    statistics.fullWaits = queue.getFullWaits();
+    statistics.emptyWaits = queue.getEmptyWaits();
+    queueStatistics.push_back(statistics);
+}
+
+void ExtractionPipeline::run(const vector<string>& imagePaths, const function<Feature*()>& createFeature,
+    BagOfVisualWord* quantizer, vector<Feature*>& slots, Log& log) {
+    Timer totalTimer;
+    totalTimer.start();
+
+    slots.assign(imagePaths.size(), nullptr);
+    stageStatistics.clear();
+    queueStatistics.clear();
+
+    // Stage statistics, in pipeline order
+    stageStatistics.resize(quantizer ? 4 : 3);
+    StageStatistics& readStage = stageStatistics[0];
+    StageStatistics& decodeStage = stageStatistics[1];
+    StageStatistics& extractStage = stageStatistics[2];
+    readStage.name = "read";          readStage.threads = readThreads;
+    decodeStage.name = "decode";      decodeStage.threads = decodeThreads;
+    extractStage.name = "extract";    extractStage.threads = extractThreads;
+    if (quantizer) {
+        stageStatistics[3].name = "quantize";
+        stageStatistics[3].threads = quantizeThreads;
+    }
+
+    BoundedQueue<PipelineItem> readQueue(queueCapacity);     // read -> decode
+    BoundedQueue<PipelineItem> decodeQueue(queueCapacity);   // decode -> extract
+    BoundedQueue<PipelineItem> extractQueue(queueCapacity);  // extract -> quantize
+
+    atomic<size_t> nextImage{ 0 };
+    atomic<int> readersLeft{ readThreads }, decodersLeft{ decodeThreads };
+    atomic<int> extractorsLeft{ extractThreads }, quantizersLeft{ quantizeThreads };
+
+    // Stage 1: read the encoded files from disk
+    auto readFiles = [&]() {
+        size_t items = 0, failures = 0;
+        double busySeconds = 0.0;
+        Timer timer;
+
+        for (size_t i = nextImage++; i < imagePaths.size(); i = nextImage++) {
+            timer.start();
+            PipelineItem item;
+            item.index = i;
+            item.path = imagePaths[i];
+
+            ifstream file(item.path, ios::binary | ios::ate);
+            bool readOk = false;
+            if (file) {
+                streamsize size = file.tellg();
+                file.seekg(0, ios::beg);
+                if (size > 0) {
+                    item.bytes.resize(static_cast<size_t>(size));
+                    readOk = static_cast<bool>(file.read(reinterpret_cast<char*>(item.bytes.data()), size));
+                }
+            }
+            timer.stop();
+            busySeconds += timer.elapsedSeconds();
+
+            if (!readOk) {
+                ++failures;
+                lock_guard<mutex> lock(logMutex);
+                log.writeToImageDatabaseLog("Failed to load image: " + item.path);
+                continue;
+            }
+
+            ++items;
+            readQueue.push(std::move(item));
+        }
+
+        if (--readersLeft == 0)
+            readQueue.close();
+
+        lock_guard<mutex> lock(statisticsMutex);
+        readStage.items += items;
+        readStage.failures += failures;
+        readStage.busySeconds += busySeconds;
+    };
+
+    // Stage 2: decode the images
+    auto decode = [&](PipelineItem& item) {
+        item.image = imdecode(item.bytes, IMREAD_COLOR);
+        item.bytes = vector<uchar>();  // release the encoded buffer
+        if (item.image.empty()) {
+            lock_guard<mutex> lock(logMutex);
+            log.writeToImageDatabaseLog("Failed to load image: " + item.path);
+            return false;
+        }
+        return true;
+    };
+
+    // Stage 3: extract the descriptors; this is the last stage unless quantization is enabled
+    auto extract = [&](PipelineItem& item) {
+        item.feature = createFeature();
+        item.feature->createFeature(item.path, item.image);
+        item.image.release();
+
+        if (!quantizer) {
+            slots[item.index] = item.feature;
+            item.feature = nullptr;
+        }
+
+        lock_guard<mutex> lock(logMutex);
+        cout << "Current Image: " << item.path << endl;
+        return true;
+    };
+
+    // Stage 4: convert the local descriptors to a BoVW histogram
+    auto quantize = [&](PipelineItem& item) {
+        Mat hist = quantizer->computeHistogram(item.feature->getDescriptor());
+        item.feature->setDescriptor(hist);
+        slots[item.index] = item.feature;
+        item.feature = nullptr;
+        return true;
+    };
+
+    vector<thread> threads;
+    for (int i = 0; i < readThreads; ++i)
+        threads.emplace_back(readFiles);
+    for (int i = 0; i < decodeThreads; ++i)
+        threads.emplace_back([&] { stageWorker(decodeStage, &readQueue, &decodeQueue, decodersLeft, decode, log); });
+    for (int i = 0; i < extractThreads; ++i)
+        threads.emplace_back([&] { stageWorker(extractStage, &decodeQueue, quantizer ? &extractQueue : nullptr, extractorsLeft, extract, log); });
+    if (quantizer) {
+        for (int i = 0; i < quantizeThreads; ++i)
+            threads.emplace_back([&] { stageWorker(stageStatistics[3], &extractQueue, nullptr, quantizersLeft, quantize, log); });
+    }
+
+    for (thread& t : threads)
+        t.join();
+
+    recordQueue("read -> decode", readQueue);
+    recordQueue("decode -> extract", decodeQueue);
+    if (quantizer)
+        recordQueue("extract -> quantize", extractQueue);
+
+    producedCount = stageStatistics.back().items;
+    totalTimer.stop();
+    elapsedSeconds = totalTimer.elapsedSeconds();
+}
+
+void ExtractionPipeline::report(Log& log) {
+    vector<string> lines;
+    ostringstream line;
+    line << fixed << setprecision(2);
+
+    line << "Pipeline: " << producedCount << " features in " << elapsedSeconds << " s ("
+        << (elapsedSeconds > 0 ? producedCount / elapsedSeconds : 0.0) << " images/s)";
+    lines.push_back(line.str());
+
+    for (const StageStatistics& stage : stageStatistics) {
+        line.str("");
+        // Busy ratio close to 1 means every thread of the stage was always working: the bottleneck
+        double capacityPerSecond = stage.busySeconds > 0 ? stage.items * stage.threads / stage.busySeconds : 0.0;
+        double busyRatio = elapsedSeconds > 0 ? stage.busySeconds / (stage.threads * elapsedSeconds) : 0.0;
+        line << "Stage " << stage.name << ": " << stage.items << " items, " << stage.failures << " failed, "
+            << stage.threads << " thread(s), busy " << busyRatio * 100.0 << "%, capacity " << capacityPerSecond << " images/s";
+        lines.push_back(line.str());
+    }
+
+    for (const QueueStatistics& queue : queueStatistics) {
+        line.str("");
+        line << "Queue " << queue.name << ": capacity " << queue.capacity << ", average " << queue.averageOccupancy
+            << ", max " << queue.maxOccupancy << ", full waits " << queue.fullWaits << ", empty waits " << queue.emptyWaits;
+        lines.push_back(line.str());
+    }
+
+    for (const string& text : lines) {
+        cout << text << endl;
+        log.writeToFeatureDatabaseLog(text);
+    }
+}
+
+vector<StageStatistics> ExtractionPipeline::getStageStatistics() {
+    return stageStatistics;
+}
+
+vector<QueueStatistics> ExtractionPipeline::getQueueStatistics() {
+    return queueStatistics;
+}
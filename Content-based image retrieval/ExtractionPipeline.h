@@ -0,0 +1,173 @@
+#pragma once
+
+#include <opencv2/opencv.hpp>
+#include <functional>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <string>
+
+#include "BoundedQueue.h"
+#include "ThreadPool.h"
+#include "Features.h"
+#include "BoVW.h"
+#include "Logs.h"
+#include "Time.h"
+
+using namespace std;
+using namespace cv;
+
+/**
+ * @struct PipelineItem
+ * @brief Unit of work travelling through the extraction pipeline (one image).
+ */
+struct PipelineItem {
+    size_t index = 0;            ///< Position of the image in the database (used as output slot).
+    string path;                 ///< Path of the image file, also used as image ID.
+    vector<uchar> bytes;         ///< Encoded file content (filled by the read stage).
+    Mat image;                   ///< Decoded BGR image (filled by the decode stage).
+    Feature* feature = nullptr;  ///< Extracted feature (filled by the extract stage).
+};
+
+/**
+ * @struct StageStatistics
+ * @brief Throughput counters of one pipeline stage.
+ */
+struct StageStatistics {
+    string name;                 ///< Stage name (read, decode, extract, quantize).
+    int threads = 0;             ///< Number of threads running the stage.
+    size_t items = 0;            ///< Number of items processed successfully.
+    size_t failures = 0;         ///< Number of items dropped because of an error.
+    double busySeconds = 0.0;    ///< Time spent processing items, summed over the stage threads.
+};
+
+/**
+ * @struct QueueStatistics
+ * @brief Occupancy counters of one queue between two pipeline stages.
+ */
+struct QueueStatistics {
+    string name;                 ///< Queue name ("producer -> consumer").
+    size_t capacity = 0;         ///< Maximum number of queued items.
+    size_t maxOccupancy = 0;     ///< Largest observed queue length.
+    double averageOccupancy = 0; ///< Average queue length observed at each push.
+    size_t fullWaits = 0;        ///< Pushes blocked by a full queue (consumer is the bottleneck).
+    size_t emptyWaits = 0;       ///< Pops blocked by an empty queue (producer is the bottleneck).
+};
+
+/**
+ * @class ExtractionPipeline
+ * @brief Runs feature extraction as overlapping stages connected by bounded queues.
+ *
+ * The stages are: file read -> decode (`imdecode`) -> descriptor extraction (`createFeature`)
+ * -> optional BoVW quantization (`computeHistogram`). Each stage runs on its own threads, so
+ * disk reads overlap with computation. The bounded queues apply back-pressure, which keeps
+ * at most a few `queueCapacity` images in memory at any time. Results are written to one slot
+ * per image, so the output order is the database order regardless of scheduling.
+ */
+class ExtractionPipeline {
+private:
+    int readThreads;                          ///< Threads of the file read stage.
+    int decodeThreads;                        ///< Threads of the decode stage.
+    int extractThreads;                       ///< Threads of the descriptor extraction stage.
+    int quantizeThreads;                      ///< Threads of the BoVW quantization stage.
+    size_t queueCapacity;                     ///< Capacity of every queue between two stages.
+
+    vector<StageStatistics> stageStatistics;  ///< Statistics of the last run, one entry per stage.
+    vector<QueueStatistics> queueStatistics;  ///< Statistics of the last run, one entry per queue.
+    double elapsedSeconds = 0.0;              ///< Wall-clock time of the last run.
+    size_t producedCount = 0;                 ///< Number of features produced by the last run.
+
+    mutex statisticsMutex;                    ///< Protects the statistics while stage threads finish.
+    mutex logMutex;                           ///< Serializes log and console output of the stage threads.
+
+    /**
+     * @brief Body of a stage thread: pops items, processes them and forwards them downstream.
+     *
+     * @param[in,out] statistics        Statistics entry of the stage.
+     * @param[in,out] input             Queue feeding the stage.
+     * @param[in,out] output            Queue fed by the stage, or nullptr for the last stage.
+     * @param[in,out] remainingWorkers  Running threads of the stage; the last one closes `output`.
+     * @param[in]     process           Processing of one item; returns false to drop the item. An
+     *                                  exception thrown by it is logged and drops the item too.
+     * @param[in,out] log               Logger for failed items.
+     *
+     * @return void
+     */
+    void stageWorker(StageStatistics& statistics, BoundedQueue<PipelineItem>* input, BoundedQueue<PipelineItem>* output,
+        atomic<int>& remainingWorkers, const function<bool(PipelineItem&)>& process, Log& log);
+
+    /**
+     * @brief Snapshots the counters of a queue after a run.
+     *
+     * @param[in] name    Name of the queue.
+     * @param[in] queue   The queue.
+     *
+     * @return void
+     */
+    void recordQueue(string name, const BoundedQueue<PipelineItem>& queue);
+
+public:
+    /**
+     * @brief Constructor that splits a thread budget between the stages.
+     *
+     * One thread reads files, a quarter of the budget decodes and the rest extracts
+     * descriptors; quantization (when enabled) gets a quarter of the budget.
+     *
+     * @param[in] threadCount     Total thread budget (<= 0 uses all hardware threads).
+     * @param[in] queueCapacity   Capacity of each queue between two stages.
+     */
+    ExtractionPipeline(int threadCount, size_t queueCapacity);
+
+    /**
+     * @brief Overrides the number of threads of each stage.
+     *
+     * @param[in] read       Threads of the file read stage.
+     * @param[in] decode     Threads of the decode stage.
+     * @param[in] extract    Threads of the descriptor extraction stage.
+     * @param[in] quantize   Threads of the BoVW quantization stage.
+     *
+     * @return void
+     */
+    void setStageThreads(int read, int decode, int extract, int quantize);
+
+    /**
+     * @brief Runs the pipeline over a list of image files.
+     *
+     * @param[in]  imagePaths      Paths of the images, in database order.
+     * @param[in]  createFeature   Factory returning a new, empty Feature of the selected type.
+     * @param[in]  quantizer       BoVW model used to convert local descriptors into histograms,
+     *                             or nullptr to skip the quantization stage.
+     * @param[out] slots           One entry per image: the extracted feature, or nullptr if the image failed.
+     * @param[in,out] log          Logger for failed images.
+     *
+     * @return void
+     */
+    void run(const vector<string>& imagePaths, const function<Feature*()>& createFeature,
+        BagOfVisualWord* quantizer, vector<Feature*>& slots, Log& log);
+
+    /**
+     * @brief Writes per-stage throughput and queue occupancy of the last run to the log and console.
+     *
+     * @param[in,out] log   Logger receiving the report.
+     *
+     * @return void
+     */
+    void report(Log& log);
+
+    /**
+     * @brief Returns the per-stage statistics of the last run.
+     *
+     * @return A vector with one entry per stage, in pipeline order.
+     */
+    vector<StageStatistics> getStageStatistics();
+
+    /**
+     * @brief Returns the per-queue statistics of the last run.
+     *
+     * @return A vector with one entry per queue, in pipeline order.
+     */
+    vector<QueueStatistics> getQueueStatistics();
+};
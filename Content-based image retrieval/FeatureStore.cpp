@@ -0,0 +1,114 @@
+#include "FeatureStore.h"
+#include "ProductQuantizer.h"
+
+bool FeatureStore::assign(Mat descriptorMatrix, vector<string> imageIds, shared_ptr<const void> dataOwner) {
+    clear();
+
+    if (!descriptorMatrix.empty() && descriptorMatrix.type() != CV_32F) {
+        cerr << "Feature store needs CV_32F descriptors." << endl;
+        return false;
+    }
+
+    if (static_cast<int>(imageIds.size()) != descriptorMatrix.rows) {
+        cerr << "Feature store: " << imageIds.size() << " IDs for " << descriptorMatrix.rows << " descriptors." << endl;
+        return false;
+    }
+
+    // Rows must follow each other in memory for sequential scans
+    if (descriptorMatrix.isContinuous()) {
+        descriptors = descriptorMatrix;
+        owner = dataOwner;
+    }
+    else {
+        descriptors = descriptorMatrix.clone();
+    }
+
+    assignIds(move(imageIds));
+    return true;
+}
+
+bool FeatureStore::assignEncoded(Mat codeMatrix, shared_ptr<const ProductQuantizer> pq, vector<string> imageIds, shared_ptr<const void> dataOwner) {
+    clear();
+
+    if (!pq || pq->empty() || codeMatrix.type() != CV_8U || codeMatrix.cols != pq->getSubspaceCount()) {
+        cerr << "Feature store: codes do not match the product quantizer." << endl;
+        return false;
+    }
+
+    if (static_cast<int>(imageIds.size()) != codeMatrix.rows) {
+        cerr << "Feature store: " << imageIds.size() << " IDs for " << codeMatrix.rows << " codes." << endl;
+        return false;
+    }
+
+    if (codeMatrix.isContinuous()) {
+        descriptors = codeMatrix;
+        owner = dataOwner;
+    }
+    else {
+        descriptors = codeMatrix.clone();
+    }
+
+    quantizer = pq;
+    assignIds(move(imageIds));
+    return true;
+}
+
+void FeatureStore::assignIds(vector<string> imageIds) {
+    ids = move(imageIds);
+    rowById.reserve(ids.size());
+    for (int i = 0; i < static_cast<int>(ids.size()); ++i)
+        rowById[ids[i]] = i;  // the last row wins if an ID is duplicated
+}
+
+bool FeatureStore::isEncoded() const {
+    return quantizer != nullptr;
+}
+
+const ProductQuantizer* FeatureStore::getQuantizer() const {
+    return quantizer.get();
+}
+
+const uint8_t* FeatureStore::getCode(int row) const {
+    return descriptors.ptr<uint8_t>(row);
+}
+
+void FeatureStore::clear() {
+    descriptors.release();
+    ids.clear();
+    rowById.clear();
+    owner.reset();
+    quantizer.reset();
+}
+
+int FeatureStore::size() const {
+    return descriptors.rows;
+}
+
+bool FeatureStore::empty() const {
+    return descriptors.rows == 0;
+}
+
+int FeatureStore::getDimensions() const {
+    return quantizer ? quantizer->getDimensions() : descriptors.cols;
+}
+
+const Mat& FeatureStore::getDescriptors() const {
+    return descriptors;
+}
+
+const float* FeatureStore::getRow(int row) const {
+    return descriptors.ptr<float>(row);
+}
+
+const vector<string>& FeatureStore::getIds() const {
+    return ids;
+}
+
+const string& FeatureStore::getId(int row) const {
+    return ids[row];
+}
+
+int FeatureStore::findRow(const string& id) const {
+    auto it = rowById.find(id);
+    return it == rowById.end() ? -1 : it->second;
+}
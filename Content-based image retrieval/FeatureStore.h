@@ -0,0 +1,165 @@
+#pragma once
+
+#include <opencv2/opencv.hpp>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+using namespace cv;
+
+class ProductQuantizer;
+
+/**
+ * @class FeatureStore
+ * @brief Dense, structure-of-arrays storage of the descriptors of an index.
+ *
+ * All descriptors live in one row-major matrix (row i = image i) next to a parallel array of
+ * image IDs and an ID -> row hash table. A linear scan therefore streams through a single
+ * contiguous block instead of chasing one heap allocation per image. The matrix can be a view
+ * on external memory (e.g., a memory-mapped index.bin); the store then keeps the owner of that
+ * memory alive.
+ *
+ * The descriptors can also be kept product-quantized: the matrix then holds one byte code per
+ * row (see ProductQuantizer) and the float rows are not available.
+ */
+class FeatureStore {
+private:
+    Mat descriptors;                    ///< One descriptor per row (CV_32F, continuous)
+    vector<string> ids;                 ///< Image ID of each row
+    unordered_map<string, int> rowById; ///< Row of each image ID
+    shared_ptr<const void> owner;       ///< Keeps the memory behind `descriptors` alive (null if the Mat owns it)
+    shared_ptr<const ProductQuantizer> quantizer;   ///< Quantizer of the codes, null for float descriptors
+
+    /**
+     * @brief Sets the IDs and their lookup table.
+     *
+     * @param[in] imageIds   Image ID of each row.
+     *
+     * @return void
+     */
+    void assignIds(vector<string> imageIds);
+
+public:
+    /**
+     * @brief Default constructor. Creates an empty store.
+     */
+    FeatureStore() {}
+
+    /**
+     * @brief Replaces the content of the store.
+     *
+     * @param[in] descriptorMatrix   One descriptor per row (CV_32F). Non-continuous matrices are copied.
+     * @param[in] imageIds           Image ID of each row (same count as the matrix rows).
+     * @param[in] dataOwner          Object owning the memory of `descriptorMatrix` when it is a view, or nullptr.
+     *
+     * @return True if the content is consistent; false otherwise (the store is then left empty).
+     */
+    bool assign(Mat descriptorMatrix, vector<string> imageIds, shared_ptr<const void> dataOwner = nullptr);
+
+    /**
+     * @brief Replaces the content of the store with product-quantized descriptors.
+     *
+     * @param[in] codeMatrix         One code per row (CV_8U, `pq->getSubspaceCount()` columns). Non-continuous matrices are copied.
+     * @param[in] pq                 Quantizer that produced the codes.
+     * @param[in] imageIds           Image ID of each row (same count as the matrix rows).
+     * @param[in] dataOwner          Object owning the memory of `codeMatrix` when it is a view, or nullptr.
+     *
+     * @return True if the content is consistent; false otherwise (the store is then left empty).
+     */
+    bool assignEncoded(Mat codeMatrix, shared_ptr<const ProductQuantizer> pq, vector<string> imageIds, shared_ptr<const void> dataOwner = nullptr);
+
+    /**
+     * @brief Tells whether the store holds product-quantized codes instead of float descriptors.
+     *
+     * @return True for codes.
+     */
+    bool isEncoded() const;
+
+    /**
+     * @brief Returns the quantizer of an encoded store.
+     *
+     * @return The quantizer, or nullptr for float descriptors.
+     */
+    const ProductQuantizer* getQuantizer() const;
+
+    /**
+     * @brief Returns the code of one row of an encoded store.
+     *
+     * @param[in] row   Row index in [0, size()).
+     *
+     * @return Pointer to `getQuantizer()->getSubspaceCount()` bytes.
+     */
+    const uint8_t* getCode(int row) const;
+
+    /**
+     * @brief Removes every descriptor.
+     *
+     * @return void
+     */
+    void clear();
+
+    /**
+     * @brief Returns the number of stored descriptors.
+     *
+     * @return The number of rows.
+     */
+    int size() const;
+
+    /**
+     * @brief Tells whether the store is empty.
+     *
+     * @return True if there is no descriptor.
+     */
+    bool empty() const;
+
+    /**
+     * @brief Returns the length of the descriptors.
+     *
+     * @return The number of columns, the decoded length for an encoded store (0 if empty).
+     */
+    int getDimensions() const;
+
+    /**
+     * @brief Returns the descriptor matrix.
+     *
+     * @return A const reference to the matrix (row i = image i), the codes for an encoded store.
+     *         Views on mapped memory are read-only.
+     */
+    const Mat& getDescriptors() const;
+
+    /**
+     * @brief Returns a pointer to the descriptor of one row.
+     *
+     * @param[in] row   Row index in [0, size()).
+     *
+     * @return Pointer to `getDimensions()` floats (float descriptors only).
+     */
+    const float* getRow(int row) const;
+
+    /**
+     * @brief Returns the image IDs.
+     *
+     * @return A const reference to the ID of each row.
+     */
+    const vector<string>& getIds() const;
+
+    /**
+     * @brief Returns the image ID of one row.
+     *
+     * @param[in] row   Row index in [0, size()).
+     *
+     * @return A const reference to the ID.
+     */
+    const string& getId(int row) const;
+
+    /**
+     * @brief Finds the row of an image ID.
+     *
+     * @param[in] id   Image ID.
+     *
+     * @return The row index, or -1 if the ID is not in the store.
+     */
+    int findRow(const string& id) const;
+};
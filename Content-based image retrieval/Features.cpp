@@ -1,5 +1,45 @@
 #include "Features.h"
+#include "ExtractionContext.h"
+
+#include <algorithm>
+
+ImagePlanes::ImagePlanes(const Mat& image, unsigned planes) : bgr(image) {
+	if ((planes & HSV) && image.channels() == 3)
+		cvtColor(image, hsv, COLOR_BGR2HSV);
+	if (planes & Gray) {
+		if (image.channels() == 3)
+			cvtColor(image, gray, COLOR_BGR2GRAY);
+		else if (image.channels() == 1)
+			gray = image;
+	}
+}
 
 String Feature::getId() {
 	return id;
-}
\ No newline at end of file
+}
+
+void Feature::keepStrongestKeypoints(const vector<KeyPoint>& keypoints, const Mat& descriptors) {
+	localFeatures = LocalFeatures();
+	if (keypointLimit <= 0 || descriptors.empty() || descriptors.rows != static_cast<int>(keypoints.size()))
+		return;
+
+	// Scratch of the calling thread, reused from one image to the next
+	ExtractionContext& context = ExtractionContext::forThread();
+	vector<int>& order = context.order;
+	order.resize(keypoints.size());
+	for (size_t i = 0; i < order.size(); ++i)
+		order[i] = static_cast<int>(i);
+	const size_t kept = min(order.size(), static_cast<size_t>(keypointLimit));
+	partial_sort(order.begin(), order.begin() + kept, order.end(),
+		[&](int a, int b) { return keypoints[a].response > keypoints[b].response; });
+
+	// SIFT components are within [0, 255] and ORB descriptors are bytes, so one byte each is enough
+	Mat& bytes = context.bytes;
+	descriptors.convertTo(bytes, CV_8U);
+	localFeatures.descriptors.create(static_cast<int>(kept), bytes.cols, CV_8U);
+	localFeatures.points.reserve(kept);
+	for (size_t i = 0; i < kept; ++i) {
+		localFeatures.points.push_back(keypoints[order[i]].pt);
+		bytes.row(order[i]).copyTo(localFeatures.descriptors.row(static_cast<int>(i)));
+	}
+}
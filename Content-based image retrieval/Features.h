@@ -2,10 +2,50 @@
 
 #include <opencv2/opencv.hpp>
 #include <string>
+#include <vector>
 
 using namespace std;
 using namespace cv;
 
+/**
+ * @struct LocalFeatures
+ * @brief Strongest keypoints of one image, kept for geometric verification.
+ */
+struct LocalFeatures {
+    vector<Point2f> points;     ///< Keypoint positions, strongest first
+    Mat descriptors;            ///< One CV_8U descriptor per keypoint (row i = point i)
+};
+
+/**
+ * @struct ImagePlanes
+ * @brief A decoded image and the color conversions shared by several features.
+ *
+ * A multi-feature extraction decodes each image once and converts it once for all the
+ * requested features: the color features read the HSV plane, SIFT and ORB the gray plane.
+ */
+struct ImagePlanes {
+    /**
+     * @enum Plane
+     * @brief Conversions a feature can ask for (see `Feature::getRequiredPlanes()`).
+     */
+    enum Plane : unsigned {
+        HSV = 1,    ///< BGR -> HSV conversion
+        Gray = 2    ///< Grayscale conversion
+    };
+
+    Mat bgr;    ///< Decoded image (BGR, or single-channel for gray files)
+    Mat hsv;    ///< HSV conversion of `bgr`, empty if not requested or `bgr` is not 3-channel
+    Mat gray;   ///< Gray conversion of `bgr` (`bgr` itself if single-channel), empty if not requested
+
+    /**
+     * @brief Derives the requested planes of a decoded image.
+     *
+     * @param[in] image    The decoded image (shared, not copied).
+     * @param[in] planes   Combination of `Plane` flags.
+     */
+    ImagePlanes(const Mat& image, unsigned planes);
+};
+
 /**
  * @class Feature
  * @brief Abstract base class for image feature representation.
@@ -17,6 +57,18 @@ class Feature {
 protected:
     String id;                ///< The ID of the image associated with this feature.
     Mat imageDescriptors;     ///< The feature descriptor matrix (e.g., SIFT, histogram, etc.).
+    int keypointLimit = 0;    ///< Number of keypoints kept in `localFeatures` (0 = none).
+    LocalFeatures localFeatures; ///< Strongest keypoints of local features (SIFT, ORB), kept after the BoVW conversion.
+
+    /**
+     * @brief Keeps the `keypointLimit` strongest keypoints and their descriptors on bytes.
+     *
+     * @param[in] keypoints     Detected keypoints.
+     * @param[in] descriptors   Their descriptors (row i = keypoint i), CV_32F or CV_8U.
+     *
+     * @return void
+     */
+    void keepStrongestKeypoints(const vector<KeyPoint>& keypoints, const Mat& descriptors);
 
 public:
     /**
@@ -61,6 +113,42 @@ public:
      */
     void setDescriptor(const Mat& newContent) { imageDescriptors = newContent; }
 
+    /**
+     * @brief Sets how many keypoints local features keep for geometric verification.
+     *
+     * @param[in] limit   Keypoints kept, the highest responses first (0 keeps none).
+     *
+     * @return void
+     */
+    void setKeypointLimit(int limit) { keypointLimit = limit; }
+
+    /**
+     * @brief Returns the keypoints kept for geometric verification.
+     *
+     * @return The positions and byte descriptors, empty for global features or a zero limit.
+     */
+    const LocalFeatures& getLocalFeatures() const { return localFeatures; }
+
+    /**
+     * @brief Returns the conversions `createFeatureFromPlanes()` reads.
+     *
+     * @return A combination of `ImagePlanes::Plane` flags, 0 if only the decoded image is used.
+     */
+    virtual unsigned getRequiredPlanes() const { return 0; }
+
+    /**
+     * @brief Extracts the feature from an image already decoded and converted.
+     *
+     * The default implementation runs `createFeature()` on the decoded image. Features that
+     * need a color conversion override it to read the shared plane instead.
+     *
+     * @param[in] image_id The ID of the image to associate with the extracted feature.
+     * @param[in] planes   The decoded image and the planes requested by `getRequiredPlanes()`.
+     *
+     * @return void
+     */
+    virtual void createFeatureFromPlanes(String image_id, const ImagePlanes& planes) { createFeature(image_id, planes.bgr); }
+
     /**
      * @brief Pure virtual method to extract and assign feature descriptors from an image.
      *
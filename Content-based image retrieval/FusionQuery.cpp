@@ -0,0 +1,148 @@
+#include "FusionQuery.h"
+
+#include <algorithm>
+#include <chrono>
+#include <unordered_map>
+
+Query& FusionQuery::addSource(string method, const FeatureStore& features, Mat vocabulary, float weight) {
+    Source source;
+    source.method = method;
+    source.features = &features;
+    source.vocabulary = vocabulary;
+    source.weight = weight;
+    source.query.reset(new Query);
+    sources.push_back(move(source));
+
+    pool.reset();  // recreated with one worker per feature on the next query
+    distributeThreads();
+    return *sources.back().query;
+}
+
+void FusionQuery::setFusion(FusionMethod method, int depth) {
+    fusion = method;
+    candidateDepth = depth;
+}
+
+void FusionQuery::setParallelism(int count, int cutoff) {
+    if (count != threadCount)
+        pool.reset();
+    threadCount = count;
+    parallelCutoff = cutoff;
+    distributeThreads();
+}
+
+void FusionQuery::distributeThreads() {
+    if (sources.empty())
+        return;
+
+    // Sequential fusion: each feature may use every thread in turn. Concurrent fusion: a pool
+    // thread count includes its caller, so the fusion thread running a feature is one of that
+    // feature's total / N scan threads, and at most total threads run at once.
+    const int total = threadCount > 0 ? threadCount : ThreadPool::defaultThreadCount();
+    const int perSource = threadCount == 1 ? total : max(1, total / static_cast<int>(sources.size()));
+    for (Source& source : sources)
+        source.query->setParallelism(perSource, parallelCutoff);
+}
+
+void FusionQuery::Search(string image_id, Mat query, int kTop) {
+    results.clear();
+    if (sources.empty()) {
+        cerr << "Fusion query without features" << endl;
+        return;
+    }
+    cout << "Fusion querying " << sources.size() << " features" << endl;
+
+    // === One task per feature: extraction, search and verification run side by side ===
+    const int depth = max(kTop, candidateDepth);
+    auto searchSource = [&](size_t s) {
+        Source& source = sources[s];
+        const auto start = chrono::steady_clock::now();
+        source.results.clear();
+
+        LocalFeatures localFeatures;
+        Mat descriptor = source.query->computeQueryDescriptor(image_id, query, source.vocabulary, source.method, &localFeatures);
+        if (!descriptor.empty() && descriptor.cols == source.features->getDimensions()) {
+            source.query->SearchBatch(descriptor, *source.features, depth, source.method);
+            source.query->VerifyBatch({ localFeatures }, *source.features);
+            if (!source.query->getBatchResults().empty())
+                source.results = source.query->getBatchResults()[0];
+        }
+        source.milliseconds = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    };
+
+    if (threadCount == 1 || sources.size() == 1) {
+        for (size_t s = 0; s < sources.size(); ++s)
+            searchSource(s);
+    }
+    else {
+        if (!pool)
+            pool.reset(new ThreadPool(static_cast<int>(sources.size())));
+        pool->parallelFor(sources.size(), searchSource);
+    }
+
+    for (const Source& source : sources) {
+        if (source.results.empty())
+            cerr << "No " << source.method << " results for the query" << endl;
+        cout << source.method << ": " << source.milliseconds << " ms" << endl;
+    }
+
+    // === Merge by image ID ===
+    fuseResults(kTop);
+    for (const auto& [id, score] : results)
+        cout << "ID: " << id << " score: " << score << endl;
+}
+
+void FusionQuery::fuseResults(int kTop) {
+    unordered_map<string, float> fused;
+    for (const Source& source : sources) {
+        const vector<pair<string, float>>& list = source.results;
+        if (list.empty())
+            continue;
+
+        if (fusion == FusionMethod::ReciprocalRank) {
+            for (size_t rank = 0; rank < list.size(); ++rank)
+                fused[list[rank].first] += source.weight / static_cast<float>(rrfConstant + rank + 1);
+            continue;
+        }
+
+        // Min-max over the list, flipped for distances so the best result maps to 1.
+        // Verification may reorder the list, so the bounds are taken over all its scores.
+        const bool similarity = Query::usesSimilarity(source.method);
+        float lowest = list[0].second, highest = list[0].second;
+        for (const auto& entry : list) {
+            lowest = min(lowest, entry.second);
+            highest = max(highest, entry.second);
+        }
+        const float range = highest - lowest;
+        for (const auto& [id, score] : list) {
+            float normalized = 1.0f;
+            if (range > 0.0f)
+                normalized = similarity ? (score - lowest) / range : (highest - score) / range;
+            fused[id] += source.weight * normalized;
+        }
+    }
+
+    results.assign(fused.begin(), fused.end());
+    const size_t k = min(results.size(), static_cast<size_t>(max(0, kTop)));
+    // Ties broken by ID so the fused ranking does not depend on hash order
+    partial_sort(results.begin(), results.begin() + k, results.end(),
+        [](const pair<string, float>& a, const pair<string, float>& b) {
+            return a.second != b.second ? a.second > b.second : a.first < b.first;
+        });
+    results.resize(k);
+}
+
+vector<pair<string, float>> FusionQuery::getResult() const {
+    return results;
+}
+
+vector<pair<string, double>> FusionQuery::getSourceTimes() const {
+    vector<pair<string, double>> times;
+    for (const Source& source : sources)
+        times.emplace_back(source.method, source.milliseconds);
+    return times;
+}
+
+int FusionQuery::size() const {
+    return static_cast<int>(sources.size());
+}
@@ -0,0 +1,166 @@
+#pragma once
+
+#include <opencv2/opencv.hpp>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "Query.h"
+#include "FeatureStore.h"
+#include "ThreadPool.h"
+
+using namespace std;
+using namespace cv;
+
+/**
+ * @enum FusionMethod
+ * @brief How the result lists of several features are merged.
+ */
+enum class FusionMethod {
+    WeightedSum,    ///< Scores normalized to [0, 1] per feature (1 = best), then summed with the feature weights
+    ReciprocalRank  ///< Sum of weight / (rrfConstant + rank): ignores the score scales altogether
+};
+
+/**
+ * @class FusionQuery
+ * @brief Late fusion of several feature indexes of the same image database.
+ *
+ * Each feature (e.g. Color Histogram, HOG, SIFT BoVW) is searched by its own `Query`, with its
+ * own vocabulary, IVF/graph/inverted index and geometric verification, so the features run
+ * concurrently on a pool without sharing any state: the latency of a fused query is the one of
+ * its slowest feature rather than the sum of all of them. Each feature returns its
+ * `candidateDepth` best images, and the lists are merged by image ID.
+ *
+ * The features do not score on the same scale: Chi-square similarity is higher-is-better,
+ * L2 distance lower-is-better, and their ranges differ. Weighted-sum fusion therefore maps
+ * each list linearly to [0, 1] with its best result at 1 and its worst at 0; reciprocal-rank
+ * fusion only uses the positions. An image missing from a list contributes nothing for that
+ * feature. Fused scores are higher-is-better.
+ */
+class FusionQuery {
+private:
+    /**
+     * @struct Source
+     * @brief One feature index taking part in the fusion.
+     */
+    struct Source {
+        string method;                      ///< Feature extraction method (e.g., "SIFT")
+        const FeatureStore* features;       ///< Descriptors of the index
+        Mat vocabulary;                     ///< BoVW vocabulary of the index (empty for global features)
+        float weight;                       ///< Weight of the feature in the fused score
+        unique_ptr<Query> query;            ///< Query executor of this feature
+        vector<pair<string, float>> results; ///< Results of the last query
+        double milliseconds = 0.0;          ///< Time taken by the last query
+    };
+
+    vector<Source> sources;                         ///< Features taking part in the fusion
+    vector<pair<string, float>> results;            ///< Fused results (image ID, fused score)
+    FusionMethod fusion = FusionMethod::WeightedSum; ///< Merging rule
+    int candidateDepth = 100;                       ///< Results requested from each feature
+    int threadCount = 0;                            ///< Threads shared by all features (<= 0 uses all hardware threads)
+    int parallelCutoff = 16384;                     ///< Parallel scan cutoff passed to every feature
+    unique_ptr<ThreadPool> pool;                    ///< One task per feature, created on the first query
+
+    static const int rrfConstant = 60;              ///< Damping of reciprocal-rank fusion (the usual value from the literature)
+
+    /**
+     * @brief Splits the threads between the features and sizes their scans.
+     *
+     * @return void
+     */
+    void distributeThreads();
+
+    /**
+     * @brief Merges the result lists of the last query into `results`.
+     *
+     * @param[in] kTop   Number of fused results kept.
+     *
+     * @return void
+     */
+    void fuseResults(int kTop);
+
+public:
+    /**
+     * @brief Default constructor. Creates a fusion without features.
+     */
+    FusionQuery() {}
+
+    FusionQuery(const FusionQuery&) = delete;
+    FusionQuery& operator=(const FusionQuery&) = delete;
+
+    /**
+     * @brief Adds a feature index to the fusion.
+     *
+     * The returned query can be given the indexes of the feature (vocabulary tree, HNSW graph,
+     * IVF lists, inverted index, geometric verifier); it stays valid as long as the fusion.
+     *
+     * @param[in] method       Feature extraction method of the index (e.g., "Color Histogram").
+     * @param[in] features     Feature store of the index; must outlive the fusion.
+     * @param[in] vocabulary   BoVW vocabulary of the index (empty for global features).
+     * @param[in] weight       Weight of the feature in the fused score.
+     *
+     * @return The query executor of the feature.
+     */
+    Query& addSource(string method, const FeatureStore& features, Mat vocabulary, float weight = 1.0f);
+
+    /**
+     * @brief Sets how the result lists are merged.
+     *
+     * @param[in] method   Weighted sum of normalized scores or reciprocal-rank fusion.
+     * @param[in] depth    Results requested from each feature (at least kTop are always requested).
+     *
+     * @return void
+     */
+    void setFusion(FusionMethod method, int depth = 100);
+
+    /**
+     * @brief Sets the number of threads shared by the features.
+     *
+     * The threads are split evenly between the features: each feature gets `count` / N of
+     * them (at least one), and the fusion-pool thread that runs the feature is one of these,
+     * since a pool counts its calling thread (see `ThreadPool`). At most `count` threads
+     * therefore run at once, N feature tasks plus their `count` / N - 1 extra scan threads
+     * each, as long as `count` >= N.
+     *
+     * @param[in] count    Total number of threads (<= 0 uses all hardware threads, 1 runs the features one after the other).
+     * @param[in] cutoff   Minimum index size for a parallel scan of one feature.
+     *
+     * @return void
+     */
+    void setParallelism(int count, int cutoff = 16384);
+
+    /**
+     * @brief Searches every feature index with one query image and fuses the results.
+     *
+     * @param[in] image_id   The identifier (or path) of the query image.
+     * @param[in] query      The query image.
+     * @param[in] kTop       The number of top results to retrieve.
+     *
+     * @return void
+     *
+     * @note This function populates the `results` vector with fused scores, higher is better.
+     */
+    void Search(string image_id, Mat query, int kTop);
+
+    /**
+     * @brief Retrieves the fused results of the last query.
+     *
+     * @return A vector of pairs containing image IDs and their fused scores, best first.
+     */
+    vector<pair<string, float>> getResult() const;
+
+    /**
+     * @brief Returns the time the features took on the last query.
+     *
+     * @return One (method, milliseconds) pair per feature, in the order they were added.
+     */
+    vector<pair<string, double>> getSourceTimes() const;
+
+    /**
+     * @brief Returns the number of features taking part in the fusion.
+     *
+     * @return The feature count.
+     */
+    int size() const;
+};
@@ -0,0 +1,218 @@
+#include "GeometricVerifier.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <numeric>
+
+bool GeometricVerifier::build(const vector<LocalFeatures>& images, int norm, int limit) {
+    clear();
+
+    int bytes = 0;
+    for (const LocalFeatures& image : images) {
+        if (image.descriptors.empty())
+            continue;
+        if (image.descriptors.type() != CV_8U || image.descriptors.rows != static_cast<int>(image.points.size())
+            || (bytes != 0 && image.descriptors.cols != bytes)) {
+            cerr << "Inconsistent keypoints for geometric verification." << endl;
+            return false;
+        }
+        bytes = image.descriptors.cols;
+    }
+
+    ownedOffsets.assign(images.size() + 1, 0);
+    for (size_t i = 0; i < images.size(); ++i)
+        ownedOffsets[i + 1] = ownedOffsets[i] + (images[i].descriptors.empty() ? 0 : images[i].points.size());
+
+    ownedPositions.resize(2 * ownedOffsets.back());
+    ownedDescriptors.resize(ownedOffsets.back() * bytes);
+    for (size_t i = 0; i < images.size(); ++i) {
+        const uint64_t first = ownedOffsets[i];
+        const int count = static_cast<int>(ownedOffsets[i + 1] - first);
+        for (int k = 0; k < count; ++k) {
+            ownedPositions[2 * (first + k)] = images[i].points[k].x;
+            ownedPositions[2 * (first + k) + 1] = images[i].points[k].y;
+            memcpy(&ownedDescriptors[(first + k) * bytes], images[i].descriptors.ptr<uint8_t>(k), bytes);
+        }
+    }
+
+    imageCount = static_cast<int>(images.size());
+    descriptorBytes = bytes;
+    normType = norm;
+    keypointLimit = limit;
+    offsets = ownedOffsets.data();
+    positions = ownedPositions.data();
+    descriptors = ownedDescriptors.data();
+    return true;
+}
+
+void GeometricVerifier::write(IndexFileWriter& writer) const {
+    if (empty())
+        return;
+
+    const uint64_t keypoints = getKeypointCount();
+    int32_t header[4] = { imageCount, descriptorBytes, normType, keypointLimit };
+    writer.beginSection(indexSectionGeometry);
+    writer.write(header, sizeof(header));
+    writer.write(&keypoints, sizeof(keypoints));
+    writer.write(offsets, (static_cast<size_t>(imageCount) + 1) * sizeof(uint64_t));
+    writer.write(positions, keypoints * 2 * sizeof(float));
+    writer.write(descriptors, keypoints * descriptorBytes);
+    writer.endSection();
+}
+
+bool GeometricVerifier::read(const IndexFileReader& reader, int images) {
+    clear();
+
+    const unsigned char* data = nullptr;
+    size_t size = 0;
+    if (!reader.findSection(indexSectionGeometry, data, size))
+        return false;
+
+    int32_t header[4] = { 0, 0, 0, 0 };
+    uint64_t keypoints = 0;
+    const size_t headerSize = sizeof(header) + sizeof(keypoints);
+    if (size < headerSize) {
+        cerr << "Corrupted keypoints in index" << endl;
+        return false;
+    }
+    memcpy(header, data, sizeof(header));
+    memcpy(&keypoints, data + sizeof(header), sizeof(keypoints));
+
+    const int bytes = header[1];
+    if (header[0] != images || images <= 0 || bytes <= 0 || (header[2] != NORM_L2 && header[2] != NORM_HAMMING)
+        || keypoints > size || size != headerSize + (static_cast<size_t>(images) + 1) * sizeof(uint64_t)
+            + keypoints * (2 * sizeof(float) + bytes)) {
+        cerr << "Keypoints do not match the index" << endl;
+        return false;
+    }
+
+    const uint64_t* keypointOffsets = reinterpret_cast<const uint64_t*>(data + headerSize);
+    bool valid = keypointOffsets[0] == 0 && keypointOffsets[images] == keypoints;
+    for (int i = 0; valid && i < images; ++i)
+        valid = keypointOffsets[i] <= keypointOffsets[i + 1];
+    if (!valid) {
+        cerr << "Corrupted keypoints in index" << endl;
+        return false;
+    }
+
+    imageCount = images;
+    descriptorBytes = bytes;
+    normType = header[2];
+    keypointLimit = header[3];
+    offsets = keypointOffsets;
+    positions = reinterpret_cast<const float*>(keypointOffsets + images + 1);
+    descriptors = reinterpret_cast<const uint8_t*>(positions + 2 * keypoints);
+    return true;
+}
+
+void GeometricVerifier::setParameters(VerificationModel fitted, double threshold, int iterations, int inliers) {
+    model = fitted;
+    reprojectionThreshold = threshold;
+    ransacIterations = max(1, iterations);
+    minInliers = max(1, inliers);
+}
+
+int GeometricVerifier::countInliers(const LocalFeatures& query, int row) const {
+    const int count = static_cast<int>(offsets[row + 1] - offsets[row]);
+    const int minSample = model == VerificationModel::Homography ? 4 : 8;
+    if (query.descriptors.empty() || query.descriptors.cols != descriptorBytes || count < minSample)
+        return 0;
+
+    // === Ratio-test matches between the query and the candidate ===
+    Mat candidate(count, descriptorBytes, CV_8U, const_cast<uint8_t*>(descriptors + offsets[row] * descriptorBytes));
+    vector<vector<DMatch>> knn;
+    BFMatcher matcher(normType);
+    matcher.knnMatch(query.descriptors, candidate, knn, 2);
+
+    vector<Point2f> queryPoints, candidatePoints;
+    vector<bool> used(count, false);
+    for (const vector<DMatch>& nearest : knn) {
+        if (nearest.size() < 2 || nearest[0].distance >= ratio * nearest[1].distance || used[nearest[0].trainIdx])
+            continue;
+        used[nearest[0].trainIdx] = true;  // one-to-one, a repeated texture cannot inflate the count
+        queryPoints.push_back(query.points[nearest[0].queryIdx]);
+        const float* position = positions + 2 * (offsets[row] + nearest[0].trainIdx);
+        candidatePoints.emplace_back(position[0], position[1]);
+    }
+    if (static_cast<int>(queryPoints.size()) < max(minSample, minInliers))
+        return 0;
+
+    // === RANSAC fit, the inliers are the matches consistent with the model ===
+    Mat mask;
+    Mat fitted = model == VerificationModel::Homography
+        ? findHomography(queryPoints, candidatePoints, RANSAC, reprojectionThreshold, mask, ransacIterations, 0.995)
+        : findFundamentalMat(queryPoints, candidatePoints, FM_RANSAC, reprojectionThreshold, 0.995, ransacIterations, mask);
+    if (fitted.empty() || mask.empty())
+        return 0;
+    return countNonZero(mask);
+}
+
+int GeometricVerifier::rerank(const LocalFeatures& query, const FeatureStore& features, int depth, double budgetMs,
+    vector<pair<string, float>>& results, ThreadPool* pool) const {
+    const int candidates = min(depth, static_cast<int>(results.size()));
+    if (empty() || candidates <= 0 || query.descriptors.empty())
+        return 0;
+
+    // -1 = not verified (started after the deadline or unknown image). The budget only decides
+    // which candidates start: one already matching and fitting runs to its end.
+    const auto deadline = chrono::steady_clock::now() + chrono::duration<double, milli>(budgetMs);
+    vector<int> inliers(candidates, -1);
+    atomic<int> verified{ 0 };
+    auto verify = [&](size_t c) {
+        if (budgetMs > 0 && chrono::steady_clock::now() >= deadline)
+            return;
+        const int row = features.findRow(results[c].first);
+        if (row < 0 || row >= imageCount)
+            return;
+        inliers[c] = countInliers(query, row);
+        ++verified;
+    };
+
+    if (pool && candidates > 1)
+        pool->parallelFor(candidates, verify);
+    else
+        for (int c = 0; c < candidates; ++c)
+            verify(c);
+
+    // Stable: verified candidates first by inliers, the rest in their BoVW order
+    vector<int> order(candidates);
+    iota(order.begin(), order.end(), 0);
+    auto key = [&](int c) { return inliers[c] >= minInliers ? inliers[c] : 0; };
+    stable_sort(order.begin(), order.end(), [&](int a, int b) { return key(a) > key(b); });
+
+    vector<pair<string, float>> head(candidates);
+    for (int i = 0; i < candidates; ++i)
+        head[i] = move(results[order[i]]);
+    move(head.begin(), head.end(), results.begin());
+    return verified;
+}
+
+void GeometricVerifier::clear() {
+    imageCount = 0;
+    descriptorBytes = 0;
+    keypointLimit = 0;
+    ownedOffsets.clear();
+    ownedPositions.clear();
+    ownedDescriptors.clear();
+    offsets = nullptr;
+    positions = nullptr;
+    descriptors = nullptr;
+}
+
+bool GeometricVerifier::empty() const {
+    return imageCount == 0 || getKeypointCount() == 0;
+}
+
+int GeometricVerifier::size() const {
+    return imageCount;
+}
+
+int GeometricVerifier::getKeypointLimit() const {
+    return keypointLimit;
+}
+
+uint64_t GeometricVerifier::getKeypointCount() const {
+    return offsets ? offsets[imageCount] : 0;
+}
@@ -0,0 +1,183 @@
+#pragma once
+
+#include <opencv2/opencv.hpp>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "Features.h"
+#include "IndexFormat.h"
+#include "FeatureStore.h"
+#include "ThreadPool.h"
+
+using namespace std;
+using namespace cv;
+
+static const char indexSectionGeometry[] = "GEOM";  ///< int32 image count, int32 descriptor bytes, int32 norm, int32 keypoint limit, uint64 keypoint count, uint64 offsets (images + 1), float (x, y) positions, uint8 descriptors
+
+/**
+ * @enum VerificationModel
+ * @brief Transformation fitted between the query and a candidate.
+ */
+enum class VerificationModel {
+    Homography,     ///< Planar scenes and rotations (4 point samples)
+    Fundamental     ///< General 3D scenes (8 point samples)
+};
+
+/**
+ * @class GeometricVerifier
+ * @brief Re-ranks the top candidates of a BoVW query by the number of geometrically consistent matches.
+ *
+ * BoVW histograms forget where the keypoints were, so images sharing many visual words in a
+ * different layout score as well as true matches. The verifier keeps, for every indexed image,
+ * its strongest keypoints with their descriptors (SIFT stored on 8 bits, ORB as its binary
+ * string). A candidate is verified by matching the raw descriptors of the query against its
+ * own with a ratio test, then fitting a homography or a fundamental matrix with RANSAC; the
+ * number of inliers measures how much of the query is really in the candidate.
+ *
+ * Verification is the expensive step of a query, so only the top R candidates are verified,
+ * several at a time on a thread pool, and candidates not started before the time budget runs
+ * out keep their BoVW rank. The budget is a start deadline, not a hard limit: candidates
+ * already being verified finish, so a query can overrun it by about one verification (a
+ * brute-force match and at most `ransacIterations` RANSAC iterations) per worker.
+ *
+ * The keypoints are stored in index.bin next to the histograms (row i = image i) and are used
+ * in place from the memory mapping.
+ */
+class GeometricVerifier {
+private:
+    int imageCount = 0;                 ///< Number of indexed images
+    int descriptorBytes = 0;            ///< Bytes per stored descriptor
+    int normType = NORM_L2;             ///< Descriptor distance (NORM_L2 for SIFT, NORM_HAMMING for ORB)
+    int keypointLimit = 0;              ///< Keypoints kept per image at extraction
+    vector<uint64_t> ownedOffsets;      ///< Keypoint offsets when built in memory
+    vector<float> ownedPositions;       ///< Keypoint positions when built in memory
+    vector<uint8_t> ownedDescriptors;   ///< Keypoint descriptors when built in memory
+    const uint64_t* offsets = nullptr;  ///< First keypoint of each image (imageCount + 1 entries)
+    const float* positions = nullptr;   ///< (x, y) of every keypoint
+    const uint8_t* descriptors = nullptr; ///< Descriptor of every keypoint
+
+    VerificationModel model = VerificationModel::Homography; ///< Transformation fitted by RANSAC
+    float ratio = 0.8f;                 ///< Lowe's ratio between the best and second-best match
+    double reprojectionThreshold = 5.0; ///< Largest distance (pixels) of an inlier to the fitted model
+    int ransacIterations = 1000;        ///< RANSAC iteration cap per candidate
+    int minInliers = 10;                ///< Fewer inliers count as no verification
+
+public:
+    /**
+     * @brief Default constructor. Creates an empty verifier.
+     */
+    GeometricVerifier() {}
+
+    GeometricVerifier(const GeometricVerifier&) = delete;
+    GeometricVerifier& operator=(const GeometricVerifier&) = delete;
+
+    /**
+     * @brief Builds the keypoint store.
+     *
+     * @param[in] images      Keypoints of every indexed image, in feature store order.
+     * @param[in] norm        Descriptor distance: NORM_L2 (SIFT) or NORM_HAMMING (ORB).
+     * @param[in] limit       Keypoints kept per image at extraction (recorded for queries).
+     *
+     * @return true if the store was built; false if the descriptors are inconsistent.
+     */
+    bool build(const vector<LocalFeatures>& images, int norm, int limit);
+
+    /**
+     * @brief Appends the keypoint section to an index file being written.
+     *
+     * @param[in,out] writer   Open index writer.
+     *
+     * @return void
+     */
+    void write(IndexFileWriter& writer) const;
+
+    /**
+     * @brief Loads the keypoint section of a mapped index file.
+     *
+     * The keypoints are used in place: the mapping must outlive the verifier.
+     *
+     * @param[in] reader   Opened index reader.
+     * @param[in] images   Number of rows of the feature store.
+     *
+     * @return true if the section was found and is consistent; false otherwise.
+     */
+    bool read(const IndexFileReader& reader, int images);
+
+    /**
+     * @brief Sets how candidates are verified.
+     *
+     * @param[in] fitted        Transformation fitted by RANSAC.
+     * @param[in] threshold     Largest reprojection (homography) or epipolar (fundamental) error of an inlier, in pixels.
+     * @param[in] iterations    RANSAC iteration cap per candidate.
+     * @param[in] inliers       Minimum inliers for a candidate to count as verified.
+     *
+     * @return void
+     */
+    void setParameters(VerificationModel fitted, double threshold = 5.0, int iterations = 1000, int inliers = 10);
+
+    /**
+     * @brief Counts the inliers of the transformation between a query and one indexed image.
+     *
+     * @param[in] query   Keypoints of the query.
+     * @param[in] row     Feature store row of the candidate.
+     *
+     * @return The number of RANSAC inliers, 0 if there are too few matches to fit the model.
+     */
+    int countInliers(const LocalFeatures& query, int row) const;
+
+    /**
+     * @brief Reorders the best results of a query by their inlier counts.
+     *
+     * The first `depth` results are verified. Those with at least the minimum number of inliers
+     * move to the front, most inliers first; the others, and candidates not started before the
+     * deadline, keep their order behind them. Scores are left unchanged.
+     *
+     * @param[in]     query      Keypoints of the query.
+     * @param[in]     features   Feature store the results refer to (maps image IDs to rows).
+     * @param[in]     depth      Number of results verified.
+     * @param[in]     budgetMs   Deadline after which no new candidate is started, in milliseconds (<= 0 = no limit).
+     * @param[in,out] results    (image ID, score) results, best first.
+     * @param[in]     pool       Pool verifying candidates in parallel, or nullptr to verify them in order.
+     *
+     * @return The number of candidates verified.
+     */
+    int rerank(const LocalFeatures& query, const FeatureStore& features, int depth, double budgetMs,
+        vector<pair<string, float>>& results, ThreadPool* pool) const;
+
+    /**
+     * @brief Releases the keypoint store.
+     *
+     * @return void
+     */
+    void clear();
+
+    /**
+     * @brief Tells whether keypoints are available.
+     *
+     * @return True if no keypoint store is built or loaded.
+     */
+    bool empty() const;
+
+    /**
+     * @brief Returns the number of indexed images.
+     *
+     * @return The image count.
+     */
+    int size() const;
+
+    /**
+     * @brief Returns the number of keypoints kept per image at extraction.
+     *
+     * @return The limit queries should use too.
+     */
+    int getKeypointLimit() const;
+
+    /**
+     * @brief Returns the total number of stored keypoints.
+     *
+     * @return The keypoint count.
+     */
+    uint64_t getKeypointCount() const;
+};
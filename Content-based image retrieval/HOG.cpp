@@ -1,22 +1,398 @@
 #include "HOG.h"
 
+#include <cmath>
+#include <memory>
+#include <vector>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define HOG_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace {
+    // Polynomial of OpenCV's atan2 in degrees (cartToPolar, fastAtan2), max error about 0.01 degree
+    const float atanP1 = 0.9997878412794807f * 57.29577951308232f;
+    const float atanP3 = -0.3258083974640975f * 57.29577951308232f;
+    const float atanP5 = 0.1555786518463281f * 57.29577951308232f;
+    const float atanP7 = -0.04432655554792128f * 57.29577951308232f;
+    const float atanEpsilon = 2.2204460492503131e-16f;
+
+    const float hysteresisClip = 0.2f;      // L2-Hys clipping of block HOG
+    const float blockEpsilon = 1e-3f;       // Keeps the normalization of empty blocks finite
+
+#ifdef HOG_SSE2
+    inline __m128 select(__m128 mask, __m128 a, __m128 b) {
+        return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+    }
+#endif
+
+    // out[i] = (a[i] - b[i]) * scale
+    void differenceRow(const uchar* a, const uchar* b, float scale, float* out, int count) {
+        int i = 0;
+#ifdef HOG_SSE2
+        const __m128i zero = _mm_setzero_si128();
+        const __m128 scaleVector = _mm_set1_ps(scale);
+        for (; i + 8 <= count; i += 8) {
+            const __m128i difference = _mm_sub_epi16(
+                _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(a + i)), zero),
+                _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(b + i)), zero));
+            const __m128i sign = _mm_srai_epi16(difference, 15);
+            _mm_storeu_ps(out + i, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(difference, sign)), scaleVector));
+            _mm_storeu_ps(out + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(difference, sign)), scaleVector));
+        }
+#endif
+        for (; i < count; ++i)
+            out[i] = (static_cast<float>(a[i]) - static_cast<float>(b[i])) * scale;
+    }
+
+    void differenceRow(const float* a, const float* b, float scale, float* out, int count) {
+        for (int i = 0; i < count; ++i)
+            out[i] = (a[i] - b[i]) * scale;
+    }
+
+    // Calls rowFunction(y, gx, gy) with the [-1, 0, 1] gradients of every row, channels
+    // interleaved, read-only. Like Sobel with BORDER_REFLECT_101, the gradient across the border is zero.
+    template <typename T, typename RowFunction>
+    void scanGradients(const Mat& image, float scale, RowFunction rowFunction) {
+        const int rows = image.rows;
+        const int channels = image.channels();
+        const int count = image.cols * channels;
+        vector<float> gx(count, 0.0f), gy(count, 0.0f);
+
+        for (int y = 0; y < rows; ++y) {
+            const T* row = image.ptr<T>(y);
+            if (count > 2 * channels)
+                differenceRow(row + 2 * channels, row, scale, gx.data() + channels, count - 2 * channels);
+            if (y > 0 && y + 1 < rows)
+                differenceRow(image.ptr<T>(y + 1), image.ptr<T>(y - 1), scale, gy.data(), count);
+            else
+                fill(gy.begin(), gy.end(), 0.0f);
+            rowFunction(y, gx.data(), gy.data());
+        }
+    }
+
+    // 8-bit images are read in place, other depths go through the float copy of the original code
+    template <typename RowFunction>
+    void scanImageGradients(const Mat& image, RowFunction rowFunction) {
+        if (image.depth() == CV_8U) {
+            scanGradients<uchar>(image, 1.0f / 255.0f, rowFunction);
+            return;
+        }
+        Mat scaled;
+        image.convertTo(scaled, CV_32F, 1 / 255.0);
+        scanGradients<float>(scaled, 1.0f, rowFunction);
+    }
+
+    // Magnitude and angle in degrees [0, 360], as cartToPolar
+    void polarRow(const float* gx, const float* gy, float* magnitude, float* angle, int count) {
+        int i = 0;
+#ifdef HOG_SSE2
+        const __m128 signMask = _mm_set1_ps(-0.0f), zero = _mm_setzero_ps(), epsilon = _mm_set1_ps(atanEpsilon);
+        const __m128 p1 = _mm_set1_ps(atanP1), p3 = _mm_set1_ps(atanP3), p5 = _mm_set1_ps(atanP5), p7 = _mm_set1_ps(atanP7);
+        const __m128 d90 = _mm_set1_ps(90.0f), d180 = _mm_set1_ps(180.0f), d360 = _mm_set1_ps(360.0f);
+        for (; i + 4 <= count; i += 4) {
+            const __m128 x = _mm_loadu_ps(gx + i), y = _mm_loadu_ps(gy + i);
+            const __m128 ax = _mm_andnot_ps(signMask, x), ay = _mm_andnot_ps(signMask, y);
+            const __m128 c = _mm_div_ps(_mm_min_ps(ax, ay), _mm_add_ps(_mm_max_ps(ax, ay), epsilon));
+            const __m128 c2 = _mm_mul_ps(c, c);
+            __m128 a = _mm_add_ps(_mm_mul_ps(p7, c2), p5);
+            a = _mm_add_ps(_mm_mul_ps(a, c2), p3);
+            a = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(a, c2), p1), c);
+            a = select(_mm_cmpge_ps(ax, ay), a, _mm_sub_ps(d90, a));
+            a = select(_mm_cmplt_ps(x, zero), _mm_sub_ps(d180, a), a);
+            a = select(_mm_cmplt_ps(y, zero), _mm_sub_ps(d360, a), a);
+            _mm_storeu_ps(angle + i, a);
+            _mm_storeu_ps(magnitude + i, _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y))));
+        }
+#endif
+        for (; i < count; ++i) {
+            const float x = gx[i], y = gy[i];
+            const float ax = abs(x), ay = abs(y);
+            const float c = min(ax, ay) / (max(ax, ay) + atanEpsilon);
+            const float c2 = c * c;
+            float a = (((atanP7 * c2 + atanP5) * c2 + atanP3) * c2 + atanP1) * c;
+            if (ax < ay)
+                a = 90.0f - a;
+            if (x < 0)
+                a = 180.0f - a;
+            if (y < 0)
+                a = 360.0f - a;
+            angle[i] = a;
+            magnitude[i] = sqrt(x * x + y * y);
+        }
+    }
+
+    // Linear interpolation between two bins: position = angle * binsPerDegree + offset, the
+    // magnitude is split between floor(position) and the next bin
+    void interpolateRow(const float* angle, const float* magnitude, float binsPerDegree, float offset,
+        int* bin, float* low, float* high, int count) {
+        int i = 0;
+#ifdef HOG_SSE2
+        const __m128 scale = _mm_set1_ps(binsPerDegree), shift = _mm_set1_ps(offset);
+        for (; i + 4 <= count; i += 4) {
+            const __m128 position = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(angle + i), scale), shift);
+            const __m128i whole = _mm_cvttps_epi32(position);
+            const __m128 m = _mm_loadu_ps(magnitude + i);
+            const __m128 h = _mm_mul_ps(_mm_sub_ps(position, _mm_cvtepi32_ps(whole)), m);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(bin + i), whole);
+            _mm_storeu_ps(high + i, h);
+            _mm_storeu_ps(low + i, _mm_sub_ps(m, h));
+        }
+#endif
+        for (; i < count; ++i) {
+            const float position = angle[i] * binsPerDegree + offset;
+            const int whole = static_cast<int>(position);
+            bin[i] = whole;
+            high[i] = (position - static_cast<float>(whole)) * magnitude[i];
+            low[i] = magnitude[i] - high[i];
+        }
+    }
+
+    // L2-Hys: L2 normalization, clipping, L2 normalization again
+    void normalizeBlock(float* block, int length) {
+        for (int pass = 0; pass < 2; ++pass) {
+            double sum = 0.0;
+            for (int i = 0; i < length; ++i)
+                sum += static_cast<double>(block[i]) * block[i];
+            const float scale = static_cast<float>(1.0 / sqrt(sum + blockEpsilon * blockEpsilon));
+            for (int i = 0; i < length; ++i)
+                block[i] = pass == 0 ? min(block[i] * scale, hysteresisClip) : block[i] * scale;
+        }
+    }
+
+    // Signed orientation histogram, every channel of every pixel votes
+    class OrientationVotes {
+    private:
+        int count;
+        int bins;
+        int stride;
+        vector<float> magnitude, angle, low, high;
+        vector<int> bin;
+        vector<float> histograms;
+
+    public:
+        // 4 interleaved histograms, so neighbors of the same orientation do not wait on each other.
+        // Bins `bins` and `bins + 1` (angles rounded up to 360 degrees) wrap around when they are merged.
+        OrientationVotes(int rowCount, int orientationBins)
+            : count(rowCount), bins(orientationBins), stride(orientationBins + 2),
+            magnitude(rowCount), angle(rowCount), low(rowCount), high(rowCount), bin(rowCount),
+            histograms(4 * (orientationBins + 2), 0.0f) {}
+
+        void addRow(const float* gx, const float* gy) {
+            polarRow(gx, gy, magnitude.data(), angle.data(), count);
+            interpolateRow(angle.data(), magnitude.data(), bins / 360.0f, 0.0f, bin.data(), low.data(), high.data(), count);
+
+            int i = 0;
+            for (; i + 4 <= count; i += 4) {
+                for (int t = 0; t < 4; ++t) {
+                    float* histogram = &histograms[t * stride];
+                    histogram[bin[i + t]] += low[i + t];
+                    histogram[bin[i + t] + 1] += high[i + t];
+                }
+            }
+            for (; i < count; ++i) {
+                histograms[bin[i]] += low[i];
+                histograms[bin[i] + 1] += high[i];
+            }
+        }
+
+        Mat finish() const {
+            Mat featureVec = Mat::zeros(1, bins, CV_32F);
+            float* histogram = featureVec.ptr<float>();
+            for (int t = 0; t < 4; ++t)
+                for (int b = 0; b < stride; ++b)
+                    histogram[b % bins] += histograms[t * stride + b];
+            return featureVec;
+        }
+    };
+
+    // Cell histograms of block HOG, each pixel votes with the channel of largest gradient
+    class BlockVotes {
+    private:
+        HOGLayout layout;
+        int rows;
+        int cols;
+        int channels;
+        vector<int> cellColumn;
+        vector<int> wrap;
+        vector<float> cells;
+        vector<float> dominantX, dominantY, magnitude, angle, low, high;
+        vector<int> bin;
+
+    public:
+        // Offset of the cell of each column, and bin of each interpolation position: the positions
+        // of signed angles span 3 x bins and fold onto the unsigned bins
+        BlockVotes(const HOGLayout& hogLayout, int imageRows, int imageCols, int imageChannels)
+            : layout(hogLayout), rows(imageRows), cols(imageCols), channels(imageChannels),
+            cellColumn(imageCols), wrap(3 * hogLayout.bins + 2),
+            cells(static_cast<size_t>(hogLayout.cellsX) * hogLayout.cellsY * hogLayout.bins, 0.0f),
+            dominantX(imageCols), dominantY(imageCols), magnitude(imageCols), angle(imageCols),
+            low(imageCols), high(imageCols), bin(imageCols) {
+            for (int x = 0; x < cols; ++x)
+                cellColumn[x] = static_cast<int>(static_cast<long long>(x) * layout.cellsX / cols) * layout.bins;
+            for (int b = 0; b < static_cast<int>(wrap.size()); ++b)
+                wrap[b] = b % layout.bins;
+        }
+
+        void addRow(int y, const float* gx, const float* gy) {
+            const int bins = layout.bins;
+
+            // The channel of largest gradient stands for the pixel
+            const float* px = gx;
+            const float* py = gy;
+            if (channels > 1) {
+                // Index arithmetic rather than branches: on textured images the winner is unpredictable
+                for (int x = 0; x < cols; ++x) {
+                    const float* cx = gx + x * channels;
+                    const float* cy = gy + x * channels;
+                    int best = 0;
+                    float bestSquare = cx[0] * cx[0] + cy[0] * cy[0];
+                    for (int c = 1; c < channels; ++c) {
+                        const float square = cx[c] * cx[c] + cy[c] * cy[c];
+                        best += (c - best) * static_cast<int>(square > bestSquare);
+                        bestSquare = max(bestSquare, square);
+                    }
+                    dominantX[x] = cx[best];
+                    dominantY[x] = cy[best];
+                }
+                px = dominantX.data();
+                py = dominantY.data();
+            }
+
+            // Bin k is centered on (k + 0.5) * 180 / bins degrees
+            polarRow(px, py, magnitude.data(), angle.data(), cols);
+            interpolateRow(angle.data(), magnitude.data(), bins / 180.0f, bins - 0.5f, bin.data(), low.data(), high.data(), cols);
+
+            float* cellRow = &cells[static_cast<size_t>(static_cast<long long>(y) * layout.cellsY / rows) * layout.cellsX * bins];
+            for (int x = 0; x < cols; ++x) {
+                float* histogram = cellRow + cellColumn[x];
+                histogram[wrap[bin[x]]] += low[x];
+                histogram[wrap[bin[x] + 1]] += high[x];
+            }
+        }
+
+        // Overlapping blocks with a stride of one cell, each normalized on its own
+        Mat finish() const {
+            const int bins = layout.bins;
+            const int blockCells = layout.blockCells;
+            const int blocksX = layout.cellsX - blockCells + 1;
+            const int blocksY = layout.cellsY - blockCells + 1;
+            const int blockLength = blockCells * blockCells * bins;
+            Mat descriptor(1, blocksX * blocksY * blockLength, CV_32F);
+            float* out = descriptor.ptr<float>();
+            for (int by = 0; by < blocksY; ++by) {
+                for (int bx = 0; bx < blocksX; ++bx) {
+                    float* block = out;
+                    for (int cy = by; cy < by + blockCells; ++cy) {
+                        for (int cx = bx; cx < bx + blockCells; ++cx) {
+                            const float* cell = &cells[(static_cast<size_t>(cy) * layout.cellsX + cx) * bins];
+                            copy(cell, cell + bins, out);
+                            out += bins;
+                        }
+                    }
+                    normalizeBlock(block, blockLength);
+                }
+            }
+            return descriptor;
+        }
+    };
+}
+
+bool HOGLayout::isValid() const {
+    return bins >= 1 && blockCells >= 1 && cellsX >= blockCells && cellsY >= blockCells;
+}
+
+int HOGLayout::descriptorSize() const {
+    if (!isValid())
+        return 0;
+    return (cellsX - blockCells + 1) * (cellsY - blockCells + 1) * blockCells * blockCells * bins;
+}
+
 void HOG::createFeature(String image_id, Mat src_image) {
-    src_image.convertTo(src_image, CV_32F, 1 / 255.0);
+    Mat hogHistogram = computeDescriptor(src_image);
+
+    id = image_id;
+    setDescriptor(hogHistogram);
+}
+
+void HOG::createFeatures(String image_id, const Mat& image, const vector<HOG*>& hogs) {
+    vector<const HOG*> extractors(hogs.begin(), hogs.end());
+    vector<Mat> descriptors;
+    computeDescriptors(image, extractors, descriptors);
+    for (size_t h = 0; h < hogs.size(); ++h) {
+        hogs[h]->id = image_id;
+        hogs[h]->setDescriptor(descriptors[h]);
+    }
+}
+
+Mat HOG::computeDescriptor(const Mat& image) const {
+    vector<Mat> descriptors;
+    computeDescriptors(image, { this }, descriptors);
+    return descriptors[0];
+}
+
+void HOG::computeDescriptors(const Mat& image, const vector<const HOG*>& hogs, vector<Mat>& descriptors) {
+    descriptors.assign(hogs.size(), Mat());
+    if (image.empty())
+        return;
+
+    // One accumulator per block layout; every orientation-mode HOG shares the same histogram
+    unique_ptr<OrientationVotes> orientation;
+    vector<unique_ptr<BlockVotes>> blocks(hogs.size());
+    bool anyVotes = false;
+    for (size_t h = 0; h < hogs.size(); ++h) {
+        if (hogs[h]->mode == HOGMode::Block) {
+            if (!hogs[h]->layout.isValid()) {
+                cerr << "Invalid HOG block layout." << endl;
+                continue;
+            }
+            blocks[h].reset(new BlockVotes(hogs[h]->layout, image.rows, image.cols, image.channels()));
+        }
+        else if (!orientation) {
+            orientation.reset(new OrientationVotes(image.cols * image.channels(), orientationBins));
+        }
+        anyVotes = true;
+    }
+    if (!anyVotes)
+        return;
+
+    scanImageGradients(image, [&](int y, const float* gx, const float* gy) {
+        if (orientation)
+            orientation->addRow(gx, gy);
+        for (const unique_ptr<BlockVotes>& block : blocks)
+            if (block)
+                block->addRow(y, gx, gy);
+    });
+
+    Mat histogram = orientation ? orientation->finish() : Mat();
+    bool histogramTaken = false;
+    for (size_t h = 0; h < hogs.size(); ++h) {
+        if (blocks[h]) {
+            descriptors[h] = blocks[h]->finish();
+        }
+        else if (hogs[h]->mode == HOGMode::Orientation) {
+            descriptors[h] = histogramTaken ? histogram.clone() : histogram;
+            histogramTaken = true;
+        }
+    }
+}
+
+Mat HOG::computeHOGOpenCV(const Mat& image) {
+    Mat source;
+    image.convertTo(source, CV_32F, 1 / 255.0);
 
     // Get gradient image using Sobel
     Mat gx, gy;
-    Sobel(src_image, gx, CV_32F, 1, 0, 1);
-    Sobel(src_image, gy, CV_32F, 0, 1, 1);
+    Sobel(source, gx, CV_32F, 1, 0, 1);
+    Sobel(source, gy, CV_32F, 0, 1, 1);
 
     // Calculate magnitude and angle
     Mat mag, angle;
     cartToPolar(gx, gy, mag, angle, true);  // angle in degrees
 
     // Compute histogram of oriented gradients
-    Mat hogHistogram = computeHOG(mag, angle, true);
-
-    id = image_id;
-    setDescriptor(hogHistogram);
+    HOG hog;
+    return hog.computeHOG(mag, angle, true);
 }
 
 Mat HOG::computeHOG(InputArray mag, InputArray ang, bool isWeighted)
@@ -24,82 +400,35 @@ Mat HOG::computeHOG(InputArray mag, InputArray ang, bool isWeighted)
     Mat magMat = mag.getMat();
     Mat angMat = ang.getMat();
 
-    if (magMat.rows != angMat.rows || magMat.cols != angMat.cols) {
+    if (magMat.rows != angMat.rows || magMat.cols != angMat.cols || magMat.channels() != angMat.channels()) {
         cerr << "Magnitude and angle matrices must have the same dimensions." << endl;
         return Mat();
     }
 
-    int rows = magMat.rows;
-    int cols = magMat.cols;
-
-    const int featureDim = 360;
-    const float circleDegree = 360.0f;
-    const float binLength = circleDegree / featureDim;
-    const float halfBin = binLength / 2.0f;
+    const int rows = magMat.rows;
+    const int count = magMat.cols * magMat.channels();  // every channel votes
+    const int featureDim = orientationBins;
 
+    // Bins are 1 degree wide and centered on whole degrees, so the bin of an angle and its
+    // neighbor on the interpolation side come straight from its integer part
     Mat featureVec = Mat::zeros(1, featureDim, CV_32F);
-    vector<float> uplimits(featureDim);
-    vector<float> medbins(featureDim);
-
-    for (int i = 0; i < featureDim; ++i) {
-        uplimits[i] = (2 * i + 1) * halfBin;
-        medbins[i] = i * binLength;
-    }
-
+    float* histogram = featureVec.ptr<float>();
     for (int i = 0; i < rows; ++i) {
-        for (int j = 0; j < cols; ++j) {
-            float angleVal = angMat.at<float>(i, j);
-            float magnitudeVal = magMat.at<float>(i, j);
-
-            int valueIdx = 0;
-            int sideIdx = 0;
-            float dif = 0.0f;
-
-            if (angleVal <= uplimits[0] || angleVal >= uplimits[featureDim - 1]) {
-                if (!isWeighted) {
-                    featureVec.at<float>(0, 0) += magnitudeVal;
-                    continue;
-                }
-                else {
-                    if (angleVal >= medbins[0] && angleVal <= uplimits[0]) {
-                        dif = abs(angleVal - medbins[0]);
-                        valueIdx = 0;
-                        sideIdx = 1;
-                    }
-                    else {
-                        dif = abs(angleVal - circleDegree);
-                        valueIdx = 0;
-                        sideIdx = featureDim - 1;
-                    }
-                }
-            }
-            else {
-                for (int k = 0; k < featureDim - 1; ++k) {
-                    if (angleVal >= uplimits[k] && angleVal < uplimits[k + 1]) {
-                        if (!isWeighted) {
-                            featureVec.at<float>(0, k + 1) += magnitudeVal;
-                            break;
-                        }
-                        else {
-                            dif = abs(angleVal - medbins[k + 1]);
-                            valueIdx = k + 1;
-                            sideIdx = (angleVal >= medbins[k + 1]) ?
-                                ((k + 1 == featureDim - 1) ? 0 : k + 2) : k;
-                            break;
-                        }
-                    }
-                }
+        const float* magnitude = magMat.ptr<float>(i);
+        const float* angle = angMat.ptr<float>(i);
+        for (int j = 0; j < count; ++j) {
+            if (!isWeighted) {
+                const int nearest = static_cast<int>(angle[j] + 0.5f);
+                histogram[nearest % featureDim] += magnitude[j];
+                continue;
             }
 
-            if (isWeighted) {
-                float prop = (binLength - dif) / binLength;
-                float valueToAdd = prop * magnitudeVal;
-                float sideValueToAdd = (1.0f - prop) * magnitudeVal;
-                featureVec.at<float>(0, valueIdx) += valueToAdd;
-                featureVec.at<float>(0, sideIdx) += sideValueToAdd;
-            }
+            const int lower = static_cast<int>(angle[j]);
+            const float side = angle[j] - static_cast<float>(lower);
+            histogram[lower % featureDim] += (1.0f - side) * magnitude[j];
+            histogram[(lower + 1) % featureDim] += side * magnitude[j];
         }
     }
 
     return featureVec;
-}
\ No newline at end of file
+}
@@ -3,10 +3,49 @@
 #include "Features.h"
 #include <opencv2/opencv.hpp>
 #include <string>
+#include <vector>
 
 using namespace std;
 using namespace cv;
 
+/**
+ * @enum HOGMode
+ * @brief Layout of the HOG descriptor.
+ */
+enum class HOGMode {
+    Orientation,    ///< One 360-bin histogram of signed orientations over the whole image (the original descriptor)
+    Block           ///< Classic cell/block HOG: unsigned orientations per cell, L2-Hys normalized overlapping blocks
+};
+
+/**
+ * @struct HOGLayout
+ * @brief Cell and block layout of block HOG.
+ *
+ * The image is split into a fixed grid of cells whatever its size, so every image gets a
+ * descriptor of the same length: (cellsY - blockCells + 1) x (cellsX - blockCells + 1) blocks
+ * of blockCells x blockCells cells with `bins` orientations each (324 floats by default).
+ */
+struct HOGLayout {
+    int cellsX = 4;         ///< Cells across the image
+    int cellsY = 4;         ///< Cells down the image
+    int blockCells = 2;     ///< Cells on each side of a block; blocks overlap with a stride of one cell
+    int bins = 9;           ///< Unsigned orientation bins over [0, 180) degrees
+
+    /**
+     * @brief Tells whether the grid holds at least one block with at least one bin.
+     *
+     * @return True if the layout can be computed.
+     */
+    bool isValid() const;
+
+    /**
+     * @brief Length of the block HOG descriptor of this layout.
+     *
+     * @return The number of floats per image, 0 for an invalid layout.
+     */
+    int descriptorSize() const;
+};
+
 /**
  * @class HOG
  * @brief Extracts and manages HOG (Histogram of Oriented Gradients) features for image representation.
@@ -14,9 +53,48 @@ using namespace cv;
  * Inherits from the abstract base class `Feature`. This class is responsible for extracting
  * HOG descriptors from input images, enabling them to be used in indexing, clustering,
  * and retrieval processes.
+ *
+ * Both modes run in a single pass over the rows of the image: the [-1, 0, 1] gradients of a
+ * row are taken from the rows above and below it, turned into magnitude and angle, and binned
+ * right away, without float copies of the image or full-size gradient images. Several HOG
+ * extractors (e.g. HOG and Block HOG) can share that pass, see `createFeatures()`. The bin of an
+ * angle and its interpolation weights are computed arithmetically, and the gradient, polar
+ * and interpolation steps process 4 values per SSE2 instruction on x86. The angle uses the
+ * same polynomial as OpenCV's `cartToPolar`.
  */
 class HOG : public Feature {
+private:
+    HOGMode mode;                           ///< Descriptor computed by `createFeature()`
+    HOGLayout layout;                       ///< Cell and block layout of block HOG
+
+    static const int orientationBins = 360; ///< Bins of the orientation histogram (1 degree each)
+
+    /**
+     * @brief Computes the descriptors of several HOG extractors in one pass over the gradients.
+     *
+     * In orientation mode every channel of every pixel votes with its own gradient, like
+     * `computeHOG()` on the gradients of the whole image; orientation-mode extractors share one
+     * histogram. In block mode each pixel votes with the channel of largest gradient, into the
+     * cell that contains it.
+     *
+     * @param[in]  image         The input image (any number of channels).
+     * @param[in]  hogs          The extractors, in any mix of modes and layouts.
+     * @param[out] descriptors   One descriptor per extractor, empty for an invalid block layout.
+     *
+     * @return void
+     */
+    static void computeDescriptors(const Mat& image, const vector<const HOG*>& hogs, vector<Mat>& descriptors);
+
 public:
+    /**
+     * @brief Constructor.
+     *
+     * @param[in] hogMode     Orientation histogram (the original descriptor) or cell/block HOG.
+     * @param[in] hogLayout   Cell and block layout of block HOG.
+     */
+    explicit HOG(HOGMode hogMode = HOGMode::Orientation, HOGLayout hogLayout = HOGLayout())
+        : mode(hogMode), layout(hogLayout) {}
+
     /**
      * @brief Extracts HOG features from an image.
      *
@@ -32,15 +110,49 @@ public:
     void createFeature(String imagePath, Mat image) override;
 
     /**
-     * @brief Computes the HOG descriptor from a given image.
+     * @brief Extracts the features of several HOG extractors from one image.
+     *
+     * The gradients of each row are computed once and binned by every extractor.
      *
-     * @param[in]  image       The input image for which HOG features are computed.
-     * @param[in]  mask        Optional mask (not used in standard HOG, but included for compatibility).
-     * @param[in]  visualize   Flag to indicate whether a visualization is to be generated (default false).
+     * @param[in] imagePath   The path or ID of the image being processed.
+     * @param[in] image       The input image (grayscale or BGR).
+     * @param[in] hogs        The extractors receiving their descriptor.
+     *
+     * @return void
+     */
+    static void createFeatures(String imagePath, const Mat& image, const vector<HOG*>& hogs);
+
+    /**
+     * @brief Computes the 360-bin orientation histogram from gradient magnitudes and angles.
+     *
+     * @param[in]  image       Gradient magnitudes (CV_32F, any number of channels).
+     * @param[in]  mask        Gradient angles in degrees, [0, 360), same size as the magnitudes.
+     * @param[in]  visualize   Whether each magnitude is split linearly between the two nearest bins (else all to the nearest).
      *
      * @return A cv::Mat containing the 1D HOG descriptor vector.
      *
      * @note This function supports downstream use in Bag-of-Visual-Words and similarity comparison.
      */
     Mat computeHOG(InputArray image, InputArray mask, bool visualize);
+
+    /**
+     * @brief Computes the orientation histogram with OpenCV's Sobel and cartToPolar.
+     *
+     * The reference for `createFeature()` in orientation mode: float copy of the image, full
+     * gradient, magnitude and angle images, then `computeHOG()`.
+     *
+     * @param[in] image   The input image (grayscale or BGR).
+     *
+     * @return A 1 x 360 CV_32F histogram.
+     */
+    static Mat computeHOGOpenCV(const Mat& image);
+
+    /**
+     * @brief Computes the descriptor of an image without storing it.
+     *
+     * @param[in] image   The input image (grayscale or BGR).
+     *
+     * @return The descriptor of the configured mode.
+     */
+    Mat computeDescriptor(const Mat& image) const;
 };
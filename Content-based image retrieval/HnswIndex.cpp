@@ -0,0 +1,474 @@
+#include "HnswIndex.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <queue>
+#include <random>
+
+#include "ThreadPool.h"
+
+HnswIndex::HnswIndex(int M, int efConstruction) {
+    setParameters(M, efConstruction);
+    selectKernel();
+}
+
+void HnswIndex::setParameters(int M, int efConstruction) {
+    this->M = max(2, M);
+    maxLinks0 = 2 * this->M;
+    this->efConstruction = max(1, efConstruction);
+}
+
+void HnswIndex::selectKernel() {
+    const DistanceKernelSet& kernels = DistanceKernels::best();
+    // Squared L2 ranks like L2 and saves a square root per visited node
+    distance = metric == HnswMetric::ChiSquare ? kernels.chiSquare : kernels.squaredL2;
+}
+
+float HnswIndex::nodeDistance(const float* query, int node) const {
+    return distance(query, vectors + static_cast<size_t>(node) * dimensions, dimensions);
+}
+
+const int32_t* HnswIndex::linksAt(int node, int level) const {
+    if (level == 0)
+        return layer0 + static_cast<size_t>(node) * (maxLinks0 + 1);
+    return upperLinks[node].data() + static_cast<size_t>(level - 1) * (M + 1);
+}
+
+int32_t* HnswIndex::mutableLinksAt(int node, int level) {
+    if (level == 0)
+        return ownedLayer0.data() + static_cast<size_t>(node) * (maxLinks0 + 1);
+    return upperLinks[node].data() + static_cast<size_t>(level - 1) * (M + 1);
+}
+
+unique_ptr<HnswIndex::VisitedSet> HnswIndex::acquireVisited() const {
+    unique_ptr<VisitedSet> visited;
+    {
+        lock_guard<mutex> lock(visitedLock);
+        if (!visitedPool.empty()) {
+            visited = move(visitedPool.back());
+            visitedPool.pop_back();
+        }
+    }
+    if (!visited)
+        visited.reset(new VisitedSet);
+
+    // A new tag marks every node as unvisited without clearing the array
+    if (visited->marks.size() != static_cast<size_t>(nodeCount)) {
+        visited->marks.assign(nodeCount, 0);
+        visited->tag = 0;
+    }
+    if (++visited->tag == 0) {
+        fill(visited->marks.begin(), visited->marks.end(), 0);
+        visited->tag = 1;
+    }
+    return visited;
+}
+
+void HnswIndex::releaseVisited(unique_ptr<VisitedSet> visited) const {
+    lock_guard<mutex> lock(visitedLock);
+    visitedPool.push_back(move(visited));
+}
+
+pair<float, int> HnswIndex::greedyClosest(const float* query, pair<float, int> start, int level, bool locked) const {
+    pair<float, int> best = start;
+    vector<int32_t> links;
+
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        {
+            unique_lock<mutex> lock;
+            if (locked)
+                lock = unique_lock<mutex>(nodeLocks[best.second]);
+            const int32_t* nodeLinks = linksAt(best.second, level);
+            links.assign(nodeLinks + 1, nodeLinks + 1 + nodeLinks[0]);
+        }
+
+        for (int32_t neighbour : links) {
+            float d = nodeDistance(query, neighbour);
+            if (d < best.first) {
+                best = make_pair(d, static_cast<int>(neighbour));
+                changed = true;
+            }
+        }
+    }
+    return best;
+}
+
+vector<pair<float, int>> HnswIndex::searchLayer(const float* query, pair<float, int> start, int ef, int level, bool locked) const {
+    unique_ptr<VisitedSet> visited = acquireVisited();
+    vector<uint32_t>& marks = visited->marks;
+    const uint32_t tag = visited->tag;
+
+    // Candidates to expand (closest first) and best nodes found so far (farthest first)
+    priority_queue<pair<float, int>, vector<pair<float, int>>, greater<pair<float, int>>> candidates;
+    priority_queue<pair<float, int>> nearest;
+    candidates.push(start);
+    nearest.push(start);
+    marks[start.second] = tag;
+
+    vector<int32_t> links;
+    while (!candidates.empty()) {
+        const pair<float, int> current = candidates.top();
+        if (current.first > nearest.top().first && static_cast<int>(nearest.size()) >= ef)
+            break;
+        candidates.pop();
+
+        {
+            unique_lock<mutex> lock;
+            if (locked)
+                lock = unique_lock<mutex>(nodeLocks[current.second]);
+            const int32_t* nodeLinks = linksAt(current.second, level);
+            links.assign(nodeLinks + 1, nodeLinks + 1 + nodeLinks[0]);
+        }
+
+        for (int32_t neighbour : links) {
+            if (marks[neighbour] == tag)
+                continue;
+            marks[neighbour] = tag;
+
+            float d = nodeDistance(query, neighbour);
+            if (static_cast<int>(nearest.size()) < ef || d < nearest.top().first) {
+                candidates.emplace(d, neighbour);
+                nearest.emplace(d, neighbour);
+                if (static_cast<int>(nearest.size()) > ef)
+                    nearest.pop();
+            }
+        }
+    }
+    releaseVisited(move(visited));
+
+    vector<pair<float, int>> result(nearest.size());
+    for (size_t i = result.size(); i-- > 0; nearest.pop())
+        result[i] = nearest.top();
+    return result;
+}
+
+vector<pair<float, int>> HnswIndex::selectNeighbours(const vector<pair<float, int>>& candidates, int maxCount) const {
+    if (static_cast<int>(candidates.size()) <= maxCount)
+        return candidates;
+
+    vector<pair<float, int>> selected;
+    selected.reserve(maxCount);
+    for (const pair<float, int>& candidate : candidates) {
+        if (static_cast<int>(selected.size()) >= maxCount)
+            break;
+
+        const float* candidateVector = vectors + static_cast<size_t>(candidate.second) * dimensions;
+        bool diverse = true;
+        for (const pair<float, int>& kept : selected) {
+            if (nodeDistance(candidateVector, kept.second) < candidate.first) {
+                diverse = false;
+                break;
+            }
+        }
+        if (diverse)
+            selected.push_back(candidate);
+    }
+    return selected;
+}
+
+void HnswIndex::addLink(int node, int newLink, int level) {
+    const int maxCount = level == 0 ? maxLinks0 : M;
+    int32_t* links = mutableLinksAt(node, level);
+
+    if (links[0] < maxCount) {
+        links[1 + links[0]] = newLink;
+        ++links[0];
+        return;
+    }
+
+    // Full list: keep the most diverse neighbours among the old ones and the new one
+    const float* base = vectors + static_cast<size_t>(node) * dimensions;
+    vector<pair<float, int>> candidates;
+    candidates.reserve(maxCount + 1);
+    for (int i = 1; i <= links[0]; ++i)
+        candidates.emplace_back(nodeDistance(base, links[i]), links[i]);
+    candidates.emplace_back(nodeDistance(base, newLink), newLink);
+    sort(candidates.begin(), candidates.end());
+
+    vector<pair<float, int>> selected = selectNeighbours(candidates, maxCount);
+    links[0] = static_cast<int32_t>(selected.size());
+    for (size_t i = 0; i < selected.size(); ++i)
+        links[1 + i] = selected[i].second;
+}
+
+void HnswIndex::insert(int node) {
+    const float* point = vectors + static_cast<size_t>(node) * dimensions;
+    const int level = levels[node];
+
+    // A node that raises the top layer keeps the graph lock until it becomes the entry point
+    unique_lock<mutex> topLock(graphLock);
+    const int currentMaxLevel = maxLevel;
+    const int currentEntryPoint = entryPoint;
+    if (currentEntryPoint < 0) {
+        entryPoint = node;
+        maxLevel = level;
+        return;
+    }
+    if (level <= currentMaxLevel)
+        topLock.unlock();
+
+    pair<float, int> closest(nodeDistance(point, currentEntryPoint), currentEntryPoint);
+    for (int l = currentMaxLevel; l > level; --l)
+        closest = greedyClosest(point, closest, l, true);
+
+    for (int l = min(level, currentMaxLevel); l >= 0; --l) {
+        vector<pair<float, int>> candidates = searchLayer(point, closest, efConstruction, l, true);
+        candidates.erase(remove_if(candidates.begin(), candidates.end(),
+            [node](const pair<float, int>& c) { return c.second == node; }), candidates.end());
+        if (candidates.empty())
+            continue;
+
+        vector<pair<float, int>> neighbours = selectNeighbours(candidates, M);
+        {
+            lock_guard<mutex> lock(nodeLocks[node]);
+            int32_t* links = mutableLinksAt(node, l);
+            links[0] = static_cast<int32_t>(neighbours.size());
+            for (size_t i = 0; i < neighbours.size(); ++i)
+                links[1 + i] = neighbours[i].second;
+        }
+
+        for (const pair<float, int>& neighbour : neighbours) {
+            lock_guard<mutex> lock(nodeLocks[neighbour.second]);
+            addLink(neighbour.second, node, l);
+        }
+
+        closest = candidates.front();
+    }
+
+    if (level > currentMaxLevel) {
+        entryPoint = node;
+        maxLevel = level;
+    }
+}
+
+void HnswIndex::build(const float* data, int count, int dims, HnswMetric graphMetric, int threadCount) {
+    clear();
+    metric = graphMetric;
+    selectKernel();
+    vectors = data;
+    nodeCount = max(0, count);
+    dimensions = dims;
+    if (nodeCount == 0)
+        return;
+
+    // Level l is drawn with probability (1/M)^l, from a fixed seed
+    mt19937 rng(100);
+    uniform_real_distribution<double> uniform(0.0, 1.0);
+    const double levelScale = 1.0 / log(static_cast<double>(M));
+    levels.resize(nodeCount);
+    upperLinks.resize(nodeCount);
+    for (int i = 0; i < nodeCount; ++i) {
+        levels[i] = static_cast<int32_t>(-log(max(uniform(rng), 1e-12)) * levelScale);
+        upperLinks[i].assign(static_cast<size_t>(levels[i]) * (M + 1), 0);
+    }
+
+    ownedLayer0.assign(static_cast<size_t>(nodeCount) * (maxLinks0 + 1), 0);
+    layer0 = ownedLayer0.data();
+    nodeLocks.reset(new mutex[nodeCount]);
+
+    insert(0);
+    if (threadCount == 1 || nodeCount < 1024) {
+        for (int i = 1; i < nodeCount; ++i)
+            insert(i);
+    }
+    else {
+        ThreadPool pool(threadCount);
+        pool.parallelFor(nodeCount - 1, [&](size_t i) {
+            insert(static_cast<int>(i) + 1);
+        });
+    }
+
+    nodeLocks.reset();
+}
+
+vector<pair<int, float>> HnswIndex::search(const float* query, size_t k, int efSearch) const {
+    vector<pair<int, float>> results;
+    if (nodeCount == 0 || k == 0)
+        return results;
+
+    const int ef = max(efSearch, static_cast<int>(min<size_t>(k, static_cast<size_t>(nodeCount))));
+
+    pair<float, int> closest(nodeDistance(query, entryPoint), entryPoint);
+    for (int l = maxLevel; l > 0; --l)
+        closest = greedyClosest(query, closest, l, false);
+
+    vector<pair<float, int>> nearest = searchLayer(query, closest, ef, 0, false);
+    const size_t count = min(k, nearest.size());
+    results.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        float d = metric == HnswMetric::L2 ? sqrt(nearest[i].first) : nearest[i].first;
+        results.emplace_back(nearest[i].second, d);
+    }
+    return results;
+}
+
+bool HnswIndex::save(const string& path) const {
+    IndexFileWriter writer;
+    if (!writer.open(path)) {
+        cerr << "Failed to open file for writing: " << path << endl;
+        return false;
+    }
+
+    HnswFileParameters parameters;
+    memset(&parameters, 0, sizeof(parameters));
+    parameters.M = M;
+    parameters.efConstruction = efConstruction;
+    parameters.metric = static_cast<int32_t>(metric);
+    parameters.nodeCount = nodeCount;
+    parameters.dimensions = dimensions;
+    parameters.entryPoint = entryPoint;
+    parameters.maxLevel = maxLevel;
+
+    writer.beginSection(hnswSectionParameters);
+    writer.write(&parameters, sizeof(parameters));
+    writer.endSection();
+
+    writer.beginSection(hnswSectionLevels);
+    writer.write(levels.data(), levels.size() * sizeof(int32_t));
+    writer.endSection();
+
+    writer.beginSection(hnswSectionLayer0);
+    writer.write(layer0, static_cast<size_t>(nodeCount) * (maxLinks0 + 1) * sizeof(int32_t));
+    writer.endSection();
+
+    writer.beginSection(hnswSectionUpper);
+    for (const vector<int32_t>& links : upperLinks)
+        writer.write(links.data(), links.size() * sizeof(int32_t));
+    writer.endSection();
+
+    return writer.close();
+}
+
+bool HnswIndex::load(const string& path, const float* data, int count, int dims) {
+    clear();
+
+    shared_ptr<MappedFile> mapped = make_shared<MappedFile>();
+    IndexFileReader reader;
+    if (!mapped->open(path) || !reader.open(mapped->getData(), mapped->getSize()))
+        return false;
+
+    const unsigned char* section = nullptr;
+    size_t sectionSize = 0;
+
+    HnswFileParameters parameters;
+    if (!reader.findSection(hnswSectionParameters, section, sectionSize) || sectionSize < sizeof(parameters)) {
+        cerr << "Corrupted HNSW index: " << path << endl;
+        return false;
+    }
+    memcpy(&parameters, section, sizeof(parameters));
+
+    if (parameters.nodeCount != count || parameters.dimensions != dims) {
+        cerr << "HNSW index " << path << " does not match the feature index" << endl;
+        return false;
+    }
+    if (parameters.M < 2 || parameters.metric < 0 || parameters.metric > static_cast<int32_t>(HnswMetric::ChiSquare)
+        || count <= 0 || parameters.entryPoint < 0 || parameters.entryPoint >= count || parameters.maxLevel < 0) {
+        cerr << "Corrupted HNSW index: " << path << endl;
+        return false;
+    }
+
+    M = parameters.M;
+    maxLinks0 = 2 * M;
+    efConstruction = parameters.efConstruction;
+    metric = static_cast<HnswMetric>(parameters.metric);
+
+    // Levels and upper layers are small and copied, layer 0 is used in place
+    if (!reader.findSection(hnswSectionLevels, section, sectionSize) || sectionSize != static_cast<size_t>(count) * sizeof(int32_t)) {
+        cerr << "Corrupted HNSW levels: " << path << endl;
+        return false;
+    }
+    levels.resize(count);
+    memcpy(levels.data(), section, sectionSize);
+
+    size_t upperCount = 0;
+    for (int32_t level : levels) {
+        if (level < 0 || level > parameters.maxLevel) {
+            cerr << "Corrupted HNSW levels: " << path << endl;
+            levels.clear();
+            return false;
+        }
+        upperCount += static_cast<size_t>(level) * (M + 1);
+    }
+
+    if (!reader.findSection(hnswSectionLayer0, section, sectionSize)
+        || sectionSize != static_cast<size_t>(count) * (maxLinks0 + 1) * sizeof(int32_t)) {
+        cerr << "Corrupted HNSW layer 0: " << path << endl;
+        levels.clear();
+        return false;
+    }
+    layer0 = reinterpret_cast<const int32_t*>(section);
+
+    if (!reader.findSection(hnswSectionUpper, section, sectionSize) || sectionSize != upperCount * sizeof(int32_t)) {
+        cerr << "Corrupted HNSW upper layers: " << path << endl;
+        clear();
+        return false;
+    }
+    upperLinks.resize(count);
+    const int32_t* upper = reinterpret_cast<const int32_t*>(section);
+    for (int i = 0; i < count; ++i) {
+        upperLinks[i].assign(upper, upper + static_cast<size_t>(levels[i]) * (M + 1));
+        upper += upperLinks[i].size();
+    }
+
+    // Every link is checked once so searches can follow them without bounds checks
+    nodeCount = count;
+    for (int node = 0; node < count; ++node) {
+        for (int level = 0; level <= levels[node]; ++level) {
+            const int32_t* links = linksAt(node, level);
+            const int maxCount = level == 0 ? maxLinks0 : M;
+            bool valid = links[0] >= 0 && links[0] <= maxCount;
+            for (int i = 1; valid && i <= links[0]; ++i)
+                valid = links[i] >= 0 && links[i] < count && levels[links[i]] >= level;
+            if (!valid) {
+                cerr << "Corrupted HNSW links: " << path << endl;
+                clear();
+                return false;
+            }
+        }
+    }
+
+    file = mapped;
+    vectors = data;
+    dimensions = dims;
+    entryPoint = parameters.entryPoint;
+    maxLevel = levels[entryPoint];
+    selectKernel();
+    return true;
+}
+
+void HnswIndex::clear() {
+    vectors = nullptr;
+    nodeCount = 0;
+    dimensions = 0;
+    entryPoint = -1;
+    maxLevel = -1;
+    levels.clear();
+    ownedLayer0.clear();
+    layer0 = nullptr;
+    upperLinks.clear();
+    file.reset();
+
+    lock_guard<mutex> lock(visitedLock);
+    visitedPool.clear();
+}
+
+bool HnswIndex::empty() const {
+    return nodeCount == 0;
+}
+
+int HnswIndex::size() const {
+    return nodeCount;
+}
+
+int HnswIndex::getDimensions() const {
+    return dimensions;
+}
+
+HnswMetric HnswIndex::getMetric() const {
+    return metric;
+}
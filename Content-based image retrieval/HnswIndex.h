@@ -0,0 +1,307 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "DistanceKernels.h"
+#include "IndexFormat.h"
+#include "MappedFile.h"
+
+using namespace std;
+
+static const char hnswSectionParameters[] = "HNSW";    ///< HnswFileParameters
+static const char hnswSectionLevels[] = "HLVL";        ///< int32 top layer of each node
+static const char hnswSectionLayer0[] = "HL0 ";        ///< int32 [count, links...] of every node on layer 0, (2M + 1) per node
+static const char hnswSectionUpper[] = "HLUP";         ///< int32 [count, links...] of layers 1..level of each node, (M + 1) per layer
+
+/**
+ * @enum HnswMetric
+ * @brief Distance used to build and search an HNSW graph.
+ */
+enum class HnswMetric {
+    L2,         ///< Euclidean distance (HOG, SIFT/ORB BoVW histograms)
+    ChiSquare   ///< Chi-square distance (color histograms and correlograms)
+};
+
+/**
+ * @struct HnswFileParameters
+ * @brief Payload of the parameter section of hnsw.bin.
+ */
+struct HnswFileParameters {
+    int32_t M;                  ///< Links per node on the upper layers (2M on layer 0)
+    int32_t efConstruction;     ///< Candidate list size used while building
+    int32_t metric;             ///< HnswMetric
+    int32_t nodeCount;          ///< Number of indexed vectors
+    int32_t dimensions;         ///< Length of the indexed vectors
+    int32_t entryPoint;         ///< Node where every search starts
+    int32_t maxLevel;           ///< Top layer of the graph
+    int32_t reserved[9];        ///< Zero
+};
+
+/**
+ * @class HnswIndex
+ * @brief Hierarchical Navigable Small World graph for approximate nearest-neighbour search.
+ *
+ * Every indexed vector is a node linked to its closest neighbours on layer 0 and, with an
+ * exponentially decreasing probability, on sparser upper layers. A search descends greedily
+ * through the upper layers and then explores layer 0 with a candidate list of `efSearch`
+ * nodes, so it visits a small part of the database instead of scanning all of it.
+ *
+ * The graph only stores links: the vectors themselves stay in the feature store and are
+ * attached by pointer. Rows of the graph are the rows of the feature store. Once built or
+ * loaded the index is read-only and can be searched from several threads at once.
+ */
+class HnswIndex {
+private:
+    /**
+     * @struct VisitedSet
+     * @brief Nodes visited by one layer search, reset in O(1) by changing the tag.
+     */
+    struct VisitedSet {
+        vector<uint32_t> marks;     ///< Tag of the last search that visited each node
+        uint32_t tag = 0;           ///< Tag of the current search
+    };
+
+    int M = 16;                                 ///< Links per node on the upper layers
+    int maxLinks0 = 32;                         ///< Links per node on layer 0
+    int efConstruction = 200;                   ///< Candidate list size used while building
+    HnswMetric metric = HnswMetric::L2;         ///< Distance of the graph
+    DistanceKernel distance = nullptr;          ///< Kernel computing `metric` (squared for L2)
+
+    const float* vectors = nullptr;             ///< Attached vectors, row i = node i
+    int nodeCount = 0;                          ///< Number of nodes
+    int dimensions = 0;                         ///< Length of a vector
+
+    int entryPoint = -1;                        ///< Node where every search starts
+    int maxLevel = -1;                          ///< Top layer of the graph
+    vector<int32_t> levels;                     ///< Top layer of each node
+    vector<int32_t> ownedLayer0;                ///< Layer 0 links when built in memory
+    const int32_t* layer0 = nullptr;            ///< Layer 0 links, in `ownedLayer0` or in the mapped file
+    vector<vector<int32_t>> upperLinks;         ///< Links of layers 1..level of each node
+    shared_ptr<MappedFile> file;                ///< Mapped hnsw.bin backing `layer0` after `load()`
+
+    unique_ptr<mutex[]> nodeLocks;              ///< One lock per node while building
+    mutex graphLock;                            ///< Protects the entry point while building
+    mutable mutex visitedLock;                  ///< Protects `visitedPool`
+    mutable vector<unique_ptr<VisitedSet>> visitedPool;  ///< Reusable visited sets, one per concurrent search
+
+    /**
+     * @brief Distance between a vector and an indexed node (squared for L2).
+     *
+     * @param[in] query   Vector of `dimensions` floats.
+     * @param[in] node    Indexed node.
+     *
+     * @return The graph distance.
+     */
+    float nodeDistance(const float* query, int node) const;
+
+    /**
+     * @brief Returns the link list of a node on one layer: the count followed by the links.
+     *
+     * @param[in] node    Indexed node.
+     * @param[in] level   Layer, at most the level of the node.
+     *
+     * @return A pointer to the list.
+     */
+    const int32_t* linksAt(int node, int level) const;
+
+    /**
+     * @brief Writable version of `linksAt()`, only valid while building.
+     *
+     * @param[in] node    Indexed node.
+     * @param[in] level   Layer, at most the level of the node.
+     *
+     * @return A pointer to the list.
+     */
+    int32_t* mutableLinksAt(int node, int level);
+
+    /**
+     * @brief Takes a visited set from the pool (or creates one) and starts a new search on it.
+     *
+     * @return A visited set with every node unvisited.
+     */
+    unique_ptr<VisitedSet> acquireVisited() const;
+
+    /**
+     * @brief Returns a visited set to the pool.
+     *
+     * @param[in] visited   Set obtained from `acquireVisited()`.
+     *
+     * @return void
+     */
+    void releaseVisited(unique_ptr<VisitedSet> visited) const;
+
+    /**
+     * @brief Moves greedily towards the query on one layer.
+     *
+     * @param[in] query      Query vector.
+     * @param[in] start      Starting node.
+     * @param[in] level      Layer to walk on.
+     * @param[in] locked     Lock the nodes while reading their links (during the build).
+     *
+     * @return The closest node found and its distance.
+     */
+    pair<float, int> greedyClosest(const float* query, pair<float, int> start, int level, bool locked) const;
+
+    /**
+     * @brief Best-first search of one layer.
+     *
+     * @param[in] query      Query vector.
+     * @param[in] start      Entry node and its distance.
+     * @param[in] ef         Size of the candidate list.
+     * @param[in] level      Layer to search.
+     * @param[in] locked     Lock the nodes while reading their links (during the build).
+     *
+     * @return Up to `ef` (distance, node) pairs, closest first.
+     */
+    vector<pair<float, int>> searchLayer(const float* query, pair<float, int> start, int ef, int level, bool locked) const;
+
+    /**
+     * @brief Keeps diverse neighbours: a candidate is dropped if it is closer to a kept neighbour than to the base node.
+     *
+     * @param[in] candidates   (distance to base, node) pairs, closest first.
+     * @param[in] maxCount     Number of neighbours to keep.
+     *
+     * @return The selected neighbours, closest first.
+     */
+    vector<pair<float, int>> selectNeighbours(const vector<pair<float, int>>& candidates, int maxCount) const;
+
+    /**
+     * @brief Adds a back link from a neighbour, pruning its list when it is full.
+     *
+     * @param[in] node       Neighbour receiving the link.
+     * @param[in] newLink    Node to link to.
+     * @param[in] level      Layer of the link.
+     *
+     * @return void
+     */
+    void addLink(int node, int newLink, int level);
+
+    /**
+     * @brief Inserts one node into the graph (its level is already drawn).
+     *
+     * @param[in] node   Row of the vector to insert.
+     *
+     * @return void
+     */
+    void insert(int node);
+
+    /**
+     * @brief Selects the distance kernel of the current metric.
+     *
+     * @return void
+     */
+    void selectKernel();
+
+public:
+    /**
+     * @brief Constructor.
+     *
+     * @param[in] M                Links per node on the upper layers (layer 0 keeps 2M).
+     * @param[in] efConstruction   Candidate list size used while building (larger = better graph, slower build).
+     */
+    HnswIndex(int M = 16, int efConstruction = 200);
+
+    HnswIndex(const HnswIndex&) = delete;
+    HnswIndex& operator=(const HnswIndex&) = delete;
+
+    /**
+     * @brief Sets the construction parameters used by the next `build()`.
+     *
+     * @param[in] M                Links per node on the upper layers (layer 0 keeps 2M).
+     * @param[in] efConstruction   Candidate list size used while building.
+     *
+     * @return void
+     */
+    void setParameters(int M, int efConstruction);
+
+    /**
+     * @brief Builds the graph over a set of vectors.
+     *
+     * Node levels are drawn from a fixed seed before the insertions start. With several
+     * threads the nodes are inserted concurrently under per-node locks, which changes the
+     * exact graph (not its quality) from one run to another.
+     *
+     * @param[in] data          `count` rows of `dims` floats; they must stay valid while the index is used.
+     * @param[in] count         Number of vectors.
+     * @param[in] dims          Length of a vector.
+     * @param[in] graphMetric   Distance of the graph.
+     * @param[in] threadCount   Number of threads (<= 0 uses all hardware threads, 1 builds sequentially).
+     *
+     * @return void
+     */
+    void build(const float* data, int count, int dims, HnswMetric graphMetric, int threadCount = 0);
+
+    /**
+     * @brief Searches the k approximate nearest neighbours of a query.
+     *
+     * @param[in] query      Query vector of `getDimensions()` floats.
+     * @param[in] k          Number of neighbours to return.
+     * @param[in] efSearch   Candidate list size (raised to k if smaller); larger values trade speed for recall.
+     *
+     * @return Up to k (row, distance) pairs, closest first. Distances are L2 or chi-square distances.
+     */
+    vector<pair<int, float>> search(const float* query, size_t k, int efSearch) const;
+
+    /**
+     * @brief Writes the graph to a file in the sectioned index format.
+     *
+     * @param[in] path   Destination file (usually hnsw.bin next to index.bin).
+     *
+     * @return true if the file was written; false otherwise.
+     */
+    bool save(const string& path) const;
+
+    /**
+     * @brief Loads a graph written by `save()` and attaches it to its vectors.
+     *
+     * Layer 0, the largest part of the graph, is used in place from the memory mapping.
+     *
+     * @param[in] path    File to read.
+     * @param[in] data    Vectors the graph was built on, row i = node i.
+     * @param[in] count   Number of vectors; must match the graph.
+     * @param[in] dims    Length of a vector; must match the graph.
+     *
+     * @return true if the graph was loaded and matches the vectors; false otherwise.
+     */
+    bool load(const string& path, const float* data, int count, int dims);
+
+    /**
+     * @brief Releases the graph.
+     *
+     * @return void
+     */
+    void clear();
+
+    /**
+     * @brief Tells whether a graph is built or loaded.
+     *
+     * @return True if the index has no node.
+     */
+    bool empty() const;
+
+    /**
+     * @brief Returns the number of indexed vectors.
+     *
+     * @return The node count.
+     */
+    int size() const;
+
+    /**
+     * @brief Returns the length of the indexed vectors.
+     *
+     * @return The vector length.
+     */
+    int getDimensions() const;
+
+    /**
+     * @brief Returns the distance of the graph.
+     *
+     * @return The metric used to build and search.
+     */
+    HnswMetric getMetric() const;
+};
@@ -5,7 +5,10 @@ Mat ImageDatabase::loadImageWithPath(string query_path) {
 }
 
 void ImageDatabase::readImageDatabase(string featureInputPath, Log& log) {
-    vector<string> fn_jpg, fn_png, fn;
+    vector<string> fn_jpg, fn_png;
+
+    imagePaths.clear();
+    cursor = 0;
 
     // Search for all .jpg files in the directory
     String directory_jpg = featureInputPath + "/*.jpg";
@@ -18,35 +21,65 @@ void ImageDatabase::readImageDatabase(string featureInputPath, Log& log) {
     glob(directory_png, fn_png, false);
 
     // Merge both .jpg and .png file paths into a single vector
-    fn.insert(fn.end(), fn_jpg.begin(), fn_jpg.end());
-    fn.insert(fn.end(), fn_png.begin(), fn_png.end());
-
-    size_t count = fn.size(); // Total number of images found
+    imagePaths.insert(imagePaths.end(), fn_jpg.begin(), fn_jpg.end());
+    imagePaths.insert(imagePaths.end(), fn_png.begin(), fn_png.end());
 
-    if (count == 0) {
+    if (imagePaths.empty()) {
         log.writeToImageDatabaseLog("No images found in the folder.");
         return;
     }
 
-    log.writeToImageDatabaseLog("Parsing folder size...");
-    Images.resize(count);  // Pre-allocate space for image objects
+    // Images are decoded lazily by nextImage() / nextBatch() / loadImage()
+    log.writeToImageDatabaseLog("Found " + to_string(imagePaths.size()) + " images");
+    log.writeToImageDatabaseLog("Parsing done");
+}
+
+size_t ImageDatabase::getImageCount() const {
+    return imagePaths.size();
+}
 
-    log.writeToImageDatabaseLog("Parsing images...");
-    for (size_t i = 0; i < count; i++) {
-        Mat image = imread(fn[i]);
-        if (image.empty()) {
-            // Skip and log if the image failed to load
-            log.writeToImageDatabaseLog("Failed to load image: " + fn[i]);
-            continue;
-        }
+const vector<string>& ImageDatabase::getImagePaths() const {
+    return imagePaths;
+}
 
-        // Assign image data and path to the Image object
-        Images[i].assignImg(fn[i], image);
-    }
+bool ImageDatabase::loadImage(size_t index, Image& image) const {
+    if (index >= imagePaths.size())
+        return false;
 
-    log.writeToImageDatabaseLog("Parsing done");
+    Mat content = imread(imagePaths[index]);
+    if (content.empty())
+        return false;
+
+    // Assign image data and path to the Image object
+    image.assignImg(imagePaths[index], content);
+    return true;
 }
 
-vector<Image> ImageDatabase::getImage() {
-    return Images;
-}
\ No newline at end of file
+void ImageDatabase::resetCursor() {
+    cursor = 0;
+}
+
+bool ImageDatabase::nextImage(Image& image, Log& log) {
+    // Release the previously streamed image before decoding the next one
+    image.assignImg("", Mat());
+
+    while (cursor < imagePaths.size()) {
+        size_t index = cursor++;
+        if (loadImage(index, image))
+            return true;
+
+        // Skip and log if the image failed to load
+        log.writeToImageDatabaseLog("Failed to load image: " + imagePaths[index]);
+    }
+    return false;
+}
+
+size_t ImageDatabase::nextBatch(vector<Image>& batch, size_t batchSize, Log& log) {
+    batch.clear();
+
+    Image image;
+    while (batch.size() < batchSize && nextImage(image, log))
+        batch.push_back(image);
+
+    return batch.size();
+}
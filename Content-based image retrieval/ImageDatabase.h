@@ -11,12 +11,13 @@ using namespace cv;
  * @class ImageDatabase
  * @brief Manages a collection of images and provides utilities for loading and displaying them.
  *
- * This class handles reading images from a given directory, storing them as `Image` objects,
- * and offering utility functions to access and display the stored images.
+ * This class handles scanning a given directory for image files and streaming them as `Image`
+ * objects through a cursor, so that only the images currently being processed are kept in memory.
  */
 class ImageDatabase {
 private:
-    vector<Image> Images;  ///< Internal container holding loaded image objects.
+    vector<string> imagePaths;  ///< Paths of all image files found in the database folder.
+    size_t cursor = 0;          ///< Index of the next image to be decoded by `nextImage()` / `nextBatch()`.
 
 public:
     /**
@@ -41,7 +42,11 @@ public:
     Mat loadImageWithPath(string path);
 
     /**
-     * @brief Reads all valid image files from a directory and stores them in the internal database.
+     * @brief Scans a directory for valid image files and registers their paths in the database.
+     *
+     * Images are not decoded here; they are streamed one at a time (or in small batches)
+     * through `nextImage()`, `nextBatch()` or `loadImage()`, so memory use does not grow
+     * with the size of the dataset.
      *
      * @param[in]      imageDatabasePath   Path to the folder containing image files.
      * @param[in,out]  log                 Logging object used to record success or error messages.
@@ -49,14 +54,65 @@ public:
      * @return void
      *
      * @note Supported image formats depend on OpenCV's `imread()` support (e.g., PNG, JPG, BMP).
-     *       Invalid or unreadable files are logged via the provided `Log` object.
+     *       Invalid or unreadable files are logged via the provided `Log` object when they are decoded.
      */
     void readImageDatabase(string imageDatabasePath, Log& log);
 
     /**
-     * @brief Retrieves the list of stored `Image` objects.
+     * @brief Returns the number of image files registered in the database.
+     *
+     * @return The number of image paths found by `readImageDatabase()`.
+     */
+    size_t getImageCount() const;
+
+    /**
+     * @brief Returns the paths of all registered image files.
+     *
+     * @return A const reference to the list of image paths, in database order.
+     */
+    const vector<string>& getImagePaths() const;
+
+    /**
+     * @brief Decodes the image at a given position of the database.
+     *
+     * This accessor does not touch the streaming cursor, so it can be used to read
+     * arbitrary images (e.g., from several worker threads at once).
+     *
+     * @param[in]  index   Position of the image in the database (0 <= index < getImageCount()).
+     * @param[out] image   Image object receiving the decoded pixels and the image path as ID.
+     *
+     * @return true if the image was decoded successfully; false otherwise.
+     */
+    bool loadImage(size_t index, Image& image) const;
+
+    /**
+     * @brief Rewinds the streaming cursor to the first image of the database.
+     *
+     * @return void
+     */
+    void resetCursor();
+
+    /**
+     * @brief Decodes the next image of the database and advances the streaming cursor.
+     *
+     * Files that fail to decode are logged and skipped. The previous content of `image`
+     * is released, so only one decoded image is alive at a time.
+     *
+     * @param[out]     image   Image object receiving the decoded pixels and the image path as ID.
+     * @param[in,out]  log     Logging object used to record files that failed to load.
+     *
+     * @return true if an image was produced; false once the end of the database is reached.
+     */
+    bool nextImage(Image& image, Log& log);
+
+    /**
+     * @brief Decodes up to `batchSize` images starting at the streaming cursor.
+     *
+     * @param[out]     batch       Vector receiving the decoded images (cleared first).
+     * @param[in]      batchSize   Maximum number of images to decode.
+     * @param[in,out]  log         Logging object used to record files that failed to load.
      *
-     * @return A vector<Image> containing all loaded images.
+     * @return The number of images placed into `batch` (0 once the end of the database is reached).
      */
-    vector<Image> getImage();
+    size_t nextBatch(vector<Image>& batch, size_t batchSize, Log& log);
 };
@@ -0,0 +1,213 @@
+#include "IndexFormat.h"
+
+bool IndexFileWriter::open(const string& path) {
+    sections.clear();
+    sectionOpen = false;
+
+    out.open(path, ios::binary | ios::trunc);
+    if (!out)
+        return false;
+
+    // Placeholder, rewritten by close() once the table offset is known
+    IndexFileHeader header;
+    memset(&header, 0, sizeof(header));
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    return static_cast<bool>(out);
+}
+
+void IndexFileWriter::align() {
+    static const char zeros[indexSectionAlignment] = {};
+    const size_t position = static_cast<size_t>(out.tellp());
+    const size_t padding = (indexSectionAlignment - position % indexSectionAlignment) % indexSectionAlignment;
+    out.write(zeros, padding);
+}
+
+void IndexFileWriter::beginSection(const char* tag) {
+    if (sectionOpen)
+        endSection();
+
+    align();
+
+    IndexSectionEntry entry;
+    memset(&entry, 0, sizeof(entry));
+    memcpy(entry.tag, tag, sizeof(entry.tag));
+    entry.offset = static_cast<uint64_t>(out.tellp());
+    sections.push_back(entry);
+    sectionOpen = true;
+}
+
+void IndexFileWriter::write(const void* data, size_t size) {
+    out.write(reinterpret_cast<const char*>(data), size);
+}
+
+void IndexFileWriter::writeMatrixHeader(int rows, int cols, int type) {
+    IndexMatrixHeader header;
+    memset(&header, 0, sizeof(header));
+    header.rows = rows;
+    header.cols = cols;
+    header.type = type;
+    header.step = static_cast<uint64_t>(cols) * CV_ELEM_SIZE(type);
+    write(&header, sizeof(header));
+}
+
+void IndexFileWriter::writeMatrix(const Mat& matrix) {
+    writeMatrixHeader(matrix.rows, matrix.cols, matrix.type());
+
+    // Row by row, so views and other non-continuous matrices are packed as well
+    const size_t rowBytes = static_cast<size_t>(matrix.cols) * matrix.elemSize();
+    for (int r = 0; r < matrix.rows; ++r)
+        write(matrix.ptr(r), rowBytes);
+}
+
+void IndexFileWriter::writeStrings(const vector<string>& strings) {
+    uint32_t counts[2] = { static_cast<uint32_t>(strings.size()), 0 };
+    write(counts, sizeof(counts));
+
+    vector<uint64_t> offsets(strings.size() + 1, 0);
+    for (size_t i = 0; i < strings.size(); ++i)
+        offsets[i + 1] = offsets[i] + strings[i].size();
+    write(offsets.data(), offsets.size() * sizeof(uint64_t));
+
+    for (const string& s : strings)
+        write(s.data(), s.size());
+}
+
+void IndexFileWriter::endSection() {
+    if (!sectionOpen)
+        return;
+
+    IndexSectionEntry& entry = sections.back();
+    entry.size = static_cast<uint64_t>(out.tellp()) - entry.offset;
+    sectionOpen = false;
+}
+
+bool IndexFileWriter::close() {
+    endSection();
+    align();
+
+    IndexFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, indexMagic, sizeof(header.magic));
+    header.version = indexFormatVersion;
+    header.sectionCount = static_cast<uint32_t>(sections.size());
+    header.tableOffset = static_cast<uint64_t>(out.tellp());
+
+    write(sections.data(), sections.size() * sizeof(IndexSectionEntry));
+
+    out.seekp(0);
+    write(&header, sizeof(header));
+
+    const bool ok = static_cast<bool>(out);
+    out.close();
+    return ok;
+}
+
+bool IndexFileReader::isIndexFile(const unsigned char* data, size_t size) {
+    return data && size >= sizeof(IndexFileHeader) && memcmp(data, indexMagic, sizeof(indexMagic)) == 0;
+}
+
+bool IndexFileReader::open(const unsigned char* data, size_t dataSize) {
+    base = nullptr;
+    size = 0;
+    sections.clear();
+    version = 0;
+
+    if (!isIndexFile(data, dataSize))
+        return false;
+
+    IndexFileHeader header;
+    memcpy(&header, data, sizeof(header));
+    if (header.version < indexOldestVersion || header.version > indexFormatVersion) {
+        cerr << "Unsupported index version: " << header.version << endl;
+        return false;
+    }
+    version = header.version;
+
+    if (header.tableOffset > dataSize || header.sectionCount > (dataSize - header.tableOffset) / sizeof(IndexSectionEntry)) {
+        cerr << "Corrupted index: section table out of bounds" << endl;
+        return false;
+    }
+
+    sections.resize(header.sectionCount);
+    memcpy(sections.data(), data + header.tableOffset, header.sectionCount * sizeof(IndexSectionEntry));
+
+    for (const IndexSectionEntry& entry : sections) {
+        if (entry.offset > dataSize || entry.size > dataSize - entry.offset) {
+            cerr << "Corrupted index: section " << string(entry.tag, sizeof(entry.tag)) << " out of bounds" << endl;
+            sections.clear();
+            return false;
+        }
+    }
+
+    base = data;
+    size = dataSize;
+    return true;
+}
+
+bool IndexFileReader::findSection(const char* tag, const unsigned char*& sectionData, size_t& sectionSize) const {
+    for (const IndexSectionEntry& entry : sections) {
+        if (memcmp(entry.tag, tag, sizeof(entry.tag)) == 0) {
+            sectionData = base + entry.offset;
+            sectionSize = static_cast<size_t>(entry.size);
+            return true;
+        }
+    }
+    return false;
+}
+
+uint32_t IndexFileReader::getVersion() const {
+    return version;
+}
+
+bool IndexFileReader::readMatrix(const unsigned char* data, size_t size, Mat& matrix) {
+    if (size < sizeof(IndexMatrixHeader))
+        return false;
+
+    IndexMatrixHeader header;
+    memcpy(&header, data, sizeof(header));
+    if (header.rows < 0 || header.cols < 0 || header.step != static_cast<uint64_t>(header.cols) * CV_ELEM_SIZE(header.type))
+        return false;
+
+    const uint64_t bytes = static_cast<uint64_t>(header.rows) * header.step;
+    if (bytes > size - sizeof(IndexMatrixHeader))
+        return false;
+
+    if (header.rows == 0 || header.cols == 0) {
+        matrix = Mat();
+        return true;
+    }
+
+    // The view points into the (read-only) file content: no copy is made
+    matrix = Mat(header.rows, header.cols, header.type,
+        const_cast<unsigned char*>(data + sizeof(IndexMatrixHeader)), static_cast<size_t>(header.step));
+    return true;
+}
+
+bool IndexFileReader::readStrings(const unsigned char* data, size_t size, vector<string>& strings) {
+    strings.clear();
+    if (size < 2 * sizeof(uint32_t))
+        return false;
+
+    uint32_t count = 0;
+    memcpy(&count, data, sizeof(count));
+
+    const size_t tableStart = 2 * sizeof(uint32_t);
+    if (count >= (size - tableStart) / sizeof(uint64_t))
+        return false;
+
+    vector<uint64_t> offsets(static_cast<size_t>(count) + 1);
+    memcpy(offsets.data(), data + tableStart, offsets.size() * sizeof(uint64_t));
+
+    const size_t charsStart = tableStart + offsets.size() * sizeof(uint64_t);
+    const size_t charsSize = size - charsStart;
+    if (offsets[count] > charsSize)
+        return false;
+
+    strings.resize(count);
+    for (uint32_t i = 0; i < count; ++i) {
+        if (offsets[i] > offsets[i + 1])
+            return false;
+        strings[i].assign(reinterpret_cast<const char*>(data + charsStart + offsets[i]), static_cast<size_t>(offsets[i + 1] - offsets[i]));
+    }
+    return true;
+}
@@ -0,0 +1,246 @@
+#pragma once
+
+#include <opencv2/opencv.hpp>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace cv;
+
+/*
+ * Layout of index.bin (all integers little-endian):
+ *
+ *   IndexFileHeader      64 bytes, magic + offset of the section table
+ *   section payloads     each one starting on a 64-byte boundary
+ *   section table        sectionCount x IndexSectionEntry
+ *
+ * A matrix payload is an IndexMatrixHeader (64 bytes) followed by the packed rows, so the
+ * data of a matrix section is 64-byte aligned in the file and in its memory mapping and can
+ * be used in place as a cv::Mat. Unknown sections are ignored by readers, so new sections can
+ * be added without breaking older code.
+ */
+
+static const char indexMagic[8] = { 'C', 'B', 'I', 'R', 'I', 'D', 'X', '\0' };  ///< First bytes of an index file
+static const uint32_t indexFormatVersion = 2;       ///< Version written in the header (2: one-pass HOG descriptor)
+static const uint32_t indexOldestVersion = 1;       ///< Oldest version readers accept
+static const size_t indexSectionAlignment = 64;     ///< Alignment of every section payload
+
+static const char indexSectionVocabulary[] = "VOCB";    ///< Flat BoVW vocabulary (matrix)
+static const char indexSectionTree[] = "TREE";          ///< Vocabulary tree: int32 branch factor, int32 depth, node centers (matrix)
+static const char indexSectionDescriptors[] = "DESC";   ///< One descriptor per image (matrix, row i = image i)
+static const char indexSectionIds[] = "IDS ";           ///< Image IDs (string table, entry i = image i)
+static const char indexSectionPqCodebook[] = "PQCB";    ///< Product quantizer: int32 subspace count, int32 zero, codebook (matrix)
+static const char indexSectionPqCodes[] = "PQCD";       ///< One product-quantized code per image (CV_8U matrix), replaces DESC
+static const char indexSectionHogLayout[] = "HOGL";     ///< Block HOG layout: int32 cellsX, cellsY, blockCells, bins
+
+/**
+ * @struct IndexFileHeader
+ * @brief Fixed-size header at the start of an index file.
+ */
+struct IndexFileHeader {
+    char magic[8];              ///< `indexMagic`
+    uint32_t version;           ///< `indexFormatVersion`
+    uint32_t sectionCount;      ///< Number of entries in the section table
+    uint64_t tableOffset;       ///< File offset of the section table
+    uint8_t reserved[40];       ///< Zero
+};
+
+/**
+ * @struct IndexSectionEntry
+ * @brief Location of one section payload.
+ */
+struct IndexSectionEntry {
+    char tag[4];                ///< Four-character section name
+    uint32_t reserved;          ///< Zero
+    uint64_t offset;            ///< File offset of the payload (multiple of `indexSectionAlignment`)
+    uint64_t size;              ///< Payload size in bytes
+};
+
+/**
+ * @struct IndexMatrixHeader
+ * @brief Shape of a matrix stored in a section; the packed rows follow immediately.
+ */
+struct IndexMatrixHeader {
+    int32_t rows;               ///< Number of rows
+    int32_t cols;               ///< Number of columns
+    int32_t type;               ///< OpenCV type (e.g., CV_32F)
+    int32_t reserved;           ///< Zero
+    uint64_t step;              ///< Bytes per row
+    uint8_t padding[40];        ///< Zero, keeps the rows 64-byte aligned
+};
+
+static_assert(sizeof(IndexFileHeader) == 64, "IndexFileHeader must be 64 bytes");
+static_assert(sizeof(IndexSectionEntry) == 24, "IndexSectionEntry must be 24 bytes");
+static_assert(sizeof(IndexMatrixHeader) == 64, "IndexMatrixHeader must be 64 bytes");
+
+/**
+ * @class IndexFileWriter
+ * @brief Writes an index file section by section.
+ *
+ * Sections are streamed to disk as they are produced; the section table is appended by
+ * `close()` and its offset patched into the header.
+ */
+class IndexFileWriter {
+private:
+    ofstream out;                           ///< Output file
+    vector<IndexSectionEntry> sections;     ///< Sections written so far
+    bool sectionOpen = false;               ///< True between `beginSection()` and `endSection()`
+
+    /**
+     * @brief Writes zero bytes up to the next multiple of `indexSectionAlignment`.
+     *
+     * @return void
+     */
+    void align();
+
+public:
+    /**
+     * @brief Creates (or truncates) the file and writes a placeholder header.
+     *
+     * @param[in] path   Path of the index file.
+     *
+     * @return True if the file could be opened.
+     */
+    bool open(const string& path);
+
+    /**
+     * @brief Starts a new section at the next aligned offset.
+     *
+     * @param[in] tag   Four-character section name (e.g., `indexSectionDescriptors`).
+     *
+     * @return void
+     */
+    void beginSection(const char* tag);
+
+    /**
+     * @brief Appends raw bytes to the current section.
+     *
+     * @param[in] data   Bytes to write.
+     * @param[in] size   Number of bytes.
+     *
+     * @return void
+     */
+    void write(const void* data, size_t size);
+
+    /**
+     * @brief Appends a matrix header; the caller then writes `rows` packed rows.
+     *
+     * @param[in] rows   Number of rows.
+     * @param[in] cols   Number of columns.
+     * @param[in] type   OpenCV type.
+     *
+     * @return void
+     */
+    void writeMatrixHeader(int rows, int cols, int type);
+
+    /**
+     * @brief Appends a whole matrix (header and packed rows).
+     *
+     * @param[in] matrix   Matrix to write (any type, 2D).
+     *
+     * @return void
+     */
+    void writeMatrix(const Mat& matrix);
+
+    /**
+     * @brief Appends a string table: uint32 count, uint32 zero, uint64 offsets[count + 1], characters.
+     *
+     * @param[in] strings   Strings to write.
+     *
+     * @return void
+     */
+    void writeStrings(const vector<string>& strings);
+
+    /**
+     * @brief Closes the current section and records its size.
+     *
+     * @return void
+     */
+    void endSection();
+
+    /**
+     * @brief Writes the section table, patches the header and closes the file.
+     *
+     * @return True if every write succeeded.
+     */
+    bool close();
+};
+
+/**
+ * @class IndexFileReader
+ * @brief Locates the sections of an index file held in memory (typically a `MappedFile`).
+ *
+ * The reader never copies payloads: it hands out pointers into the buffer, which must stay
+ * valid while they are used.
+ */
+class IndexFileReader {
+private:
+    const unsigned char* base = nullptr;    ///< Start of the file content
+    size_t size = 0;                        ///< Size of the file content
+    vector<IndexSectionEntry> sections;     ///< Validated section table
+    uint32_t version = 0;                   ///< Format version of the file
+
+public:
+    /**
+     * @brief Tells whether a buffer starts with the index file magic.
+     *
+     * @param[in] data   File content.
+     * @param[in] size   Size in bytes.
+     *
+     * @return True if the buffer is in the sectioned format (as opposed to the legacy format).
+     */
+    static bool isIndexFile(const unsigned char* data, size_t size);
+
+    /**
+     * @brief Parses and validates the header and section table.
+     *
+     * @param[in] data   File content.
+     * @param[in] size   Size in bytes.
+     *
+     * @return True if the file is well formed.
+     */
+    bool open(const unsigned char* data, size_t size);
+
+    /**
+     * @brief Finds a section by tag.
+     *
+     * @param[in]  tag           Four-character section name.
+     * @param[out] sectionData   Start of the payload.
+     * @param[out] sectionSize   Payload size in bytes.
+     *
+     * @return True if the section exists.
+     */
+    bool findSection(const char* tag, const unsigned char*& sectionData, size_t& sectionSize) const;
+
+    /**
+     * @brief Gets the format version of the opened file.
+     *
+     * @return The version written in the header, between `indexOldestVersion` and `indexFormatVersion`.
+     */
+    uint32_t getVersion() const;
+
+    /**
+     * @brief Builds a matrix header on a matrix payload without copying the data.
+     *
+     * @param[in]  data     Start of the matrix payload.
+     * @param[in]  size     Bytes available from `data`.
+     * @param[out] matrix   Read-only view on the rows; must not be written to.
+     *
+     * @return True if the payload holds a complete matrix.
+     */
+    static bool readMatrix(const unsigned char* data, size_t size, Mat& matrix);
+
+    /**
+     * @brief Decodes a string table written by `IndexFileWriter::writeStrings()`.
+     *
+     * @param[in]  data      Start of the string table.
+     * @param[in]  size      Bytes available from `data`.
+     * @param[out] strings   Decoded strings.
+     *
+     * @return True if the table is well formed.
+     */
+    static bool readStrings(const unsigned char* data, size_t size, vector<string>& strings);
+};
@@ -5,101 +5,371 @@
 #include "ORB.h"
 #include "HOG.h"
 
-Indexer::~Indexer() {
-	for (auto& [id, featurePtr] : features) {
-		delete featurePtr;
-	}
-	features.clear();
-}
-
-void Indexer::indexingImageDatabase(string imageDatabasePath, string selectedFeature, ImageDatabase imageDatabase, Log& log, int vocabularySize) {
+void Indexer::indexingImageDatabase(string imageDatabasePath, string selectedFeature, ImageDatabase& imageDatabase, Log& log, int vocabularySize) {
 	Mat labels, centers;
 	vector<Feature*> extractedFeatures;
 
+	// Local feature indexes are stored per vocabulary size
+	if ((selectedFeature == "SIFT" || selectedFeature == "ORB") && !pretrainedVocabulary.empty())
+		vocabularySize = pretrainedVocabulary.rows;
+	else if ((selectedFeature == "SIFT" || selectedFeature == "ORB") && treeBranchFactor > 0)
+		vocabularySize = VocabularyTree::wordCount(treeBranchFactor, treeDepth);
+
 	// Extract features from all images in the database
 	extractFeatureImageDatabase(imageDatabasePath, selectedFeature, imageDatabase, extractedFeatures, log, vocabularySize);
 
 	// Create an index based on the clustering result and save to disk
 	saveIndex(imageDatabasePath, selectedFeature, extractedFeatures, log, vocabularySize);
 
+	// The descriptors now live in the feature store
+	for (Feature* feature : extractedFeatures)
+		delete feature;
+
 	// Log completion of index saving
 	log.writeToFeatureDatabaseLog("Save index done");
 }
 
-void Indexer::extractFeatureImageDatabase(string imageDatabasePath, string selectedFeature, ImageDatabase database, vector<Feature*>& extractedFeatures, Log& log, int dictionarySize) {
-	// Extract Color Histogram features
-	if (selectedFeature == "Color Histogram") {
-		for (int i = 0; i < database.getImage().size(); i++) {
-			Feature* colorhistogram = new ColorHistogram;
-			cout << "Current Image: " << database.getImage()[i].getId() << endl;
-			colorhistogram->createFeature(database.getImage()[i].getId(), database.getImage()[i].getImg());
-			extractedFeatures.push_back(colorhistogram);
+void Indexer::indexingImageDatabase(string imageDatabasePath, const vector<string>& selectedFeatures, ImageDatabase& database, Log& log, int vocabularySize) {
+	for (size_t f = 0; f < selectedFeatures.size(); ++f) {
+		if (!isSupportedFeature(selectedFeatures[f])) {
+			cerr << "Unsupported feature type: " << selectedFeatures[f] << endl;
+			return;
 		}
-	}
-	// Extract Color Correlogram features
-	else if (selectedFeature == "Color Correlogram") {
-		for (int i = 0; i < database.getImage().size(); i++) {
-			Feature* colorcorrelogram = new ColorCorrelogram;
-			cout << "Current Image: " << database.getImage()[i].getId() << endl;
-			colorcorrelogram->createFeature(database.getImage()[i].getId(), database.getImage()[i].getImg());
-			extractedFeatures.push_back(colorcorrelogram);
+		if (find(selectedFeatures.begin(), selectedFeatures.begin() + f, selectedFeatures[f]) != selectedFeatures.begin() + f) {
+			cerr << "Feature type selected twice: " << selectedFeatures[f] << endl;
+			return;
 		}
 	}
-	// Extract HOG features (Note: Bug fixed  was incorrectly using ORBFeature)
-	else if (selectedFeature == "HOG") {
-		for (int i = 0; i < database.getImage().size(); i++) {
-			Feature* hog = new HOG;
-			cout << "Current Image: " << database.getImage()[i].getId() << endl;
-			hog->createFeature(database.getImage()[i].getId(), database.getImage()[i].getImg());
-			extractedFeatures.push_back(hog);
+	if (selectedFeatures.size() < 2) {
+		if (!selectedFeatures.empty())
+			indexingImageDatabase(imageDatabasePath, selectedFeatures[0], database, log, vocabularySize);
+		return;
+	}
+
+	if (pipelineMode || !pretrainedVocabulary.empty())
+		log.writeToFeatureDatabaseLog("Multi-feature extraction runs the per-image loop and trains its own vocabularies");
+
+	// Step 1: Decode and convert each image once, then extract every feature from it
+	const size_t featureCount = selectedFeatures.size();
+	const size_t imageCount = database.getImageCount();
+	vector<vector<Feature*>> slots(featureCount, vector<Feature*>(imageCount, nullptr));
+	ThreadPool pool(threadCount);
+	mutex logMutex;
+
+	string methods;
+	for (const string& method : selectedFeatures)
+		methods += (methods.empty() ? "" : ", ") + method;
+	log.writeToFeatureDatabaseLog("Extracting " + methods + " with " + to_string(pool.getThreadCount()) + " threads");
+
+	pool.parallelFor(imageCount, [&](size_t i) {
+		Image image;
+		if (!database.loadImage(i, image)) {
+			lock_guard<mutex> lock(logMutex);
+			log.writeToImageDatabaseLog("Failed to load image: " + database.getImagePaths()[i]);
+			return;
+		}
+
+		// HOG variants share one gradient pass, the other features read the shared planes
+		vector<Feature*> features(featureCount);
+		vector<HOG*> hogs;
+		unsigned planes = 0;
+		for (size_t f = 0; f < featureCount; ++f) {
+			features[f] = createFeatureObject(selectedFeatures[f], geometricKeypoints, hogLayout);
+			planes |= features[f]->getRequiredPlanes();
+			if (HOG* hog = dynamic_cast<HOG*>(features[f]))
+				hogs.push_back(hog);
+		}
+
+		const ImagePlanes shared(image.getImg(), planes);
+		if (!hogs.empty())
+			HOG::createFeatures(image.getId(), shared.bgr, hogs);
+		for (size_t f = 0; f < featureCount; ++f) {
+			if (!dynamic_cast<HOG*>(features[f]))
+				features[f]->createFeatureFromPlanes(image.getId(), shared);
+			slots[f][i] = features[f];
 		}
+
+		lock_guard<mutex> lock(logMutex);
+		cout << "Current Image: " << image.getId() << endl;
+	});
+
+	// Step 2: One index per feature, built and saved one after the other
+	for (size_t f = 0; f < featureCount; ++f) {
+		const string& selectedFeature = selectedFeatures[f];
+		int dictionarySize = vocabularySize;
+		if ((selectedFeature == "SIFT" || selectedFeature == "ORB") && treeBranchFactor > 0)
+			dictionarySize = VocabularyTree::wordCount(treeBranchFactor, treeDepth);
+
+		vector<Feature*> extractedFeatures;
+		convertExtractedFeatures(selectedFeature, slots[f], nullptr, false, pool, extractedFeatures, log, dictionarySize);
+		saveIndex(imageDatabasePath, selectedFeature, extractedFeatures, log, dictionarySize);
+
+		for (Feature* feature : extractedFeatures)
+			delete feature;
+		log.writeToFeatureDatabaseLog("Save " + selectedFeature + " index done");
+	}
+}
+
+void Indexer::extractFeatureImageDatabase(string imageDatabasePath, string selectedFeature, ImageDatabase& database, vector<Feature*>& extractedFeatures, Log& log, int dictionarySize) {
+	if (!isSupportedFeature(selectedFeature)) {
+		cerr << "Unsupported feature type: " << selectedFeature << endl;
+		return;
+	}
+
+	bool isLocalFeature = (selectedFeature == "SIFT" || selectedFeature == "ORB");
+
+	// A vocabulary taken from an existing index lets local descriptors be quantized during extraction
+	BagOfVisualWord pretrained(pretrainedVocabulary);
+	if (!pretrainedVocabularyTree.empty())
+		pretrained.setVocabularyTree(pretrainedVocabularyTree);
+	BagOfVisualWord* quantizer = (isLocalFeature && !pretrainedVocabulary.empty()) ? &pretrained : nullptr;
+
+	ThreadPool pool(threadCount);
+	mutex logMutex;
+
+	// Step 1: Extract features. Every image owns a preallocated slot,
+	// so the output order does not depend on which worker handled which image.
+	size_t imageCount = database.getImageCount();
+	vector<Feature*> slots(imageCount, nullptr);
+	bool quantized = false;
+
+	if (pipelineMode) {
+		// Overlapping read -> decode -> extract (-> quantize) stages connected by bounded queues
+		log.writeToFeatureDatabaseLog("Extracting " + selectedFeature + " with the staged pipeline");
+		ExtractionPipeline pipeline(threadCount, pipelineQueueCapacity);
+		pipeline.run(database.getImagePaths(), [&]() { return createFeatureObject(selectedFeature, geometricKeypoints, hogLayout); }, quantizer, slots, log);
+		pipeline.report(log);
+		quantized = (quantizer != nullptr);
+	}
+	else {
+		log.writeToFeatureDatabaseLog("Extracting " + selectedFeature + " with " + to_string(pool.getThreadCount()) + " threads");
+		pool.parallelFor(imageCount, [&](size_t i) {
+			// Each worker decodes its own image, which is released as soon as the feature is computed
+			Image image;
+			if (!database.loadImage(i, image)) {
+				lock_guard<mutex> lock(logMutex);
+				log.writeToImageDatabaseLog("Failed to load image: " + database.getImagePaths()[i]);
+				return;
+			}
+
+			Feature* feature = createFeatureObject(selectedFeature, geometricKeypoints, hogLayout);
+			feature->createFeature(image.getId(), image.getImg());
+			slots[i] = feature;
+
+			lock_guard<mutex> lock(logMutex);
+			cout << "Current Image: " << image.getId() << endl;
+		});
+	}
+
+	convertExtractedFeatures(selectedFeature, slots, quantizer, quantized, pool, extractedFeatures, log, dictionarySize);
+}
+
+void Indexer::convertExtractedFeatures(const string& selectedFeature, const vector<Feature*>& slots, BagOfVisualWord* quantizer, bool quantized, ThreadPool& pool, vector<Feature*>& extractedFeatures, Log& log, int dictionarySize) {
+	bool isLocalFeature = (selectedFeature == "SIFT" || selectedFeature == "ORB");
+
+	// Only local features carry a vocabulary
+	vocabulary.release();
+	vocabularyTree = VocabularyTree();
+
+	// Keep successfully extracted features in database order
+	vector<Feature*> rawFeatures;
+	rawFeatures.reserve(slots.size());
+	for (Feature* feature : slots) {
+		if (feature)
+			rawFeatures.push_back(feature);
 	}
-	else if (selectedFeature == "SIFT" || selectedFeature == "ORB") {
-		vector<Mat> allDescriptors;
-		vector<Feature*> rawFeatures;
-		Feature* feat = nullptr;
-
-		// Step 1: Extract raw descriptors
-		for (int i = 0; i < database.getImage().size(); i++) {
-			if (selectedFeature == "SIFT")
-				feat = static_cast<Feature*>(new SIFTFeature);
-			else if (selectedFeature == "ORB")
-				feat = static_cast<Feature*>(new ORBFeature);
-			else if (selectedFeature == "HOG")
-				feat = static_cast<Feature*>(new HOG);
-
-			cout << "Current Image: " << database.getImage()[i].getId() << endl;
-			feat->createFeature(database.getImage()[i].getId(), database.getImage()[i].getImg());
-			rawFeatures.push_back(feat);
 
+	// Global features are used as they are
+	if (!isLocalFeature) {
+		extractedFeatures.insert(extractedFeatures.end(), rawFeatures.begin(), rawFeatures.end());
+		return;
+	}
+
+	// Local features (SIFT, ORB) are converted to Bag of Visual Words histograms,
+	// using either a flat vocabulary or a vocabulary tree
+	BagOfVisualWord bovw = (treeBranchFactor > 0) ? BagOfVisualWord(treeBranchFactor, treeDepth) : BagOfVisualWord(dictionarySize);
+	bovw.setThreadCount(threadCount);
+	bovw.setMiniBatchTraining(miniBatchSize, trainingSampleSize);
+	if (quantizer) {
+		bovw = *quantizer;
+		log.writeToFeatureDatabaseLog("Using pretrained vocabulary of " + to_string(pretrainedVocabulary.rows) + " words");
+	}
+	else {
+		vector<Mat> allDescriptors;
+		for (Feature* feat : rawFeatures) {
 			Mat desc = feat->getDescriptor();
 			if (!desc.empty() && desc.rows > 1)
 				allDescriptors.push_back(desc);
 		}
 		cout << allDescriptors.size() << endl;
+
 		// Step 2: Build BoVW vocabulary
-		BagOfVisualWord bovw(dictionarySize);
 		bovw.buildVocabulary(allDescriptors);
+	}
 
-		// Save vocabulary to use later in indexing
-		this->vocabulary = bovw.getVocabulary();
+	// Save vocabulary to use later in indexing
+	this->vocabulary = bovw.getVocabulary();
+	this->vocabularyTree = bovw.getVocabularyTree();
 
-		// Step 3: Convert descriptors to BoVW histograms
-		for (Feature* feat : rawFeatures) {
-			Mat hist = bovw.computeHistogram(feat->getDescriptor());
-			feat->setDescriptor(hist);
-			extractedFeatures.push_back(feat);
-		}
+	// Step 3: Convert descriptors to BoVW histograms, in parallel and in place
+	if (!quantized) {
+		pool.parallelFor(rawFeatures.size(), [&](size_t i) {
+			Mat hist = bovw.computeHistogram(rawFeatures[i]->getDescriptor());
+			rawFeatures[i]->setDescriptor(hist);
+		});
 	}
+
+	extractedFeatures.insert(extractedFeatures.end(), rawFeatures.begin(), rawFeatures.end());
+}
+
+bool Indexer::isSupportedFeature(string selectedFeature) {
+	const vector<string> methods = supportedFeatures();
+	return find(methods.begin(), methods.end(), selectedFeature) != methods.end();
+}
+
+vector<string> Indexer::supportedFeatures() {
+	return { "Color Histogram", "Color Correlogram", "Color Correlogram Exact", "HOG", "Block HOG", "SIFT", "ORB" };
+}
+
+Feature* Indexer::createFeatureObject(string selectedFeature, int keypointLimit, const HOGLayout& layout) {
+	Feature* feature = nullptr;
+	if (selectedFeature == "Color Histogram")
+		feature = new ColorHistogram();
+	else if (selectedFeature == "Color Correlogram")
+		feature = new ColorCorrelogram();
+	else if (selectedFeature == "Color Correlogram Exact")
+		feature = new ColorCorrelogram(CorrelogramMode::Exact);
+	else if (selectedFeature == "HOG")
+		feature = new HOG();
+	else if (selectedFeature == "Block HOG")
+		feature = new HOG(HOGMode::Block, layout);
+	else if (selectedFeature == "SIFT")
+		feature = new SIFTFeature();
+	else if (selectedFeature == "ORB")
+		feature = new ORBFeature();
+
+	if (feature)
+		feature->setKeypointLimit(keypointLimit);
+	return feature;
+}
+
+void Indexer::setThreadCount(int count) {
+	threadCount = count;
+}
+
+int Indexer::getThreadCount() {
+	return threadCount;
+}
+
+void Indexer::setPipelineMode(bool enabled, size_t queueCapacity) {
+	pipelineMode = enabled;
+	pipelineQueueCapacity = queueCapacity;
+}
+
+void Indexer::setPretrainedVocabulary(Mat vocab, const VocabularyTree& tree) {
+	pretrainedVocabulary = vocab.clone();
+	pretrainedVocabularyTree = tree;
+}
+
+void Indexer::setVocabularyTree(int branchFactor, int depth) {
+	if (branchFactor > 0 && VocabularyTree::wordCount(branchFactor, depth) == 0) {
+		cerr << "Invalid vocabulary tree shape, using a flat vocabulary" << endl;
+		branchFactor = 0;
+	}
+	treeBranchFactor = branchFactor;
+	treeDepth = depth;
+}
+
+void Indexer::setMiniBatchTraining(int batchSize, int sampleSize) {
+	miniBatchSize = batchSize;
+	trainingSampleSize = sampleSize;
+}
+
+const VocabularyTree& Indexer::getVocabularyTree() {
+	return vocabularyTree;
+}
+
+void Indexer::setHnswGraph(int M, int efConstruction) {
+	hnswM = M;
+	hnswEfConstruction = efConstruction;
+}
+
+const HnswIndex& Indexer::getHnswIndex() {
+	return hnswIndex;
+}
+
+void Indexer::setIvfLists(int listCount) {
+	ivfListCount = listCount;
+}
+
+void Indexer::setProductQuantization(int subspaces) {
+	pqSubspaces = subspaces;
+}
+
+const IvfIndex& Indexer::getIvfIndex() {
+	return ivfIndex;
+}
+
+void Indexer::setInvertedIndex(bool enabled, bool packed) {
+	invertedIndexEnabled = enabled;
+	invertedIndexPacked = packed;
+}
+
+const InvertedIndex& Indexer::getInvertedIndex() {
+	return invertedIndex;
+}
+
+void Indexer::setGeometricVerification(int keypointsPerImage) {
+	geometricKeypoints = keypointsPerImage;
+}
+
+void Indexer::setVerificationModel(VerificationModel model) {
+	// The epipolar distance of an inlier is tighter than a reprojection error
+	geometricVerifier.setParameters(model, model == VerificationModel::Fundamental ? 3.0 : 5.0);
+}
+
+const GeometricVerifier& Indexer::getGeometricVerifier() {
+	return geometricVerifier;
+}
+
+void Indexer::setHogLayout(const HOGLayout& layout) {
+	hogLayout = layout;
+}
+
+const HOGLayout& Indexer::getHogLayout() {
+	return indexHogLayout;
 }
 
 bool Indexer::saveIndex(string indexPath, string selectedFeature, vector<Feature*>& extractedFeatures, Log& log, int dictionarySize) {
-	// 1. Save features as map<string, Feature*>
+	// The graph points into the feature store, which is replaced below
+	hnswIndex.clear();
+	ivfIndex.clear();
+	invertedIndex.clear();
+	geometricVerifier.clear();
+	indexHogLayout = selectedFeature == "Block HOG" ? hogLayout : HOGLayout();
+
+	// 1. Gather the descriptors into the dense feature store, ordered by image ID
 	map<string, Feature*> features;
 	for (Feature* f : extractedFeatures) {
+		const Mat& desc = f->getDescriptor();
+		if (desc.empty()) continue;
+
+		CV_Assert(desc.rows == 1 && desc.type() == CV_32F);
 		features[f->getId()] = f;  // override if duplicate ID
 	}
 
+	Mat descriptors;
+	vector<string> ids;
+	vector<LocalFeatures> keypoints;
+	ids.reserve(features.size());
+	for (const auto& [imageId, f] : features) {
+		descriptors.push_back(f->getDescriptor());
+		ids.push_back(imageId);
+		if (geometricKeypoints > 0)
+			keypoints.push_back(f->getLocalFeatures());
+	}
+	featureStore.assign(descriptors, ids);
+
 	// 2. Prepare output path
 	if (selectedFeature == "HOG" || selectedFeature == "SIFT" || selectedFeature == "ORB")
 		indexPath = utils.extractPath(indexPath) + "extracted_feature/" + utils.extractFileName(indexPath) + "/" + selectedFeature + "/" + to_string(dictionarySize);
@@ -109,57 +379,124 @@ bool Indexer::saveIndex(string indexPath, string selectedFeature, vector<Feature
 	createFolderIfNotExists(indexPath);
 	string indexFile = indexPath + "/index.bin";
 
-	ofstream out(indexFile, ios::binary | ios::trunc);
-	if (!out) {
+	IndexFileWriter writer;
+	if (!writer.open(indexFile)) {
 		cerr << "Failed to open file for writing: " << indexFile << endl;
 		return false;
 	}
 
 	// 3. Save vocabulary (for BoVW)
-	if (!vocabulary.empty()) {
-		int vocabRows = vocabulary.rows;
-		int vocabCols = vocabulary.cols;
-		int vocabType = vocabulary.type();
-
-		out.write(reinterpret_cast<char*>(&vocabRows), sizeof(int));
-		out.write(reinterpret_cast<char*>(&vocabCols), sizeof(int));
-		out.write(reinterpret_cast<char*>(&vocabType), sizeof(int));
+	if (!vocabularyTree.empty()) {
+		int32_t shape[2] = { vocabularyTree.getBranchFactor(), vocabularyTree.getDepth() };
+		writer.beginSection(indexSectionTree);
+		writer.write(shape, sizeof(shape));
+		writer.writeMatrix(vocabularyTree.getNodeCenters());
+		writer.endSection();
+	}
+	else if (!vocabulary.empty()) {
+		writer.beginSection(indexSectionVocabulary);
+		writer.writeMatrix(vocabulary);
+		writer.endSection();
+	}
 
-		Mat vocabCont = vocabulary.isContinuous() ? vocabulary : vocabulary.clone();
-		out.write(reinterpret_cast<const char*>(vocabCont.data), vocabRows * vocabCols * vocabCont.elemSize());
+	// 4. Save descriptors as one contiguous block (row i = image i), or their product-quantized
+	//    codes, and the IDs as a string table
+	shared_ptr<ProductQuantizer> quantizer;
+	Mat codes;
+	if (pqSubspaces > 0 && !featureStore.empty()) {
+		quantizer = make_shared<ProductQuantizer>();
+		if (!quantizer->train(featureStore.getDescriptors(), pqSubspaces, threadCount, miniBatchSize, trainingSampleSize)) {
+			writer.close();
+			return false;
+		}
+		codes = quantizer->encode(featureStore.getDescriptors());
+
+		int32_t shape[2] = { quantizer->getSubspaceCount(), 0 };
+		writer.beginSection(indexSectionPqCodebook);
+		writer.write(shape, sizeof(shape));
+		writer.writeMatrix(quantizer->getCodebook());
+		writer.endSection();
+
+		writer.beginSection(indexSectionPqCodes);
+		writer.writeMatrix(codes);
+		writer.endSection();
+		log.writeToFeatureDatabaseLog("Product quantization: " + to_string(quantizer->getSubspaceCount()) + " bytes per image");
 	}
 	else {
-		int zero = 0;
-		out.write(reinterpret_cast<char*>(&zero), sizeof(int)); // rows = 0
-		out.write(reinterpret_cast<char*>(&zero), sizeof(int)); // cols = 0
-		out.write(reinterpret_cast<char*>(&zero), sizeof(int)); // type = 0
+		writer.beginSection(indexSectionDescriptors);
+		writer.writeMatrix(featureStore.getDescriptors());
+		writer.endSection();
 	}
 
-	// 4. Save descriptors (one per image ID)
-	int featureCount = features.size();
-	out.write(reinterpret_cast<char*>(&featureCount), sizeof(int));
-	for (const auto& [imageId, f] : features) {
-		int idLen = imageId.size();
-		out.write(reinterpret_cast<const char*>(&idLen), sizeof(int));
-		out.write(imageId.c_str(), idLen);
+	writer.beginSection(indexSectionIds);
+	writer.writeStrings(featureStore.getIds());
+	writer.endSection();
 
-		const Mat& desc = f->getDescriptor();
-		if (desc.empty()) continue;
+	// Block HOG queries must be extracted with the layout of the index
+	if (selectedFeature == "Block HOG") {
+		int32_t layout[4] = { hogLayout.cellsX, hogLayout.cellsY, hogLayout.blockCells, hogLayout.bins };
+		writer.beginSection(indexSectionHogLayout);
+		writer.write(layout, sizeof(layout));
+		writer.endSection();
+	}
 
-		CV_Assert(desc.rows == 1 && desc.type() == CV_32F);
+	// 5. Partition the descriptors into IVF lists (row numbers only, the descriptors are not copied)
+	if (ivfListCount > 0 && !featureStore.empty()) {
+		if (ivfIndex.train(featureStore.getDescriptors(), ivfListCount, threadCount, miniBatchSize, trainingSampleSize)) {
+			ivfIndex.write(writer);
+			log.writeToFeatureDatabaseLog("IVF lists: " + to_string(ivfIndex.getListCount()));
+		}
+	}
 
-		int rows = desc.rows;
-		int cols = desc.cols;
-		int type = desc.type();
+	// 6. Posting lists of the BoVW histograms, word by word, with TF-IDF weights
+	if (invertedIndexEnabled && !vocabulary.empty() && !featureStore.empty()) {
+		if (invertedIndex.build(featureStore.getDescriptors(), invertedIndexPacked)) {
+			invertedIndex.write(writer);
+			log.writeToFeatureDatabaseLog("Inverted index: " + to_string(invertedIndex.getPostingCount()) + " postings over "
+				+ to_string(invertedIndex.getWordCount()) + " words, " + to_string(invertedIndex.getPostingBytes()) + " bytes"
+				+ (invertedIndex.isCompressed() ? " (packed)" : ""));
+		}
+	}
 
-		out.write(reinterpret_cast<char*>(&rows), sizeof(int));
-		out.write(reinterpret_cast<char*>(&cols), sizeof(int));
-		out.write(reinterpret_cast<char*>(&type), sizeof(int));
-		out.write(reinterpret_cast<const char*>(desc.data), rows * cols * sizeof(float));
+	// 7. Strongest keypoints of each image, for the geometric verification of query results
+	if (geometricKeypoints > 0 && (selectedFeature == "SIFT" || selectedFeature == "ORB")) {
+		if (geometricVerifier.build(keypoints, selectedFeature == "ORB" ? NORM_HAMMING : NORM_L2, geometricKeypoints)) {
+			geometricVerifier.write(writer);
+			log.writeToFeatureDatabaseLog("Geometric verification: " + to_string(geometricVerifier.getKeypointCount()) + " keypoints");
+		}
+	}
+
+	if (!writer.close()) {
+		cerr << "Failed to write index: " << indexFile << endl;
+		return false;
 	}
 
-	out.close();
 	log.writeToFeatureDatabaseLog("Index saved to: " + indexFile);
+
+	// The float descriptors are released, the store keeps what the file holds
+	if (quantizer)
+		featureStore.assignEncoded(codes, quantizer, featureStore.getIds());
+
+	// 8. Build the HNSW graph over the stored descriptors and save it next to index.bin
+	string hnswFile = indexPath + "/hnsw.bin";
+	if (hnswM > 0 && featureStore.isEncoded())
+		cout << "No HNSW graph for a product-quantized index." << endl;
+	if (hnswM <= 0 || featureStore.empty() || featureStore.isEncoded()) {
+		error_code ec;
+		fs::remove(hnswFile, ec);  // a graph left by an earlier run would not match the new index
+		return true;
+	}
+
+	HnswMetric metric = (selectedFeature == "Color Histogram" || selectedFeature == "Color Correlogram"
+		|| selectedFeature == "Color Correlogram Exact") ? HnswMetric::ChiSquare : HnswMetric::L2;
+	hnswIndex.setParameters(hnswM, hnswEfConstruction);
+	hnswIndex.build(featureStore.getRow(0), featureStore.size(), featureStore.getDimensions(), metric, threadCount);
+	if (!hnswIndex.save(hnswFile)) {
+		cerr << "Failed to write HNSW graph: " << hnswFile << endl;
+		return false;
+	}
+
+	log.writeToFeatureDatabaseLog("HNSW graph saved to: " + hnswFile);
 	return true;
 }
 
@@ -196,32 +533,203 @@ bool Indexer::readIndex(string indexPath) {
 	indexPath += "/index.bin";
 	cout << "Reading index from: " << indexPath << endl;
 
-	ifstream in(indexPath, ios::binary);
-	if (!in) {
-		cerr << "Failed to open file for reading: " << indexPath << endl;
-		return false;
+	clearIndex();
+
+	// Sectioned indexes are mapped and used in place
+	bool ok = false;
+	shared_ptr<MappedFile> file = make_shared<MappedFile>();
+	if (file->open(indexPath) && IndexFileReader::isIndexFile(file->getData(), file->getSize())) {
+		ok = readMappedIndex(file, selectedFeature);
+	}
+	else {
+		file.reset();
+
+		// Older indexes are parsed field by field
+		ifstream in(indexPath, ios::binary);
+		if (!in) {
+			cerr << "Failed to open file for reading: " << indexPath << endl;
+			return false;
+		}
+
+		// Their HOG descriptors are out of date
+		if (selectedFeature == "HOG") {
+			cerr << "HOG index in the legacy format, rebuild it: " << indexPath << endl;
+			return false;
+		}
+
+		ok = readLegacyIndex(in);
+		in.close();
+	}
+
+	// The HNSW graph is optional, the exhaustive scan is used without it
+	string hnswFile = utils.extractPath(indexPath) + "hnsw.bin";
+	if (ok && !featureStore.empty() && !featureStore.isEncoded() && fs::exists(hnswFile)) {
+		if (hnswIndex.load(hnswFile, featureStore.getRow(0), featureStore.size(), featureStore.getDimensions()))
+			cout << "HNSW graph loaded: " << hnswIndex.size() << " nodes" << endl;
+		else
+			hnswIndex.clear();
 	}
+	return ok;
+}
 
-	features.clear();  // Now a map<string, Feature*>
+void Indexer::clearIndex() {
+	hnswIndex.clear();
+	ivfIndex.clear();
+	invertedIndex.clear();
+	geometricVerifier.clear();
+	featureStore.clear();
 	vocabulary.release();
+	vocabularyTree = VocabularyTree();
+	indexHogLayout = HOGLayout();
+}
+
+bool Indexer::readMappedIndex(shared_ptr<MappedFile> file, const string& selectedFeature) {
+	IndexFileReader reader;
+	if (!reader.open(file->getData(), file->getSize()))
+		return false;
+
+	// The HOG descriptor changed in version 2: every channel of every pixel votes
+	if (selectedFeature == "HOG" && reader.getVersion() < hogDescriptorVersion) {
+		cerr << "HOG index built with the previous descriptor, rebuild it" << endl;
+		return false;
+	}
+
+	const unsigned char* data = nullptr;
+	size_t size = 0;
+	Mat matrix;
+
+	// Step 0: Read vocabulary. It is small and handed to BagOfVisualWord, so it is copied out of the mapping.
+	if (reader.findSection(indexSectionTree, data, size)) {
+		int32_t shape[2] = { 0, 0 };
+		if (size < sizeof(shape) || !IndexFileReader::readMatrix(data + sizeof(shape), size - sizeof(shape), matrix)) {
+			cerr << "Corrupted vocabulary tree in index" << endl;
+			return false;
+		}
+		memcpy(shape, data, sizeof(shape));
+		if (!vocabularyTree.setTree(shape[0], shape[1], matrix.clone()))
+			return false;
 
+		vocabulary = vocabularyTree.getLeafCenters();
+		cout << "Vocabulary tree loaded. Shape: " << shape[0] << "^" << shape[1] << ", " << vocabulary.rows << " words" << endl;
+	}
+	else if (reader.findSection(indexSectionVocabulary, data, size) && IndexFileReader::readMatrix(data, size, matrix)) {
+		vocabulary = matrix.clone();
+		cout << "Vocabulary loaded. Size: " << vocabulary.rows << "x" << vocabulary.cols << endl;
+	}
+	else {
+		cout << "No vocabulary found in index." << endl;
+	}
+
+	vector<string> ids;
+	if (!reader.findSection(indexSectionIds, data, size) || !IndexFileReader::readStrings(data, size, ids)) {
+		cerr << "Corrupted image IDs in index" << endl;
+		return false;
+	}
+
+	// Step 1: The descriptor block (or code block) is used in place, the feature store keeps the mapping alive
+	Mat descriptors;
+	if (reader.findSection(indexSectionDescriptors, data, size)) {
+		if (!IndexFileReader::readMatrix(data, size, descriptors)) {
+			cerr << "Corrupted descriptor block in index" << endl;
+			return false;
+		}
+		if (!featureStore.assign(descriptors, move(ids), file))
+			return false;
+	}
+	else {
+		// Product-quantized index: the small codebook is copied, the codes are mapped
+		shared_ptr<ProductQuantizer> quantizer = make_shared<ProductQuantizer>();
+		int32_t shape[2] = { 0, 0 };
+		Mat codebook;
+		if (!reader.findSection(indexSectionPqCodebook, data, size) || size < sizeof(shape)
+			|| !IndexFileReader::readMatrix(data + sizeof(shape), size - sizeof(shape), codebook)) {
+			cerr << "Index has neither descriptors nor a product quantizer" << endl;
+			return false;
+		}
+		memcpy(shape, data, sizeof(shape));
+		if (!quantizer->setCodebook(codebook.clone(), shape[0]))
+			return false;
+
+		if (!reader.findSection(indexSectionPqCodes, data, size) || !IndexFileReader::readMatrix(data, size, descriptors)) {
+			cerr << "Corrupted product-quantized codes in index" << endl;
+			return false;
+		}
+		if (!featureStore.assignEncoded(descriptors, quantizer, move(ids), file))
+			return false;
+		cout << "Product-quantized index: " << quantizer->getSubspaceCount() << " bytes per image" << endl;
+	}
+
+	// Step 2: Block HOG layout; indexes without one were built with the default layout
+	if (reader.findSection(indexSectionHogLayout, data, size)) {
+		int32_t layout[4] = { 0, 0, 0, 0 };
+		if (size >= sizeof(layout))
+			memcpy(layout, data, sizeof(layout));
+		indexHogLayout.cellsX = layout[0];
+		indexHogLayout.cellsY = layout[1];
+		indexHogLayout.blockCells = layout[2];
+		indexHogLayout.bins = layout[3];
+		if (!featureStore.empty() && indexHogLayout.descriptorSize() != featureStore.getDimensions()) {
+			cerr << "Corrupted HOG layout in index" << endl;
+			return false;
+		}
+		cout << "HOG layout loaded: " << layout[0] << "x" << layout[1] << " cells, " << layout[2] << "-cell blocks, " << layout[3] << " bins" << endl;
+	}
+
+	// Step 3: Optional IVF lists, used in place like the descriptors
+	if (ivfIndex.read(reader, featureStore.size(), featureStore.getDimensions()))
+		cout << "IVF index loaded: " << ivfIndex.getListCount() << " lists" << endl;
+
+	// Step 4: Optional inverted index of the BoVW histograms
+	if (invertedIndex.read(reader, featureStore.size()))
+		cout << "Inverted index loaded: " << invertedIndex.getPostingCount() << " postings"
+			<< (invertedIndex.isCompressed() ? " (packed)" : "") << endl;
+
+	// Step 5: Optional keypoints for geometric verification
+	if (geometricVerifier.read(reader, featureStore.size()))
+		cout << "Keypoints loaded: " << geometricVerifier.getKeypointCount() << endl;
+	return true;
+}
+
+bool Indexer::readLegacyIndex(ifstream& in) {
 	// Step 0: Read vocabulary
 	int vocabRows = 0, vocabCols = 0, vocabType = 0;
 	in.read(reinterpret_cast<char*>(&vocabRows), sizeof(int));
-	in.read(reinterpret_cast<char*>(&vocabCols), sizeof(int));
-	in.read(reinterpret_cast<char*>(&vocabType), sizeof(int));
 
-	if (vocabRows > 0 && vocabCols > 0) {
-		vocabulary.create(vocabRows, vocabCols, vocabType);
-		size_t vocabSize = vocabRows * vocabCols * vocabulary.elemSize();
-		in.read(reinterpret_cast<char*>(vocabulary.data), vocabSize);
-		cout << "Vocabulary loaded. Size: " << vocabRows << "x" << vocabCols << endl;
+	if (vocabRows == vocabularyTreeMarker) {
+		// Vocabulary tree: shape, then the centers of all nodes
+		int branchFactor = 0, depth = 0;
+		in.read(reinterpret_cast<char*>(&branchFactor), sizeof(int));
+		in.read(reinterpret_cast<char*>(&depth), sizeof(int));
+		in.read(reinterpret_cast<char*>(&vocabRows), sizeof(int));
+		in.read(reinterpret_cast<char*>(&vocabCols), sizeof(int));
+		in.read(reinterpret_cast<char*>(&vocabType), sizeof(int));
+
+		Mat nodes(vocabRows, vocabCols, vocabType);
+		in.read(reinterpret_cast<char*>(nodes.data), vocabRows * vocabCols * nodes.elemSize());
+		if (!vocabularyTree.setTree(branchFactor, depth, nodes))
+			return false;
+
+		vocabulary = vocabularyTree.getLeafCenters();
+		cout << "Vocabulary tree loaded. Shape: " << branchFactor << "^" << depth << ", " << vocabulary.rows << " words" << endl;
 	}
 	else {
-		cout << "No vocabulary found in index." << endl;
+		in.read(reinterpret_cast<char*>(&vocabCols), sizeof(int));
+		in.read(reinterpret_cast<char*>(&vocabType), sizeof(int));
+
+		if (vocabRows > 0 && vocabCols > 0) {
+			vocabulary.create(vocabRows, vocabCols, vocabType);
+			size_t vocabSize = vocabRows * vocabCols * vocabulary.elemSize();
+			in.read(reinterpret_cast<char*>(vocabulary.data), vocabSize);
+			cout << "Vocabulary loaded. Size: " << vocabRows << "x" << vocabCols << endl;
+		}
+		else {
+			cout << "No vocabulary found in index." << endl;
+		}
 	}
 
-	// Step 1: Read features
+	// Step 1: Read features into one descriptor matrix
+	Mat descriptors;
+	vector<string> ids;
 	int featureCount = 0;
 	in.read(reinterpret_cast<char*>(&featureCount), sizeof(int));
 
@@ -242,33 +750,18 @@ bool Indexer::readIndex(string indexPath) {
 		size_t dataSize = rows * cols * CV_ELEM_SIZE(type);
 		in.read(reinterpret_cast<char*>(descriptor.data), dataSize);
 
-		// Instantiate appropriate feature class
-		Feature* f = nullptr;
-		if (selectedFeature == "Color Histogram")
-			f = new ColorHistogram();
-		else if (selectedFeature == "HOG")
-			f = new HOG();
-		else if (selectedFeature == "Color Correlogram")
-			f = new ColorCorrelogram();
-		else if (selectedFeature == "SIFT")
-			f = new SIFTFeature();
-		else if (selectedFeature == "ORB")
-			f = new ORBFeature();
-
-		if (!f) continue;
+		if (!in || descriptor.empty())
+			break;
 
-		f->setDescriptor(descriptor);
-		f->setId(imageId);
-		features[imageId] = f;
+		descriptors.push_back(descriptor.reshape(1, 1));
+		ids.push_back(imageId);
 	}
 
-	in.close();
-	return true;
+	return featureStore.assign(descriptors, move(ids));
 }
 
-
-map<string, Feature*> Indexer::getFeatures() {
-	return features;
+const FeatureStore& Indexer::getFeatureStore() {
+	return featureStore;
 }
 
 Mat Indexer::getVocab() {
@@ -4,11 +4,23 @@
 #include <fstream>
 #include <vector>
 #include <iostream>
+#include <memory>
 
 #include "Utils.h"
 #include "Features.h"
 #include "ImageDatabase.h"
 #include "BoVW.h"
+#include "ThreadPool.h"
+#include "ExtractionPipeline.h"
+#include "IndexFormat.h"
+#include "MappedFile.h"
+#include "FeatureStore.h"
+#include "HnswIndex.h"
+#include "IvfIndex.h"
+#include "InvertedIndex.h"
+#include "GeometricVerifier.h"
+#include "ProductQuantizer.h"
+#include "HOG.h"
 
 namespace fs = filesystem;
 
@@ -24,21 +36,87 @@ class Indexer {
 private:
     Utils utils;                        ///< Utility functions for common operations
     Mat vocabulary;                     ///< Vocabulary (cluster centers) used for BoVW
-    map<string, Feature*> features;     ///< Map of feature IDs to their corresponding Feature pointers
+    FeatureStore featureStore;          ///< Descriptors of the loaded or extracted index
+    int threadCount = 0;                ///< Number of extraction threads (<= 0 uses all hardware threads)
+    bool pipelineMode = false;          ///< Run extraction as overlapping read/decode/extract/quantize stages
+    size_t pipelineQueueCapacity = 32;  ///< Capacity of each queue between two pipeline stages
+    Mat pretrainedVocabulary;           ///< Vocabulary reused instead of training a new one (empty = train)
+    VocabularyTree pretrainedVocabularyTree; ///< Vocabulary tree reused together with `pretrainedVocabulary`
+    VocabularyTree vocabularyTree;      ///< Vocabulary tree (hierarchical BoVW), empty for a flat vocabulary
+    int treeBranchFactor = 0;           ///< Branching factor of the vocabulary tree to train (0 = flat k-means)
+    int treeDepth = 0;                  ///< Depth of the vocabulary tree to train
+    int miniBatchSize = 0;              ///< Batch size of mini-batch k-means (0 = full k-means)
+    int trainingSampleSize = 0;         ///< Descriptors sampled to train the vocabulary (0 = all of them)
+    HnswIndex hnswIndex;                ///< HNSW graph over the feature store, empty if none was built or found
+    int hnswM = 0;                      ///< Links per node of the HNSW graph to build (0 = no graph)
+    int hnswEfConstruction = 200;       ///< Candidate list size used to build the HNSW graph
+    IvfIndex ivfIndex;                  ///< IVF lists over the feature store, empty if the index has none
+    int ivfListCount = 0;               ///< Number of IVF lists to build (0 = no IVF index)
+    int pqSubspaces = 0;                ///< Bytes per product-quantized descriptor (0 = store float descriptors)
+    InvertedIndex invertedIndex;        ///< TF-IDF posting lists of the BoVW histograms, empty if the index has none
+    bool invertedIndexEnabled = false;  ///< Build the inverted index when saving a BoVW index
+    bool invertedIndexPacked = false;   ///< Compress the posting lists of the inverted index
+    GeometricVerifier geometricVerifier; ///< Strongest keypoints of each image (SIFT, ORB), empty if the index has none
+    int geometricKeypoints = 0;         ///< Keypoints kept per image for geometric verification (0 = none)
+    HOGLayout hogLayout;                ///< Cell and block layout of the Block HOG indexes to build
+    HOGLayout indexHogLayout;           ///< Block HOG layout of the loaded (or last saved) index
+
+    static const int vocabularyTreeMarker = -2;  ///< Value of the vocabulary row count flagging a tree in legacy index.bin files
+    static const uint32_t hogDescriptorVersion = 2; ///< First index format version holding the one-pass HOG descriptor
 
-public:
     /**
-     * @brief Default constructor.
+     * @brief Releases the loaded index (feature store and vocabulary).
+     *
+     * @return void
      */
-    Indexer() {}
+    void clearIndex();
+
+    /**
+     * @brief Loads an index in the sectioned format from its memory mapping.
+     *
+     * HOG indexes written before `hogDescriptorVersion` hold the old descriptor, which queries
+     * no longer compute, and are rejected.
+     *
+     * @param[in] file              Mapped index.bin; the feature store keeps it alive.
+     * @param[in] selectedFeature   Feature extraction method of the index (from its folder name).
+     *
+     * @return true if the index is well formed; false otherwise.
+     */
+    bool readMappedIndex(shared_ptr<MappedFile> file, const string& selectedFeature);
+
+    /**
+     * @brief Loads an index in the legacy field-by-field format.
+     *
+     * @param[in,out] in   Opened index.bin.
+     *
+     * @return true if the index was loaded; false otherwise.
+     */
+    bool readLegacyIndex(ifstream& in);
 
     /**
-     * @brief Destructor for the Indexer class.
+     * @brief Turns the extracted features of one method into the descriptors of its index.
+     *
+     * Global features are kept as they are. Local features (SIFT, ORB) get a vocabulary, the
+     * pretrained one or one trained on their descriptors, and are converted to BoVW histograms.
      *
-     * Releases dynamically allocated memory held by Feature pointers
-     * stored in the `features` map. Prevents memory leaks by deleting each object.
+     * @param[in]  selectedFeature     Feature extraction method of the features.
+     * @param[in]  slots               One feature per image in database order, nullptr for images that failed.
+     * @param[in]  quantizer           Pretrained vocabulary to use, nullptr to train one.
+     * @param[in]  quantized           Whether the descriptors were already quantized with `quantizer`.
+     * @param[in]  pool                Workers of the BoVW conversion.
+     * @param[out] extractedFeatures   The features ready for `saveIndex()`, in database order.
+     * @param[in,out] log              Logger for process feedback.
+     * @param[in]  dictionarySize      The number of clusters (visual words) to generate.
+     *
+     * @return void
      */
-    ~Indexer();
+    void convertExtractedFeatures(const string& selectedFeature, const vector<Feature*>& slots, BagOfVisualWord* quantizer, bool quantized, ThreadPool& pool, vector<Feature*>& extractedFeatures, Log& log, int dictionarySize);
+
+public:
+    /**
+     * @brief Default constructor.
+     */
+    Indexer() {}
 
     /**
      * @brief Performs feature extraction and indexing for the entire image database.
@@ -48,36 +126,280 @@ public:
      *
      * @param[in] imageDatabasePath   Path to the image database (used to locate or create the extracted_feature folder).
      * @param[in] selectedFeature     The feature extraction method to use (e.g., "SIFT", "HOG").
-     * @param[in] imageDatabase       The ImageDatabase object containing loaded images.
+     * @param[in,out] imageDatabase   The ImageDatabase whose images are streamed through its cursor.
+     * @param[in,out] log             Logging utility for recording indexing process details.
+     * @param[in] vocabularySize      The number of clusters (visual words) to use in BoVW.
+     */
+    void indexingImageDatabase(string imageDatabasePath, string selectedFeature, ImageDatabase& database, Log& log, int vocabularySize);
+
+    /**
+     * @brief Extracts several features in one pass over the image database and saves one index per feature.
+     *
+     * Each image is decoded once and converted once to the planes its features need (HSV for
+     * the color features, gray for SIFT and ORB, see `ImagePlanes`); HOG and Block HOG share
+     * one gradient pass. The indexes are then built and saved one after the other, exactly as
+     * `indexingImageDatabase()` would for each feature alone. Extraction always runs on the
+     * per-image loop and local features always train their own vocabulary (flat or tree).
+     *
+     * @param[in] imageDatabasePath   Path to the image database (used to locate or create the extracted_feature folder).
+     * @param[in] selectedFeatures    The feature extraction methods, each at most once (e.g., {"Color Histogram", "HOG", "SIFT"}).
+     * @param[in,out] database        The ImageDatabase whose images are streamed through its cursor.
      * @param[in,out] log             Logging utility for recording indexing process details.
      * @param[in] vocabularySize      The number of clusters (visual words) to use in BoVW.
      */
-    void indexingImageDatabase(string imageDatabasePath, string selectedFeature, ImageDatabase database, Log& log, int vocabularySize);
+    void indexingImageDatabase(string imageDatabasePath, const vector<string>& selectedFeatures, ImageDatabase& database, Log& log, int vocabularySize);
 
     /**
      * @brief Extract features from all images using the selected method.
      *
-     * Iterates through all images and applies the given feature extraction method
-     * (e.g., Color Histogram, HOG, SIFT, ORB). Stores extracted features for indexing.
+     * Distributes the images over a pool of `threadCount` workers and applies the given feature
+     * extraction method (e.g., Color Histogram, HOG, SIFT, ORB). Each worker decodes one image at
+     * a time and releases it as soon as its feature is computed. Results are written to one
+     * preallocated slot per image, so `extractedFeatures` keeps the database order.
      *
      * @param[in] imageDatabasePath   Path to the image database folder.
      * @param[in] selectedFeature     Feature extraction method (e.g., "SIFT", "ORB").
-     * @param[in] database            The ImageDatabase containing loaded images.
+     * @param[in] database            The ImageDatabase whose images are decoded on demand.
      * @param[out] extractedFeatures  Vector to store extracted features from each image.
      * @param[in,out] log             Logger for process feedback.
      * @param[in] dictionarySize      The number of clusters (visual words) to generate.
      *
      * @return void
      *
-     * @note Supported methods include: "Color Histogram", "Color Correlogram", "SIFT", "HOG", and "ORB".
+     * @note Supported methods include: "Color Histogram", "Color Correlogram", "Color Correlogram Exact"
+     *       (every pixel counted), "SIFT", "HOG", "Block HOG" (cell/block layout), and "ORB".
+     */
+    void extractFeatureImageDatabase(string imageDatabasePath, string selectedFeature, ImageDatabase& database, vector<Feature*>& extractedFeatures, Log& log, int dictionarySize);
+
+    /**
+     * @brief Checks whether a feature extraction method is supported by the indexer.
+     *
+     * @param[in] selectedFeature   Feature extraction method (e.g., "SIFT", "ORB").
+     *
+     * @return true if the method is one of the supported feature types; false otherwise.
+     */
+    static bool isSupportedFeature(string selectedFeature);
+
+    /**
+     * @brief Lists the feature extraction methods supported by the indexer.
+     *
+     * @return The method names, in the order of the documentation.
+     */
+    static vector<string> supportedFeatures();
+
+    /**
+     * @brief Allocates an empty Feature object of the requested type.
+     *
+     * @param[in] selectedFeature   Feature extraction method (e.g., "SIFT", "ORB").
+     * @param[in] keypointLimit     Keypoints local features keep for geometric verification (0 = none).
+     * @param[in] layout            Cell and block layout of "Block HOG".
+     *
+     * @return A newly allocated Feature owned by the caller, or nullptr for an unsupported method.
+     */
+    static Feature* createFeatureObject(string selectedFeature, int keypointLimit = 0, const HOGLayout& layout = HOGLayout());
+
+    /**
+     * @brief Sets the number of threads used for feature extraction and BoVW quantization.
+     *
+     * Each image is processed by one worker and written to its own preallocated slot,
+     * so the produced index does not depend on the thread count.
+     *
+     * @param[in] count   Number of threads; a value <= 0 uses all hardware threads, 1 runs sequentially.
+     *
+     * @return void
+     */
+    void setThreadCount(int count);
+
+    /**
+     * @brief Gets the configured number of extraction threads.
+     *
+     * @return The thread count (<= 0 means all hardware threads).
+     */
+    int getThreadCount();
+
+    /**
+     * @brief Enables or disables the staged extraction pipeline.
+     *
+     * In pipeline mode, file reading, decoding, descriptor extraction and (when a pretrained
+     * vocabulary is set) BoVW quantization run concurrently as separate stages connected by
+     * bounded queues. Per-stage throughput and queue occupancy are written to the log.
+     *
+     * @param[in] enabled         true to use the pipeline, false for the parallel per-image loop.
+     * @param[in] queueCapacity   Capacity of each queue between two stages.
+     *
+     * @return void
+     */
+    void setPipelineMode(bool enabled, size_t queueCapacity);
+
+    /**
+     * @brief Reuses an existing vocabulary for SIFT/ORB indexing instead of training a new one.
+     *
+     * With a pretrained vocabulary the k-means step is skipped, which allows descriptors to
+     * be quantized as soon as they are extracted.
+     *
+     * @param[in] vocab   Vocabulary matrix (one visual word per row); an empty matrix re-enables training.
+     * @param[in] tree    Vocabulary tree whose leaves are `vocab`, or an empty tree for a flat vocabulary.
+     *
+     * @return void
+     */
+    void setPretrainedVocabulary(Mat vocab, const VocabularyTree& tree = VocabularyTree());
+
+    /**
+     * @brief Selects a vocabulary tree instead of a flat k-means vocabulary for SIFT/ORB.
+     *
+     * The tree has branchFactor^depth words and quantizes a descriptor in
+     * O(branchFactor * depth). It is stored in index.bin and used again at query time.
+     *
+     * @param[in] branchFactor   Number of children per node (0 selects the flat vocabulary).
+     * @param[in] depth          Number of tree levels.
+     *
+     * @return void
+     */
+    void setVocabularyTree(int branchFactor, int depth);
+
+    /**
+     * @brief Trains the SIFT/ORB vocabulary with mini-batch k-means on a descriptor sample.
+     *
+     * @param[in] batchSize    Batch size of mini-batch k-means (0 keeps the full k-means).
+     * @param[in] sampleSize   Number of descriptors sampled for training (0 uses all of them).
+     *
+     * @return void
+     */
+    void setMiniBatchTraining(int batchSize, int sampleSize);
+
+    /**
+     * @brief Builds an HNSW graph over the descriptors when saving an index.
+     *
+     * The graph is written to hnsw.bin next to index.bin and loaded again by `readIndex()`.
+     * Color features use a chi-square graph, the other features an L2 graph.
+     *
+     * @param[in] M                Links per node (0 disables the graph).
+     * @param[in] efConstruction   Candidate list size used while building.
+     *
+     * @return void
+     */
+    void setHnswGraph(int M, int efConstruction);
+
+    /**
+     * @brief Partitions the descriptors into IVF lists when saving an index.
+     *
+     * The coarse centroids and the lists are stored in index.bin. The centroids are trained
+     * like the vocabulary (see `setMiniBatchTraining()`).
+     *
+     * @param[in] listCount   Number of lists (0 disables the IVF index).
+     *
+     * @return void
+     */
+    void setIvfLists(int listCount);
+
+    /**
+     * @brief Stores the descriptors product-quantized instead of as floats when saving an index.
+     *
+     * Each descriptor becomes `subspaces` bytes. The codebooks are trained on the descriptors
+     * (or on `setMiniBatchTraining()`'s sample, with its mini-batch k-means) and stored in index.bin with the codes. The
+     * float descriptors are not written, so no HNSW graph is built for an encoded index.
+     *
+     * @param[in] subspaces   Number of subspaces, i.e. bytes per image (0 keeps float descriptors).
+     *
+     * @return void
+     */
+    void setProductQuantization(int subspaces);
+
+    /**
+     * @brief Builds an inverted file over the BoVW histograms when saving an index.
+     *
+     * The posting lists (visual word -> images, with TF-IDF weights) are stored in index.bin.
+     * Only BoVW features (SIFT, ORB, HOG with a vocabulary) get one.
+     *
+     * @param[in] enabled   True to build the inverted index.
+     * @param[in] packed    True to store the images delta + bit-packed and the weights on 8 bits.
+     *
+     * @return void
+     */
+    void setInvertedIndex(bool enabled, bool packed = false);
+
+    /**
+     * @brief Keeps the strongest keypoints of every image for geometric verification.
+     *
+     * The positions and descriptors (one byte per component) of up to `keypointsPerImage`
+     * keypoints of each SIFT/ORB image are stored in index.bin next to the BoVW histograms.
+     *
+     * @param[in] keypointsPerImage   Keypoints kept per image (0 stores none).
+     *
+     * @return void
+     */
+    void setGeometricVerification(int keypointsPerImage);
+
+    /**
+     * @brief Sets the transformation fitted when verifying query results.
+     *
+     * @param[in] model   Homography (planar scenes) or fundamental matrix (general 3D scenes).
+     *
+     * @return void
+     */
+    void setVerificationModel(VerificationModel model);
+
+    /**
+     * @brief Sets the cell and block layout of the Block HOG indexes to build.
+     *
+     * The layout is stored in index.bin, so queries extract their descriptor with the same one
+     * (see `getHogLayout()`).
+     *
+     * @param[in] layout   Cells across and down the image, cells per block side and orientation bins.
+     *
+     * @return void
+     */
+    void setHogLayout(const HOGLayout& layout);
+
+    /**
+     * @brief Get the Block HOG layout of the current index.
+     *
+     * @return The layout stored in the index, the default layout for indexes without one.
+     */
+    const HOGLayout& getHogLayout();
+
+    /**
+     * @brief Get the IVF index of the current index.
+     *
+     * @return The IVF lists, empty if the index has none.
+     */
+    const IvfIndex& getIvfIndex();
+
+    /**
+     * @brief Get the inverted index of the current index.
+     *
+     * @return The TF-IDF posting lists, empty if the index has none.
+     */
+    const InvertedIndex& getInvertedIndex();
+
+    /**
+     * @brief Get the keypoint store of the current index.
+     *
+     * @return The verifier, empty if the index has no keypoints.
      */
-    void extractFeatureImageDatabase(string imageDatabasePath, string selectedFeature, ImageDatabase database, vector<Feature*>& extractedFeatures, Log& log, int dictionarySize);
+    const GeometricVerifier& getGeometricVerifier();
+
+    /**
+     * @brief Get the HNSW graph of the current index.
+     *
+     * @return The graph, empty if the index has none.
+     */
+    const HnswIndex& getHnswIndex();
+
+    /**
+     * @brief Get the vocabulary tree of the current index.
+     *
+     * @return The vocabulary tree, empty if the index uses a flat vocabulary.
+     */
+    const VocabularyTree& getVocabularyTree();
 
     /**
      * @brief Save clustered features as an index to disk.
      *
      * Groups features into clusters and serializes the index (with cluster centers and mappings)
-     * to disk, enabling later retrieval and matching.
+     * to disk, enabling later retrieval and matching. The file is written in the sectioned format
+     * of IndexFormat.h: all descriptors form one contiguous 64-byte aligned block, followed by
+     * the table of image IDs.
      *
      * @param[in] indexPath          Destination folder for the index file.
      * @param[in] selectedFeature    Feature extraction method used.
@@ -103,21 +425,27 @@ public:
      * @brief Load a saved index from disk.
      *
      * Reads a binary index file and reconstructs the in-memory structure for
-     * the BoVW vocabulary and feature mappings.
+     * the BoVW vocabulary and feature mappings. Sectioned index files are memory-mapped and
+     * their descriptor block is used in place by the feature store, so loading does not
+     * copy descriptors and the pages are shared with other processes reading the same index.
+     * Files in the legacy format are still parsed field by field. An hnsw.bin found in the same
+     * folder is loaded as well when it matches the descriptors. HOG indexes in the legacy format
+     * or written before the one-pass HOG descriptor are rejected and must be rebuilt.
      *
      * @param[in] indexPath Path to the directory containing the saved index.
      * @return true if index was loaded successfully; false otherwise.
      *
-     * @note Supported types: "Color Histogram", "Color Correlogram", "SIFT", "HOG", and "ORB".
+     * @note Supported types: "Color Histogram", "Color Correlogram", "Color Correlogram Exact", "SIFT", "HOG", "Block HOG", and "ORB".
      */
     bool readIndex(string indexPath);
 
     /**
-     * @brief Get the map of extracted features.
-     * 
-     * @return A map from feature ID to Feature pointer.
+     * @brief Get the descriptors of the loaded (or last extracted) index.
+     *
+     * @return A const reference to the feature store; it stays valid until the next `readIndex()`
+     *         or indexing run.
      */
-    map<string, Feature*> getFeatures();
+    const FeatureStore& getFeatureStore();
 
     /**
      * @brief Get the BoVW vocabulary (cluster centers).
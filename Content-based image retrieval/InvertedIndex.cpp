@@ -0,0 +1,529 @@
+#include "InvertedIndex.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "TopK.h"
+
+/**
+ * @brief Extracts gap `j` of a group of eight gaps of `bits` bits.
+ *
+ * @param[in] input   Start of the group (followed by at least 8 readable bytes).
+ *
+ * @return The gap.
+ */
+template<int bits, int j>
+static inline uint32_t extractGap(const uint8_t* input) {
+    const uint64_t mask = bits == 32 ? 0xFFFFFFFFull : (1ull << bits) - 1;
+    uint64_t word;
+    memcpy(&word, input + (j * bits) / 8, sizeof(word));
+    return static_cast<uint32_t>((word >> ((j * bits) % 8)) & mask);
+}
+
+/**
+ * @brief Unpacks one block of 128 gaps of `bits` bits, least significant bits first.
+ *
+ * Eight gaps take exactly `bits` bytes, so inside a group of eight every byte offset and shift
+ * is a constant: the group is written out and compiles to straight-line loads, shifts and masks.
+ *
+ * @param[in]  input   Packed gaps (followed by at least 8 readable bytes).
+ * @param[out] gaps    Unpacked gaps.
+ *
+ * @return void
+ */
+template<int bits>
+static void unpackGaps(const uint8_t* input, uint32_t* gaps) {
+    for (int group = 0; group < 128 / 8; ++group, input += bits, gaps += 8) {
+        gaps[0] = extractGap<bits, 0>(input);
+        gaps[1] = extractGap<bits, 1>(input);
+        gaps[2] = extractGap<bits, 2>(input);
+        gaps[3] = extractGap<bits, 3>(input);
+        gaps[4] = extractGap<bits, 4>(input);
+        gaps[5] = extractGap<bits, 5>(input);
+        gaps[6] = extractGap<bits, 6>(input);
+        gaps[7] = extractGap<bits, 7>(input);
+    }
+}
+
+typedef void (*GapUnpacker)(const uint8_t*, uint32_t*);
+
+static const GapUnpacker gapUnpackers[33] = {
+    unpackGaps<0>, unpackGaps<1>, unpackGaps<2>, unpackGaps<3>, unpackGaps<4>, unpackGaps<5>, unpackGaps<6>, unpackGaps<7>,
+    unpackGaps<8>, unpackGaps<9>, unpackGaps<10>, unpackGaps<11>, unpackGaps<12>, unpackGaps<13>, unpackGaps<14>, unpackGaps<15>,
+    unpackGaps<16>, unpackGaps<17>, unpackGaps<18>, unpackGaps<19>, unpackGaps<20>, unpackGaps<21>, unpackGaps<22>, unpackGaps<23>,
+    unpackGaps<24>, unpackGaps<25>, unpackGaps<26>, unpackGaps<27>, unpackGaps<28>, unpackGaps<29>, unpackGaps<30>, unpackGaps<31>,
+    unpackGaps<32>
+};
+
+/**
+ * @brief Reads one variable-byte gap, refusing to read past the end of its list.
+ *
+ * @param[in,out] input   Position in the stream, moved past the gap.
+ * @param[in]     end     End of the list.
+ * @param[out]    gap     Decoded gap.
+ *
+ * @return true if a complete gap of at most 32 bits was read; false otherwise.
+ */
+static bool readCheckedVarByte(const uint8_t*& input, const uint8_t* end, uint64_t& gap) {
+    gap = 0;
+    for (int shift = 0; shift < 35; shift += 7) {
+        if (input >= end)
+            return false;
+        const uint8_t byte = *input++;
+        gap |= static_cast<uint64_t>(byte & 0x7F) << shift;
+        if (!(byte & 0x80))
+            return gap <= 0xFFFFFFFFull;
+    }
+    return false;
+}
+
+bool InvertedIndex::build(const Mat& histograms, bool packed) {
+    clear();
+    if (histograms.empty() || histograms.type() != CV_32F) {
+        cerr << "Inverted index needs CV_32F BoVW histograms." << endl;
+        return false;
+    }
+
+    const int images = histograms.rows;
+    const int words = histograms.cols;
+
+    // === Document frequency and IDF of every word ===
+    vector<uint64_t> counts(static_cast<size_t>(words) + 1, 0);
+    for (int r = 0; r < images; ++r) {
+        const float* hist = histograms.ptr<float>(r);
+        for (int w = 0; w < words; ++w)
+            if (hist[w] != 0.0f)
+                ++counts[w + 1];
+    }
+
+    // A word found in every image has an IDF of 0: its postings would add nothing to any score,
+    // so its list is left empty
+    ownedIdf.assign(words, 0.0f);
+    for (int w = 0; w < words; ++w) {
+        if (counts[w + 1] > 0)
+            ownedIdf[w] = static_cast<float>(log(static_cast<double>(images) / counts[w + 1]));
+        if (ownedIdf[w] == 0.0f)
+            counts[w + 1] = 0;
+    }
+
+    ownedOffsets.assign(counts.begin(), counts.end());
+    for (int w = 0; w < words; ++w)
+        ownedOffsets[w + 1] += ownedOffsets[w];
+
+    // === Fill the posting lists with L2-normalized TF-IDF weights, images in increasing order ===
+    ownedRows.resize(ownedOffsets[words]);
+    ownedWeights.resize(ownedOffsets[words]);
+    vector<uint64_t> next(ownedOffsets.begin(), ownedOffsets.end() - 1);
+    for (int r = 0; r < images; ++r) {
+        const float* hist = histograms.ptr<float>(r);
+        double norm = 0.0;
+        for (int w = 0; w < words; ++w) {
+            const double weight = hist[w] * ownedIdf[w];
+            norm += weight * weight;
+        }
+        const float scale = norm > 0.0 ? static_cast<float>(1.0 / sqrt(norm)) : 0.0f;
+
+        for (int w = 0; w < words; ++w) {
+            if (hist[w] == 0.0f || ownedIdf[w] == 0.0f)
+                continue;
+            ownedRows[next[w]] = r;
+            ownedWeights[next[w]] = hist[w] * ownedIdf[w] * scale;
+            ++next[w];
+        }
+    }
+
+    wordCount = words;
+    imageCount = images;
+    useOwnedArrays();
+    if (packed)
+        compress();
+    return true;
+}
+
+void InvertedIndex::useOwnedArrays() {
+    idf = ownedIdf.data();
+    offsets = ownedOffsets.data();
+    rows = ownedRows.data();
+    weights = ownedWeights.data();
+}
+
+void InvertedIndex::compress() {
+    const uint64_t postings = getPostingCount();
+    ownedStreamOffsets.assign(static_cast<size_t>(wordCount) + 1, 0);
+    ownedScales.assign(wordCount, 0.0f);
+    ownedQuantized.resize(postings);
+    ownedStream.clear();
+
+    for (int w = 0; w < wordCount; ++w) {
+        const uint64_t begin = ownedOffsets[w];
+        const uint64_t end = ownedOffsets[w + 1];
+        encodeList(ownedRows.data() + begin, end - begin, ownedStream);
+        ownedStreamOffsets[w + 1] = ownedStream.size();
+
+        // One byte per weight, relative to the largest weight of the word; a posting never rounds to 0
+        float largest = 0.0f;
+        for (uint64_t p = begin; p < end; ++p)
+            largest = max(largest, ownedWeights[p]);
+        const float scale = largest / 255.0f;
+        ownedScales[w] = scale;
+        for (uint64_t p = begin; p < end; ++p)
+            ownedQuantized[p] = static_cast<uint8_t>(scale > 0.0f ? min(255L, max(1L, lround(ownedWeights[p] / scale))) : 1);
+    }
+    ownedStream.resize(ownedStream.size() + streamPadding, 0);
+
+    vector<int32_t>().swap(ownedRows);
+    vector<float>().swap(ownedWeights);
+    rows = nullptr;
+    weights = nullptr;
+
+    compressed = true;
+    streamSize = ownedStream.size();
+    streamOffsets = ownedStreamOffsets.data();
+    weightScales = ownedScales.data();
+    quantizedWeights = ownedQuantized.data();
+    stream = ownedStream.data();
+}
+
+void InvertedIndex::encodeList(const int32_t* images, size_t count, vector<uint8_t>& output) {
+    int32_t previous = -1;
+    size_t i = 0;
+
+    // Full blocks: one byte of width, then the gaps packed on that many bits
+    uint32_t gaps[blockSize];
+    for (; i + blockSize <= count; i += blockSize) {
+        uint32_t largest = 0;
+        for (int j = 0; j < blockSize; ++j) {
+            gaps[j] = static_cast<uint32_t>(images[i + j] - previous - 1);
+            previous = images[i + j];
+            largest |= gaps[j];
+        }
+
+        int bits = 0;
+        while (bits < 32 && (largest >> bits) != 0)
+            ++bits;
+        output.push_back(static_cast<uint8_t>(bits));
+
+        uint64_t buffer = 0;
+        int buffered = 0;
+        for (int j = 0; j < blockSize; ++j) {
+            buffer |= static_cast<uint64_t>(gaps[j]) << buffered;
+            buffered += bits;
+            for (; buffered >= 8; buffered -= 8, buffer >>= 8)
+                output.push_back(static_cast<uint8_t>(buffer));
+        }
+    }
+
+    // End of the list: variable-byte gaps, 7 bits per byte
+    for (; i < count; ++i) {
+        uint32_t gap = static_cast<uint32_t>(images[i] - previous - 1);
+        previous = images[i];
+        for (; gap >= 0x80; gap >>= 7)
+            output.push_back(static_cast<uint8_t>(gap | 0x80));
+        output.push_back(static_cast<uint8_t>(gap));
+    }
+}
+
+const uint8_t* InvertedIndex::decodeGaps(const uint8_t* input, int count, uint32_t* gaps) {
+    if (count == blockSize) {
+        const int bits = *input++;
+        gapUnpackers[bits](input, gaps);
+        input += 16 * bits;
+    }
+    else {
+        for (int j = 0; j < count; ++j) {
+            uint32_t gap = 0;
+            for (int shift = 0;; shift += 7) {
+                const uint8_t byte = *input++;
+                gap |= static_cast<uint32_t>(byte & 0x7F) << shift;
+                if (!(byte & 0x80))
+                    break;
+            }
+            gaps[j] = gap;
+        }
+    }
+    return input;
+}
+
+bool InvertedIndex::validateStream() const {
+    if (streamOffsets[0] != 0 || streamSize < streamPadding || streamOffsets[wordCount] != streamSize - streamPadding)
+        return false;
+
+    uint32_t gaps[blockSize];
+    for (int w = 0; w < wordCount; ++w) {
+        if (streamOffsets[w] > streamOffsets[w + 1])
+            return false;
+
+        const uint8_t* input = stream + streamOffsets[w];
+        const uint8_t* end = stream + streamOffsets[w + 1];
+        int64_t previous = -1;
+        uint64_t remaining = offsets[w + 1] - offsets[w];
+        for (; remaining >= static_cast<uint64_t>(blockSize); remaining -= blockSize) {
+            if (input >= end || *input > 32 || end - input < 1 + 16 * static_cast<ptrdiff_t>(*input))
+                return false;
+            const int bits = *input++;
+            gapUnpackers[bits](input, gaps);
+            input += 16 * bits;
+            for (int j = 0; j < blockSize; ++j)
+                previous += static_cast<int64_t>(gaps[j]) + 1;
+            if (previous >= imageCount)
+                return false;
+        }
+        for (; remaining > 0; --remaining) {
+            uint64_t gap = 0;
+            if (!readCheckedVarByte(input, end, gap))
+                return false;
+            previous += static_cast<int64_t>(gap) + 1;
+            if (previous >= imageCount)
+                return false;
+        }
+        if (input != end)
+            return false;
+    }
+    return true;
+}
+
+void InvertedIndex::write(IndexFileWriter& writer) const {
+    if (empty())
+        return;
+
+    writer.beginSection(indexSectionInvertedIdf);
+    writer.write(idf, static_cast<size_t>(wordCount) * sizeof(float));
+    writer.endSection();
+
+    const uint64_t postings = getPostingCount();
+    int32_t counts[2] = { wordCount, imageCount };
+    if (compressed) {
+        writer.beginSection(indexSectionInvertedPacked);
+        writer.write(counts, sizeof(counts));
+        writer.write(&postings, sizeof(postings));
+        writer.write(&streamSize, sizeof(streamSize));
+        writer.write(offsets, (static_cast<size_t>(wordCount) + 1) * sizeof(uint64_t));
+        writer.write(streamOffsets, (static_cast<size_t>(wordCount) + 1) * sizeof(uint64_t));
+        writer.write(weightScales, static_cast<size_t>(wordCount) * sizeof(float));
+        writer.write(quantizedWeights, postings);
+        writer.write(stream, streamSize);
+        writer.endSection();
+        return;
+    }
+
+    writer.beginSection(indexSectionInvertedPostings);
+    writer.write(counts, sizeof(counts));
+    writer.write(&postings, sizeof(postings));
+    writer.write(offsets, (static_cast<size_t>(wordCount) + 1) * sizeof(uint64_t));
+    writer.write(rows, postings * sizeof(int32_t));
+    writer.write(weights, postings * sizeof(float));
+    writer.endSection();
+}
+
+bool InvertedIndex::read(const IndexFileReader& reader, int images) {
+    clear();
+
+    const unsigned char* data = nullptr;
+    size_t size = 0;
+    const bool packed = !reader.findSection(indexSectionInvertedPostings, data, size);
+    if (packed && !reader.findSection(indexSectionInvertedPacked, data, size))
+        return false;
+
+    int32_t counts[2] = { 0, 0 };
+    uint64_t postings = 0;
+    uint64_t packedSize = 0;
+    const size_t headerSize = sizeof(counts) + sizeof(postings) + (packed ? sizeof(packedSize) : 0);
+    if (size < headerSize) {
+        cerr << "Corrupted inverted index" << endl;
+        return false;
+    }
+    memcpy(counts, data, sizeof(counts));
+    memcpy(&postings, data + sizeof(counts), sizeof(postings));
+    if (packed)
+        memcpy(&packedSize, data + sizeof(counts) + sizeof(postings), sizeof(packedSize));
+
+    // Both layouts start with the posting offsets; the packed one then has stream offsets and scales
+    const int words = counts[0];
+    const size_t offsetBytes = (static_cast<size_t>(max(words, 0)) + 1) * sizeof(uint64_t);
+    const size_t expected = packed
+        ? headerSize + 2 * offsetBytes + static_cast<size_t>(max(words, 0)) * sizeof(float) + postings + packedSize
+        : headerSize + offsetBytes + postings * (sizeof(int32_t) + sizeof(float));
+    if (words <= 0 || counts[1] != images || postings > size || packedSize > size || size != expected) {
+        cerr << "Inverted index does not match the index" << endl;
+        return false;
+    }
+
+    const unsigned char* idfData = nullptr;
+    size_t idfSize = 0;
+    if (!reader.findSection(indexSectionInvertedIdf, idfData, idfSize) || idfSize != static_cast<size_t>(words) * sizeof(float)) {
+        cerr << "Corrupted inverted index IDF" << endl;
+        return false;
+    }
+
+    wordCount = words;
+    imageCount = images;
+    idf = reinterpret_cast<const float*>(idfData);
+    offsets = reinterpret_cast<const uint64_t*>(data + headerSize);
+
+    // Offsets must be increasing and images in range, so a query never reads out of bounds
+    bool valid = offsets[0] == 0 && offsets[words] == postings;
+    for (int w = 0; valid && w < words; ++w)
+        valid = offsets[w] <= offsets[w + 1];
+
+    if (packed) {
+        compressed = true;
+        streamSize = packedSize;
+        streamOffsets = offsets + words + 1;
+        weightScales = reinterpret_cast<const float*>(streamOffsets + words + 1);
+        quantizedWeights = reinterpret_cast<const uint8_t*>(weightScales + words);
+        stream = quantizedWeights + postings;
+        valid = valid && validateStream();
+    }
+    else {
+        rows = reinterpret_cast<const int32_t*>(offsets + words + 1);
+        weights = reinterpret_cast<const float*>(rows + postings);
+        for (uint64_t p = 0; valid && p < postings; ++p)
+            valid = rows[p] >= 0 && rows[p] < images;
+    }
+
+    if (!valid) {
+        cerr << "Corrupted inverted index postings" << endl;
+        clear();
+        return false;
+    }
+    return true;
+}
+
+vector<pair<int, float>> InvertedIndex::search(const float* histogram, size_t k) const {
+    vector<pair<int, float>> results;
+    if (empty() || k == 0)
+        return results;
+
+    // === Query TF-IDF vector, normalized like the indexed ones ===
+    vector<pair<int, float>> queryWords;
+    double norm = 0.0;
+    for (int w = 0; w < wordCount; ++w) {
+        const float weight = histogram[w] * idf[w];
+        if (weight != 0.0f) {
+            queryWords.emplace_back(w, weight);
+            norm += static_cast<double>(weight) * weight;
+        }
+    }
+    if (queryWords.empty())
+        return results;
+    const float scale = static_cast<float>(1.0 / sqrt(norm));
+
+    unique_ptr<Accumulator> accumulator;
+    {
+        lock_guard<mutex> lock(accumulatorLock);
+        if (!accumulatorPool.empty()) {
+            accumulator = move(accumulatorPool.back());
+            accumulatorPool.pop_back();
+        }
+    }
+    if (!accumulator)
+        accumulator.reset(new Accumulator);
+    if (accumulator->scores.size() != static_cast<size_t>(imageCount))
+        accumulator->scores.assign(imageCount, 0.0f);
+
+    // === Walk only the posting lists of the query words ===
+    vector<float>& scores = accumulator->scores;
+    vector<int>& touched = accumulator->touched;
+    for (const auto& [word, weight] : queryWords) {
+        const float queryWeight = weight * scale;
+        if (!compressed) {
+            for (uint64_t p = offsets[word]; p < offsets[word + 1]; ++p) {
+                const int image = rows[p];
+                if (scores[image] == 0.0f)
+                    touched.push_back(image);
+                scores[image] += queryWeight * weights[p];
+            }
+            continue;
+        }
+
+        // Packed list: the gaps and weights of one block are decoded into the cache, the weights
+        // in a separate (vectorizable) loop, and the images are rebuilt while accumulating
+        const float step = queryWeight * weightScales[word];
+        const uint8_t* input = stream + streamOffsets[word];
+        int32_t image = -1;
+        uint32_t gaps[blockSize];
+        float contributions[blockSize];
+        for (uint64_t p = offsets[word]; p < offsets[word + 1]; p += blockSize) {
+            const int count = static_cast<int>(min<uint64_t>(blockSize, offsets[word + 1] - p));
+            input = decodeGaps(input, count, gaps);
+            const uint8_t* blockWeights = quantizedWeights + p;
+            for (int j = 0; j < count; ++j)
+                contributions[j] = step * blockWeights[j];
+            for (int j = 0; j < count; ++j) {
+                image += static_cast<int32_t>(gaps[j]) + 1;
+                if (scores[image] == 0.0f)
+                    touched.push_back(image);
+                scores[image] += contributions[j];
+            }
+        }
+    }
+
+    // Cosine similarity -> distance between unit vectors; the accumulator is reset as it is read
+    TopKSelector topK(k, false);
+    for (int image : touched) {
+        const float cosine = min(1.0f, scores[image]);
+        topK.push(image, sqrt(max(0.0f, 2.0f - 2.0f * cosine)));
+        scores[image] = 0.0f;
+    }
+    touched.clear();
+
+    {
+        lock_guard<mutex> lock(accumulatorLock);
+        accumulatorPool.push_back(move(accumulator));
+    }
+
+    return topK.sortedResults();
+}
+
+void InvertedIndex::clear() {
+    wordCount = 0;
+    imageCount = 0;
+    ownedIdf.clear();
+    ownedOffsets.clear();
+    ownedRows.clear();
+    ownedWeights.clear();
+    idf = nullptr;
+    offsets = nullptr;
+    rows = nullptr;
+    weights = nullptr;
+
+    compressed = false;
+    streamSize = 0;
+    ownedStreamOffsets.clear();
+    ownedScales.clear();
+    ownedQuantized.clear();
+    ownedStream.clear();
+    streamOffsets = nullptr;
+    weightScales = nullptr;
+    quantizedWeights = nullptr;
+    stream = nullptr;
+
+    lock_guard<mutex> lock(accumulatorLock);
+    accumulatorPool.clear();
+}
+
+bool InvertedIndex::empty() const {
+    return wordCount == 0 || imageCount == 0;
+}
+
+int InvertedIndex::size() const {
+    return imageCount;
+}
+
+int InvertedIndex::getWordCount() const {
+    return wordCount;
+}
+
+uint64_t InvertedIndex::getPostingCount() const {
+    return offsets ? offsets[wordCount] : 0;
+}
+
+bool InvertedIndex::isCompressed() const {
+    return compressed;
+}
+
+uint64_t InvertedIndex::getPostingBytes() const {
+    const uint64_t postings = getPostingCount();
+    return compressed ? postings + streamSize : postings * (sizeof(int32_t) + sizeof(float));
+}
@@ -0,0 +1,230 @@
+#pragma once
+
+#include <opencv2/opencv.hpp>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "IndexFormat.h"
+
+using namespace std;
+using namespace cv;
+
+static const char indexSectionInvertedIdf[] = "INVI";       ///< IDF of every visual word (float array)
+static const char indexSectionInvertedPostings[] = "INVP";  ///< int32 word count, int32 image count, uint64 posting count, uint64 offsets (words + 1), int32 rows, float weights
+static const char indexSectionInvertedPacked[] = "INVC";    ///< int32 word count, int32 image count, uint64 posting count, uint64 stream size, uint64 offsets (words + 1), uint64 stream offsets (words + 1), float weight scales (words), uint8 weights, packed image stream
+
+/**
+ * @class InvertedIndex
+ * @brief Inverted file from visual words to the images containing them, with TF-IDF weights.
+ *
+ * BoVW histograms have a few hundred non-zero words out of thousands, so instead of comparing
+ * dense histograms the index keeps, for every word, the list of (image, weight) pairs where the
+ * word occurs. Weights are TF-IDF: the histogram value times log(N / df) of the word, and each
+ * image vector is L2-normalized. A query only walks the posting lists of its own words and
+ * accumulates the cosine similarity of the images it meets, so its cost depends on the number
+ * of postings touched rather than on the collection size times the vocabulary size. Words
+ * found in every image (IDF 0) weigh nothing and get no postings.
+ *
+ * Postings are stored word by word (compressed sparse rows) and can be used in place from a
+ * memory-mapped index.bin.
+ *
+ * Posting lists can be compressed. The images of a list are increasing, so they are stored
+ * as gaps: full blocks of 128 gaps are bit-packed with the width of their largest gap (one
+ * byte of width, then 16 bytes per bit), the remainder of the list uses variable-byte codes.
+ * Each weight becomes one byte, scaled by the largest weight of its word. A posting then
+ * takes about 2 bytes instead of 8. Blocks are unpacked by routines specialized for each bit
+ * width, without branches, so the decoding keeps up with the accumulation it feeds.
+ */
+class InvertedIndex {
+private:
+    /**
+     * @struct Accumulator
+     * @brief Score of each image for one query, with the list of images touched so it can be reset cheaply.
+     */
+    struct Accumulator {
+        vector<float> scores;       ///< Accumulated similarity of each image (0 when untouched)
+        vector<int> touched;        ///< Images with a non-zero score
+    };
+
+    static const int blockSize = 128;   ///< Gaps bit-packed together in a compressed posting list
+    static const int streamPadding = 8; ///< Zero bytes after the packed stream, read by the unpacking of the last block
+
+    int wordCount = 0;                  ///< Vocabulary size
+    int imageCount = 0;                 ///< Number of indexed images
+    vector<float> ownedIdf;             ///< IDF of each word when built in memory
+    vector<uint64_t> ownedOffsets;      ///< Posting offsets when built in memory
+    vector<int32_t> ownedRows;          ///< Posting images when built in memory
+    vector<float> ownedWeights;         ///< Posting weights when built in memory
+    const float* idf = nullptr;         ///< IDF of each word (0 for words in no image)
+    const uint64_t* offsets = nullptr;  ///< Start of the posting list of each word (wordCount + 1 entries)
+    const int32_t* rows = nullptr;      ///< Image (feature store row) of each posting
+    const float* weights = nullptr;     ///< Normalized TF-IDF weight of each posting
+
+    bool compressed = false;                    ///< True if the postings are packed (rows and weights are then null)
+    uint64_t streamSize = 0;                    ///< Size of the packed image stream, padding included
+    vector<uint64_t> ownedStreamOffsets;        ///< Stream offsets when built in memory
+    vector<float> ownedScales;                  ///< Weight scales when built in memory
+    vector<uint8_t> ownedQuantized;             ///< Quantized weights when built in memory
+    vector<uint8_t> ownedStream;                ///< Packed image stream when built in memory
+    const uint64_t* streamOffsets = nullptr;    ///< Start of the packed images of each word (wordCount + 1 entries)
+    const float* weightScales = nullptr;        ///< Value of one quantization step of the weights of each word
+    const uint8_t* quantizedWeights = nullptr;  ///< Quantized weight of each posting
+    const uint8_t* stream = nullptr;            ///< Packed images of every word
+
+    mutable mutex accumulatorLock;                          ///< Protects `accumulatorPool`
+    mutable vector<unique_ptr<Accumulator>> accumulatorPool; ///< Reusable accumulators, one per concurrent search
+
+    /**
+     * @brief Points the index at the owned arrays after a build.
+     *
+     * @return void
+     */
+    void useOwnedArrays();
+
+    /**
+     * @brief Replaces the built rows and weights by their compressed form.
+     *
+     * @return void
+     */
+    void compress();
+
+    /**
+     * @brief Appends the packed form of one posting list to the stream.
+     *
+     * @param[in]     images   Images of the list, increasing.
+     * @param[in]     count    Number of postings.
+     * @param[in,out] output   Stream receiving the blocks.
+     *
+     * @return void
+     */
+    static void encodeList(const int32_t* images, size_t count, vector<uint8_t>& output);
+
+    /**
+     * @brief Decodes the gaps of the next block of a packed posting list.
+     *
+     * A block of `blockSize` postings is bit-packed, a shorter one (the end of the list) is
+     * variable-byte coded. Image i of the list is image i - 1 plus gap i plus one, the first
+     * image following -1.
+     *
+     * @param[in]  input   Start of the block in the stream.
+     * @param[in]  count   Postings in the block.
+     * @param[out] gaps    Decoded gaps (`count` entries).
+     *
+     * @return The start of the next block.
+     */
+    static const uint8_t* decodeGaps(const uint8_t* input, int count, uint32_t* gaps);
+
+    /**
+     * @brief Checks that every packed list stays in the stream and refers to existing images.
+     *
+     * @return true if the stream can be decoded safely; false otherwise.
+     */
+    bool validateStream() const;
+
+public:
+    /**
+     * @brief Default constructor. Creates an empty index.
+     */
+    InvertedIndex() {}
+
+    InvertedIndex(const InvertedIndex&) = delete;
+    InvertedIndex& operator=(const InvertedIndex&) = delete;
+
+    /**
+     * @brief Builds the posting lists from BoVW histograms.
+     *
+     * @param[in] histograms   One histogram per row (CV_32F, one column per visual word).
+     * @param[in] packed       True to compress the posting lists (8-bit weights).
+     *
+     * @return true if the index was built; false otherwise.
+     */
+    bool build(const Mat& histograms, bool packed = false);
+
+    /**
+     * @brief Appends the inverted index sections to an index file being written.
+     *
+     * @param[in,out] writer   Open index writer.
+     *
+     * @return void
+     */
+    void write(IndexFileWriter& writer) const;
+
+    /**
+     * @brief Loads the inverted index sections of a mapped index file.
+     *
+     * The postings are used in place: the mapping must outlive the index.
+     *
+     * @param[in] reader    Opened index reader.
+     * @param[in] images    Number of rows of the feature store the postings refer to.
+     *
+     * @return true if the sections were found and are consistent; false otherwise.
+     */
+    bool read(const IndexFileReader& reader, int images);
+
+    /**
+     * @brief Finds the images most similar to a query histogram.
+     *
+     * Only the posting lists of the non-zero words of the query are read. Images sharing no
+     * word with the query are never touched and are not returned.
+     *
+     * @param[in] histogram   Query BoVW histogram (getWordCount() floats).
+     * @param[in] k           Number of results.
+     *
+     * @return Up to k (row, distance) pairs, closest first. The distance is the L2 distance
+     *         between the normalized TF-IDF vectors, sqrt(2 - 2 cos), so it ranks like the
+     *         cosine similarity and stays comparable with the dense L2 scan.
+     */
+    vector<pair<int, float>> search(const float* histogram, size_t k) const;
+
+    /**
+     * @brief Releases the index.
+     *
+     * @return void
+     */
+    void clear();
+
+    /**
+     * @brief Tells whether the index has postings.
+     *
+     * @return True if no index is built or loaded.
+     */
+    bool empty() const;
+
+    /**
+     * @brief Returns the number of indexed images.
+     *
+     * @return The image count.
+     */
+    int size() const;
+
+    /**
+     * @brief Returns the vocabulary size.
+     *
+     * @return The number of posting lists.
+     */
+    int getWordCount() const;
+
+    /**
+     * @brief Returns the total number of postings.
+     *
+     * @return The number of (image, weight) pairs.
+     */
+    uint64_t getPostingCount() const;
+
+    /**
+     * @brief Tells whether the posting lists are compressed.
+     *
+     * @return True for packed images and quantized weights.
+     */
+    bool isCompressed() const;
+
+    /**
+     * @brief Returns the memory taken by the posting lists.
+     *
+     * @return Bytes of images and weights (offsets excluded).
+     */
+    uint64_t getPostingBytes() const;
+};
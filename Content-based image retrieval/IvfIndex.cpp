@@ -0,0 +1,165 @@
+#include "IvfIndex.h"
+
+#include <algorithm>
+
+#include "BoVW.h"
+#include "DistanceKernels.h"
+
+bool IvfIndex::train(const Mat& descriptors, int lists, int threadCount, int miniBatchSize, int sampleSize) {
+    clear();
+    if (descriptors.empty() || descriptors.type() != CV_32F || lists <= 0) {
+        cerr << "IVF index needs CV_32F descriptors and at least one list." << endl;
+        return false;
+    }
+
+    // === Coarse quantizer: the same k-means as the BoVW vocabulary ===
+    lists = min(lists, descriptors.rows);
+    BagOfVisualWord coarse(lists);
+    coarse.setThreadCount(threadCount);
+    coarse.setMiniBatchTraining(miniBatchSize, sampleSize);
+
+    vector<Mat> trainingSet = { descriptors };
+    coarse.buildVocabulary(trainingSet);
+    Mat trained = coarse.getVocabulary();
+    if (trained.rows != lists) {
+        cerr << "IVF coarse quantizer training failed." << endl;
+        return false;
+    }
+
+    // === Assign every row to its nearest centroid and group the rows by list ===
+    vector<int> labels;
+    BagOfVisualWord::assignNearestWords(descriptors, trained, BagOfVisualWord::computeRowNorms(trained), labels);
+
+    ownedLists.assign(static_cast<size_t>(lists) + 1 + descriptors.rows, 0);
+    int32_t* offsets = ownedLists.data();
+    int32_t* rows = offsets + lists + 1;
+    for (int label : labels)
+        ++offsets[label + 1];
+    for (int l = 0; l < lists; ++l)
+        offsets[l + 1] += offsets[l];
+
+    // Counting sort keeps the rows of a list in increasing order
+    vector<int32_t> next(offsets, offsets + lists);
+    for (int r = 0; r < descriptors.rows; ++r)
+        rows[next[labels[r]]++] = r;
+
+    centroids = trained;
+    listOffsets = offsets;
+    listRows = rows;
+    listCount = lists;
+    rowCount = descriptors.rows;
+    return true;
+}
+
+void IvfIndex::write(IndexFileWriter& writer) const {
+    if (empty())
+        return;
+
+    writer.beginSection(indexSectionIvfCentroids);
+    writer.writeMatrix(centroids);
+    writer.endSection();
+
+    int32_t counts[2] = { listCount, rowCount };
+    writer.beginSection(indexSectionIvfLists);
+    writer.write(counts, sizeof(counts));
+    writer.write(listOffsets, (static_cast<size_t>(listCount) + 1) * sizeof(int32_t));
+    writer.write(listRows, static_cast<size_t>(rowCount) * sizeof(int32_t));
+    writer.endSection();
+}
+
+bool IvfIndex::read(const IndexFileReader& reader, int rows, int dims) {
+    clear();
+
+    const unsigned char* data = nullptr;
+    size_t size = 0;
+    Mat matrix;
+    if (!reader.findSection(indexSectionIvfCentroids, data, size))
+        return false;
+    if (!IndexFileReader::readMatrix(data, size, matrix) || matrix.type() != CV_32F || matrix.cols != dims || matrix.rows == 0) {
+        cerr << "Corrupted IVF centroids in index" << endl;
+        return false;
+    }
+
+    int32_t counts[2] = { 0, 0 };
+    if (!reader.findSection(indexSectionIvfLists, data, size) || size < sizeof(counts)) {
+        cerr << "Corrupted IVF lists in index" << endl;
+        return false;
+    }
+    memcpy(counts, data, sizeof(counts));
+
+    const size_t expected = sizeof(counts) + (static_cast<size_t>(matrix.rows) + 1 + rows) * sizeof(int32_t);
+    if (counts[0] != matrix.rows || counts[1] != rows || size != expected) {
+        cerr << "IVF lists do not match the index" << endl;
+        return false;
+    }
+
+    // Offsets must be increasing and rows in range, so a probe never reads out of the store
+    const int32_t* offsets = reinterpret_cast<const int32_t*>(data + sizeof(counts));
+    const int32_t* listData = offsets + counts[0] + 1;
+    bool valid = offsets[0] == 0 && offsets[counts[0]] == rows;
+    for (int l = 0; valid && l < counts[0]; ++l)
+        valid = offsets[l] <= offsets[l + 1];
+    for (int r = 0; valid && r < rows; ++r)
+        valid = listData[r] >= 0 && listData[r] < rows;
+    if (!valid) {
+        cerr << "Corrupted IVF lists in index" << endl;
+        return false;
+    }
+
+    centroids = matrix;
+    listOffsets = offsets;
+    listRows = listData;
+    listCount = counts[0];
+    rowCount = rows;
+    return true;
+}
+
+vector<int> IvfIndex::probe(const float* query, int nprobe) const {
+    vector<int> nearest;
+    if (empty() || nprobe <= 0)
+        return nearest;
+
+    const DistanceKernel squaredL2 = DistanceKernels::best().squaredL2;
+    const size_t dims = static_cast<size_t>(centroids.cols);
+    vector<pair<float, int>> distances(listCount);
+    for (int l = 0; l < listCount; ++l)
+        distances[l] = make_pair(squaredL2(query, centroids.ptr<float>(l), dims), l);
+
+    const int count = min(nprobe, listCount);
+    partial_sort(distances.begin(), distances.begin() + count, distances.end());
+
+    nearest.reserve(count);
+    for (int i = 0; i < count; ++i)
+        nearest.push_back(distances[i].second);
+    return nearest;
+}
+
+const int32_t* IvfIndex::getList(int list, int& length) const {
+    length = listOffsets[list + 1] - listOffsets[list];
+    return listRows + listOffsets[list];
+}
+
+void IvfIndex::clear() {
+    centroids.release();
+    ownedLists.clear();
+    listOffsets = nullptr;
+    listRows = nullptr;
+    listCount = 0;
+    rowCount = 0;
+}
+
+bool IvfIndex::empty() const {
+    return listCount == 0;
+}
+
+int IvfIndex::getListCount() const {
+    return listCount;
+}
+
+int IvfIndex::size() const {
+    return rowCount;
+}
+
+int IvfIndex::getDimensions() const {
+    return centroids.cols;
+}
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <opencv2/opencv.hpp>
+#include <cstdint>
+#include <vector>
+
+#include "IndexFormat.h"
+
+using namespace std;
+using namespace cv;
+
+static const char indexSectionIvfCentroids[] = "IVFC";  ///< Coarse centroids of the IVF index (matrix)
+static const char indexSectionIvfLists[] = "IVFL";      ///< int32 list count, int32 row count, (lists + 1) offsets, then the rows of every list
+
+/**
+ * @class IvfIndex
+ * @brief Inverted-file index: the stored descriptors partitioned by a coarse k-means.
+ *
+ * Every indexed image belongs to the list of its nearest coarse centroid. A query is compared
+ * to the centroids first and only the rows of its `nprobe` nearest lists are scanned, so the
+ * cost of a query falls roughly by a factor `listCount / nprobe` at some loss of recall.
+ * The lists only hold row numbers of the feature store (4 bytes per image), the descriptors
+ * themselves are not duplicated.
+ */
+class IvfIndex {
+private:
+    Mat centroids;                      ///< Coarse centroids (one list per row, CV_32F)
+    vector<int32_t> ownedLists;         ///< Offsets and rows when trained in memory
+    const int32_t* listOffsets = nullptr;   ///< Start of each list in `listRows` (listCount + 1 entries)
+    const int32_t* listRows = nullptr;      ///< Feature store rows, grouped by list
+    int listCount = 0;                  ///< Number of lists
+    int rowCount = 0;                   ///< Number of indexed rows
+
+public:
+    /**
+     * @brief Partitions a descriptor matrix into lists.
+     *
+     * The coarse centroids are trained with the BoVW k-means machinery (`cv::kmeans`, or
+     * mini-batch k-means on a sample when `miniBatchSize` > 0) and every row is assigned to
+     * its nearest centroid.
+     *
+     * @param[in] descriptors     Indexed descriptors (one row per image, CV_32F).
+     * @param[in] lists           Number of lists (clamped to the number of rows).
+     * @param[in] threadCount     Threads used by the k-means (<= 0 uses all hardware threads).
+     * @param[in] miniBatchSize   Batch size of mini-batch k-means (0 = full k-means).
+     * @param[in] sampleSize      Rows sampled to train the centroids (0 = all of them).
+     *
+     * @return true if the index was built; false otherwise.
+     */
+    bool train(const Mat& descriptors, int lists, int threadCount = 0, int miniBatchSize = 0, int sampleSize = 0);
+
+    /**
+     * @brief Appends the IVF sections to an index file being written.
+     *
+     * @param[in,out] writer   Open index writer.
+     *
+     * @return void
+     */
+    void write(IndexFileWriter& writer) const;
+
+    /**
+     * @brief Loads the IVF sections of a mapped index file.
+     *
+     * The lists are used in place: the mapping must outlive the index.
+     *
+     * @param[in] reader     Opened index reader.
+     * @param[in] rows       Number of rows of the feature store the lists refer to.
+     * @param[in] dims       Descriptor length of the feature store.
+     *
+     * @return true if IVF sections were found and are consistent; false otherwise.
+     */
+    bool read(const IndexFileReader& reader, int rows, int dims);
+
+    /**
+     * @brief Returns the lists nearest to a query (L2 distance to the coarse centroids).
+     *
+     * @param[in] query    Query descriptor (getDimensions() floats).
+     * @param[in] nprobe   Number of lists to return (clamped to the list count).
+     *
+     * @return The list numbers, nearest first.
+     */
+    vector<int> probe(const float* query, int nprobe) const;
+
+    /**
+     * @brief Returns the rows of one list.
+     *
+     * @param[in]  list     List number.
+     * @param[out] length   Number of rows in the list.
+     *
+     * @return A pointer to the feature store rows of the list.
+     */
+    const int32_t* getList(int list, int& length) const;
+
+    /**
+     * @brief Releases the index.
+     *
+     * @return void
+     */
+    void clear();
+
+    /**
+     * @brief Tells whether the index has lists.
+     *
+     * @return True if no index is trained or loaded.
+     */
+    bool empty() const;
+
+    /**
+     * @brief Returns the number of lists.
+     *
+     * @return The list count.
+     */
+    int getListCount() const;
+
+    /**
+     * @brief Returns the number of indexed rows.
+     *
+     * @return The row count.
+     */
+    int size() const;
+
+    /**
+     * @brief Returns the descriptor length of the centroids.
+     *
+     * @return The number of columns of the centroids.
+     */
+    int getDimensions() const;
+};
@@ -7,16 +7,27 @@ int main(int argc, char* argv[]) {
 		ImageRetrievalUI app;
 		app.run();
 	}
-	else if (argc == 5) {
+	else if (argc >= 5) {
+		// Optional "name=value" settings may follow the mode (e.g., threads=8)
 		if (string(argv[4]) == "Extraction") {
 			Tester tester(argv[1], argv[2], argv[3], EXTRACT);
+			for (int i = 5; i < argc; ++i)
+				tester.setOption(argv[i]);
 			tester.runTestFeatureExtraction();
 			tester.writeExtractionResultToFile(argv[1], argv[2], atoi(argv[3]), "Extraction_result");
 		}
 		else if (string(argv[4]) == "Query") {
 			Tester tester(argv[1], argv[2], argv[3], QUERY);
+			for (int i = 5; i < argc; ++i)
+				tester.setOption(argv[i]);
 			tester.runTestQuery();
 			tester.writeQueryResultToFile(argv[1], argv[2], atoi(argv[3]), "Query_result");
+		}
+		else if (string(argv[4]) == "Benchmark") {
+			// Arguments: database size, repetitions, extra descriptor length (0 for none)
+			Tester tester(argv[1], argv[2], argv[3], BENCHMARK);
+			tester.runDistanceBenchmark();
+			tester.writeBenchmarkResultToFile("Benchmark_result");
 		}	
 	}
 	else {
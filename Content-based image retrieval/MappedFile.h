@@ -0,0 +1,82 @@
+#pragma once
+
+#include <string>
+#include <cstddef>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+using namespace std;
+
+/**
+ * @class MappedFile
+ * @brief Read-only memory mapping of a whole file.
+ *
+ * The file content is accessed in place through the OS page cache instead of being copied
+ * into heap buffers: pages are loaded on first access and are shared by every process that
+ * maps the same file. The mapping stays valid until `close()` or destruction, so any view
+ * built on `getData()` must not outlive the object.
+ */
+class MappedFile {
+private:
+    const unsigned char* data = nullptr;    ///< First byte of the mapping (nullptr if not open)
+    size_t size = 0;                        ///< Size of the mapped file in bytes
+#ifdef _WIN32
+    HANDLE fileHandle = INVALID_HANDLE_VALUE;   ///< Handle of the opened file
+    HANDLE mappingHandle = NULL;                ///< Handle of the file mapping object
+#else
+    int fileDescriptor = -1;                ///< Descriptor of the opened file
+#endif
+
+public:
+    /**
+     * @brief Default constructor. No file is mapped.
+     */
+    MappedFile() {}
+
+    /**
+     * @brief Destructor. Unmaps the file.
+     */
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    /**
+     * @brief Maps a file read-only, replacing any previous mapping.
+     *
+     * @param[in] path   Path of the file.
+     *
+     * @return True if the file was mapped, false if it cannot be opened or is empty.
+     */
+    bool open(const string& path);
+
+    /**
+     * @brief Unmaps the file. Views on the previous data become invalid.
+     *
+     * @return void
+     */
+    void close();
+
+    /**
+     * @brief Tells whether a file is mapped.
+     *
+     * @return True if a file is mapped.
+     */
+    bool isOpen() const;
+
+    /**
+     * @brief Returns the mapped bytes (page-aligned).
+     *
+     * @return Pointer to the first byte, nullptr if no file is mapped.
+     */
+    const unsigned char* getData() const;
+
+    /**
+     * @brief Returns the size of the mapped file.
+     *
+     * @return Size in bytes.
+     */
+    size_t getSize() const;
+};
@@ -0,0 +1,333 @@
+#include "MiniBatchKMeans.h"
+#include "BoVW.h"
+
+void MiniBatchKMeans::setStoppingCriteria(double tol, int noImprovementSteps) {
+    tolerance = tol;
+    maxNoImprovement = noImprovementSteps;
+}
+
+void MiniBatchKMeans::setSeed(unsigned int value) {
+    seed = value;
+}
+
+void MiniBatchKMeans::setThreadCount(int count) {
+    threadCount = count;
+}
+
+Mat MiniBatchKMeans::getCenters() const {
+    return centers;
+}
+
+double MiniBatchKMeans::getInertia() const {
+    return inertia;
+}
+
+bool MiniBatchKMeans::hasConverged() const {
+    return converged;
+}
+
+const vector<MiniBatchIteration>& MiniBatchKMeans::getHistory() const {
+    return history;
+}
+
+Mat MiniBatchKMeans::sampleDescriptors(const vector<Mat>& descriptors, int sampleSize, unsigned int seed) {
+    // First pass: validate the matrices and count the rows without copying anything
+    vector<bool> usable(descriptors.size(), false);
+    long long total = 0;
+    int dims = -1;
+    for (size_t i = 0; i < descriptors.size(); ++i) {
+        const Mat& desc = descriptors[i];
+        if (desc.empty())
+            continue;
+
+        // Only accept 2D descriptors (rows = keypoints, cols = descriptor length)
+        if (desc.dims != 2 || (dims >= 0 && desc.cols != dims)) {
+            cerr << "Descriptor with unexpected dimensions, skipping.\n";
+            continue;
+        }
+
+        dims = desc.cols;
+        usable[i] = true;
+        total += desc.rows;
+    }
+
+    if (total == 0)
+        return Mat();
+
+    const long long wanted = (sampleSize <= 0 || sampleSize >= total) ? total : sampleSize;
+    Mat sample(static_cast<int>(wanted), dims, CV_32F);
+
+    // Second pass: selection sampling keeps each row with probability (rows still wanted) / (rows left),
+    // which yields exactly `wanted` uniformly chosen rows (all of them when no sampling is requested)
+    RNG rng(seed);
+    long long remaining = total;
+    int filled = 0;
+    Mat floatDesc;
+    for (size_t i = 0; i < descriptors.size() && filled < wanted; ++i) {
+        if (!usable[i])
+            continue;
+
+        // Ensure descriptors are of type CV_32F (required for k-means)
+        if (descriptors[i].type() != CV_32F)
+            descriptors[i].convertTo(floatDesc, CV_32F);
+        else
+            floatDesc = descriptors[i];
+
+        for (int r = 0; r < floatDesc.rows && filled < wanted; ++r, --remaining) {
+            if (rng.uniform(0.0, 1.0) * remaining < static_cast<double>(wanted - filled))
+                floatDesc.row(r).copyTo(sample.row(filled++));
+        }
+    }
+
+    return sample.rowRange(0, filled);
+}
+
+void MiniBatchKMeans::assign(const Mat& samples, ThreadPool& pool, vector<int>& labels, vector<float>& distances) const {
+    labels.resize(samples.rows);
+    distances.resize(samples.rows);
+
+    const size_t chunks = (samples.rows + assignmentChunkRows - 1) / assignmentChunkRows;
+    pool.parallelFor(chunks, [&](size_t chunk) {
+        const int r0 = static_cast<int>(chunk) * assignmentChunkRows;
+        const int r1 = min(samples.rows, r0 + assignmentChunkRows);
+
+        vector<int> chunkLabels;
+        vector<float> chunkDistances;
+        BagOfVisualWord::assignNearestWords(samples.rowRange(r0, r1), centers, centerNorms, chunkLabels, &chunkDistances);
+
+        copy(chunkLabels.begin(), chunkLabels.end(), labels.begin() + r0);
+        copy(chunkDistances.begin(), chunkDistances.end(), distances.begin() + r0);
+    });
+}
+
+void MiniBatchKMeans::seedCenters(const Mat& samples, ThreadPool& pool, RNG& rng) {
+    const int dims = samples.cols;
+
+    // k-means++ costs one pass over the candidates per center, so it runs on a few times k
+    // random samples rather than on the whole training set
+    const int candidateRows = min(samples.rows, max(3 * clusterCount, 3 * batchSize));
+    Mat candidates;
+    if (candidateRows < samples.rows) {
+        candidates.create(candidateRows, dims, CV_32F);
+        for (int i = 0; i < candidateRows; ++i)
+            samples.row(rng.uniform(0, samples.rows)).copyTo(candidates.row(i));
+    }
+    else {
+        candidates = samples;
+    }
+
+    centers.create(clusterCount, dims, CV_32F);
+    vector<float> minDistances(candidateRows, FLT_MAX);  // squared distance to the closest chosen center
+    const size_t chunks = (candidateRows + assignmentChunkRows - 1) / assignmentChunkRows;
+    vector<double> chunkSums(chunks, 0.0);
+
+    int chosen = rng.uniform(0, candidateRows);
+    for (int c = 0; c < clusterCount; ++c) {
+        candidates.row(chosen).copyTo(centers.row(c));
+        if (c + 1 == clusterCount)
+            break;
+
+        // Update the distances with the new center
+        const float* center = centers.ptr<float>(c);
+        pool.parallelFor(chunks, [&](size_t chunk) {
+            const int r0 = static_cast<int>(chunk) * assignmentChunkRows;
+            const int r1 = min(candidateRows, r0 + assignmentChunkRows);
+
+            double sum = 0.0;
+            for (int r = r0; r < r1; ++r) {
+                const float* x = candidates.ptr<float>(r);
+                float dist = 0.0f;
+                for (int d = 0; d < dims; ++d) {
+                    const float diff = x[d] - center[d];
+                    dist += diff * diff;
+                }
+                if (dist < minDistances[r])
+                    minDistances[r] = dist;
+                sum += minDistances[r];
+            }
+            chunkSums[chunk] = sum;
+        });
+
+        double total = 0.0;
+        for (double sum : chunkSums)
+            total += sum;
+
+        // Every candidate is already a center: any choice is as good as another
+        if (total <= 0.0) {
+            chosen = rng.uniform(0, candidateRows);
+            continue;
+        }
+
+        // Draw the next center with probability proportional to its squared distance
+        double target = rng.uniform(0.0, total);
+        size_t chunk = 0;
+        while (chunk + 1 < chunks && target >= chunkSums[chunk]) {
+            target -= chunkSums[chunk];
+            ++chunk;
+        }
+
+        const int r0 = static_cast<int>(chunk) * assignmentChunkRows;
+        const int r1 = min(candidateRows, r0 + assignmentChunkRows);
+        chosen = r1 - 1;
+        for (int r = r0; r < r1; ++r) {
+            if (target < minDistances[r]) {
+                chosen = r;
+                break;
+            }
+            target -= minDistances[r];
+        }
+    }
+
+    centerNorms = BagOfVisualWord::computeRowNorms(centers);
+}
+
+bool MiniBatchKMeans::fit(const Mat& samples) {
+    history.clear();
+    converged = false;
+    inertia = 0.0;
+
+    if (clusterCount <= 0 || batchSize <= 0) {
+        cerr << "Error: mini-batch k-means needs a positive cluster count and batch size.\n";
+        return false;
+    }
+
+    if (samples.empty() || samples.type() != CV_32F) {
+        cerr << "Error: mini-batch k-means needs CV_32F samples.\n";
+        return false;
+    }
+
+    if (samples.rows < clusterCount) {
+        cerr << "Error: Not enough descriptors (" << samples.rows
+            << ") for dictionary size (" << clusterCount << ").\n";
+        return false;
+    }
+
+    const int rows = samples.rows;
+    const int dims = samples.cols;
+
+    ThreadPool pool(threadCount);
+    RNG rng(seed);
+
+    seedCenters(samples, pool, rng);
+    centerCounts.assign(clusterCount, 0);
+
+    // Total variance of the data, so the tolerance does not depend on the descriptor scale
+    vector<double> columnMeans(dims, 0.0);
+    double meanSquaredNorm = 0.0;
+    for (int r = 0; r < rows; ++r) {
+        const float* x = samples.ptr<float>(r);
+        for (int d = 0; d < dims; ++d) {
+            columnMeans[d] += x[d];
+            meanSquaredNorm += static_cast<double>(x[d]) * x[d];
+        }
+    }
+    meanSquaredNorm /= rows;
+    double dataVariance = meanSquaredNorm;
+    for (int d = 0; d < dims; ++d) {
+        columnMeans[d] /= rows;
+        dataVariance -= columnMeans[d] * columnMeans[d];
+    }
+
+    const int stepRows = min(batchSize, rows);
+    const double smoothing = min(1.0, 2.0 * stepRows / (rows + 1.0));
+
+    Mat batch(stepRows, dims, CV_32F);
+    Mat batchSums = Mat::zeros(clusterCount, dims, CV_32F);
+    vector<int> batchCounts(clusterCount, 0);
+    vector<int> touched;
+    vector<int> labels;
+    vector<float> distances;
+
+    double smoothedInertia = 0.0;
+    double bestInertia = DBL_MAX;
+    int stepsWithoutImprovement = 0;
+
+    for (int iteration = 1; iteration <= maxIterations; ++iteration) {
+        // Draw a batch and assign it to the current centers
+        for (int i = 0; i < stepRows; ++i)
+            samples.row(rng.uniform(0, rows)).copyTo(batch.row(i));
+        assign(batch, pool, labels, distances);
+
+        // Accumulate the batch per center
+        double batchInertia = 0.0;
+        touched.clear();
+        for (int i = 0; i < stepRows; ++i) {
+            const int c = labels[i];
+            batchInertia += distances[i];
+            if (batchCounts[c]++ == 0)
+                touched.push_back(c);
+
+            float* sum = batchSums.ptr<float>(c);
+            const float* x = batch.ptr<float>(i);
+            for (int d = 0; d < dims; ++d)
+                sum[d] += x[d];
+        }
+        batchInertia /= stepRows;
+
+        // Each touched center becomes the mean of every sample it has received so far,
+        // i.e. a learning rate of 1 / count per sample
+        double shift = 0.0;
+        float* norms = centerNorms.ptr<float>(0);
+        for (int c : touched) {
+            const long long seen = centerCounts[c] + batchCounts[c];
+            const float oldWeight = static_cast<float>(static_cast<double>(centerCounts[c]) / seen);
+            const float sampleWeight = static_cast<float>(1.0 / seen);
+
+            float* center = centers.ptr<float>(c);
+            float* sum = batchSums.ptr<float>(c);
+            float norm = 0.0f;
+            for (int d = 0; d < dims; ++d) {
+                const float updated = center[d] * oldWeight + sum[d] * sampleWeight;
+                const float delta = updated - center[d];
+                shift += delta * delta;
+                norm += updated * updated;
+                center[d] = updated;
+                sum[d] = 0.0f;
+            }
+
+            norms[c] = norm;
+            centerCounts[c] = seen;
+            batchCounts[c] = 0;
+        }
+        shift /= touched.size();
+
+        smoothedInertia = (iteration == 1) ? batchInertia : smoothedInertia * (1.0 - smoothing) + batchInertia * smoothing;
+
+        MiniBatchIteration stats;
+        stats.iteration = iteration;
+        stats.batchInertia = batchInertia;
+        stats.smoothedInertia = smoothedInertia;
+        stats.centerShift = shift;
+        history.push_back(stats);
+
+        if (iteration == 1 || iteration % 10 == 0)
+            cout << "Mini-batch k-means step " << iteration << "/" << maxIterations
+                << ": inertia " << smoothedInertia << ", center shift " << shift << endl;
+
+        // Stopping criteria: the centers no longer move, or the inertia no longer improves
+        if (tolerance > 0.0 && shift <= tolerance * dataVariance) {
+            converged = true;
+            break;
+        }
+
+        if (smoothedInertia < bestInertia) {
+            bestInertia = smoothedInertia;
+            stepsWithoutImprovement = 0;
+        }
+        else if (maxNoImprovement > 0 && ++stepsWithoutImprovement >= maxNoImprovement) {
+            converged = true;
+            break;
+        }
+    }
+
+    // Final inertia over the whole training set
+    assign(samples, pool, labels, distances);
+    double total = 0.0;
+    for (float dist : distances)
+        total += dist;
+    inertia = total / rows;
+
+    cout << "Mini-batch k-means " << (converged ? "converged" : "stopped") << " after " << history.size()
+        << " steps, inertia " << inertia << endl;
+    return true;
+}
@@ -0,0 +1,170 @@
+#pragma once
+
+#include <opencv2/opencv.hpp>
+#include <vector>
+#include <iostream>
+
+#include "ThreadPool.h"
+
+using namespace std;
+using namespace cv;
+
+/**
+ * @struct MiniBatchIteration
+ * @brief Convergence statistics of one mini-batch step.
+ */
+struct MiniBatchIteration {
+    int iteration = 0;              ///< Step number (starting at 1)
+    double batchInertia = 0.0;      ///< Mean squared distance of the batch to its nearest center
+    double smoothedInertia = 0.0;   ///< Exponentially weighted average of the batch inertia
+    double centerShift = 0.0;       ///< Mean squared displacement of the centers during the step
+};
+
+/**
+ * @class MiniBatchKMeans
+ * @brief Mini-batch k-means clustering used to train large visual vocabularies.
+ *
+ * Instead of reassigning every sample at each iteration like `cv::kmeans`, each step draws a
+ * small random batch, assigns it to the nearest centers (in parallel, with the batched GEMM
+ * assignment of `BagOfVisualWord`) and moves those centers towards the batch with a per-center
+ * learning rate of 1 / (number of samples seen). Centers are seeded with k-means++ on a
+ * subset of the samples. Training stops after `maxIterations` steps, when the centers stop
+ * moving (`tolerance`), or when the smoothed batch inertia has not improved for
+ * `maxNoImprovement` steps.
+ *
+ * Together with `sampleDescriptors()`, the time and memory needed to train a vocabulary depend
+ * on the sample size and batch size rather than on the number of descriptors in the corpus.
+ */
+class MiniBatchKMeans {
+private:
+    int clusterCount;               ///< Number of clusters (k)
+    int batchSize;                  ///< Samples drawn per step
+    int maxIterations;              ///< Maximum number of steps
+    double tolerance = 1e-4;        ///< Stop when the mean squared center shift falls below tolerance * data variance
+    int maxNoImprovement = 10;      ///< Stop after this many steps without a better smoothed inertia (0 = never)
+    unsigned int seed = 0x5EED;     ///< Seed of the random batches and of the k-means++ seeding
+    int threadCount = 0;            ///< Threads used for the assignment steps (<= 0 uses all hardware threads)
+
+    Mat centers;                    ///< Cluster centers (k x dims, CV_32F)
+    Mat centerNorms;                ///< Squared L2 norm of each center (1 x k, CV_32F)
+    vector<long long> centerCounts; ///< Number of samples that have moved each center so far
+
+    vector<MiniBatchIteration> history; ///< Statistics of every step of the last `fit()`
+    bool converged = false;         ///< True if the last `fit()` stopped before `maxIterations`
+    double inertia = 0.0;           ///< Mean squared distance of all samples to their nearest center after `fit()`
+
+    static const int assignmentChunkRows = 1024;  ///< Rows assigned per parallel task
+
+    /**
+     * @brief Picks the initial centers with k-means++ on (a subset of) the samples.
+     *
+     * @param[in] samples   Training samples (CV_32F).
+     * @param[in] pool      Thread pool used to update the distances to the chosen centers.
+     * @param[in] rng       Random generator.
+     *
+     * @return void
+     */
+    void seedCenters(const Mat& samples, ThreadPool& pool, RNG& rng);
+
+    /**
+     * @brief Assigns samples to their nearest center, splitting the rows across the pool.
+     *
+     * @param[in]  samples     Samples to assign (CV_32F).
+     * @param[in]  pool        Thread pool.
+     * @param[out] labels      Nearest center of each sample.
+     * @param[out] distances   Squared distance of each sample to its nearest center.
+     *
+     * @return void
+     */
+    void assign(const Mat& samples, ThreadPool& pool, vector<int>& labels, vector<float>& distances) const;
+
+public:
+    /**
+     * @brief Constructor.
+     *
+     * @param[in] clusterCount    Number of clusters (k).
+     * @param[in] batchSize       Number of samples drawn per step.
+     * @param[in] maxIterations   Maximum number of steps.
+     */
+    MiniBatchKMeans(int clusterCount, int batchSize = 1024, int maxIterations = 200)
+        : clusterCount(clusterCount), batchSize(batchSize), maxIterations(maxIterations) {}
+
+    /**
+     * @brief Sets the early stopping criteria.
+     *
+     * @param[in] tol                Center shift tolerance, relative to the variance of the data (0 disables it).
+     * @param[in] noImprovementSteps Steps without a better smoothed inertia before stopping (0 disables it).
+     *
+     * @return void
+     */
+    void setStoppingCriteria(double tol, int noImprovementSteps);
+
+    /**
+     * @brief Sets the seed of the random generator, so training can be repeated.
+     *
+     * @param[in] value   Seed.
+     *
+     * @return void
+     */
+    void setSeed(unsigned int value);
+
+    /**
+     * @brief Sets the number of threads used for the assignment steps.
+     *
+     * @param[in] count   Number of threads; a value <= 0 uses all hardware threads.
+     *
+     * @return void
+     */
+    void setThreadCount(int count);
+
+    /**
+     * @brief Clusters the samples.
+     *
+     * @param[in] samples   Training samples (rows = samples, CV_32F), at least `clusterCount` rows.
+     *
+     * @return True if the centers were trained, false if the input is invalid.
+     */
+    bool fit(const Mat& samples);
+
+    /**
+     * @brief Returns the trained centers.
+     *
+     * @return A k x dims matrix (CV_32F), empty before `fit()`.
+     */
+    Mat getCenters() const;
+
+    /**
+     * @brief Returns the mean squared distance of the training samples to their nearest center.
+     *
+     * @return The inertia computed at the end of `fit()`.
+     */
+    double getInertia() const;
+
+    /**
+     * @brief Tells whether the last `fit()` met a stopping criterion before `maxIterations`.
+     *
+     * @return True if training converged.
+     */
+    bool hasConverged() const;
+
+    /**
+     * @brief Returns the statistics of every step of the last `fit()`.
+     *
+     * @return A const reference to the per-step statistics.
+     */
+    const vector<MiniBatchIteration>& getHistory() const;
+
+    /**
+     * @brief Stacks a uniform random sample of descriptor rows into one CV_32F matrix.
+     *
+     * Rows are selected in a single pass (selection sampling), so only the sample is
+     * ever copied, whatever the total number of descriptors.
+     *
+     * @param[in] descriptors   One matrix of descriptors per image (rows = local descriptors).
+     * @param[in] sampleSize    Number of rows to keep; a value <= 0 keeps every row.
+     * @param[in] seed          Seed of the random selection.
+     *
+     * @return The sampled descriptors (CV_32F), empty if there are none.
+     */
+    static Mat sampleDescriptors(const vector<Mat>& descriptors, int sampleSize, unsigned int seed = 0x5EED);
+};
@@ -1,23 +1,33 @@
 #include "ORB.h"
 
 void ORBFeature::createFeature(string image_id, Mat image) {
-    id = image_id;
+    // The detector only reads the image, so a gray input is used as it is
+    ExtractionContext& context = ExtractionContext::forThread();
+    extractFromGray(image_id, context.toGray(image), context);
+}
+
+unsigned ORBFeature::getRequiredPlanes() const {
+    return ImagePlanes::Gray;
+}
 
-    Mat gray;
-    if (image.channels() == 3)
-        cvtColor(image, gray, COLOR_BGR2GRAY);
+void ORBFeature::createFeatureFromPlanes(String image_id, const ImagePlanes& planes) {
+    if (planes.gray.empty())
+        createFeature(image_id, planes.bgr);
     else
-        gray = image.clone();
+        extractFromGray(image_id, planes.gray, ExtractionContext::forThread());
+}
 
-    Ptr<ORB> orb = ORB::create();
-    vector<KeyPoint> keypoints;
-    Mat descriptors;
+void ORBFeature::extractFromGray(const String& image_id, const Mat& gray, ExtractionContext& context) {
+    id = image_id;
 
-    orb->detectAndCompute(gray, noArray(), keypoints, descriptors);
+    // ORB keeps at most 500 keypoints, so the byte descriptors usually fit the previous buffer;
+    // only their float conversion is allocated for the feature
+    context.getOrb().detectAndCompute(gray, noArray(), context.keypoints, context.descriptors);
+    keepStrongestKeypoints(context.keypoints, context.descriptors);
 
-    if (!descriptors.empty() && descriptors.type() != CV_32F) {
-        descriptors.convertTo(descriptors, CV_32F);
-    }
+    Mat descriptors;
+    if (!context.descriptors.empty())
+        context.descriptors.convertTo(descriptors, CV_32F);
 
     imageDescriptors = descriptors;
 }
\ No newline at end of file
@@ -1,15 +1,29 @@
 #pragma once
 
 #include "Features.h"
+#include "ExtractionContext.h"
 
 /**
  * @class ORBFeature
  * @brief A class that implements the ORB (Oriented FAST and Rotated BRIEF) feature extraction method.
  *
  * Inherits from the abstract Feature class and overrides the createFeature() method
- * to extract ORB descriptors from a given image.
+ * to extract ORB descriptors from a given image. The detector and the scratch buffers come from
+ * the `ExtractionContext` of the calling thread.
  */
 class ORBFeature : public Feature {
+private:
+    /**
+     * @brief Detects and describes the keypoints of a gray image and stores the descriptors.
+     *
+     * @param[in] image_id      Path or ID of the image.
+     * @param[in] gray          Single-channel image.
+     * @param[in,out] context   Detector and scratch buffers of the calling thread.
+     *
+     * @return void
+     */
+    void extractFromGray(const String& image_id, const Mat& gray, ExtractionContext& context);
+
 public:
     /**
      * @brief Default constructor.
@@ -32,4 +46,21 @@ public:
      * @note The descriptors are stored internally and can be accessed using inherited methods.
      */
     void createFeature(String imagePath, Mat image) override;
+
+    /**
+     * @brief Asks for the shared gray plane.
+     *
+     * @return `ImagePlanes::Gray`.
+     */
+    unsigned getRequiredPlanes() const override;
+
+    /**
+     * @brief Extracts ORB features from the shared gray plane.
+     *
+     * @param[in] imagePath  Path or ID of the image.
+     * @param[in] planes     The decoded image and its gray plane.
+     *
+     * @return void
+     */
+    void createFeatureFromPlanes(String imagePath, const ImagePlanes& planes) override;
 };
@@ -0,0 +1,123 @@
+#include "ProductQuantizer.h"
+
+#include "BoVW.h"
+#include "MiniBatchKMeans.h"
+
+void ProductQuantizer::setBoundaries(int dims, int subspaces) {
+    boundaries.resize(subspaces + 1);
+    for (int s = 0; s <= subspaces; ++s)
+        boundaries[s] = static_cast<int>(static_cast<long long>(s) * dims / subspaces);
+}
+
+bool ProductQuantizer::train(const Mat& descriptors, int subspaces, int threadCount, int miniBatchSize, int sampleSize) {
+    codebook.release();
+    boundaries.clear();
+    if (descriptors.empty() || descriptors.type() != CV_32F) {
+        cerr << "Product quantizer needs CV_32F descriptors." << endl;
+        return false;
+    }
+
+    Mat training = MiniBatchKMeans::sampleDescriptors({ descriptors }, sampleSize);
+    const int dims = training.cols;
+    subspaces = max(1, min(subspaces, dims));
+    const int centroidCount = min(maxCentroids, training.rows);
+    setBoundaries(dims, subspaces);
+
+    // === One k-means per subspace, the centroids are written side by side ===
+    Mat centroids(centroidCount, dims, CV_32F);
+    for (int s = 0; s < subspaces; ++s) {
+        vector<Mat> part = { training.colRange(boundaries[s], boundaries[s + 1]).clone() };
+        BagOfVisualWord subspaceWords(centroidCount);
+        subspaceWords.setThreadCount(threadCount);
+        subspaceWords.setMiniBatchTraining(miniBatchSize, 0);  // already sampled above
+        subspaceWords.buildVocabulary(part);
+
+        Mat words = subspaceWords.getVocabulary();
+        if (words.rows != centroidCount) {
+            cerr << "Product quantizer: training of subspace " << s << " failed." << endl;
+            boundaries.clear();
+            return false;
+        }
+        words.copyTo(centroids.colRange(boundaries[s], boundaries[s + 1]));
+    }
+
+    codebook = centroids;
+    return true;
+}
+
+Mat ProductQuantizer::encode(const Mat& descriptors) const {
+    CV_Assert(!empty() && descriptors.type() == CV_32F && descriptors.cols == getDimensions());
+
+    const int subspaces = getSubspaceCount();
+    Mat codes(descriptors.rows, subspaces, CV_8U);
+    vector<int> labels;
+    for (int s = 0; s < subspaces; ++s) {
+        // Nearest centroid of each part, with the blocked GEMM assignment of the BoVW
+        Mat centers = codebook.colRange(boundaries[s], boundaries[s + 1]).clone();
+        BagOfVisualWord::assignNearestWords(descriptors.colRange(boundaries[s], boundaries[s + 1]),
+            centers, BagOfVisualWord::computeRowNorms(centers), labels);
+
+        for (int r = 0; r < descriptors.rows; ++r)
+            codes.at<uchar>(r, s) = static_cast<uchar>(labels[r]);
+    }
+    return codes;
+}
+
+void ProductQuantizer::computeTable(const float* query, bool chiSquare, float* table) const {
+    const int subspaces = getSubspaceCount();
+    for (int s = 0; s < subspaces; ++s, table += tableStride) {
+        const int begin = boundaries[s];
+        const int end = boundaries[s + 1];
+
+        for (int c = 0; c < codebook.rows; ++c) {
+            const float* centroid = codebook.ptr<float>(c);
+            float sum = 0.0f;
+            for (int j = begin; j < end; ++j) {
+                const float diff = query[j] - centroid[j];
+                if (chiSquare) {
+                    const float total = query[j] + centroid[j];
+                    if (total != 0.0f)
+                        sum += diff * diff / total;
+                }
+                else {
+                    sum += diff * diff;
+                }
+            }
+            table[c] = sum;
+        }
+    }
+}
+
+bool ProductQuantizer::setCodebook(Mat centroids, int subspaces) {
+    codebook.release();
+    boundaries.clear();
+    if (centroids.empty() || centroids.type() != CV_32F || centroids.rows > maxCentroids
+        || subspaces < 1 || subspaces > centroids.cols) {
+        cerr << "Invalid product quantizer codebook." << endl;
+        return false;
+    }
+
+    codebook = centroids.isContinuous() ? centroids : centroids.clone();
+    setBoundaries(codebook.cols, subspaces);
+    return true;
+}
+
+const Mat& ProductQuantizer::getCodebook() const {
+    return codebook;
+}
+
+int ProductQuantizer::getSubspaceCount() const {
+    return boundaries.empty() ? 0 : static_cast<int>(boundaries.size()) - 1;
+}
+
+int ProductQuantizer::getDimensions() const {
+    return codebook.cols;
+}
+
+size_t ProductQuantizer::getTableSize() const {
+    return static_cast<size_t>(getSubspaceCount()) * tableStride;
+}
+
+bool ProductQuantizer::empty() const {
+    return codebook.empty();
+}
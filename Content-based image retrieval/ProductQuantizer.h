@@ -0,0 +1,156 @@
+#pragma once
+
+#include <opencv2/opencv.hpp>
+#include <cstdint>
+#include <vector>
+
+using namespace std;
+using namespace cv;
+
+/**
+ * @class ProductQuantizer
+ * @brief Compresses descriptors into one byte per subspace (product quantization).
+ *
+ * A descriptor of D floats is cut into `m` consecutive subspaces and each part is replaced by
+ * the index of its nearest centroid in a 256-entry codebook trained for that subspace, so an
+ * image costs m bytes instead of 4D. With m between D/16 and D/4 the index is 16 to 64 times
+ * smaller.
+ *
+ * Queries are compared to codes by asymmetric distance computation (ADC): the query is not
+ * quantized, instead the distance of each query part to each centroid of its subspace is
+ * computed once into a lookup table of m x 256 floats, and the distance to an encoded image
+ * is the sum of m table entries. Both L2 and chi-square distances are sums over the
+ * dimensions, so the same tables serve the two metrics.
+ *
+ * All codebooks are stored in one `centroidCount x D` matrix: the columns of subspace s hold
+ * the centroids of that subspace.
+ */
+class ProductQuantizer {
+private:
+    Mat codebook;                   ///< Centroids of every subspace (centroidCount x D, CV_32F)
+    vector<int> boundaries;         ///< First column of each subspace, plus D at the end
+
+    /**
+     * @brief Splits D columns into `subspaces` consecutive ranges of (almost) equal width.
+     *
+     * @param[in] dims        Descriptor length.
+     * @param[in] subspaces   Number of subspaces.
+     *
+     * @return void
+     */
+    void setBoundaries(int dims, int subspaces);
+
+public:
+    static const int maxCentroids = 256;    ///< Centroids per subspace (one byte per code)
+    static const int tableStride = 256;     ///< Floats per subspace in an ADC lookup table
+
+    /**
+     * @brief Default constructor. Creates an empty quantizer.
+     */
+    ProductQuantizer() {}
+
+    /**
+     * @brief Trains one codebook per subspace with the BoVW k-means.
+     *
+     * Each subspace uses `cv::kmeans`, or mini-batch k-means when `miniBatchSize` > 0, like
+     * the vocabulary and the IVF centroids.
+     *
+     * @param[in] descriptors     Training descriptors (one per row, CV_32F).
+     * @param[in] subspaces       Number of subspaces m (clamped to [1, D]); the code length in bytes.
+     * @param[in] threadCount     Threads used by the k-means (<= 0 uses all hardware threads).
+     * @param[in] miniBatchSize   Batch size of mini-batch k-means (0 = full k-means).
+     * @param[in] sampleSize      Rows sampled for training (0 uses all of them).
+     *
+     * @return true if every codebook was trained; false otherwise.
+     */
+    bool train(const Mat& descriptors, int subspaces, int threadCount = 0, int miniBatchSize = 0, int sampleSize = 0);
+
+    /**
+     * @brief Encodes descriptors.
+     *
+     * @param[in] descriptors   Descriptors to encode (one per row, CV_32F, getDimensions() columns).
+     *
+     * @return A rows x getSubspaceCount() CV_8U matrix of codes.
+     */
+    Mat encode(const Mat& descriptors) const;
+
+    /**
+     * @brief Computes the ADC lookup table of a query.
+     *
+     * @param[in]  query        Query descriptor (getDimensions() floats).
+     * @param[in]  chiSquare    True for chi-square terms, false for squared L2 terms.
+     * @param[out] table        getSubspaceCount() x tableStride floats; entry (s, c) is the
+     *                          distance of the s-th part of the query to centroid c of subspace s.
+     *
+     * @return void
+     */
+    void computeTable(const float* query, bool chiSquare, float* table) const;
+
+    /**
+     * @brief Sums the table entries selected by a code.
+     *
+     * @param[in] table       ADC lookup table of the query.
+     * @param[in] code        Code of one image (getSubspaceCount() bytes).
+     * @param[in] subspaces   Number of subspaces.
+     *
+     * @return The approximate distance (squared L2 or chi-square).
+     */
+    static inline float tableDistance(const float* table, const uint8_t* code, int subspaces) {
+        float d0 = 0.0f, d1 = 0.0f, d2 = 0.0f, d3 = 0.0f;
+        int s = 0;
+        for (; s + 4 <= subspaces; s += 4, table += 4 * tableStride) {
+            d0 += table[code[s]];
+            d1 += table[tableStride + code[s + 1]];
+            d2 += table[2 * tableStride + code[s + 2]];
+            d3 += table[3 * tableStride + code[s + 3]];
+        }
+        for (; s < subspaces; ++s, table += tableStride)
+            d0 += table[code[s]];
+        return (d0 + d1) + (d2 + d3);
+    }
+
+    /**
+     * @brief Restores a trained quantizer (e.g., read from index.bin).
+     *
+     * @param[in] centroids   Codebook matrix (centroidCount x D, CV_32F, at most 256 rows).
+     * @param[in] subspaces   Number of subspaces.
+     *
+     * @return true if the codebook is consistent; false otherwise.
+     */
+    bool setCodebook(Mat centroids, int subspaces);
+
+    /**
+     * @brief Returns the codebook matrix.
+     *
+     * @return The centroids of every subspace, side by side.
+     */
+    const Mat& getCodebook() const;
+
+    /**
+     * @brief Returns the number of subspaces (code length in bytes).
+     *
+     * @return m, or 0 if the quantizer is empty.
+     */
+    int getSubspaceCount() const;
+
+    /**
+     * @brief Returns the length of the encoded descriptors.
+     *
+     * @return D, or 0 if the quantizer is empty.
+     */
+    int getDimensions() const;
+
+    /**
+     * @brief Returns the number of floats of an ADC lookup table.
+     *
+     * @return getSubspaceCount() * tableStride.
+     */
+    size_t getTableSize() const;
+
+    /**
+     * @brief Tells whether the quantizer is trained.
+     *
+     * @return True if there is no codebook.
+     */
+    bool empty() const;
+};
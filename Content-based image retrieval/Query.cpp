@@ -1,106 +1,498 @@
 #include "Query.h"
 
-void Query::Search(string image_id, Mat query,
-    map<string, Feature*>& features,
-    Mat& vocabulary,
-    int kTop, string extractMethod)
-{
-    Distance distance;
+Mat Query::computeQueryDescriptor(string image_id, Mat query, Mat& vocabulary, string extractMethod, LocalFeatures* localFeatures) const {
+    return extractQueryDescriptor(image_id, query, vocabulary, treeQuantizer.get(), hogLayout, extractMethod, localFeatures);
+}
+
+Mat Query::extractQueryDescriptor(string image_id, Mat query, Mat& vocabulary, const BagOfVisualWord* quantizer, const HOGLayout& layout, string extractMethod, LocalFeatures* localFeatures) const {
     Feature* feature = nullptr;
-    results.clear();
-    cout << "Querying" << endl;
 
     // === Feature selection ===
-    if (extractMethod == "Color Histogram") {
+    if (extractMethod == "Color Histogram")
         feature = new ColorHistogram;
-        useSimilarity = true;
-    }
-    else if (extractMethod == "Color Correlogram") {
+    else if (extractMethod == "Color Correlogram")
         feature = new ColorCorrelogram;
-        useSimilarity = true;
-    }
-    else if (extractMethod == "HOG") {
+    else if (extractMethod == "Color Correlogram Exact")
+        feature = new ColorCorrelogram(CorrelogramMode::Exact);
+    else if (extractMethod == "HOG")
         feature = new HOG;
-        useSimilarity = false;
-    }
-    else if (extractMethod == "SIFT") {
+    else if (extractMethod == "Block HOG")
+        feature = new HOG(HOGMode::Block, layout);
+    else if (extractMethod == "SIFT")
         feature = new SIFTFeature;
-        useSimilarity = false;
-    }
-    else if (extractMethod == "ORB") {
+    else if (extractMethod == "ORB")
         feature = new ORBFeature;
-        useSimilarity = false;
-    }
     else {
         cerr << "Unsupported feature type!" << endl;
-        return;
+        return Mat();
     }
 
     // === Feature extraction ===
     Image img;
     img.assignImg(image_id, query);
+    if (localFeatures && geometricVerifier)
+        feature->setKeypointLimit(geometricVerifier->getKeypointLimit());
     feature->createFeature(img.getId(), img.getImg());
-    cout << "Query image feature extraction done" << endl;
+    if (localFeatures)
+        *localFeatures = feature->getLocalFeatures();
 
     // === Convert to BoVW if local feature ===
     if ((extractMethod == "SIFT" || extractMethod == "ORB" || extractMethod == "HOG") && !vocabulary.empty()) {
         const Mat& localDescriptors = feature->getDescriptor();
         if (!localDescriptors.empty()) {
-            BagOfVisualWord bovw(vocabulary);
-            Mat hist = bovw.computeHistogram(localDescriptors);
+            // The tree gives the same words as the index was built with, in O(branch * depth) per descriptor
+            Mat hist = quantizer ? quantizer->computeHistogram(localDescriptors)
+                : BagOfVisualWord(vocabulary).computeHistogram(localDescriptors);
             feature->setDescriptor(hist);
         }
     }
 
-    const Mat& queryDescriptor = feature->getDescriptor();
+    Mat queryDescriptor = feature->getDescriptor();
+    delete feature;
+
+    // The SIMD kernels read raw rows: continuous CV_32F data
+    if (queryDescriptor.empty())
+        return Mat();
+    if (queryDescriptor.type() != CV_32F)
+        queryDescriptor.convertTo(queryDescriptor, CV_32F);
+    else if (!queryDescriptor.isContinuous())
+        queryDescriptor = queryDescriptor.clone();
+
+    return queryDescriptor.reshape(1, 1);
+}
+
+bool Query::usesSimilarity(string extractMethod) {
+    return extractMethod == "Color Histogram" || extractMethod == "Color Correlogram"
+        || extractMethod == "Color Correlogram Exact";
+}
+
+void Query::Search(string image_id, Mat query,
+    const FeatureStore& features,
+    Mat& vocabulary,
+    int kTop, string extractMethod)
+{
+    results.clear();
+    cout << "Querying" << endl;
+
+    useSimilarity = usesSimilarity(extractMethod);
+
+    LocalFeatures localFeatures;
+    Mat queryDescriptor = computeQueryDescriptor(image_id, query, vocabulary, extractMethod,
+        useVerification(features) ? &localFeatures : nullptr);
+    cout << "Query image feature extraction done" << endl;
+
     if (queryDescriptor.empty()) {
         cerr << "Query descriptor is empty!" << endl;
-        delete feature;
         return;
     }
 
-    // === Search all features ===
-    vector<pair<string, float>> distances;
-    for (const auto& [imgId, f] : features) {
-        const Mat& featDescriptor = f->getDescriptor();
-        if (featDescriptor.empty())
-            cout << "No descriptor found" << endl;
+    if (queryDescriptor.cols != features.getDimensions()) {
+        cerr << "Query descriptor length " << queryDescriptor.cols << " does not match the index (" << features.getDimensions() << ")" << endl;
+        return;
+    }
+
+    const float* queryData = queryDescriptor.ptr<float>(0);
+    const size_t k = static_cast<size_t>(max(0, min(kTop, features.size())));
+    const size_t depth = candidateCount(features, k);
 
-        float score = 0;
-        string type;
+    // === Indexed search: only the query's posting lists, the nearest IVF lists or a small part of the graph are visited ===
+    if (useInverted(features) || useIvf(features) || useGraph(features)) {
+        searchIndexed(features, queryData, depth, results);
+        if (useVerification(features))
+            verifyResults(localFeatures, features, results, k);
+        for (const auto& [id, score] : results)
+            cout << "ID: " << id << " score: " << score << endl;
+        return;
+    }
 
-        if (useSimilarity) {
-            type = "Chi-square";
-            score = distance.calculateSimilarity(queryDescriptor, featDescriptor, type);
+    // === Search all features, verified geometrically if the index keeps keypoints ===
+    for (const auto& [row, score] : scanTopK(features, queryData, depth))
+        results.emplace_back(features.getId(row), score);
+    if (useVerification(features))
+        verifyResults(localFeatures, features, results, k);
+    for (const auto& [id, score] : results)
+        cout << "ID: " << id << " score: " << score << endl;
+}
+
+vector<pair<int, float>> Query::scanTopK(const FeatureStore& features, const float* queryData, size_t k) {
+    // Sequential passes over the descriptor matrix.
+    // Chi-square similarity for color features (higher = better), L2 distance otherwise (lower = better).
+    // Only the k best row indices are kept, image IDs are attached by the caller.
+    TopKSelector topK(k, useSimilarity);
+    vector<float> table;
+    const float* scanQuery = prepareQuery(features, queryData, table);
+
+    const int rows = features.size();
+    if (threadCount == 1 || rows < parallelCutoff || rows < 2 * minRowsPerChunk) {
+        scanRows(features, scanQuery, 0, rows, topK);
+    }
+    else {
+        if (!pool)
+            pool.reset(new ThreadPool(threadCount));
+
+        // A few slices per thread balance the load; each slice has its own top-k
+        const int chunkCount = min(pool->getThreadCount() * 4, rows / minRowsPerChunk);
+        const int chunkRows = (rows + chunkCount - 1) / chunkCount;
+        vector<TopKSelector> partial(chunkCount, TopKSelector(k, useSimilarity));
+
+        pool->parallelFor(chunkCount, [&](size_t chunk) {
+            const int begin = static_cast<int>(chunk) * chunkRows;
+            scanRows(features, scanQuery, begin, min(rows, begin + chunkRows), partial[chunk]);
+        });
+
+        for (const TopKSelector& selector : partial)
+            topK.merge(selector);
+    }
+
+    return topK.sortedResults();
+}
+
+void Query::CascadeSearch(string image_id, Mat query,
+    const FeatureStore& coarseFeatures, Mat& coarseVocabulary, string coarseMethod, const HOGLayout& coarseLayout,
+    const FeatureStore& fineFeatures, Mat& fineVocabulary, string fineMethod,
+    int shortlistSize, int kTop)
+{
+    results.clear();
+    cout << "Cascade querying: " << coarseMethod << " -> " << fineMethod << endl;
+
+    // === Stage 1: the cheap feature shortlists candidates over the whole coarse index ===
+    // The vocabulary tree belongs to the fine index, the coarse descriptor uses its own flat vocabulary and layout
+    Mat coarseDescriptor = extractQueryDescriptor(image_id, query, coarseVocabulary, nullptr, coarseLayout, coarseMethod, nullptr);
+    if (coarseDescriptor.empty() || coarseDescriptor.cols != coarseFeatures.getDimensions()) {
+        cerr << "No usable " << coarseMethod << " descriptor for the query" << endl;
+        return;
+    }
+
+    useSimilarity = usesSimilarity(coarseMethod);
+    const size_t shortlist = static_cast<size_t>(max(0, min(shortlistSize, coarseFeatures.size())));
+    vector<pair<int, float>> candidates = scanTopK(coarseFeatures, coarseDescriptor.ptr<float>(0), shortlist);
+
+    // === Stage 2: the expensive feature only scores the shortlist ===
+    LocalFeatures localFeatures;
+    Mat fineDescriptor = computeQueryDescriptor(image_id, query, fineVocabulary, fineMethod,
+        useVerification(fineFeatures) ? &localFeatures : nullptr);
+    if (fineDescriptor.empty() || fineDescriptor.cols != fineFeatures.getDimensions()) {
+        cerr << "No usable " << fineMethod << " descriptor for the query" << endl;
+        return;
+    }
+
+    useSimilarity = usesSimilarity(fineMethod);
+    vector<float> table;
+    const float* fineQuery = prepareQuery(fineFeatures, fineDescriptor.ptr<float>(0), table);
+    const size_t k = static_cast<size_t>(max(0, kTop));
+    TopKSelector topK(candidateCount(fineFeatures, k), useSimilarity);
+    for (const auto& candidate : candidates) {
+        // Both indexes were built from the same database, images are matched by ID
+        const int row = fineFeatures.findRow(coarseFeatures.getId(candidate.first));
+        if (row >= 0)
+            scanRows(fineFeatures, fineQuery, row, row + 1, topK);
+    }
+
+    for (const auto& [row, score] : topK.sortedResults())
+        results.emplace_back(fineFeatures.getId(row), score);
+    if (useVerification(fineFeatures))
+        verifyResults(localFeatures, fineFeatures, results, k);
+    for (const auto& [id, score] : results)
+        cout << "ID: " << id << " score: " << score << endl;
+}
+
+
+void Query::SearchBatch(const Mat& queryDescriptors, const FeatureStore& features, int kTop, string extractMethod) {
+    batchResults.clear();
+    batchCandidates.clear();
+    if (queryDescriptors.empty())
+        return;
+
+    if (queryDescriptors.cols != features.getDimensions()) {
+        cerr << "Query descriptor length " << queryDescriptors.cols << " does not match the index (" << features.getDimensions() << ")" << endl;
+        return;
+    }
+
+    useSimilarity = usesSimilarity(extractMethod);
+
+    Mat queries = queryDescriptors;
+    if (queries.type() != CV_32F)
+        queries.convertTo(queries, CV_32F);
+    else if (!queries.isContinuous())
+        queries = queries.clone();
+
+    const int queryCount = queries.rows;
+    const int rows = features.size();
+    const size_t k = static_cast<size_t>(max(0, min(kTop, rows)));
+    const size_t depth = candidateCount(features, k);
+    cout << "Batch querying " << queryCount << " images" << endl;
+
+    // === Indexed search: one inverted file, IVF or graph search per query, queries spread over the pool ===
+    if (useInverted(features) || useIvf(features) || useGraph(features)) {
+        batchResults.resize(queryCount);
+        auto searchOne = [&](size_t q) {
+            searchIndexed(features, queries.ptr<float>(static_cast<int>(q)), depth, batchResults[q]);
+        };
+        if (threadCount == 1 || queryCount < 2) {
+            for (int q = 0; q < queryCount; ++q)
+                searchOne(q);
         }
         else {
-            type = "L2";
-            score = distance.calculateDistance(queryDescriptor, featDescriptor, type);
+            if (!pool)
+                pool.reset(new ThreadPool(threadCount));
+            pool->parallelFor(queryCount, searchOne);
         }
+        keepBatchCandidates(features, k);
+        return;
+    }
+
+    // === Scan the index tile by tile ===
+    // Each slice of the index keeps one top-k per query. Inside a slice, every query scans an
+    // index tile sized to stay in cache before moving on to the next tile, so every index row
+    // comes from memory once per batch and from cache for the other queries.
+    // On an encoded index the rows are codes and the queries ADC tables, built for a group of
+    // queries at a time to bound their memory.
+    const ProductQuantizer* quantizer = features.getQuantizer();
+    const size_t rowBytes = quantizer ? static_cast<size_t>(quantizer->getSubspaceCount())
+        : static_cast<size_t>(features.getDimensions()) * sizeof(float);
+    const size_t queryFloats = quantizer ? quantizer->getTableSize() : static_cast<size_t>(features.getDimensions());
+    const int tileRows = static_cast<int>(max<size_t>(8, batchTileBytes / rowBytes));
+    const int groupSize = quantizer ? adcBatchQueries : queryCount;
+
+    vector<const float*> scanQueries(queryCount);
+    vector<float> tables;
+    int groupBegin = 0, groupEnd = 0;
+
+    // topK[q - firstQuery] receives the scores of query q
+    auto scanSlice = [&](int begin, int end, vector<TopKSelector>& topK, int firstQuery) {
+        for (int tileBegin = begin; tileBegin < end; tileBegin += tileRows) {
+            const int tileEnd = min(end, tileBegin + tileRows);
+            for (int q = groupBegin; q < groupEnd; ++q)
+                scanRows(features, scanQueries[q], tileBegin, tileEnd, topK[q - firstQuery]);
+        }
+    };
+
+    vector<TopKSelector> topK(queryCount, TopKSelector(depth, useSimilarity));
+    for (groupBegin = 0; groupBegin < queryCount; groupBegin = groupEnd) {
+        groupEnd = min(queryCount, groupBegin + groupSize);
+        if (quantizer) {
+            tables.resize(static_cast<size_t>(groupEnd - groupBegin) * queryFloats);
+            for (int q = groupBegin; q < groupEnd; ++q) {
+                float* table = tables.data() + static_cast<size_t>(q - groupBegin) * queryFloats;
+                quantizer->computeTable(queries.ptr<float>(q), useSimilarity, table);
+                scanQueries[q] = table;
+            }
+        }
+        else {
+            for (int q = groupBegin; q < groupEnd; ++q)
+                scanQueries[q] = queries.ptr<float>(q);
+        }
+
+        // The batch does queryCount times the work of one query, so it goes parallel much earlier
+        const long long work = static_cast<long long>(rows) * (groupEnd - groupBegin);
+        if (threadCount == 1 || work < parallelCutoff || rows < 2 * tileRows) {
+            scanSlice(0, rows, topK, 0);
+            continue;
+        }
+
+        if (!pool)
+            pool.reset(new ThreadPool(threadCount));
+
+        const int sliceCount = min(pool->getThreadCount() * 4, rows / tileRows);
+        const int sliceRows = (rows + sliceCount - 1) / sliceCount;
+        vector<vector<TopKSelector>> partial(sliceCount, vector<TopKSelector>(groupEnd - groupBegin, TopKSelector(depth, useSimilarity)));
+
+        pool->parallelFor(sliceCount, [&](size_t slice) {
+            const int begin = static_cast<int>(slice) * sliceRows;
+            scanSlice(begin, min(rows, begin + sliceRows), partial[slice], groupBegin);
+        });
+
+        for (const vector<TopKSelector>& sliceTopK : partial)
+            for (int q = groupBegin; q < groupEnd; ++q)
+                topK[q].merge(sliceTopK[q - groupBegin]);
+    }
+
+    // === Attach image IDs ===
+    batchResults.resize(queryCount);
+    for (int q = 0; q < queryCount; ++q)
+        for (const auto& [row, score] : topK[q].sortedResults())
+            batchResults[q].emplace_back(features.getId(row), score);
+    keepBatchCandidates(features, k);
+}
+
+void Query::keepBatchCandidates(const FeatureStore& features, size_t k) {
+    if (!useVerification(features))
+        return;
+
+    // The deeper lists wait for VerifyBatch, the results hold the k best until then
+    batchCandidates = batchResults;
+    batchKeep = k;
+    for (vector<pair<string, float>>& list : batchResults)
+        if (list.size() > k)
+            list.resize(k);
+}
+
+void Query::scanRows(const FeatureStore& features, const float* query, int begin, int end, TopKSelector& topK) const {
+    if (const ProductQuantizer* quantizer = features.getQuantizer()) {
+        const int subspaces = quantizer->getSubspaceCount();
+        for (int row = begin; row < end; ++row)
+            topK.push(row, adcScore(ProductQuantizer::tableDistance(query, features.getCode(row), subspaces)));
+        return;
+    }
+
+    const size_t dims = static_cast<size_t>(features.getDimensions());
+    for (int row = begin; row < end; ++row)
+        topK.push(row, scoreRow(query, features.getRow(row), dims));
+}
+
+const float* Query::prepareQuery(const FeatureStore& features, const float* query, vector<float>& table) const {
+    const ProductQuantizer* quantizer = features.getQuantizer();
+    if (!quantizer)
+        return query;
+
+    table.resize(quantizer->getTableSize());
+    quantizer->computeTable(query, useSimilarity, table.data());
+    return table.data();
+}
+
+float Query::adcScore(float distance) const {
+    // Same scores as Distance::chiSquareSimilarity and Distance::l2Distance
+    return useSimilarity ? static_cast<float>(1.0 / (1.0 + 0.5 * distance)) : sqrt(max(0.0f, distance));
+}
+
+float Query::scoreRow(const float* query, const float* row, size_t dims) const {
+    return useSimilarity
+        ? Distance::chiSquareSimilarity(query, row, dims)
+        : Distance::l2Distance(query, row, dims);
+}
+
+bool Query::useIvf(const FeatureStore& features) const {
+    return ivfIndex && ivfProbes > 0 && !ivfIndex->empty()
+        && ivfIndex->size() == features.size() && ivfIndex->getDimensions() == features.getDimensions();
+}
 
-        distances.emplace_back(imgId, score);
+void Query::searchIvf(const FeatureStore& features, const float* query, size_t k, vector<pair<string, float>>& output) const {
+    const size_t dims = static_cast<size_t>(features.getDimensions());
+    const ProductQuantizer* quantizer = features.getQuantizer();
+    vector<float> table;
+    const float* scanQuery = prepareQuery(features, query, table);
+    TopKSelector topK(k, useSimilarity);
+
+    for (int list : ivfIndex->probe(query, ivfProbes)) {
+        int length = 0;
+        const int32_t* rows = ivfIndex->getList(list, length);
+        for (int i = 0; i < length; ++i) {
+            float score = quantizer
+                ? adcScore(ProductQuantizer::tableDistance(scanQuery, features.getCode(rows[i]), quantizer->getSubspaceCount()))
+                : scoreRow(scanQuery, features.getRow(rows[i]), dims);
+            topK.push(rows[i], score);
+        }
     }
 
-    // === Sort results ===
-    if (useSimilarity) {
-        std::sort(distances.begin(), distances.end(),
-            [](const auto& a, const auto& b) { return a.second > b.second; });  // Higher = better
+    output.clear();
+    for (const auto& [row, score] : topK.sortedResults())
+        output.emplace_back(features.getId(row), score);
+}
+
+bool Query::useInverted(const FeatureStore& features) const {
+    return invertedIndex && !invertedIndex->empty()
+        && invertedIndex->size() == features.size() && invertedIndex->getWordCount() == features.getDimensions();
+}
+
+void Query::searchIndexed(const FeatureStore& features, const float* query, size_t k, vector<pair<string, float>>& output) const {
+    if (useInverted(features)) {
+        output.clear();
+        for (const auto& [row, distance] : invertedIndex->search(query, k))
+            output.emplace_back(features.getId(row), distance);
+    }
+    else if (useIvf(features)) {
+        searchIvf(features, query, k, output);
     }
     else {
-        std::sort(distances.begin(), distances.end(),
-            [](const auto& a, const auto& b) { return a.second < b.second; });  // Lower = better
+        searchGraph(features, query, k, output);
     }
+}
+
+bool Query::useGraph(const FeatureStore& features) const {
+    return hnswIndex && !hnswIndex->empty() && !features.isEncoded()
+        && hnswIndex->size() == features.size() && hnswIndex->getDimensions() == features.getDimensions();
+}
 
-    // === Output top-k results ===
-    for (int i = 0; i < std::min(kTop, static_cast<int>(distances.size())); ++i) {
-        cout << "ID: " << distances[i].first << " score: " << distances[i].second << endl;
-        results.push_back(distances[i]);
+void Query::searchGraph(const FeatureStore& features, const float* query, size_t k, vector<pair<string, float>>& output) const {
+    output.clear();
+    for (const auto& [row, distance] : hnswIndex->search(query, k, efSearch)) {
+        // Same score as Distance::chiSquareSimilarity for the color features
+        float score = hnswIndex->getMetric() == HnswMetric::ChiSquare ? static_cast<float>(1.0 / (1.0 + 0.5 * distance)) : distance;
+        output.emplace_back(features.getId(row), score);
     }
+}
 
-    delete feature;
+void Query::setIvfIndex(const IvfIndex* index, int nprobe) {
+    ivfIndex = index;
+    ivfProbes = nprobe;
+}
+
+void Query::setInvertedIndex(const InvertedIndex* index) {
+    invertedIndex = index;
+}
+
+void Query::setGeometricVerification(const GeometricVerifier* verifier, int depth, double budgetMs) {
+    geometricVerifier = verifier;
+    rerankDepth = depth;
+    rerankBudgetMs = budgetMs;
+}
+
+bool Query::useVerification(const FeatureStore& features) const {
+    return geometricVerifier && rerankDepth > 0 && !geometricVerifier->empty() && geometricVerifier->size() == features.size();
 }
 
+size_t Query::candidateCount(const FeatureStore& features, size_t k) const {
+    if (!useVerification(features))
+        return k;
+    return max(k, static_cast<size_t>(min(rerankDepth, features.size())));
+}
+
+void Query::VerifyBatch(const vector<LocalFeatures>& queryFeatures, const FeatureStore& features) {
+    if (!useVerification(features) || batchCandidates.size() != batchResults.size())
+        return;
+
+    const size_t queryCount = min(queryFeatures.size(), batchCandidates.size());
+    for (size_t q = 0; q < queryCount; ++q) {
+        verifyResults(queryFeatures[q], features, batchCandidates[q], batchKeep);
+        batchResults[q] = batchCandidates[q];
+    }
+    batchCandidates.clear();
+}
+
+void Query::verifyResults(const LocalFeatures& localFeatures, const FeatureStore& features, vector<pair<string, float>>& output, size_t k) {
+    if (!pool && threadCount != 1)
+        pool.reset(new ThreadPool(threadCount));
+    const int verified = geometricVerifier->rerank(localFeatures, features, rerankDepth, rerankBudgetMs, output, pool.get());
+    if (verified < min(rerankDepth, static_cast<int>(output.size())))
+        cout << "Geometric verification: " << verified << " candidates within " << rerankBudgetMs << " ms" << endl;
+    if (output.size() > k)
+        output.resize(k);
+}
+
+void Query::setHnswIndex(const HnswIndex* index, int ef) {
+    hnswIndex = index;
+    efSearch = ef;
+}
+
+void Query::setParallelism(int count, int cutoff) {
+    if (count != threadCount)
+        pool.reset();  // recreated with the new size on the next parallel scan
+    threadCount = count;
+    parallelCutoff = cutoff;
+}
+
+void Query::setVocabularyTree(const VocabularyTree* tree) {
+    treeQuantizer.reset(tree && !tree->empty() ? new BagOfVisualWord(*tree) : nullptr);
+}
+
+void Query::setHogLayout(const HOGLayout& layout) {
+    hogLayout = layout;
+}
 
 vector<pair<string, float>> Query::getResult() {
 	return results;
 }
+
+const vector<vector<pair<string, float>>>& Query::getBatchResults() const {
+    return batchResults;
+}
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <opencv2/opencv.hpp>
+#include <memory>
 #include <unordered_set>
 #include <string>
 #include <vector>
@@ -14,6 +15,14 @@
 #include "ORB.h"
 #include "SIFT.h"
 #include "BoVW.h"
+#include "FeatureStore.h"
+#include "TopK.h"
+#include "ThreadPool.h"
+#include "HnswIndex.h"
+#include "IvfIndex.h"
+#include "InvertedIndex.h"
+#include "GeometricVerifier.h"
+#include "ProductQuantizer.h"
 
 using namespace std;
 using namespace cv;
@@ -29,15 +38,319 @@ class Query {
 private:
     Image QueryImage;                          ///< Query image metadata and path
     vector<pair<string, float>> results;       ///< Retrieval results (image path, score)
+    vector<vector<pair<string, float>>> batchResults;  ///< Retrieval results of each query of the last batch
+    vector<vector<pair<string, float>>> batchCandidates; ///< Deeper result lists of the last batch awaiting `VerifyBatch()` (empty without verification)
+    size_t batchKeep = 0;                              ///< Results kept per query of the last batch once verified
     bool useSimilarity = false;                        ///< Flag to determine whether to use similarity (true) or distance (false)
+    unique_ptr<BagOfVisualWord> treeQuantizer;         ///< Quantizer of the index's vocabulary tree, built once (nullptr = flat vocabulary)
+    HOGLayout hogLayout;                               ///< Cell and block layout of a Block HOG index
+    const HnswIndex* hnswIndex = nullptr;              ///< HNSW graph of the index (nullptr or empty = exhaustive scan)
+    int efSearch = 64;                                 ///< Candidate list size of HNSW searches
+    const IvfIndex* ivfIndex = nullptr;                ///< IVF lists of the index (nullptr or empty = no IVF)
+    int ivfProbes = 8;                                 ///< Number of IVF lists scanned per query (<= 0 disables IVF)
+    const InvertedIndex* invertedIndex = nullptr;      ///< TF-IDF posting lists of the index (nullptr or empty = dense comparison)
+    const GeometricVerifier* geometricVerifier = nullptr; ///< Keypoints of the index (nullptr or empty = no re-ranking)
+    int rerankDepth = 50;                              ///< Number of results verified geometrically (<= 0 disables re-ranking)
+    double rerankBudgetMs = 200.0;                     ///< Deadline for starting verifications of one query, in milliseconds
+    int threadCount = 0;                               ///< Threads scanning one query (<= 0 uses all hardware threads)
+    int parallelCutoff = 16384;                        ///< Indexes with fewer rows are scanned on the calling thread
+    unique_ptr<ThreadPool> pool;                       ///< Scan workers, created on the first large scan
+
+    static const int minRowsPerChunk = 4096;           ///< Smallest slice of the index scanned by one task
+    static const size_t batchTileBytes = 128 * 1024;   ///< Size of the index tile scanned by every query of a batch in turn
+    static const int adcBatchQueries = 64;             ///< Queries whose ADC tables are built at once by a batch on an encoded index
+
+    /**
+     * @brief Scores a range of rows of the index and offers them to a top-k selector.
+     *
+     * On a product-quantized store each row costs one table lookup per subspace, and the codes
+     * are read sequentially, so the scan is limited by memory bandwidth.
+     *
+     * @param[in]     features   Feature store of the index.
+     * @param[in]     query      Query descriptor (features.getDimensions() floats), or its ADC
+     *                           lookup table for an encoded store (see `prepareQuery`).
+     * @param[in]     begin      First row to score.
+     * @param[in]     end        One past the last row to score.
+     * @param[in,out] topK       Selector receiving the scores.
+     *
+     * @return void
+     */
+    void scanRows(const FeatureStore& features, const float* query, int begin, int end, TopKSelector& topK) const;
+
+    /**
+     * @brief Returns what `scanRows` compares the rows to.
+     *
+     * @param[in]  features   Feature store of the index.
+     * @param[in]  query      Query descriptor.
+     * @param[out] table      Storage for the ADC lookup table of an encoded store.
+     *
+     * @return `query` itself, or `table` filled with its ADC lookup table for an encoded store.
+     */
+    const float* prepareQuery(const FeatureStore& features, const float* query, vector<float>& table) const;
+
+    /**
+     * @brief Turns an ADC distance into the score of the exhaustive scan.
+     *
+     * @param[in] distance   Sum of table entries (chi-square or squared L2).
+     *
+     * @return Chi-square similarity for color features, L2 distance otherwise.
+     */
+    float adcScore(float distance) const;
+
+    /**
+     * @brief Scores one indexed descriptor against the query.
+     *
+     * @param[in] query    Query descriptor.
+     * @param[in] row      Indexed descriptor.
+     * @param[in] dims     Descriptor length.
+     *
+     * @return Chi-square similarity for color features, L2 distance otherwise.
+     */
+    float scoreRow(const float* query, const float* row, size_t dims) const;
+
+    /**
+     * @brief Tells whether the IVF lists can answer queries on a feature store.
+     *
+     * @param[in] features   Feature store of the index.
+     *
+     * @return True if IVF lists are set, probing is enabled and the lists cover the same descriptors.
+     */
+    bool useIvf(const FeatureStore& features) const;
+
+    /**
+     * @brief Tells whether the inverted index can answer queries on a feature store.
+     *
+     * @param[in] features   Feature store of the index.
+     *
+     * @return True if posting lists are set and were built over the same histograms.
+     */
+    bool useInverted(const FeatureStore& features) const;
+
+    /**
+     * @brief Answers one query from the inverted index, the IVF lists or the HNSW graph.
+     *
+     * The inverted index comes first, then IVF, then the graph (see the setters).
+     *
+     * @param[in]  features   Feature store of the index.
+     * @param[in]  query      Query descriptor (features.getDimensions() floats).
+     * @param[in]  k          Number of results.
+     * @param[out] output     The (image ID, score) results, best first.
+     *
+     * @return void
+     */
+    void searchIndexed(const FeatureStore& features, const float* query, size_t k, vector<pair<string, float>>& output) const;
+
+    /**
+     * @brief Tells whether the results on a feature store can be verified geometrically.
+     *
+     * @param[in] features   Feature store of the index.
+     *
+     * @return True if a verifier with keypoints of the same images is set and re-ranking is enabled.
+     */
+    bool useVerification(const FeatureStore& features) const;
+
+    /**
+     * @brief Number of results a search must collect so that verification can reorder them.
+     *
+     * @param[in] features   Feature store of the index.
+     * @param[in] k          Number of results returned to the caller.
+     *
+     * @return max(k, `rerankDepth`) when the results are verified, k otherwise.
+     */
+    size_t candidateCount(const FeatureStore& features, size_t k) const;
+
+    /**
+     * @brief Extracts the descriptor of a query image with an explicit tree quantizer.
+     *
+     * @param[in] image_id       The identifier (or path) of the query image.
+     * @param[in] query          The query image.
+     * @param[in] vocabulary     Visual vocabulary of the index (empty for global features).
+     * @param[in] quantizer      Quantizer of the index's vocabulary tree (nullptr = flat `vocabulary`).
+     * @param[in] layout         Cell and block layout of a Block HOG index.
+     * @param[in] extractMethod  The feature extraction method used by the index.
+     * @param[out] localFeatures If not null and a geometric verifier is set, receives the strongest keypoints of the query.
+     *
+     * @return A continuous 1xD CV_32F descriptor, or an empty matrix if extraction failed.
+     */
+    Mat extractQueryDescriptor(string image_id, Mat query, Mat& vocabulary, const BagOfVisualWord* quantizer, const HOGLayout& layout, string extractMethod, LocalFeatures* localFeatures) const;
+
+    /**
+     * @brief Keeps the deeper lists of a batch search for `VerifyBatch()` and cuts the results to k.
+     *
+     * @param[in] features   Feature store of the index.
+     * @param[in] k          Number of results per query.
+     *
+     * @return void
+     */
+    void keepBatchCandidates(const FeatureStore& features, size_t k);
+
+    /**
+     * @brief Scores every image of an index against one query, in parallel on large indexes.
+     *
+     * Uses the metric of `useSimilarity`; the IVF lists, graph and inverted index are ignored.
+     *
+     * @param[in] features    Feature store of the index.
+     * @param[in] queryData   Query descriptor (features.getDimensions() floats).
+     * @param[in] k           Number of results.
+     *
+     * @return The k best (row, score) pairs, best first.
+     */
+    vector<pair<int, float>> scanTopK(const FeatureStore& features, const float* queryData, size_t k);
+
+    /**
+     * @brief Re-ranks the results of one query geometrically, candidates verified on the pool.
+     *
+     * @param[in]     localFeatures   Keypoints of the query.
+     * @param[in]     features        Feature store of the index.
+     * @param[in,out] output          The (image ID, score) candidates, best first; the k best once verified.
+     * @param[in]     k               Number of results kept after re-ranking.
+     *
+     * @return void
+     */
+    void verifyResults(const LocalFeatures& localFeatures, const FeatureStore& features, vector<pair<string, float>>& output, size_t k);
+
+    /**
+     * @brief Scans the `ivfProbes` IVF lists nearest to one query.
+     *
+     * @param[in]  features   Feature store of the index.
+     * @param[in]  query      Query descriptor (features.getDimensions() floats).
+     * @param[in]  k          Number of results.
+     * @param[out] output     The (image ID, score) results, best first.
+     *
+     * @return void
+     */
+    void searchIvf(const FeatureStore& features, const float* query, size_t k, vector<pair<string, float>>& output) const;
+
+    /**
+     * @brief Tells whether the HNSW graph can answer queries on a feature store.
+     *
+     * @param[in] features   Feature store of the index.
+     *
+     * @return True if a graph is set and was built on the same (float) descriptors.
+     */
+    bool useGraph(const FeatureStore& features) const;
+
+    /**
+     * @brief Searches the HNSW graph for one query.
+     *
+     * @param[in]  features   Feature store of the index.
+     * @param[in]  query      Query descriptor (features.getDimensions() floats).
+     * @param[in]  k          Number of results.
+     * @param[out] output     The (image ID, score) results, best first. Chi-square graph distances
+     *                        are turned into the same similarity as the exhaustive scan.
+     *
+     * @return void
+     */
+    void searchGraph(const FeatureStore& features, const float* query, size_t k, vector<pair<string, float>>& output) const;
 
 public:
+    /**
+     * @brief Returns whether a feature type is ranked by similarity rather than distance.
+     *
+     * @param[in] extractMethod  The feature extraction method.
+     *
+     * @return True for the color features (chi-square similarity), false for the others (L2 distance).
+     */
+    static bool usesSimilarity(string extractMethod);
+
+    /**
+     * @brief Sets the parallelism of the scan of one query.
+     *
+     * The index is split into slices scanned by a thread pool, each slice keeping its own
+     * top-k, and the partial results are merged at the end. Indexes smaller than the cutoff
+     * are scanned on the calling thread, where starting the workers would cost more than it saves.
+     *
+     * @param[in] count    Number of threads (<= 0 uses all hardware threads, 1 disables the parallel scan).
+     * @param[in] cutoff   Minimum number of indexed images for a parallel scan.
+     *
+     * @return void
+     */
+    void setParallelism(int count, int cutoff = 16384);
+
+    /**
+     * @brief Sets the vocabulary tree used to quantize local query descriptors.
+     *
+     * The quantizer is built here once and reused by every query.
+     *
+     * @param[in] tree   Vocabulary tree of the loaded index, or nullptr (or an empty tree) to use
+     *                   the flat vocabulary.
+     *
+     * @return void
+     */
+    void setVocabularyTree(const VocabularyTree* tree);
+
+    /**
+     * @brief Sets the cell and block layout used to extract Block HOG query descriptors.
+     *
+     * @param[in] layout   Layout stored in the loaded index (see `Indexer::getHogLayout()`).
+     *
+     * @return void
+     */
+    void setHogLayout(const HOGLayout& layout);
+
+    /**
+     * @brief Sets the HNSW graph used instead of the exhaustive scan.
+     *
+     * @param[in] index      HNSW graph of the loaded index, or nullptr to always scan every image.
+     *                       The graph must outlive the searches that use it.
+     * @param[in] efSearch   Candidate list size of a search (larger = better recall, slower).
+     *
+     * @return void
+     */
+    void setHnswIndex(const HnswIndex* index, int efSearch = 64);
+
+    /**
+     * @brief Sets the IVF lists scanned instead of the whole index.
+     *
+     * IVF takes precedence over the HNSW graph when both are set and `nprobe` > 0.
+     *
+     * @param[in] index    IVF index of the loaded index, or nullptr to disable IVF.
+     *                     The index must outlive the searches that use it.
+     * @param[in] nprobe   Number of lists scanned per query (<= 0 disables IVF); can be changed between queries.
+     *
+     * @return void
+     */
+    void setIvfIndex(const IvfIndex* index, int nprobe = 8);
+
+    /**
+     * @brief Sets the inverted file answering BoVW queries instead of the dense scan.
+     *
+     * Only the posting lists of the words present in the query are read, and images are
+     * ranked by the cosine similarity of their TF-IDF vectors, reported as the L2 distance
+     * between the normalized vectors. Takes precedence over IVF and HNSW.
+     *
+     * @param[in] index   Inverted index of the loaded index, or nullptr to disable it.
+     *                    The index must outlive the searches that use it.
+     *
+     * @return void
+     */
+    void setInvertedIndex(const InvertedIndex* index);
+
+    /**
+     * @brief Sets the keypoints used to re-rank SIFT/ORB results geometrically.
+     *
+     * The search then collects at least `depth` candidates, even when fewer results are
+     * requested. They are verified by matching the keypoints of the query with theirs and
+     * fitting a transformation with RANSAC, reordered by their inlier counts (see
+     * `GeometricVerifier::rerank`), and cut back to the requested number, so an image ranked
+     * beyond k by its descriptor can still enter the results.
+     *
+     * @param[in] verifier   Keypoint store of the loaded index, or nullptr to disable re-ranking.
+     *                       It must outlive the searches that use it.
+     * @param[in] depth      Number of results verified (<= 0 disables re-ranking).
+     * @param[in] budgetMs   Time after which no new candidate of a query is verified, in milliseconds
+     *                       (<= 0 = no limit); candidates already started finish.
+     *
+     * @return void
+     */
+    void setGeometricVerification(const GeometricVerifier* verifier, int depth = 50, double budgetMs = 200.0);
+
     /**
      * @brief Executes the query process by comparing the query image to the feature index.
      *
      * @param[in] image_id       The identifier (or path) of the query image.
      * @param[in] query          The feature vector (cv::Mat) of the query image.
-     * @param[in] features       Map of image IDs to their corresponding Feature pointers.
+     * @param[in] features       Dense store of the indexed descriptors, scanned row by row.
      * @param[in] vocabulary     Visual vocabulary used for BoVW-based comparison.
      * @param[in] kTop           The number of top results to retrieve.
      * @param[in] extractMethod  The feature extraction method used (e.g., "SIFT", "ORB", "Color Histogram").
@@ -45,8 +358,101 @@ public:
      * @return void
      *
      * @note This function populates the `results` vector with the top-k most similar or closest images.
+     *       When IVF lists or an HNSW graph are set, the results are approximate.
+     */
+    void Search(string image_id, Mat query, const FeatureStore& features, Mat& vocabulary, int kTop, string extractMethod);
+
+    /**
+     * @brief Runs a two-stage query: a cheap feature shortlists candidates, an expensive one ranks them.
+     *
+     * The coarse index (e.g. Color Histogram) is scanned completely for the `shortlistSize`
+     * best images, then only those images are scored with the fine feature (e.g. SIFT BoVW),
+     * so the query costs one cheap scan plus `shortlistSize` expensive comparisons. Both
+     * indexes must come from the same image database: shortlisted images are looked up in the
+     * fine index by ID, images missing from it are dropped. The fine results are re-ranked
+     * geometrically when a verifier is set.
+     *
+     * @param[in] image_id           The identifier (or path) of the query image.
+     * @param[in] query              The query image.
+     * @param[in] coarseFeatures     Feature store of the cheap index.
+     * @param[in] coarseVocabulary   Flat vocabulary of the cheap index (empty for global features).
+     * @param[in] coarseMethod       Feature of the cheap index (e.g., "Color Histogram").
+     * @param[in] coarseLayout       Block HOG layout of the cheap index (see `Indexer::getHogLayout()`).
+     * @param[in] fineFeatures       Feature store of the expensive index.
+     * @param[in] fineVocabulary     Vocabulary of the expensive index; a tree set with `setVocabularyTree`
+     *                               and a layout set with `setHogLayout` apply to it.
+     * @param[in] fineMethod         Feature of the expensive index (e.g., "SIFT").
+     * @param[in] shortlistSize      Number of candidates passed to the second stage.
+     * @param[in] kTop               The number of top results to retrieve.
+     *
+     * @return void
+     *
+     * @note This function populates the `results` vector with fine-feature scores.
+     */
+    void CascadeSearch(string image_id, Mat query,
+        const FeatureStore& coarseFeatures, Mat& coarseVocabulary, string coarseMethod, const HOGLayout& coarseLayout,
+        const FeatureStore& fineFeatures, Mat& fineVocabulary, string fineMethod,
+        int shortlistSize, int kTop);
+
+    /**
+     * @brief Extracts the descriptor of a query image as it is stored in the index.
+     *
+     * Local features (SIFT, ORB, HOG) are turned into a BoVW histogram when a vocabulary is given,
+     * with the vocabulary tree set by `setVocabularyTree` if any. Block HOG uses the layout set by
+     * `setHogLayout`.
+     *
+     * @param[in] image_id       The identifier (or path) of the query image.
+     * @param[in] query          The query image.
+     * @param[in] vocabulary     Visual vocabulary of the index (empty for global features).
+     * @param[in] extractMethod  The feature extraction method used by the index.
+     * @param[out] localFeatures If not null and a geometric verifier is set, receives the strongest
+     *                           keypoints of the query (as many as the index keeps per image).
+     *
+     * @return A continuous 1xD CV_32F descriptor, or an empty matrix if extraction failed.
+     */
+    Mat computeQueryDescriptor(string image_id, Mat query, Mat& vocabulary, string extractMethod, LocalFeatures* localFeatures = nullptr) const;
+
+    /**
+     * @brief Searches the index for several queries at once.
+     *
+     * The index is scanned in tiles small enough to stay in cache: every query scans a tile in
+     * turn, row by row as in `Search`, before the next tile is read, so each index row is read
+     * from memory once per batch and from cache for the other queries. Slices of the index are
+     * scanned in parallel like in `Search`, and only the top-k of each query is kept. When the
+     * results will be verified, the top `depth` candidates of each query (see
+     * `setGeometricVerification`) are kept for `VerifyBatch` as well.
+     *
+     * @param[in] queryDescriptors   One query descriptor per row (see `computeQueryDescriptor`).
+     * @param[in] features           Dense store of the indexed descriptors.
+     * @param[in] kTop               The number of top results to retrieve per query.
+     * @param[in] extractMethod      The feature extraction method used by the index.
+     *
+     * @return void
+     *
+     * @note This function populates the batch results, one list per query row, in row order.
+     */
+    void SearchBatch(const Mat& queryDescriptors, const FeatureStore& features, int kTop, string extractMethod);
+
+    /**
+     * @brief Re-ranks the results of the last batch search geometrically.
+     *
+     * Queries are verified one after the other, the candidates of each query in parallel,
+     * each query with its own time budget. The candidates kept by `SearchBatch` are verified,
+     * then cut back to kTop. Does nothing if no verifier is set.
+     *
+     * @param[in] queryFeatures   Keypoints of each query, in batch row order (see `computeQueryDescriptor`).
+     * @param[in] features        Dense store of the indexed descriptors.
+     *
+     * @return void
+     */
+    void VerifyBatch(const vector<LocalFeatures>& queryFeatures, const FeatureStore& features);
+
+    /**
+     * @brief Retrieves the results of the last batch search.
+     *
+     * @return One vector of (image path, score) pairs per query, sorted by similarity or distance.
      */
-    void Search(string image_id, Mat query, map<string, Feature*>& features, Mat& vocabulary, int kTop, string extractMethod);
+    const vector<vector<pair<string, float>>>& getBatchResults() const;
 
     /**
      * @brief Retrieves the top-k search results after querying.
@@ -1,19 +1,29 @@
 #include "SIFT.h"
 
 void SIFTFeature::createFeature(String image_id, Mat image) {
-    id = image_id;
+    // The detector only reads the image, so a gray input is used as it is
+    ExtractionContext& context = ExtractionContext::forThread();
+    extractFromGray(image_id, context.toGray(image), context);
+}
+
+unsigned SIFTFeature::getRequiredPlanes() const {
+    return ImagePlanes::Gray;
+}
 
-    Mat gray;
-    if (image.channels() == 3)
-        cvtColor(image, gray, COLOR_BGR2GRAY);
+void SIFTFeature::createFeatureFromPlanes(String image_id, const ImagePlanes& planes) {
+    if (planes.gray.empty())
+        createFeature(image_id, planes.bgr);
     else
-        gray = image.clone();
+        extractFromGray(image_id, planes.gray, ExtractionContext::forThread());
+}
 
-    Ptr<SIFT> sift = SIFT::create();
-    vector<KeyPoint> keypoints;
-    Mat descriptors;
+void SIFTFeature::extractFromGray(const String& image_id, const Mat& gray, ExtractionContext& context) {
+    id = image_id;
 
-    sift->detectAndCompute(gray, noArray(), keypoints, descriptors);
+    // SIFT descriptors are already CV_32F: the detector output is the matrix the feature keeps
+    Mat descriptors;
+    context.getSift().detectAndCompute(gray, noArray(), context.keypoints, descriptors);
+    keepStrongestKeypoints(context.keypoints, descriptors);
 
     if (!descriptors.empty() && descriptors.type() != CV_32F) {
         descriptors.convertTo(descriptors, CV_32F);
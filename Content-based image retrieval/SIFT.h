@@ -1,6 +1,7 @@
 #pragma once
 
 #include "Features.h"
+#include "ExtractionContext.h"
 #include <opencv2/features2d.hpp>
 
 /**
@@ -9,9 +10,22 @@
  *
  * This class inherits from the abstract Feature base class and overrides the createFeature method
  * to extract SIFT descriptors from a given image. The resulting descriptors can be used for
- * local feature matching and Bag-of-Visual-Words indexing.
+ * local feature matching and Bag-of-Visual-Words indexing. The detector and the scratch buffers
+ * come from the `ExtractionContext` of the calling thread.
  */
 class SIFTFeature : public Feature {
+private:
+    /**
+     * @brief Detects and describes the keypoints of a gray image and stores the descriptors.
+     *
+     * @param[in] image_id      Path or ID of the image.
+     * @param[in] gray          Single-channel image.
+     * @param[in,out] context   Detector and scratch buffers of the calling thread.
+     *
+     * @return void
+     */
+    void extractFromGray(const String& image_id, const Mat& gray, ExtractionContext& context);
+
 public:
     /**
      * @brief Default constructor.
@@ -34,4 +48,21 @@ public:
      * @note The descriptors are stored internally and can be accessed using inherited methods.
      */
     void createFeature(String imagePath, Mat image) override;
+
+    /**
+     * @brief Asks for the shared gray plane.
+     *
+     * @return `ImagePlanes::Gray`.
+     */
+    unsigned getRequiredPlanes() const override;
+
+    /**
+     * @brief Extracts SIFT features from the shared gray plane.
+     *
+     * @param[in] imagePath  Path or ID of the image.
+     * @param[in] planes     The decoded image and its gray plane.
+     *
+     * @return void
+     */
+    void createFeatureFromPlanes(String imagePath, const ImagePlanes& planes) override;
 };
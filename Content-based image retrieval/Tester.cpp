@@ -6,6 +6,11 @@ Tester::Tester(char* a, char* b, char* c, Mode mode) {
         selectedMethod = b; // Method for feature extraction (e.g., "SIFT", "SURF", "ORB")   
         vocabularySize = atoi(c); // Size of the vocabulary for indexing
     }
+    else if (mode == BENCHMARK) {
+        benchmarkRows = atoi(a); // Number of database vectors
+        benchmarkRepetitions = atoi(b); // Number of passes over the database
+        benchmarkLength = atoi(c); // Extra descriptor length (e.g., a vocabulary size), 0 for none
+    }
     else {
         queryFolderPath = a; // Path to the query image
         indexPath = b; // Path to the image database
@@ -13,6 +18,162 @@ Tester::Tester(char* a, char* b, char* c, Mode mode) {
     }
 }
 
+bool Tester::setOption(string option) {
+    size_t separator = option.find('=');
+    if (separator == string::npos) {
+        cout << "Ignoring malformed option: " << option << endl;
+        return false;
+    }
+
+    string name = option.substr(0, separator);
+    string value = option.substr(separator + 1);
+
+    if (name == "threads") {
+        threadCount = atoi(value.c_str());
+        return true;
+    }
+    if (name == "pipeline") {
+        pipelineMode = (value == "1" || value == "true");
+        return true;
+    }
+    if (name == "queue") {
+        int capacity = atoi(value.c_str());
+        if (capacity <= 0) {
+            cout << "Queue capacity must be a positive number: " << value << endl;
+            return false;
+        }
+        queueCapacity = capacity;
+        return true;
+    }
+    if (name == "vocabulary") {
+        vocabularyIndexPath = value;
+        return true;
+    }
+    if (name == "tree") {
+        // Shape of the vocabulary tree, e.g. tree=10x4 for 10^4 words
+        size_t x = value.find('x');
+        if (x == string::npos) {
+            cout << "Vocabulary tree must be given as BxL: " << value << endl;
+            return false;
+        }
+        treeBranchFactor = atoi(value.substr(0, x).c_str());
+        treeDepth = atoi(value.substr(x + 1).c_str());
+        return true;
+    }
+
+    if (name == "batch") {
+        miniBatchSize = atoi(value.c_str());
+        return true;
+    }
+    if (name == "sample") {
+        trainingSampleSize = atoi(value.c_str());
+        return true;
+    }
+    if (name == "cutoff") {
+        queryCutoff = atoi(value.c_str());
+        return true;
+    }
+    if (name == "hnsw") {
+        // Graph parameters, e.g. hnsw=16,200 for M = 16 and efConstruction = 200
+        size_t comma = value.find(',');
+        hnswM = atoi(value.substr(0, comma).c_str());
+        if (comma != string::npos)
+            hnswEfConstruction = atoi(value.substr(comma + 1).c_str());
+        return true;
+    }
+    if (name == "ef") {
+        hnswEfSearch = atoi(value.c_str());
+        return true;
+    }
+    if (name == "ivf") {
+        ivfListCount = atoi(value.c_str());
+        return true;
+    }
+    if (name == "nprobe") {
+        ivfProbes = atoi(value.c_str());
+        return true;
+    }
+    if (name == "pq") {
+        pqSubspaces = atoi(value.c_str());
+        return true;
+    }
+    if (name == "keypoints") {
+        geometricKeypoints = atoi(value.c_str());
+        return true;
+    }
+    if (name == "rerank") {
+        // Depth and time budget, e.g. rerank=100,250 verifies the top 100 results within 250 ms
+        size_t comma = value.find(',');
+        rerankDepth = atoi(value.substr(0, comma).c_str());
+        if (comma != string::npos)
+            rerankBudgetMs = atof(value.substr(comma + 1).c_str());
+        return true;
+    }
+    if (name == "model") {
+        if (value != "homography" && value != "fundamental") {
+            cout << "Unknown verification model: " << value << endl;
+            return false;
+        }
+        verificationModel = value == "fundamental" ? VerificationModel::Fundamental : VerificationModel::Homography;
+        return true;
+    }
+    if (name == "cascade") {
+        // Cheap index and shortlist size, e.g. cascade=index/ColorHistogram,200
+        if (!fusionIndexPaths.empty()) {
+            cout << "Cascade and fusion queries cannot be combined, ignoring: " << option << endl;
+            return false;
+        }
+        size_t comma = value.find(',');
+        cascadeIndexPath = value.substr(0, comma);
+        if (comma != string::npos)
+            cascadeShortlist = atoi(value.substr(comma + 1).c_str());
+        return true;
+    }
+    if (name == "fuse") {
+        // Index and weight, e.g. fuse=index/HOG,0.5
+        if (!cascadeIndexPath.empty()) {
+            cout << "Cascade and fusion queries cannot be combined, ignoring: " << option << endl;
+            return false;
+        }
+        size_t comma = value.find(',');
+        float weight = comma != string::npos ? static_cast<float>(atof(value.substr(comma + 1).c_str())) : 1.0f;
+        fusionIndexPaths.emplace_back(value.substr(0, comma), weight);
+        return true;
+    }
+    if (name == "fusion") {
+        size_t comma = value.find(',');
+        string method = value.substr(0, comma);
+        if (method != "sum" && method != "rrf") {
+            cout << "Unknown fusion method: " << method << endl;
+            return false;
+        }
+        fusionMethod = method == "rrf" ? FusionMethod::ReciprocalRank : FusionMethod::WeightedSum;
+        if (comma != string::npos)
+            fusionDepth = atoi(value.substr(comma + 1).c_str());
+        return true;
+    }
+    if (name == "hoglayout") {
+        // Cells across, cells down, cells per block side and bins, e.g. hoglayout=8,8,2,9
+        HOGLayout layout;
+        char comma[3] = { 0, 0, 0 };
+        istringstream fields(value);
+        fields >> layout.cellsX >> comma[0] >> layout.cellsY >> comma[1] >> layout.blockCells >> comma[2] >> layout.bins;
+        if (fields.fail() || string(comma, 3) != ",,," || !layout.isValid()) {
+            cout << "HOG layout must be given as CX,CY,B,BINS with B <= CX, CY: " << value << endl;
+            return false;
+        }
+        hogLayout = layout;
+        return true;
+    }
+    if (name == "inverted") {
+        invertedIndex = value == "packed" ? 2 : (atoi(value.c_str()) != 0 ? 1 : 0);
+        return true;
+    }
+
+    cout << "Unknown option: " << name << endl;
+    return false;
+}
+
 void Tester::writeExtractionResultToFile(char* Path, char* Method, int vocabulary, string filename) {
     ofstream log(filename + ".txt", ios::app); // append mode
 
@@ -28,6 +189,24 @@ void Tester::writeExtractionResultToFile(char* Path, char* Method, int vocabular
     log << "Image Database: " << imageDatabasePath << "\n";
     log << "Selected Method: " << selectedMethod << "\n";
 	log << "Vocabulary Size: " << vocabularySize << "\n";
+    log << "Threads: " << (threadCount > 0 ? threadCount : ThreadPool::defaultThreadCount()) << "\n";
+    log << "Pipeline: " << (pipelineMode ? "on" : "off") << "\n";
+    if (treeBranchFactor > 0)
+        log << "Vocabulary Tree: " << treeBranchFactor << "x" << treeDepth << "\n";
+    if (miniBatchSize > 0)
+        log << "Mini-batch k-means: batch " << miniBatchSize << "\n";
+    if (trainingSampleSize > 0)
+        log << "Training sample: " << trainingSampleSize << " descriptors\n";
+    if (ivfListCount > 0)
+        log << "IVF lists: " << ivfListCount << "\n";
+    if (pqSubspaces > 0)
+        log << "Product quantization: " << pqSubspaces << " bytes per image\n";
+    if (hnswM > 0)
+        log << "HNSW graph: M " << hnswM << ", efConstruction " << hnswEfConstruction << "\n";
+    if (geometricKeypoints > 0)
+        log << "Keypoints per image: " << geometricKeypoints << "\n";
+    if (invertedIndex > 0)
+        log << "Inverted index: " << (invertedIndex == 2 ? "packed" : "on") << "\n";
     log << "Run time: " << elapsedTimes << " seconds" << "\n";
     log << "---------------------------------\n";
 
@@ -59,6 +238,24 @@ void Tester::writeQueryResultToFile(char* queryImage, char* IndexPath, int k, st
     log << "Feature: " << utils.extractFeatureName(indexPath) << "\n";
 	log << "Vocabulary Size:" << vocabulary << "\n";
     log << "kTop " << kTop << "\n";
+    if (!fusionIndexPaths.empty()) {
+        log << "Fusion: " << (fusionMethod == FusionMethod::ReciprocalRank ? "reciprocal rank" : "weighted sum")
+            << ", depth " << fusionDepth << "\n";
+        for (const auto& [path, weight] : fusionIndexPaths)
+            log << "  + " << utils.extractFeatureName(path) << " weight " << weight << "\n";
+    }
+    if (!cascadeIndexPath.empty())
+        log << "Cascade: " << utils.extractFeatureName(cascadeIndexPath) << " shortlist " << cascadeShortlist << "\n";
+    else if (!indexer.getInvertedIndex().empty() && invertedIndex != 0)
+        log << "Inverted index: " << indexer.getInvertedIndex().getPostingCount() << " postings, "
+            << indexer.getInvertedIndex().getPostingBytes() << " bytes" << (indexer.getInvertedIndex().isCompressed() ? " (packed)" : "") << "\n";
+    else if (!indexer.getIvfIndex().empty() && ivfProbes > 0)
+        log << "IVF nprobe: " << ivfProbes << " of " << indexer.getIvfIndex().getListCount() << " lists\n";
+    else if (!indexer.getHnswIndex().empty())
+        log << "HNSW efSearch: " << hnswEfSearch << "\n";
+    if (!indexer.getGeometricVerifier().empty() && rerankDepth > 0)
+        log << "Geometric re-ranking: top " << rerankDepth << ", " << rerankBudgetMs << " ms, "
+            << (verificationModel == VerificationModel::Fundamental ? "fundamental matrix" : "homography") << "\n";
     log << "Run time: " << queryExecutionTimes << " seconds" << "\n";
   //  for (int i = 0; i < APs.size(); ++i) {
 		//log << "Average Precision for query " << i + 1 << ": " << APs[i] << "\n";
@@ -70,25 +267,109 @@ void Tester::writeQueryResultToFile(char* queryImage, char* IndexPath, int k, st
 }
 
 void Tester::runTestFeatureExtraction() {
+    indexer.setThreadCount(threadCount);
+    indexer.setPipelineMode(pipelineMode, queueCapacity);
+    indexer.setVocabularyTree(treeBranchFactor, treeDepth);
+    indexer.setMiniBatchTraining(miniBatchSize, trainingSampleSize);
+    indexer.setHnswGraph(hnswM, hnswEfConstruction);
+    indexer.setIvfLists(ivfListCount);
+    indexer.setProductQuantization(pqSubspaces);
+    indexer.setInvertedIndex(invertedIndex > 0, invertedIndex == 2);
+    indexer.setGeometricVerification(geometricKeypoints);
+    indexer.setHogLayout(hogLayout);
+
+    // Reuse the vocabulary of an existing index so SIFT/ORB descriptors are quantized while extracting
+    if (!vocabularyIndexPath.empty()) {
+        Indexer vocabularySource;
+        if (vocabularySource.readIndex(vocabularyIndexPath))
+            indexer.setPretrainedVocabulary(vocabularySource.getVocab(), vocabularySource.getVocabularyTree());
+    }
+
     timer.start();
     if (!inputPath.empty()) {
+        // Only the image paths are registered here, the indexer streams the images one by one
         imagedatabase.readImageDatabase(inputPath, log);
-        indexer.indexingImageDatabase(inputPath, selectedMethod, imagedatabase, log, vocabularySize);
+        cout << "Images found: " << imagedatabase.getImageCount() << endl;
+
+        // "All" or a comma-separated list extracts several features in one pass over the images
+        vector<string> methods;
+        if (selectedMethod == "All") {
+            methods = Indexer::supportedFeatures();
+        }
+        else if (selectedMethod.find(',') != string::npos) {
+            size_t start = 0;
+            while (start <= selectedMethod.size()) {
+                size_t comma = selectedMethod.find(',', start);
+                if (comma == string::npos)
+                    comma = selectedMethod.size();
+                methods.push_back(selectedMethod.substr(start, comma - start));
+                start = comma + 1;
+            }
+        }
+
+        if (imagedatabase.getImageCount() > 0) {
+            if (methods.empty())
+                indexer.indexingImageDatabase(inputPath, selectedMethod, imagedatabase, log, vocabularySize);
+            else
+                indexer.indexingImageDatabase(inputPath, methods, imagedatabase, log, vocabularySize);
+        }
     }
     timer.stop(); 
     elapsedTimes = timer.elapsedSeconds();
 }
 
+void Tester::configureQuery(Query& target, Indexer& source) {
+    target.setVocabularyTree(&source.getVocabularyTree());
+    target.setHogLayout(source.getHogLayout());
+    target.setParallelism(threadCount, queryCutoff);
+    target.setHnswIndex(&source.getHnswIndex(), hnswEfSearch);
+    target.setIvfIndex(&source.getIvfIndex(), ivfProbes);
+    target.setInvertedIndex(invertedIndex != 0 ? &source.getInvertedIndex() : nullptr);
+    source.setVerificationModel(verificationModel);
+    target.setGeometricVerification(&source.getGeometricVerifier(), rerankDepth, rerankBudgetMs);
+}
+
 void Tester::runTestQuery() {
     indexer.readIndex(indexPath);
-    map<string, Feature*> features = indexer.getFeatures();
+    const FeatureStore& features = indexer.getFeatureStore();
     Mat vocabulary = indexer.getVocab();
+    configureQuery(query, indexer);
 
     cout << "Getting started" << endl;
     cout << "Feature size: " << features.size() << endl;
 
 	selectedMethod = utils.extractFeatureName(indexPath);
 
+    // Cascade: the cheap index shortlists, the queried index ranks the shortlist
+    string cascadeMethod;
+    Mat cascadeVocabulary;
+    if (!cascadeIndexPath.empty()) {
+        if (!cascadeIndexer.readIndex(cascadeIndexPath)) {
+            cout << "Unable to read the cascade index: " << cascadeIndexPath << endl;
+            return;
+        }
+        cascadeMethod = utils.extractFeatureName(cascadeIndexPath);
+        cascadeVocabulary = cascadeIndexer.getVocab();
+        cout << "Cascade: " << cascadeMethod << " shortlist " << cascadeShortlist << endl;
+    }
+
+    // Fusion: the queried index and every fused one are searched side by side
+    if (!fusionIndexPaths.empty()) {
+        configureQuery(fusionQuery.addSource(selectedMethod, features, vocabulary), indexer);
+        for (const auto& [path, weight] : fusionIndexPaths) {
+            fusionIndexers.emplace_back(new Indexer);
+            Indexer& fused = *fusionIndexers.back();
+            if (!fused.readIndex(path)) {
+                cout << "Unable to read the fused index: " << path << endl;
+                return;
+            }
+            configureQuery(fusionQuery.addSource(utils.extractFeatureName(path), fused.getFeatureStore(), fused.getVocab(), weight), fused);
+        }
+        fusionQuery.setFusion(fusionMethod, fusionDepth);
+        fusionQuery.setParallelism(threadCount, queryCutoff);
+    }
+    const bool singleQueries = !cascadeMethod.empty() || fusionQuery.size() > 0;
+
     // Get all image file names in the query folder
     vector<String> imageFiles;
 
@@ -117,6 +398,11 @@ void Tester::runTestQuery() {
 
     timer.start();
 
+    // Extract every query descriptor first, then search them all in one batch
+    vector<string> queryIds;
+    vector<Mat> queryDescriptors;
+    vector<LocalFeatures> queryKeypoints;
+    vector<vector<pair<string, float>>> singleResults;
     for (size_t i = 0; i < count; i++) {
         // Extract image ID
         size_t lastSlash = fn[i].find_last_of("\\/");
@@ -135,14 +421,53 @@ void Tester::runTestQuery() {
             continue;
         }
 
-        // Assign and run search
         Image queryImage;
         queryImage.assignImg(nameWithoutExt, img);
-        query.Search(queryImage.getId(), queryImage.getImg(), features, vocabulary, kTop, selectedMethod);
-        vector<pair<string, float>> results = query.getResult();
+        queryIds.push_back(queryImage.getId());
+        if (fusionQuery.size() > 0) {
+            fusionQuery.Search(queryImage.getId(), queryImage.getImg(), kTop);
+            singleResults.push_back(fusionQuery.getResult());
+            continue;
+        }
+        if (!cascadeMethod.empty()) {
+            query.CascadeSearch(queryImage.getId(), queryImage.getImg(),
+                cascadeIndexer.getFeatureStore(), cascadeVocabulary, cascadeMethod, cascadeIndexer.getHogLayout(),
+                features, vocabulary, selectedMethod, cascadeShortlist, kTop);
+            singleResults.push_back(query.getResult());
+            continue;
+        }
+        queryKeypoints.emplace_back();
+        queryDescriptors.push_back(query.computeQueryDescriptor(queryImage.getId(), queryImage.getImg(), vocabulary, selectedMethod, &queryKeypoints.back()));
+    }
+
+    // Queries whose descriptor could not be computed keep an empty result list
+    Mat batch;
+    vector<LocalFeatures> batchKeypoints;
+    vector<int> batchRows(queryDescriptors.size(), -1);
+    for (size_t i = 0; i < queryDescriptors.size(); i++) {
+        if (queryDescriptors[i].empty() || queryDescriptors[i].cols != features.getDimensions()) {
+            cerr << "No usable descriptor for query " << queryIds[i] << endl;
+            continue;
+        }
+        batchRows[i] = batch.rows;
+        batch.push_back(queryDescriptors[i]);
+        batchKeypoints.push_back(queryKeypoints[i]);
+    }
 
-        // Evaluate this query
-        evaluator.calculateAveragePrecision(results, queryImage.getId(), features);
+    if (!singleQueries) {
+        query.SearchBatch(batch, features, kTop, selectedMethod);
+        query.VerifyBatch(batchKeypoints, features);
+    }
+    const vector<vector<pair<string, float>>>& batchResults = query.getBatchResults();
+
+    // Evaluate each query in folder order, cascade and fused queries already have their results
+    for (size_t i = 0; i < queryIds.size(); i++) {
+        vector<pair<string, float>> results;
+        if (singleQueries)
+            results = singleResults[i];
+        else if (batchRows[i] >= 0 && batchRows[i] < static_cast<int>(batchResults.size()))
+            results = batchResults[batchRows[i]];
+        evaluator.calculateAveragePrecision(results, queryIds[i], features);
     }
 
     // Calculate final mAP
@@ -151,4 +476,241 @@ void Tester::runTestQuery() {
     queryExecutionTimes = timer.elapsedSeconds();
     mAP = evaluator.getMAP();
     APs = evaluator.getAP();
-}
\ No newline at end of file
+}
+
+void Tester::runDistanceBenchmark() {
+    benchmarkResults.clear();
+    if (benchmarkRows <= 0 || benchmarkRepetitions <= 0) {
+        cout << "Benchmark needs a positive database size and repetition count." << endl;
+        return;
+    }
+
+    vector<int> lengths = { 360, 576, 1024 };  // HOG, Color Correlogram, Color Histogram
+    if (benchmarkLength > 0)
+        lengths.push_back(benchmarkLength);
+
+    const char* metricNames[] = { "Chi-square", "L2", "L1" };
+    vector<SimdLevel> levels = DistanceKernels::availableLevels();
+    RNG rng(12345);
+
+    cout << "Selected kernels: " << DistanceKernels::best().name << endl;
+
+    for (int length : lengths) {
+        // L1-normalized histograms with about one empty bin in three, like the color features
+        Mat database(benchmarkRows, length, CV_32F);
+        Mat queryVector(1, length, CV_32F);
+        rng.fill(database, RNG::UNIFORM, 0.0, 1.0);
+        rng.fill(queryVector, RNG::UNIFORM, 0.0, 1.0);
+        for (int r = 0; r < database.rows; ++r) {
+            float* row = database.ptr<float>(r);
+            for (int i = 0; i < length; ++i)
+                if (rng.uniform(0, 3) == 0) row[i] = 0.0f;
+            normalize(database.row(r), database.row(r), 1, 0, NORM_L1);
+        }
+        normalize(queryVector, queryVector, 1, 0, NORM_L1);
+
+        const float* query = queryVector.ptr<float>(0);
+        vector<float> reference(benchmarkRows), scores(benchmarkRows);
+
+        for (int metric = 0; metric < 3; ++metric) {
+            double scalarSeconds = 0.0;
+
+            for (SimdLevel level : levels) {
+                const DistanceKernelSet& kernels = DistanceKernels::forLevel(level);
+                DistanceKernel kernel = metric == 0 ? kernels.chiSquare : (metric == 1 ? kernels.squaredL2 : kernels.l1);
+
+                timer.start();
+                for (int repetition = 0; repetition < benchmarkRepetitions; ++repetition)
+                    for (int r = 0; r < benchmarkRows; ++r)
+                        scores[r] = kernel(query, database.ptr<float>(r), length);
+                timer.stop();
+                const double seconds = timer.elapsedSeconds();
+
+                // Every instruction set must agree with the scalar kernel
+                double maxRelativeError = 0.0;
+                if (level == SimdLevel::Scalar) {
+                    scalarSeconds = seconds;
+                    reference = scores;
+                }
+                else {
+                    for (int r = 0; r < benchmarkRows; ++r) {
+                        double error = fabs(scores[r] - reference[r]) / max(1e-12, static_cast<double>(fabs(reference[r])));
+                        maxRelativeError = max(maxRelativeError, error);
+                    }
+                }
+
+                const double nanosecondsPerVector = seconds * 1e9 / (static_cast<double>(benchmarkRows) * benchmarkRepetitions);
+                ostringstream line;
+                line << "Length " << length << " | " << metricNames[metric] << " | " << kernels.name
+                    << " | " << fixed << setprecision(1) << nanosecondsPerVector << " ns/vector"
+                    << " | speedup " << setprecision(2) << (seconds > 0.0 ? scalarSeconds / seconds : 0.0) << "x"
+                    << " | max rel. error " << scientific << setprecision(1) << maxRelativeError;
+
+                cout << line.str() << endl;
+                benchmarkResults.push_back(line.str());
+            }
+        }
+    }
+
+    // === Color histogram: OpenCV conversion + calcHist against the fused kernel ===
+    // Full-HD frames, one of uniform noise (no color coherence) and one of smooth gradients
+    Mat noise(1080, 1920, CV_8UC3), gradient(1080, 1920, CV_8UC3);
+    rng.fill(noise, RNG::UNIFORM, 0, 256);
+    for (int y = 0; y < gradient.rows; ++y) {
+        uchar* pixel = gradient.ptr<uchar>(y);
+        for (int x = 0; x < gradient.cols; ++x, pixel += 3) {
+            pixel[0] = saturate_cast<uchar>(x / 8 + rng.uniform(0, 8));
+            pixel[1] = saturate_cast<uchar>(y / 5 + rng.uniform(0, 8));
+            pixel[2] = saturate_cast<uchar>((x + y) / 11);
+        }
+    }
+
+    const char* imageNames[] = { "noise", "gradient" };
+    const char* kernelNames[] = { "OpenCV", "fused scalar", "fused SSE4.2" };
+    const Mat* images[] = { &noise, &gradient };
+    for (int image = 0; image < 2; ++image) {
+        Mat reference = ColorHistogram::computeHistogramOpenCV(*images[image]);
+        double openCvSeconds = 0.0;
+
+        for (int kernel = 0; kernel < 3; ++kernel) {
+            if (kernel == 2 && DistanceKernels::detectSimdLevel() == SimdLevel::Scalar)
+                continue;
+
+            Mat histogram;
+            timer.start();
+            for (int repetition = 0; repetition < benchmarkRepetitions; ++repetition)
+                histogram = kernel == 0 ? ColorHistogram::computeHistogramOpenCV(*images[image])
+                    : ColorHistogram::computeHistogramFused(*images[image], kernel == 2);
+            timer.stop();
+            const double seconds = timer.elapsedSeconds();
+            if (kernel == 0)
+                openCvSeconds = seconds;
+
+            // The fused kernel must give the very same floats
+            const bool identical = histogram.total() == reference.total()
+                && memcmp(histogram.data, reference.data, reference.total() * sizeof(float)) == 0;
+            const double millisecondsPerImage = seconds * 1e3 / benchmarkRepetitions;
+            ostringstream line;
+            line << "Color Histogram " << images[image]->cols << "x" << images[image]->rows << " " << imageNames[image]
+                << " | " << kernelNames[kernel]
+                << " | " << fixed << setprecision(2) << millisecondsPerImage << " ms/image"
+                << " | " << setprecision(0) << (millisecondsPerImage > 0.0 ? images[image]->total() / (millisecondsPerImage * 1e3) : 0.0) << " MP/s"
+                << " | speedup " << setprecision(2) << (seconds > 0.0 ? openCvSeconds / seconds : 0.0) << "x"
+                << " | " << (identical ? "identical" : "DIFFERENT");
+
+            cout << line.str() << endl;
+            benchmarkResults.push_back(line.str());
+        }
+    }
+
+    // === HOG: Sobel + cartToPolar + binning against the one-pass kernels ===
+    const char* hogNames[] = { "OpenCV", "one pass", "block (one pass)" };
+    HOG orientationHog, blockHog(HOGMode::Block);
+    for (int image = 0; image < 2; ++image) {
+        Mat reference = HOG::computeHOGOpenCV(*images[image]);
+        double openCvSeconds = 0.0;
+
+        for (int kernel = 0; kernel < 3; ++kernel) {
+            Mat descriptor;
+            timer.start();
+            for (int repetition = 0; repetition < benchmarkRepetitions; ++repetition)
+                descriptor = kernel == 0 ? HOG::computeHOGOpenCV(*images[image])
+                    : (kernel == 1 ? orientationHog : blockHog).computeDescriptor(*images[image]);
+            timer.stop();
+            const double seconds = timer.elapsedSeconds();
+            if (kernel == 0)
+                openCvSeconds = seconds;
+
+            const double millisecondsPerImage = seconds * 1e3 / benchmarkRepetitions;
+            ostringstream line;
+            line << "HOG " << images[image]->cols << "x" << images[image]->rows << " " << imageNames[image]
+                << " | " << hogNames[kernel]
+                << " | " << fixed << setprecision(2) << millisecondsPerImage << " ms/image"
+                << " | speedup " << setprecision(2) << (seconds > 0.0 ? openCvSeconds / seconds : 0.0) << "x";
+
+            // The one-pass histogram differs from the reference by float rounding only
+            if (kernel == 1) {
+                double largest = 0.0;
+                minMaxLoc(reference, nullptr, &largest);
+                line << " | max rel. error " << scientific << setprecision(1)
+                    << (largest > 0.0 ? norm(descriptor, reference, NORM_INF) / largest : 0.0);
+            }
+
+            cout << line.str() << endl;
+            benchmarkResults.push_back(line.str());
+        }
+    }
+
+    // === Color correlogram: original loops against the one-sweep sampled and exact modes ===
+    const char* correlogramNames[] = { "original", "sampled (one sweep)", "exact (one sweep)" };
+    ColorCorrelogram sampledCorrelogram, exactCorrelogram(CorrelogramMode::Exact);
+    for (int image = 0; image < 2; ++image) {
+        Mat reference = ColorCorrelogram::computeReference(*images[image]);
+        Mat sampled;
+        double originalSeconds = 0.0;
+
+        for (int kernel = 0; kernel < 3; ++kernel) {
+            Mat descriptor;
+            timer.start();
+            for (int repetition = 0; repetition < benchmarkRepetitions; ++repetition) {
+                if (kernel == 0) {
+                    descriptor = ColorCorrelogram::computeReference(*images[image]);
+                    continue;
+                }
+                ColorCorrelogram& correlogram = kernel == 1 ? sampledCorrelogram : exactCorrelogram;
+                correlogram.createFeature("benchmark", *images[image]);
+                descriptor = correlogram.getDescriptor();
+            }
+            timer.stop();
+            const double seconds = timer.elapsedSeconds();
+            if (kernel == 0)
+                originalSeconds = seconds;
+            if (kernel == 1)
+                sampled = descriptor;
+
+            const double millisecondsPerImage = seconds * 1e3 / benchmarkRepetitions;
+            ostringstream line;
+            line << "Color Correlogram " << images[image]->cols << "x" << images[image]->rows << " " << imageNames[image]
+                << " | " << correlogramNames[kernel]
+                << " | " << fixed << setprecision(2) << millisecondsPerImage << " ms/image"
+                << " | speedup " << setprecision(2) << (seconds > 0.0 ? originalSeconds / seconds : 0.0) << "x";
+
+            // The sampled mode reproduces the original floats; the exact mode is compared with it
+            // by the L1 distance of each distance's histogram (each sums to 1)
+            if (kernel == 1) {
+                const bool identical = descriptor.total() == reference.total()
+                    && memcmp(descriptor.data, reference.data, reference.total() * sizeof(float)) == 0;
+                line << " | " << (identical ? "identical" : "DIFFERENT");
+            }
+            else if (kernel == 2 && sampled.total() == descriptor.total()) {
+                const int perDistance = static_cast<int>(descriptor.total()) / 4;
+                line << " | L1 vs sampled per distance" << setprecision(3);
+                for (int d = 0; d < 4; ++d)
+                    line << " " << norm(descriptor.colRange(d * perDistance, (d + 1) * perDistance),
+                        sampled.colRange(d * perDistance, (d + 1) * perDistance), NORM_L1);
+            }
+
+            cout << line.str() << endl;
+            benchmarkResults.push_back(line.str());
+        }
+    }
+}
+
+void Tester::writeBenchmarkResultToFile(string filename) {
+    ofstream log(filename + ".txt", ios::app); // append mode
+
+    if (!log.is_open()) {
+        cout << "Unable to open log file.\n";
+        return;
+    }
+
+    log << "Distance Kernel Benchmark with:\n";
+    log << "Database Size: " << benchmarkRows << "\n";
+    log << "Repetitions: " << benchmarkRepetitions << "\n";
+    log << "Selected Kernels: " << DistanceKernels::best().name << "\n";
+    for (const string& line : benchmarkResults)
+        log << line << "\n";
+    log << "---------------------------------\n";
+
+    log.close();
+}
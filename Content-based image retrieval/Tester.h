@@ -1,13 +1,16 @@
 #pragma once
 
 #include <string>
+#include <sstream>
+#include <iomanip>
 #include "UI.h"
+#include "FusionQuery.h"
 
 /**
  * @enum Mode
- * @brief Specifies the mode for the Tester: either feature extraction or query.
+ * @brief Specifies the mode for the Tester: feature extraction, query, or kernel benchmark.
  */
-enum Mode { EXTRACT, QUERY };
+enum Mode { EXTRACT, QUERY, BENCHMARK };
 
 /**
  * @class Tester
@@ -25,6 +28,36 @@ private:
     string indexPath;           ///< Path to the indexed features folder (used in QUERY mode)
     int kTop;                   ///< Number of top retrieval results to return
     int vocabularySize;         ///< Size of the visual vocabulary for BoVW-based indexing
+    int threadCount = 0;        ///< Number of worker threads (<= 0 uses all hardware threads)
+    bool pipelineMode = false;  ///< Use the staged read/decode/extract/quantize pipeline for extraction
+    int queueCapacity = 32;     ///< Capacity of each queue between two pipeline stages
+    string vocabularyIndexPath; ///< Index folder whose vocabulary is reused for SIFT/ORB extraction
+    int treeBranchFactor = 0;   ///< Branching factor of the vocabulary tree (0 = flat vocabulary)
+    int treeDepth = 0;          ///< Depth of the vocabulary tree
+    int miniBatchSize = 0;      ///< Batch size of mini-batch k-means (0 = full k-means)
+    int trainingSampleSize = 0; ///< Descriptors sampled to train the vocabulary (0 = all of them)
+    int queryCutoff = 16384;    ///< Minimum index size for a parallel query scan
+    int hnswM = 0;              ///< Links per node of the HNSW graph built at extraction (0 = no graph)
+    int hnswEfConstruction = 200; ///< Candidate list size used to build the HNSW graph
+    int hnswEfSearch = 64;      ///< Candidate list size of HNSW queries
+    int ivfListCount = 0;       ///< Number of IVF lists built at extraction (0 = no IVF index)
+    int ivfProbes = 8;          ///< Number of IVF lists scanned per query (0 = exact scan)
+    int pqSubspaces = 0;        ///< Bytes per product-quantized descriptor (0 = float descriptors)
+    int invertedIndex = -1;     ///< `inverted` setting: 1 builds the inverted index, 2 a packed one, 0 does not use it (-1 = not given)
+    int geometricKeypoints = 0; ///< Keypoints kept per image at extraction for geometric verification (0 = none)
+    int rerankDepth = 50;       ///< Number of results verified geometrically per query (0 = no re-ranking)
+    double rerankBudgetMs = 200.0; ///< Deadline for starting verifications of one query, in milliseconds
+    VerificationModel verificationModel = VerificationModel::Homography; ///< Transformation fitted by the verification
+    string cascadeIndexPath;    ///< Index folder of the cheap feature shortlisting candidates (empty = single-stage queries)
+    int cascadeShortlist = 100; ///< Number of candidates passed from the cheap feature to the indexed one
+    vector<pair<string, float>> fusionIndexPaths; ///< Index folders fused with the queried one, with their weights (empty = single feature)
+    FusionMethod fusionMethod = FusionMethod::WeightedSum; ///< Merging rule of fused queries
+    int fusionDepth = 100;      ///< Results requested from each fused feature
+    HOGLayout hogLayout;        ///< Cell and block layout of Block HOG indexes built at extraction
+    int benchmarkRows = 0;      ///< Number of database vectors scanned per benchmark pass (BENCHMARK mode)
+    int benchmarkRepetitions = 0; ///< Number of benchmark passes (BENCHMARK mode)
+    int benchmarkLength = 0;    ///< Extra descriptor length to benchmark, e.g. a vocabulary size (0 = none)
+    vector<string> benchmarkResults; ///< One line per benchmarked (length, metric, instruction set)
 
     double elapsedTimes;         ///< Time taken for feature extraction
     double queryExecutionTimes; ///< Time taken for query execution
@@ -35,21 +68,73 @@ private:
     Query query;                ///< Query executor
     Timer timer;                ///< Timer for benchmarking
     Indexer indexer;            ///< Indexing utility
+    Indexer cascadeIndexer;     ///< Index of the cheap feature in cascade queries
+    vector<unique_ptr<Indexer>> fusionIndexers; ///< Indexes fused with the queried one
+    FusionQuery fusionQuery;    ///< Fused query executor
     ImageDatabase imagedatabase;///< Image loader and manager
     Evaluator evaluator;        ///< Evaluation utility (for computing AP, mAP)
     Utils utils;                ///< Helper functions
 
+    /**
+     * @brief Gives a query executor the search settings and the indexes loaded with an index.
+     *
+     * @param[out]    target    Query executor to configure.
+     * @param[in,out] source    Indexer holding the loaded index.
+     *
+     * @return void
+     */
+    void configureQuery(Query& target, Indexer& source);
+
 public:
     /**
      * @brief Constructor for Tester class.
      *
-     * @param[in] a      The first argument, interpreted as input or query path.
-     * @param[in] b      The second argument, interpreted as method or index path.
-     * @param[in] c      The third argument, interpreted as vocabulary size or kTop.
-     * @param[in] mode   Mode of operation: EXTRACT or QUERY.
+     * @param[in] a      The first argument, interpreted as input or query path (benchmark: database size).
+     * @param[in] b      The second argument, interpreted as method or index path (benchmark: repetitions).
+     * @param[in] c      The third argument, interpreted as vocabulary size or kTop (benchmark: extra descriptor length).
+     * @param[in] mode   Mode of operation: EXTRACT, QUERY or BENCHMARK.
      */
     Tester(char* a, char* b, char* c, Mode mode);
 
+    /**
+     * @brief Applies an optional command-line setting given as "name=value".
+     *
+     * Supported settings:
+     * - `threads=N`   Number of worker threads (0 = all hardware threads, 1 = sequential).
+     * - `pipeline=0|1`   Run extraction as overlapping pipeline stages.
+     * - `queue=N`       Capacity of each queue between two pipeline stages.
+     * - `vocabulary=PATH`   Reuse the vocabulary of an existing SIFT/ORB index folder.
+     * - `tree=BxL`      Train a vocabulary tree with B branches and L levels instead of flat k-means.
+     * - `batch=N`       Train the vocabulary with mini-batch k-means, N descriptors per batch.
+     * - `sample=N`      Train the vocabulary on N randomly sampled descriptors.
+     * - `cutoff=N`      Scan queries in parallel (with `threads`) only on indexes of at least N images.
+     * - `hnsw=M[,EF]`   Build an HNSW graph with M links per node (and construction list size EF) next to the index.
+     * - `ef=N`          Candidate list size of HNSW queries.
+     * - `ivf=N`         Partition the index into N IVF lists at extraction.
+     * - `nprobe=N`      Number of IVF lists scanned per query (0 scans the whole index).
+     * - `pq=M`          Store each descriptor as M product-quantized bytes instead of floats.
+     * - `inverted=0|1|packed`  Build a TF-IDF inverted index of the BoVW histograms at extraction
+     *                   (`packed` compresses the posting lists); queries use it when the index has
+     *                   one, unless `inverted=0`.
+     * - `keypoints=N`   Keep the N strongest SIFT/ORB keypoints of each image for geometric verification.
+     * - `rerank=R[,MS]` Verify the top R results of each query geometrically (no new candidate is started after MS milliseconds).
+     * - `model=homography|fundamental`   Transformation fitted by the geometric verification.
+     * - `cascade=PATH[,N]`  Shortlist the N best images with the index at PATH (e.g. a Color
+     *                   Histogram index of the same database), then rank only them with the queried index.
+     * - `fuse=PATH[,W]` Also search the index at PATH (weight W, default 1) and fuse its results with
+     *                   those of the queried index; may be given several times. Cannot be combined
+     *                   with `cascade`: whichever is given second is rejected.
+     * - `fusion=sum|rrf[,D]`   Fuse by weighted sum of normalized scores or by reciprocal rank,
+     *                   over the D best results of each feature.
+     * - `hoglayout=CX,CY,B,BINS`   Build Block HOG indexes on a CX x CY cell grid with B x B-cell blocks
+     *                   and BINS orientations (default 4,4,2,9); queries read the layout from the index.
+     *
+     * @param[in] option   The option string.
+     *
+     * @return true if the option was recognized; false otherwise.
+     */
+    bool setOption(string option);
+
     /**
      * @brief Writes feature extraction summary and performance results to file.
      *
@@ -79,6 +164,8 @@ public:
      *
      * This function loads images, extracts features using the selected method,
      * builds the BoVW vocabulary, indexes the features, and logs the process.
+     * A method list such as "Color Histogram,HOG,SIFT", or "All", extracts every listed
+     * feature in one pass over the images and saves one index per feature.
      * 
      * @return void
      */
@@ -87,10 +174,37 @@ public:
     /**
      * @brief Runs the image retrieval process.
      *
-     * Loads query images, computes their feature vectors, performs retrieval,
-     * ranks the results, and evaluates using Average Precision and mAP.
+     * Loads query images, computes their feature vectors, retrieves all of them
+     * in one batch search, and evaluates using Average Precision and mAP.
      * 
      * @return void
      */
     void runTestQuery();
+
+    /**
+     * @brief Benchmarks the Chi-square, L2 and L1 kernels of every supported instruction set.
+     *
+     * Scans `benchmarkRows` random histogram-like vectors `benchmarkRepetitions` times for the
+     * descriptor lengths produced by this project (HOG 360, Color Correlogram 576,
+     * Color Histogram 1024, plus `benchmarkLength` if set), and reports the time per vector,
+     * the speedup over the scalar kernel and the largest relative difference to it.
+     * Then times the Color Histogram extraction of full-HD images `benchmarkRepetitions` times
+     * with OpenCV and with the fused kernel, and checks that both give the same descriptor.
+     * Then times HOG with OpenCV's Sobel and cartToPolar against the one-pass kernels.
+     * Last, times the Color Correlogram with the original per-distance loops against the
+     * sampled and exact one-sweep modes, checks that the sampled mode gives the original
+     * descriptor, and reports the L1 difference between the sampled and exact modes.
+     *
+     * @return void
+     */
+    void runDistanceBenchmark();
+
+    /**
+     * @brief Writes the benchmark table to file.
+     *
+     * @param[in] filenamePrefix    Output filename prefix.
+     *
+     * @return void
+     */
+    void writeBenchmarkResultToFile(string filenamePrefix);
 };
@@ -0,0 +1,110 @@
+#include "ThreadPool.h"
+
+ThreadPool::ThreadPool(int threadCount) {
+    if (threadCount <= 0)
+        threadCount = defaultThreadCount();
+
+    // The calling thread runs iterations too, so only threadCount - 1 workers are needed
+    for (int i = 1; i < threadCount; ++i)
+        workers.emplace_back(&ThreadPool::workerLoop, this);
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        lock_guard<mutex> lock(jobMutex);
+        stopping = true;
+    }
+    jobReady.notify_all();
+
+    for (thread& worker : workers)
+        worker.join();
+}
+
+int ThreadPool::getThreadCount() const {
+    return static_cast<int>(workers.size()) + 1;
+}
+
+int ThreadPool::defaultThreadCount() {
+    unsigned int hardwareThreads = thread::hardware_concurrency();
+    return hardwareThreads > 0 ? static_cast<int>(hardwareThreads) : 1;
+}
+
+void ThreadPool::parallelFor(size_t count, const function<void(size_t)>& body) {
+    if (count == 0)
+        return;
+
+    // Nothing to share: run the loop inline
+    if (workers.empty() || count == 1) {
+        for (size_t i = 0; i < count; ++i)
+            body(i);
+        return;
+    }
+
+    lock_guard<mutex> callLock(callMutex);
+
+    // Publish the job and wake up the workers
+    {
+        lock_guard<mutex> lock(jobMutex);
+        task = &body;
+        taskCount = count;
+        nextIndex = 0;
+        activeWorkers = workers.size();
+        error = nullptr;
+        ++generation;
+    }
+    jobReady.notify_all();
+
+    // The calling thread takes part in the loop as well
+    runTasks();
+
+    // Wait until every worker has left the job before the loop body goes out of scope
+    exception_ptr firstError;
+    {
+        unique_lock<mutex> lock(jobMutex);
+        jobDone.wait(lock, [this] { return activeWorkers == 0; });
+        task = nullptr;
+        firstError = error;
+        error = nullptr;
+    }
+
+    if (firstError)
+        rethrow_exception(firstError);
+}
+
+void ThreadPool::workerLoop() {
+    unsigned long long seenGeneration = 0;
+
+    while (true) {
+        {
+            unique_lock<mutex> lock(jobMutex);
+            jobReady.wait(lock, [&] { return stopping || generation != seenGeneration; });
+            if (stopping)
+                return;
+            seenGeneration = generation;
+        }
+
+        runTasks();
+
+        {
+            lock_guard<mutex> lock(jobMutex);
+            if (--activeWorkers == 0)
+                jobDone.notify_one();
+        }
+    }
+}
+
+void ThreadPool::runTasks() {
+    for (size_t i = nextIndex++; i < taskCount; i = nextIndex++) {
+        try {
+            (*task)(i);
+        }
+        catch (...) {
+            lock_guard<mutex> lock(jobMutex);
+            if (!error)
+                error = current_exception();
+
+            // Skip the remaining iterations
+            nextIndex = taskCount;
+        }
+    }
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <exception>
+#include <vector>
+
+using namespace std;
+
+/**
+ * @class ThreadPool
+ * @brief A fixed-size pool of worker threads used to run data-parallel loops.
+ *
+ * The workers are created once and sleep between jobs, so the same pool can be reused by
+ * several loops (feature extraction, BoVW quantization, ...) without paying the thread
+ * creation cost each time. Loop iterations are handed out one by one through a shared
+ * counter, which keeps every worker busy even when the cost per iteration varies a lot
+ * (e.g., images of very different sizes).
+ */
+class ThreadPool {
+private:
+    vector<thread> workers;             ///< Background worker threads (the calling thread also takes part in each loop).
+    mutex jobMutex;                     ///< Protects the job state shared with the workers.
+    mutex callMutex;                    ///< Serializes concurrent calls to `parallelFor()`.
+    condition_variable jobReady;        ///< Signals the workers that a new job is available (or that the pool stops).
+    condition_variable jobDone;         ///< Signals the caller that every worker has left the current job.
+
+    const function<void(size_t)>* task = nullptr;  ///< Loop body of the current job.
+    size_t taskCount = 0;               ///< Number of iterations of the current job.
+    atomic<size_t> nextIndex{ 0 };      ///< Next iteration to hand out.
+    size_t activeWorkers = 0;           ///< Workers that have not finished the current job yet.
+    unsigned long long generation = 0;  ///< Incremented for every new job so sleeping workers can detect it.
+    bool stopping = false;              ///< Set by the destructor to terminate the workers.
+    exception_ptr error;                ///< First exception thrown by the loop body, rethrown by `parallelFor()`.
+
+    /**
+     * @brief Main loop of a worker thread: waits for a job, runs iterations, reports completion.
+     *
+     * @return void
+     */
+    void workerLoop();
+
+    /**
+     * @brief Runs iterations of the current job until the shared counter is exhausted.
+     *
+     * @return void
+     */
+    void runTasks();
+
+public:
+    /**
+     * @brief Constructor that starts the worker threads.
+     *
+     * @param[in] threadCount   Total number of threads taking part in a loop, including the caller.
+     *                          A value <= 0 selects `defaultThreadCount()`, 1 runs every loop inline.
+     */
+    explicit ThreadPool(int threadCount = 0);
+
+    /**
+     * @brief Destructor. Wakes up and joins all worker threads.
+     */
+    ~ThreadPool();
+
+    /**
+     * @brief Returns the number of threads taking part in a loop, including the caller.
+     *
+     * @return The thread count of the pool.
+     */
+    int getThreadCount() const;
+
+    /**
+     * @brief Runs `task(i)` for every i in [0, count) and blocks until all iterations are done.
+     *
+     * Iterations may run in any order and on any thread, so the loop body must only write
+     * to per-iteration locations (e.g., preallocated slots) or synchronize by itself.
+     *
+     * @param[in] count   Number of iterations.
+     * @param[in] task    Loop body, called once per iteration index.
+     *
+     * @return void
+     *
+     * @note If an iteration throws, the remaining iterations are skipped and the first
+     *       exception is rethrown in the calling thread. The loop body must not call
+     *       `parallelFor()` on the same pool.
+     */
+    void parallelFor(size_t count, const function<void(size_t)>& task);
+
+    /**
+     * @brief Returns the number of hardware threads available on this machine.
+     *
+     * @return The number of hardware threads (at least 1).
+     */
+    static int defaultThreadCount();
+};
@@ -0,0 +1,68 @@
+#include "TopK.h"
+
+TopKSelector::TopKSelector(size_t k, bool higherIsBetter) : capacity(k), higherIsBetter(higherIsBetter) {
+    heap.reserve(k);
+}
+
+bool TopKSelector::isBetter(const pair<int, float>& a, const pair<int, float>& b) const {
+    if (a.second != b.second)
+        return higherIsBetter ? a.second > b.second : a.second < b.second;
+    return a.first < b.first;
+}
+
+void TopKSelector::push(int row, float score) {
+    if (capacity == 0 || score != score)  // NaN
+        return;
+
+    const pair<int, float> candidate(row, score);
+    // The heap comparator puts the worst kept result at the front
+    auto worseFirst = [this](const pair<int, float>& a, const pair<int, float>& b) { return isBetter(a, b); };
+
+    if (heap.size() < capacity) {
+        heap.push_back(candidate);
+        push_heap(heap.begin(), heap.end(), worseFirst);
+        return;
+    }
+
+    if (!isBetter(candidate, heap.front()))
+        return;
+
+    pop_heap(heap.begin(), heap.end(), worseFirst);
+    heap.back() = candidate;
+    push_heap(heap.begin(), heap.end(), worseFirst);
+}
+
+bool TopKSelector::accepts(float score) const {
+    if (capacity == 0 || score != score)
+        return false;
+    if (heap.size() < capacity)
+        return true;
+
+    // Ties may still enter through a smaller row index, so only a strictly worse score is rejected
+    const float worst = heap.front().second;
+    return higherIsBetter ? score >= worst : score <= worst;
+}
+
+void TopKSelector::merge(const TopKSelector& other) {
+    for (const pair<int, float>& result : other.heap)
+        push(result.first, result.second);
+}
+
+size_t TopKSelector::size() const {
+    return heap.size();
+}
+
+bool TopKSelector::full() const {
+    return capacity > 0 && heap.size() == capacity;
+}
+
+float TopKSelector::worstScore() const {
+    return heap.empty() ? 0.0f : heap.front().second;
+}
+
+vector<pair<int, float>> TopKSelector::sortedResults() const {
+    vector<pair<int, float>> results = heap;
+    sort(results.begin(), results.end(),
+        [this](const pair<int, float>& a, const pair<int, float>& b) { return isBetter(a, b); });
+    return results;
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+/**
+ * @class TopKSelector
+ * @brief Keeps the k best (row, score) pairs of a stream of scores.
+ *
+ * The selector is a bounded binary heap whose root is the worst result kept so far, so each
+ * new score costs one comparison when it cannot enter the top k and O(log k) otherwise. Only
+ * integer row indices are stored; callers map the final k rows to image IDs. Scores can be
+ * similarities (higher is better) or distances (lower is better). Equal scores are ordered by
+ * row index so the result does not depend on the scan order.
+ */
+class TopKSelector {
+private:
+    size_t capacity;                    ///< Number of results to keep (k)
+    bool higherIsBetter;                ///< True for similarities, false for distances
+    vector<pair<int, float>> heap;      ///< Kept (row, score) pairs, worst one at the front
+
+    /**
+     * @brief Tells whether a result ranks before another one.
+     *
+     * @param[in] a   First (row, score) pair.
+     * @param[in] b   Second (row, score) pair.
+     *
+     * @return True if `a` is a better result than `b`.
+     */
+    bool isBetter(const pair<int, float>& a, const pair<int, float>& b) const;
+
+public:
+    /**
+     * @brief Constructor.
+     *
+     * @param[in] k                 Number of results to keep.
+     * @param[in] higherIsBetter    True to keep the highest scores (similarity), false for the lowest (distance).
+     */
+    TopKSelector(size_t k, bool higherIsBetter);
+
+    /**
+     * @brief Offers a result to the selector.
+     *
+     * @param[in] row     Row index of the result.
+     * @param[in] score   Score of the result (NaN scores are ignored).
+     *
+     * @return void
+     */
+    void push(int row, float score);
+
+    /**
+     * @brief Tells whether a score would currently enter the top k.
+     *
+     * Useful as a cutoff: a candidate whose score (or a bound of it) does not qualify can be skipped.
+     *
+     * @param[in] score   Score to test.
+     *
+     * @return True if the selector is not full or the score beats the worst kept result.
+     */
+    bool accepts(float score) const;
+
+    /**
+     * @brief Adds every result kept by another selector with the same ordering.
+     *
+     * @param[in] other   Selector to merge.
+     *
+     * @return void
+     */
+    void merge(const TopKSelector& other);
+
+    /**
+     * @brief Returns the number of results kept.
+     *
+     * @return A value between 0 and k.
+     */
+    size_t size() const;
+
+    /**
+     * @brief Tells whether k results are kept.
+     *
+     * @return True if the selector is full.
+     */
+    bool full() const;
+
+    /**
+     * @brief Returns the score of the worst kept result.
+     *
+     * @return The k-th best score so far (only meaningful when `size() > 0`).
+     */
+    float worstScore() const;
+
+    /**
+     * @brief Returns the kept results, best first.
+     *
+     * @return The (row, score) pairs sorted from best to worst.
+     */
+    vector<pair<int, float>> sortedResults() const;
+};
@@ -104,8 +104,14 @@ void ImageRetrievalUI::onMouse(int event, int x, int y, int, void* userdata) {
 }
 
 void ImageRetrievalUI::queryImage() {
-    map<string, Feature*> features = indexer.getFeatures();
+    const FeatureStore& features = indexer.getFeatureStore();
     Mat vocabulary = indexer.getVocab();
+    query.setVocabularyTree(&indexer.getVocabularyTree());
+    query.setHogLayout(indexer.getHogLayout());
+    query.setHnswIndex(&indexer.getHnswIndex());
+    query.setIvfIndex(&indexer.getIvfIndex());
+    query.setInvertedIndex(&indexer.getInvertedIndex());
+    query.setGeometricVerification(&indexer.getGeometricVerifier());
 
     cout << "Getting started" << endl;
     cout << features.size() << endl;
@@ -179,7 +185,7 @@ void ImageRetrievalUI::drawRetrievedImages(Mat& ui) {
             putText(ui, rankText, Point(rankTextX, rankTextY), FONT_HERSHEY_SIMPLEX, 0.6, Scalar(0, 0, 0), 1);
 
             string DistanceText = "";
-            if (selectedFeature == "HOG" || selectedFeature == "ORB" || selectedFeature == "SIFT")
+            if (selectedFeature == "HOG" || selectedFeature == "Block HOG" || selectedFeature == "ORB" || selectedFeature == "SIFT")
                 DistanceText = "Distance: " + to_string(retrievedImages[i].second);
             else 
                 DistanceText = "Similarity: " + to_string(retrievedImages[i].second);
@@ -263,7 +269,7 @@ void ImageRetrievalUI::drawRetrievedImagesGrid(string windowName) {
 
         // === Draw Distance ===
         string distText;
-        if (selectedFeature == "HOG" || selectedFeature == "ORB" || selectedFeature == "SIFT")
+        if (selectedFeature == "HOG" || selectedFeature == "Block HOG" || selectedFeature == "ORB" || selectedFeature == "SIFT")
             distText = "Distance: " + to_string(retrievedImages[i].second);
         else
             distText = "Similarity: " + to_string(retrievedImages[i].second);
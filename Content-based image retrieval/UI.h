@@ -55,7 +55,7 @@ private:
     int scrollOffset = 0;                       ///< Offset for scrolling through images
     int dropdownScrollOffset = 0;               ///< Offset for scrolling through dropdown items
     const int maxDropdownVisibleItems = 3;      ///< Maximum number of visible items in dropdown
-	vector<string> featureMethods = { "Color Histogram", "Color Correlogram", "SIFT", "HOG", "ORB" };   ///< List of feature extraction methods
+	vector<string> featureMethods = { "Color Histogram", "Color Correlogram", "Color Correlogram Exact", "SIFT", "HOG", "Block HOG", "ORB" };   ///< List of feature extraction methods
 	int selectedMethodIndex = -1;               ///< Index of the selected method in the dropdown
 
     // GUI elements for Feature Extraction tab
@@ -0,0 +1,163 @@
+#include "VocabularyTree.h"
+#include "BoVW.h"
+
+int VocabularyTree::wordCount(int branch, int levels) {
+    if (branch < 2 || levels < 1)
+        return 0;
+
+    long long count = 1;
+    for (int l = 0; l < levels; ++l) {
+        count *= branch;
+        if (count > INT_MAX)
+            return 0;
+    }
+    return static_cast<int>(count);
+}
+
+int VocabularyTree::computeLevelOffsets() {
+    levelOffsets.assign(depth, 0);
+
+    long long total = 0, levelSize = 1;
+    for (int l = 0; l < depth; ++l) {
+        levelSize *= branchFactor;
+        levelOffsets[l] = static_cast<int>(total);
+        total += levelSize;
+    }
+    return static_cast<int>(total);
+}
+
+bool VocabularyTree::build(const Mat& descriptors, int threadCount) {
+    if (wordCount(branchFactor, depth) == 0) {
+        cerr << "Error: invalid vocabulary tree shape " << branchFactor << "^" << depth << ".\n";
+        return false;
+    }
+    if (descriptors.empty() || descriptors.type() != CV_32F) {
+        cerr << "Error: vocabulary tree needs CV_32F descriptors.\n";
+        return false;
+    }
+
+    const int dims = descriptors.cols;
+    nodeCenters.create(computeLevelOffsets(), dims, CV_32F);
+
+    // Descriptors (row indices) currently assigned to each node of the level being split.
+    // The root owns everything.
+    vector<vector<int>> members(1);
+    members[0].resize(descriptors.rows);
+    for (int i = 0; i < descriptors.rows; ++i)
+        members[0][i] = i;
+
+    Mat rootCenter;
+    reduce(descriptors, rootCenter, 0, REDUCE_AVG);
+
+    ThreadPool pool(threadCount);
+
+    for (int level = 0; level < depth; ++level) {
+        vector<vector<int>> childMembers(members.size() * branchFactor);
+        const int childOffset = levelOffsets[level];
+        const int parentOffset = level > 0 ? levelOffsets[level - 1] : 0;
+
+        pool.parallelFor(members.size(), [&](size_t node) {
+            const vector<int>& rows = members[node];
+            Mat parentCenter = level > 0 ? nodeCenters.row(parentOffset + static_cast<int>(node)) : rootCenter;
+            Mat children = nodeCenters.rowRange(childOffset + static_cast<int>(node) * branchFactor,
+                childOffset + static_cast<int>(node + 1) * branchFactor);
+
+            // Not enough data to split: the children repeat the parent (or the few descriptors left)
+            if (static_cast<int>(rows.size()) < branchFactor) {
+                for (int c = 0; c < branchFactor; ++c) {
+                    if (c < static_cast<int>(rows.size()))
+                        descriptors.row(rows[c]).copyTo(children.row(c));
+                    else
+                        parentCenter.copyTo(children.row(c));
+                }
+                for (int c = 0; c < static_cast<int>(rows.size()); ++c)
+                    childMembers[node * branchFactor + c].push_back(rows[c]);
+                return;
+            }
+
+            Mat subset(static_cast<int>(rows.size()), dims, CV_32F);
+            for (int i = 0; i < subset.rows; ++i)
+                descriptors.row(rows[i]).copyTo(subset.row(i));
+
+            // Per-node seed keeps the tree independent of the thread scheduling
+            theRNG() = RNG(0x9E3779B9u ^ static_cast<unsigned>(childOffset + node * branchFactor));
+
+            Mat labels, centers;
+            kmeans(subset, branchFactor, labels,
+                TermCriteria(TermCriteria::EPS + TermCriteria::MAX_ITER, 20, 0.01),
+                1, KMEANS_PP_CENTERS, centers);
+            centers.copyTo(children);
+
+            for (int i = 0; i < subset.rows; ++i)
+                childMembers[node * branchFactor + labels.at<int>(i)].push_back(rows[i]);
+        });
+
+        members.swap(childMembers);
+    }
+
+    nodeNorms = BagOfVisualWord::computeRowNorms(nodeCenters);
+    return true;
+}
+
+void VocabularyTree::quantize(const Mat& descriptors, vector<int>& words) const {
+    words.assign(descriptors.rows, 0);
+    if (empty() || descriptors.empty())
+        return;
+
+    CV_Assert(descriptors.type() == CV_32F && descriptors.cols == nodeCenters.cols);
+
+    const int dims = descriptors.cols;
+    const float* norms = nodeNorms.ptr<float>(0);
+
+    for (int i = 0; i < descriptors.rows; ++i) {
+        const float* x = descriptors.ptr<float>(i);
+        int node = 0;  // index of the current node within its level (the root is node 0 of level 0)
+
+        for (int level = 0; level < depth; ++level) {
+            // Pick the closest of the branchFactor children: min ||c||^2 - 2 x.c
+            const int first = levelOffsets[level] + node * branchFactor;
+            int bestChild = 0;
+            float bestScore = FLT_MAX;
+            for (int c = 0; c < branchFactor; ++c) {
+                const float* center = nodeCenters.ptr<float>(first + c);
+                float dot = 0.0f;
+                for (int d = 0; d < dims; ++d)
+                    dot += x[d] * center[d];
+
+                float score = norms[first + c] - 2.0f * dot;
+                if (score < bestScore) {
+                    bestScore = score;
+                    bestChild = c;
+                }
+            }
+            node = node * branchFactor + bestChild;
+        }
+
+        words[i] = node;
+    }
+}
+
+bool VocabularyTree::setTree(int branch, int levels, Mat centers) {
+    branchFactor = branch;
+    depth = levels;
+    if (wordCount(branch, levels) == 0 || centers.type() != CV_32F || centers.rows != computeLevelOffsets()) {
+        cerr << "Error: vocabulary tree data does not match its shape.\n";
+        nodeCenters.release();
+        nodeNorms.release();
+        return false;
+    }
+
+    nodeCenters = centers;
+    nodeNorms = BagOfVisualWord::computeRowNorms(nodeCenters);
+    return true;
+}
+
+int VocabularyTree::getWordCount() const {
+    return empty() ? 0 : wordCount(branchFactor, depth);
+}
+
+Mat VocabularyTree::getLeafCenters() const {
+    if (empty())
+        return Mat();
+    return nodeCenters.rowRange(levelOffsets[depth - 1], nodeCenters.rows);
+}
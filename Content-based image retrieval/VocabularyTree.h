@@ -0,0 +1,141 @@
+#pragma once
+
+#include <opencv2/opencv.hpp>
+#include <climits>
+#include <vector>
+
+#include "ThreadPool.h"
+
+using namespace std;
+using namespace cv;
+
+/**
+ * @class VocabularyTree
+ * @brief Hierarchical k-means vocabulary (Nister & Stewenius) for logarithmic-time quantization.
+ *
+ * The descriptors are clustered into `branchFactor` groups, each group is clustered again,
+ * and so on for `depth` levels. The leaves are the visual words, so the vocabulary has
+ * branchFactor^depth words while quantizing a descriptor only compares it with
+ * branchFactor centers per level, i.e. O(branchFactor * depth) instead of O(words).
+ *
+ * The tree is complete: level l (1..depth) holds branchFactor^l nodes stored contiguously
+ * in `nodeCenters`, and the children of node i of level l are nodes
+ * [i * branchFactor, (i + 1) * branchFactor) of level l + 1. Nodes that received fewer
+ * descriptors than `branchFactor` during training repeat their parent center, so the
+ * layout stays complete and the corresponding leaves simply never receive words.
+ */
+class VocabularyTree {
+private:
+    int branchFactor = 0;           ///< Number of children of every internal node.
+    int depth = 0;                  ///< Number of levels below the root (leaves are at level `depth`).
+    Mat nodeCenters;                ///< Centers of all non-root nodes, level by level (CV_32F).
+    Mat nodeNorms;                  ///< Squared L2 norm of each node center (1 x nodeCenters.rows, CV_32F).
+    vector<int> levelOffsets;       ///< First row of each level in `nodeCenters` (index 0 = level 1).
+
+    /**
+     * @brief Computes the row offset of every level and the total number of nodes.
+     *
+     * @return The total number of non-root nodes.
+     */
+    int computeLevelOffsets();
+
+public:
+    /**
+     * @brief Default constructor (empty tree).
+     */
+    VocabularyTree() {}
+
+    /**
+     * @brief Constructor with the tree shape.
+     *
+     * @param[in] branchFactor   Number of children per node (>= 2).
+     * @param[in] depth          Number of levels (>= 1); the tree has branchFactor^depth words.
+     */
+    VocabularyTree(int branchFactor, int depth) : branchFactor(branchFactor), depth(depth) {}
+
+    /**
+     * @brief Trains the tree with hierarchical k-means.
+     *
+     * All nodes of one level are clustered in parallel; each node seeds its own random
+     * generator, so the result does not depend on the number of threads.
+     *
+     * @param[in] descriptors   Training descriptors (rows = descriptors, CV_32F).
+     * @param[in] threadCount   Number of threads (<= 0 uses all hardware threads).
+     *
+     * @return true if the tree was trained; false if the input or the shape is invalid.
+     */
+    bool build(const Mat& descriptors, int threadCount = 0);
+
+    /**
+     * @brief Finds the leaf (visual word) of every descriptor by descending the tree.
+     *
+     * @param[in]  descriptors   Descriptors to quantize (rows = descriptors, CV_32F).
+     * @param[out] words         Leaf index in [0, getWordCount()) for each descriptor.
+     *
+     * @return void
+     */
+    void quantize(const Mat& descriptors, vector<int>& words) const;
+
+    /**
+     * @brief Restores a trained tree (e.g., read from an index file).
+     *
+     * @param[in] branch    Number of children per node.
+     * @param[in] levels    Number of levels.
+     * @param[in] centers   Centers of all non-root nodes, level by level.
+     *
+     * @return true if the matrix matches the shape; false otherwise.
+     */
+    bool setTree(int branch, int levels, Mat centers);
+
+    /**
+     * @brief Returns the number of visual words (leaves).
+     *
+     * @return branchFactor^depth, or 0 for an empty tree.
+     */
+    int getWordCount() const;
+
+    /**
+     * @brief Returns the centers of the leaves, i.e. the flat vocabulary equivalent to the tree.
+     *
+     * @return A getWordCount() x dimension matrix sharing data with the tree.
+     */
+    Mat getLeafCenters() const;
+
+    /**
+     * @brief Returns the centers of all non-root nodes, level by level.
+     *
+     * @return The node center matrix.
+     */
+    const Mat& getNodeCenters() const { return nodeCenters; }
+
+    /**
+     * @brief Returns the branching factor.
+     *
+     * @return The number of children per node.
+     */
+    int getBranchFactor() const { return branchFactor; }
+
+    /**
+     * @brief Returns the depth.
+     *
+     * @return The number of levels below the root.
+     */
+    int getDepth() const { return depth; }
+
+    /**
+     * @brief Checks whether the tree has been trained or loaded.
+     *
+     * @return true if the tree holds no centers.
+     */
+    bool empty() const { return nodeCenters.empty(); }
+
+    /**
+     * @brief Computes the number of words of a tree shape, guarding against overflow.
+     *
+     * @param[in] branch   Number of children per node.
+     * @param[in] levels   Number of levels.
+     *
+     * @return branch^levels, or 0 if the shape is invalid or the count does not fit in an int.
+     */
+    static int wordCount(int branch, int levels);
+};